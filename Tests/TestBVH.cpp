@@ -0,0 +1,96 @@
+/* Bounding volume hierarchy depth limits and validation */
+#include "TestCommon.hxx"
+
+/* Depth of the deepest leaf */
+static uint32_t bvh_depth(const BVH &bvh, uint32_t node_index = 0)
+{
+    const BVHNode &node = bvh.nodes[node_index];
+    if (node.count > 0) return 0;
+    return 1 + std::max(bvh_depth(bvh, node_index + 1), bvh_depth(bvh, node.offset));
+}
+
+static bool throws_on_deserialize(const BVH &bvh)
+{
+    std::vector<char> data = serialize_bvh(bvh);
+    try { deserialize_bvh(data.data(), data.size()); }
+    catch (const std::runtime_error &) { return true; }
+    return false;
+}
+
+int main()
+{
+    /* Boxes at exponentially growing x make every SAH split peel off only the
+       few largest, so the tree grows deep */
+    {
+        std::vector<BVHBounds> boxes(2000);
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            float x = std::ldexp(1.0f, (int) (i % 120));
+            float lower[3] = { x, 0.0f, 0.0f }, upper[3] = { x, 1.0f, 1.0f };
+            boxes[i].grow(lower);
+            boxes[i].grow(upper);
+        }
+        BVH bvh = BVHBuilder(boxes).build();
+        CHECK(bvh_depth(bvh) <= BVH_MAX_DEPTH);
+        CHECK(!throws_on_deserialize(bvh));
+
+        /* Every box is still found */
+        std::vector<uint32_t> tets;
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            query_bvh_box(bvh, boxes[i].lower, boxes[i].upper, tets);
+            CHECK(std::find(tets.begin(), tets.end(), (uint32_t) i) != tets.end());
+        }
+    }
+
+    /* Coincident boxes */
+    {
+        std::vector<BVHBounds> boxes(100000);
+        float lower[3] = { 0.0f, 0.0f, 0.0f }, upper[3] = { 1.0f, 1.0f, 1.0f };
+        for (BVHBounds &box : boxes) {
+            box.grow(lower);
+            box.grow(upper);
+        }
+        BVH bvh = BVHBuilder(boxes).build();
+        CHECK(bvh_depth(bvh) <= BVH_MAX_DEPTH);
+        std::vector<uint32_t> tets;
+        query_bvh_box(bvh, lower, upper, tets);
+        CHECK(tets.size() == boxes.size());
+    }
+
+    /* Corrupt trees are rejected instead of overflowing the traversal */
+    {
+        std::vector<float> points;
+        std::vector<uint32_t> indices;
+        make_grid_mesh(4, points, indices);
+        BVH bvh = build_bvh(points, indices, 4);
+        CHECK(!throws_on_deserialize(bvh));
+        CHECK(bvh.nodes[0].count == 0);
+
+        BVH looped = bvh;
+        looped.nodes[0].offset = 0;
+        CHECK(throws_on_deserialize(looped));
+
+        BVH past_end = bvh;
+        past_end.nodes.back().offset = (uint32_t) bvh.primitives.size();
+        CHECK(throws_on_deserialize(past_end));
+
+        /* A chain of inner nodes, each with a leaf on the right */
+        BVH chain;
+        chain.primitives = { 0 };
+        const uint32_t length = BVH_MAX_DEPTH + 4;
+        for (uint32_t d = 0; d < length; ++d) {
+            BVHNode inner = {};
+            inner.offset = 2 * length - d;
+            chain.nodes.push_back(inner);
+        }
+        BVHNode leaf = {};
+        leaf.count = 1;
+        for (uint32_t d = 0; d <= length; ++d) chain.nodes.push_back(leaf);
+        CHECK(throws_on_deserialize(chain));
+        bool threw = false;
+        try { traverse_bvh_where(chain, [](const BVHNode &) { return true; }, [](uint32_t, uint32_t) {}); }
+        catch (const std::runtime_error &) { threw = true; }
+        CHECK(threw);
+    }
+
+    return test_result("TestBVH");
+}
@@ -0,0 +1,121 @@
+/* Brick octrees: voxel averages at every level, skipped bricks and corrupt files */
+#include "TestCommon.hxx"
+
+/* A linear field, whose average over a voxel is its value at the centre */
+static double linear_field(double x, double y, double z) { return 1.0 + 2.0 * x - 0.5 * y + 0.25 * z; }
+
+/* The L shaped mesh leaves out the cells with x and y beyond 2 */
+static bool in_mesh(double x, double y) { return x < 2.0 || y < 2.0; }
+
+/* Writes a copy of an octree file with some bytes changed, and reports whether opening it throws */
+template <typename Change>
+static bool open_throws(const std::vector<char> &bytes, const std::string &path, Change change)
+{
+    std::vector<char> changed = bytes;
+    change(changed);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(changed.data(), changed.size());
+    file.close();
+    try {
+        BrickOctree octree(path);
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+int main()
+{
+    std::string path = (std::filesystem::temp_directory_path() / "TestBrickOctree.bin").string();
+    std::string corrupt_path = (std::filesystem::temp_directory_path() / "TestBrickOctree_corrupt.bin").string();
+
+    std::vector<double> points, scalars;
+    std::vector<uint32_t> grid_indices, indices;
+    make_grid_mesh(4, points, grid_indices);
+    for (size_t t = 0; t < grid_indices.size() / 4; ++t) {
+        double centre[3] = { 0.0, 0.0, 0.0 };
+        for (int c = 0; c < 4; ++c)
+            for (int a = 0; a < 3; ++a) centre[a] += points[grid_indices[t * 4 + c] * 3 + a] / 4.0;
+        if (in_mesh(centre[0], centre[1])) indices.insert(indices.end(), &grid_indices[t * 4], &grid_indices[t * 4 + 4]);
+    }
+    for (size_t v = 0; v < points.size() / 3; ++v) scalars.push_back(linear_field(points[v * 3], points[v * 3 + 1], points[v * 3 + 2]));
+
+    /* Voxels a quarter wide in bricks of 4, so every brick covers a unit cube of
+       cells at level 0 and the mesh fills or misses each voxel at every level */
+    BrickOctreeHeader header = build_brick_octree(points, scalars, indices, 4, false, path, 16, 4);
+    BrickOctree octree(path);
+    CHECK(header.num_levels == 3 && octree.num_levels() == 3);
+    CHECK(octree.brick_size() == 4 && octree.voxel_size(0) == 0.25);
+
+    /* Bricks beyond x and y of 2 are touched by the bounds of their neighbours only,
+       and are skipped, as is their parent at level 1 */
+    CHECK(octree.num_bricks(0) == 64 - 16);
+    CHECK(octree.num_bricks(1) == 8 - 2);
+    CHECK(octree.num_bricks(2) == 1);
+    for (uint32_t z = 0; z < 4; ++z) {
+        CHECK(octree.brick(0, 2, 2, z) == nullptr && octree.brick(0, 3, 3, z) == nullptr);
+        CHECK(octree.brick(0, 1, 1, z) != nullptr && octree.brick(0, 3, 1, z) != nullptr);
+    }
+    CHECK(octree.brick(1, 1, 1, 0) == nullptr && octree.brick(1, 1, 1, 1) == nullptr && octree.brick(1, 0, 1, 1) != nullptr);
+    for (uint32_t level = 0; level < 3; ++level)
+        for (uint64_t n = 0; n < octree.num_bricks(level); ++n) {
+            uint32_t x, y, z;
+            octree.brick_coordinates(level, n, x, y, z);
+            CHECK(octree.brick(level, x, y, z) != nullptr);
+        }
+
+    /* Level 0 holds the averages of the field over each voxel, and coarser levels
+       the averages of their children, all of them the value at the voxel centre */
+    for (uint32_t level = 0; level < 3; ++level) {
+        double size = octree.voxel_size(level);
+        CHECK(octree.dims(level, 0) == 16u >> level);
+        for (uint32_t k = 0; k < octree.dims(level, 2); ++k)
+            for (uint32_t j = 0; j < octree.dims(level, 1); ++j)
+                for (uint32_t i = 0; i < octree.dims(level, 0); ++i) {
+                    double x = (i + 0.5) * size, y = (j + 0.5) * size, z = (k + 0.5) * size;
+                    float value = octree.value(level, i, j, k);
+                    if (in_mesh(x, y)) CHECK(std::abs(value - linear_field(x, y, z)) < 1e-4);
+                    else CHECK(std::isnan(value));
+                }
+    }
+
+    /* Opening checks the header and every brick the tables point to */
+    std::vector<char> bytes(std::filesystem::file_size(path));
+    {
+        std::ifstream file(path, std::ios::binary);
+        file.read(bytes.data(), bytes.size());
+    }
+    auto patch_header = [](auto change) {
+        return [change](std::vector<char> &bytes) {
+            BrickOctreeHeader header;
+            std::memcpy(&header, bytes.data(), sizeof(header));
+            change(header);
+            std::memcpy(bytes.data(), &header, sizeof(header));
+        };
+    };
+    auto patch_entry = [&](uint64_t offset) {
+        return [&, offset](std::vector<char> &bytes) {
+            BrickEntry entry;
+            std::memcpy(&entry, bytes.data() + header.table_offset, sizeof(entry));
+            entry.offset = offset;
+            std::memcpy(bytes.data() + header.table_offset, &entry, sizeof(entry));
+        };
+    };
+    CHECK(!open_throws(bytes, corrupt_path, [](std::vector<char>&) {}));
+    CHECK(open_throws(bytes, corrupt_path, patch_header([](BrickOctreeHeader &h) { h.brick_size = 0; })));
+    CHECK(open_throws(bytes, corrupt_path, patch_header([](BrickOctreeHeader &h) { h.brick_size = 3; })));
+    CHECK(open_throws(bytes, corrupt_path, patch_header([](BrickOctreeHeader &h) { h.table_offset += 4; })));
+    CHECK(open_throws(bytes, corrupt_path, patch_header([](BrickOctreeHeader &h) { h.num_bricks[1] = 1ull << 60; })));
+    CHECK(open_throws(bytes, corrupt_path, [](std::vector<char> &bytes) { bytes.resize(bytes.size() - 8); }));
+    CHECK(open_throws(bytes, corrupt_path, patch_entry(bytes.size())));
+    CHECK(open_throws(bytes, corrupt_path, patch_entry(header.table_offset - 4)));
+    CHECK(open_throws(bytes, corrupt_path, patch_entry(sizeof(BrickOctreeHeader) + 2)));
+    CHECK(open_throws(bytes, corrupt_path, [&](std::vector<char> &bytes) {
+        std::swap_ranges(bytes.data() + header.table_offset, bytes.data() + header.table_offset + sizeof(BrickEntry),
+                         bytes.data() + header.table_offset + sizeof(BrickEntry));
+    }));
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(corrupt_path);
+    return test_result("TestBrickOctree");
+}
@@ -0,0 +1,74 @@
+/* Small helpers shared by the TetraTools tests. Every test is its own executable,
+   which returns non zero when any check fails. */
+#pragma once
+
+#include "../TetraTools.hxx"
+
+#include <cstdio>
+#include <random>
+
+static int test_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            test_failures++; \
+        } \
+    } while (0)
+
+/* Returns the exit code of a test, after reporting how many checks failed */
+inline int test_result(const char *name)
+{
+    if (test_failures) std::fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+    else std::printf("%s: passed\n", name);
+    return test_failures ? 1 : 0;
+}
+
+/* Fills points and indices with an n x n x n grid of unit cubes, each split into
+   six positively oriented tetrahedra around its main diagonal */
+template <typename T>
+void make_grid_mesh(uint32_t n, std::vector<T> &points, std::vector<uint32_t> &indices)
+{
+    /* Corners of a cube as x + 2y + 4z. Each tetrahedron walks from corner 0 to 7
+       along the axes in one order; odd orders get their last two corners swapped */
+    static const uint32_t CUBE_TETS[6][4] = {
+        { 0, 1, 3, 7 }, { 0, 2, 7, 3 }, { 0, 2, 6, 7 },
+        { 0, 4, 7, 6 }, { 0, 4, 5, 7 }, { 0, 1, 7, 5 },
+    };
+    uint32_t side = n + 1;
+    points.clear();
+    indices.clear();
+    for (uint32_t z = 0; z < side; ++z)
+        for (uint32_t y = 0; y < side; ++y)
+            for (uint32_t x = 0; x < side; ++x) {
+                points.push_back((T) x);
+                points.push_back((T) y);
+                points.push_back((T) z);
+            }
+    for (uint32_t z = 0; z < n; ++z)
+        for (uint32_t y = 0; y < n; ++y)
+            for (uint32_t x = 0; x < n; ++x)
+                for (const auto &tet : CUBE_TETS)
+                    for (uint32_t corner : tet)
+                        indices.push_back((x + (corner & 1)) + side * ((y + ((corner >> 1) & 1)) + side * (z + ((corner >> 2) & 1))));
+}
+
+/* Renumbers the vertices of a mesh with a seeded random permutation */
+template <typename T>
+void shuffle_vertices(std::vector<T> &points, std::vector<uint32_t> &indices, uint32_t seed)
+{
+    size_t num_points = points.size() / 3;
+    std::vector<uint32_t> order(num_points);
+    for (size_t v = 0; v < num_points; ++v) order[v] = (uint32_t) v;
+    std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+
+    std::vector<T> shuffled(points.size());
+    std::vector<uint32_t> rank(num_points);
+    for (size_t v = 0; v < num_points; ++v) {
+        rank[order[v]] = (uint32_t) v;
+        for (int a = 0; a < 3; ++a) shuffled[v * 3 + a] = points[order[v] * 3 + a];
+    }
+    points.swap(shuffled);
+    for (uint32_t &index : indices) index = rank[index];
+}
@@ -0,0 +1,71 @@
+/* Compact tetrahedral topology */
+#include "TestCommon.hxx"
+
+int main()
+{
+    std::vector<float> points;
+    std::vector<uint32_t> indices;
+    make_grid_mesh(5, points, indices);
+    shuffle_vertices(points, indices, 3);
+    size_t num_points = points.size() / 3, num_tetrahedra = indices.size() / 4;
+
+    /* Rotate the corners of some tetrahedra, so that they are far from sorted */
+    for (size_t t = 0; t < num_tetrahedra; t += 3)
+        std::rotate(&indices[t * 4], &indices[t * 4 + 2], &indices[t * 4 + 4]);
+
+    std::vector<uint32_t> tet_order;
+    CompactTetTopology topology = CompactTetTopology::build(indices.data(), num_tetrahedra, 4, num_points, tet_order);
+    std::vector<uint32_t> sorted_indices = indices;
+    permute_records(sorted_indices, 4, tet_order);
+
+    /* Corners keep the order they were built with, in every query */
+    CHECK(topology.to_indices() == sorted_indices);
+    std::vector<int32_t> neighbors = compute_neighbors(sorted_indices.data(), num_tetrahedra, 4, num_points);
+    StarScratch scratch;
+    for (size_t t = 0; t < num_tetrahedra; ++t)
+        for (uint32_t i = 0; i < 4; ++i) {
+            CHECK(topology.neighbor(t, i) == neighbors[t * 4 + i]);
+            CHECK(topology.vertex(t, i, scratch) == sorted_indices[t * 4 + i]);
+
+            uint32_t face[3], expected[3], count = 0;
+            topology.face(t, i, face, scratch);
+            for (uint32_t k = 0; k < 4; ++k)
+                if (k != i) expected[count++] = sorted_indices[t * 4 + k];
+            std::sort(expected, expected + 3);
+            CHECK(std::equal(face, face + 3, expected));
+        }
+
+    /* Vertex stars match the incidence */
+    CSRGraph incidence = build_vertex_to_primitive(sorted_indices.data(), num_tetrahedra, 4, num_points);
+    std::vector<uint32_t> star;
+    for (size_t v = 0; v < num_points; ++v) {
+        topology.vertex_star((uint32_t) v, star, scratch);
+        std::sort(star.begin(), star.end());
+        CHECK(std::equal(star.begin(), star.end(), incidence.neighbors.begin() + incidence.offsets[v], incidence.neighbors.begin() + incidence.offsets[v + 1]));
+    }
+
+    /* Scratches grow with the largest star, not with the mesh: on a larger grid
+       they stay far below one word per tetrahedron */
+    {
+        std::vector<float> grid_points;
+        std::vector<uint32_t> grid_indices, grid_order;
+        make_grid_mesh(24, grid_points, grid_indices);
+        shuffle_vertices(grid_points, grid_indices, 5);
+        size_t grid_tetrahedra = grid_indices.size() / 4;
+        CompactTetTopology grid = CompactTetTopology::build(grid_indices.data(), grid_tetrahedra, 4, grid_points.size() / 3, grid_order);
+        permute_records(grid_indices, 4, grid_order);
+        CHECK(grid.to_indices() == grid_indices);
+
+        StarScratch grid_scratch;
+        uint32_t vertices[4];
+        for (size_t t = 0; t < grid_tetrahedra; t += 7) {
+            grid.tet_vertices(t, vertices, grid_scratch);
+            CHECK(std::equal(vertices, vertices + 4, &grid_indices[t * 4]));
+        }
+        for (size_t v = 0; v < grid_points.size() / 3; v += 5) grid.vertex_star((uint32_t) v, star, grid_scratch);
+        CHECK(grid_scratch.memory_bytes() <= 4096);
+        CHECK(grid_scratch.memory_bytes() * 100 < grid_tetrahedra * sizeof(uint32_t));
+    }
+
+    return test_result("TestCompactTopology");
+}
@@ -0,0 +1,83 @@
+/* Tetrahedron and point gradients. This test is also built with TETRATOOLS_NO_SIMD,
+   so both the SIMD and the scalar kernel are checked. */
+#include "TestCommon.hxx"
+
+/* A linear field with coefficients that keep the grid arithmetic exact */
+static const double FIELD[4] = { 1.5, 0.5, -2.0, 3.25 };
+
+template <typename T>
+static void check_linear_field(uint32_t n)
+{
+    std::vector<T> points, scalars;
+    std::vector<uint32_t> indices;
+    make_grid_mesh(n, points, indices);
+    shuffle_vertices(points, indices, n);
+
+    /* One flat tetrahedron at the end, which gets a zero gradient and volume */
+    indices.insert(indices.end(), { 0, 1, 2, 0 });
+    size_t num_points = points.size() / 3, num_tetrahedra = indices.size() / 4;
+    for (size_t v = 0; v < num_points; ++v)
+        scalars.push_back((T) (FIELD[0] + FIELD[1] * points[v * 3] + FIELD[2] * points[v * 3 + 1] + FIELD[3] * points[v * 3 + 2]));
+
+    std::vector<T> gradients(num_tetrahedra * 3);
+    std::vector<double> volumes(num_tetrahedra);
+    compute_tet_gradients(points.data(), scalars.data(), indices.data(), num_tetrahedra, 4, gradients.data(), volumes.data());
+    for (size_t t = 0; t + 1 < num_tetrahedra; ++t) {
+        for (int a = 0; a < 3; ++a) CHECK(gradients[t * 3 + a] == (T) FIELD[1 + a]);
+        CHECK(volumes[t] == 1.0 / 6.0);
+    }
+    for (int a = 0; a < 3; ++a) CHECK(gradients[(num_tetrahedra - 1) * 3 + a] == 0);
+    CHECK(volumes[num_tetrahedra - 1] == 0.0);
+
+    /* Averaging equal gradients gives the field's gradient back at every point */
+    indices.resize(indices.size() - 4);
+    std::vector<T> point_gradients = compute_point_gradients(points, scalars, indices, 4);
+    for (size_t v = 0; v < num_points; ++v)
+        for (int a = 0; a < 3; ++a) CHECK(std::abs(point_gradients[v * 3 + a] - FIELD[1 + a]) < 1e-5);
+}
+
+int main()
+{
+    /* Block counts which leave a partial block, and one which does not */
+    for (uint32_t n : { 1, 3, 4 }) {
+        check_linear_field<double>(n);
+        check_linear_field<float>(n);
+    }
+
+    /* Irregular tetrahedra, also of quadratic meshes, against one at a time Cramer's rule */
+    {
+        std::mt19937_64 random(50);
+        std::uniform_real_distribution<double> coordinate(-1.0, 1.0);
+        size_t num_tetrahedra = 101;
+        std::vector<double> points, scalars;
+        std::vector<uint32_t> indices;
+        for (size_t t = 0; t < num_tetrahedra; ++t)
+            for (int c = 0; c < 10; ++c) {
+                indices.push_back((uint32_t) (points.size() / 3));
+                for (int a = 0; a < 3; ++a) points.push_back(coordinate(random));
+                scalars.push_back(coordinate(random));
+            }
+        std::vector<double> gradients = compute_tet_gradients(points, scalars, indices, 10);
+        for (size_t t = 0; t < num_tetrahedra; ++t) {
+            const uint32_t *tet = &indices[t * 10];
+            double m[3][3], r[3];
+            for (int c = 0; c < 3; ++c) {
+                for (int a = 0; a < 3; ++a) m[c][a] = points[tet[c + 1] * 3 + a] - points[tet[0] * 3 + a];
+                r[c] = scalars[tet[c + 1]] - scalars[tet[0]];
+            }
+            auto det = [](const double x[3][3]) {
+                return x[0][0] * (x[1][1] * x[2][2] - x[1][2] * x[2][1]) - x[0][1] * (x[1][0] * x[2][2] - x[1][2] * x[2][0]) + x[0][2] * (x[1][0] * x[2][1] - x[1][1] * x[2][0]);
+            };
+            double d = det(m);
+            for (int a = 0; a < 3; ++a) {
+                double column[3][3];
+                for (int c = 0; c < 3; ++c)
+                    for (int b = 0; b < 3; ++b) column[c][b] = (b == a) ? r[c] : m[c][b];
+                double expected = det(column) / d;
+                CHECK(std::abs(gradients[t * 3 + a] - expected) <= 1e-9 * std::max(1.0, std::abs(expected)));
+            }
+        }
+    }
+
+    return test_result("TestGradients");
+}
@@ -0,0 +1,61 @@
+/* Batched point location and interpolation, on whichever SIMD path is compiled in */
+#include "TestCommon.hxx"
+
+int main()
+{
+    const uint32_t n = 4;
+    std::vector<double> points, scalars;
+    std::vector<uint32_t> indices;
+    make_grid_mesh(n, points, indices);
+    size_t num_points = points.size() / 3;
+    for (size_t v = 0; v < num_points; ++v)
+        scalars.push_back(points[v * 3] + 2.0 * points[v * 3 + 1] - 3.0 * points[v * 3 + 2]);
+    BVH bvh = build_bvh(points, indices, 4);
+
+    /* Every leaf lane agrees with the one at a time containment test */
+    std::mt19937 random(4);
+    std::uniform_real_distribution<double> coordinate(-0.5, n + 0.5);
+    TetBlock block;
+    double weights[4][BVH_MAX_LEAF_SIZE];
+    for (int i = 0; i < 2000; ++i) {
+        double q[3] = { coordinate(random), coordinate(random), coordinate(random) };
+        traverse_bvh_where(bvh, [](const BVHNode &) { return true; }, [&](uint32_t first, uint32_t count) {
+            const uint32_t *leaf = &bvh.primitives[first];
+            block.gather(points.data(), indices.data(), 4, leaf, count);
+            uint32_t inside = block.locate(q, weights);
+            CHECK((inside >> count) == 0);
+            for (uint32_t lane = 0; lane < count; ++lane) {
+                const uint32_t *tet = &indices[(size_t) leaf[lane] * 4];
+                bool contains = tet_contains_point(&points[tet[0] * 3], &points[tet[1] * 3], &points[tet[2] * 3], &points[tet[3] * 3], q);
+                bool located = (inside >> lane) & 1;
+                /* Points within the tolerance of a face may go either way */
+                double smallest = std::min(std::min(weights[0][lane], weights[1][lane]), std::min(weights[2][lane], weights[3][lane]));
+                if (std::abs(smallest) > 1e-6) CHECK(contains == located);
+                if (located) {
+                    double p[3] = { 0.0, 0.0, 0.0 };
+                    for (int c = 0; c < 4; ++c)
+                        for (int a = 0; a < 3; ++a) p[a] += weights[c][lane] * points[tet[c] * 3 + a];
+                    for (int a = 0; a < 3; ++a) CHECK(std::abs(p[a] - q[a]) < 1e-9);
+                }
+            }
+        });
+    }
+
+    /* Linear fields are reproduced inside, and queries outside give -1 and NaN */
+    std::vector<double> queries;
+    for (int i = 0; i < 5000; ++i) queries.push_back(coordinate(random));
+    size_t num_queries = queries.size() / 3;
+    std::vector<int64_t> tets(num_queries);
+    std::vector<double> values(num_queries);
+    interpolate_points(bvh, points.data(), scalars.data(), indices.data(), 4, false, queries.data(), num_queries, tets.data(), values.data());
+    for (size_t i = 0; i < num_queries; ++i) {
+        const double *q = &queries[i * 3];
+        bool outside = false;
+        for (int a = 0; a < 3; ++a) outside |= q[a] < 0.0 || q[a] > n;
+        CHECK(outside == (tets[i] < 0));
+        if (outside) CHECK(std::isnan(values[i]));
+        else CHECK(std::abs(values[i] - (q[0] + 2.0 * q[1] - 3.0 * q[2])) < 1e-9);
+    }
+
+    return test_result("TestInterpolation");
+}
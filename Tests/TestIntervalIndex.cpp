@@ -0,0 +1,135 @@
+/* Scalar range index: queries against a brute force scan, and validation of stored indices */
+#include "TestCommon.hxx"
+
+/* Tetrahedra whose scalar range overlaps [lo, hi], by testing all of them */
+static std::vector<uint32_t> scan_active_tets(const std::vector<double> &scalars, const std::vector<uint32_t> &indices, bool data_is_per_cell, double lo, double hi)
+{
+    std::vector<uint32_t> tets;
+    for (size_t t = 0; t < indices.size() / 4; ++t) {
+        double tet_lo, tet_hi;
+        tet_scalar_range(scalars.data(), &indices[t * 4], t, data_is_per_cell, tet_lo, tet_hi);
+        if (tet_lo <= hi && tet_hi >= lo) tets.push_back((uint32_t) t);
+    }
+    return tets;
+}
+
+static bool throws_on_deserialize(const IntervalIndex &index)
+{
+    std::vector<char> data = serialize_interval_index(index);
+    try { deserialize_interval_index(data.data(), data.size()); }
+    catch (const std::runtime_error &) { return true; }
+    return false;
+}
+
+int main()
+{
+    std::vector<double> points;
+    std::vector<uint32_t> indices;
+    make_grid_mesh(6, points, indices);
+    shuffle_vertices(points, indices, 39);
+    size_t num_points = points.size() / 3, num_tetrahedra = indices.size() / 4;
+
+    std::mt19937_64 random(39);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<double> point_scalars(num_points), cell_scalars(num_tetrahedra);
+    for (size_t v = 0; v < num_points; ++v) point_scalars[v] = std::sin(points[v * 3]) + 0.5 * points[v * 3 + 1] - 0.25 * points[v * 3 + 2];
+    for (double &s : cell_scalars) s = unit(random);
+
+    /* Point values, including values at the vertices, and ranges, at block sizes
+       which do and do not divide the tetrahedron count */
+    for (bool data_is_per_cell : { false, true }) {
+        const std::vector<double> &scalars = data_is_per_cell ? cell_scalars : point_scalars;
+        double lower = *std::min_element(scalars.begin(), scalars.end()), upper = *std::max_element(scalars.begin(), scalars.end());
+        for (uint32_t block_size : { 1u, 7u, 16u, 256u, 4096u }) {
+            IntervalIndex index = build_interval_index(scalars, indices, 4, data_is_per_cell, block_size);
+            std::vector<char> data = serialize_interval_index(index);
+            IntervalIndex read = deserialize_interval_index(data.data(), data.size());
+
+            std::vector<uint32_t> tets;
+            for (int q = 0; q < 50; ++q) {
+                double lo = lower - 0.1 + unit(random) * (upper - lower + 0.2), hi = lo;
+                if (q % 5 == 1) lo = hi = scalars[random() % scalars.size()];
+                if (q % 5 >= 2) hi = lo + unit(random) * (upper - lower) * 0.2;
+                find_active_tets(read, scalars, indices, 4, data_is_per_cell, lo, hi, tets);
+                CHECK(tets == scan_active_tets(scalars, indices, data_is_per_cell, lo, hi));
+            }
+            find_active_tets(read, scalars, indices, 4, data_is_per_cell, upper + 1.0, upper + 2.0, tets);
+            CHECK(tets.empty());
+            find_active_tets(read, scalars, indices, 4, data_is_per_cell, lower, upper, tets);
+            CHECK(tets.size() == num_tetrahedra);
+        }
+    }
+
+    /* Corrupt indices are refused */
+    {
+        IntervalIndex index = build_interval_index(point_scalars, indices, 4, false, 16);
+        CHECK(!throws_on_deserialize(index));
+        CHECK(index.nodes.size() > 2 && index.nodes[0].left != IntervalNode::NO_CHILD);
+
+        IntervalIndex zero_block = index;
+        zero_block.block_size = 0;
+        CHECK(throws_on_deserialize(zero_block));
+
+        IntervalIndex looped = index;
+        looped.nodes[0].left = 0;
+        CHECK(throws_on_deserialize(looped));
+
+        IntervalIndex past_end = index;
+        past_end.nodes[0].right = (uint32_t) index.nodes.size();
+        CHECK(throws_on_deserialize(past_end));
+
+        IntervalIndex shared = index;
+        shared.nodes[0].right = shared.nodes[0].left;
+        CHECK(throws_on_deserialize(shared));
+
+        IntervalIndex too_many = index;
+        too_many.nodes.back().count += 1;
+        CHECK(throws_on_deserialize(too_many));
+
+        IntervalIndex bad_block = index;
+        bad_block.by_max[3] = (uint32_t) (index.block_ranges.size() / 2);
+        CHECK(throws_on_deserialize(bad_block));
+
+        IntervalIndex stale = index;
+        stale.num_tetrahedra += 100;
+        CHECK(throws_on_deserialize(stale));
+
+        /* A block count whose size (24 bytes per block) wraps around to the real size */
+        std::vector<char> data = serialize_interval_index(index);
+        uint64_t counts[4];
+        std::memcpy(counts, data.data(), sizeof(counts));
+        counts[2] += 1ull << 61;
+        std::memcpy(data.data(), counts, sizeof(counts));
+        bool threw = false;
+        try { deserialize_interval_index(data.data(), data.size()); }
+        catch (const std::runtime_error &) { threw = true; }
+        CHECK(threw);
+    }
+
+    /* A stored index built for other tetrahedra is refused rather than used */
+    {
+        std::string path = (std::filesystem::temp_directory_path() / "TestIntervalIndex.bin").string();
+        std::string surface_path = (std::filesystem::temp_directory_path() / "TestIntervalIndex_surface.bin").string();
+        write_to_binary(points, point_scalars, indices, 4, false, path);
+        write_isosurfaces_as_binary(path, { 0.5 }, surface_path);
+        uint32_t plain_triangles = read_binary_header(surface_path).num_indices;
+
+        add_interval_index_to_binary(path);
+        write_isosurfaces_as_binary(path, { 0.5 }, surface_path);
+        CHECK(read_binary_header(surface_path).num_indices == plain_triangles);
+
+        write_to_binary(points, point_scalars, indices, 4, false, path);
+        std::vector<uint32_t> fewer(indices.begin(), indices.end() - 4 * 40);
+        std::vector<char> data = serialize_interval_index(build_interval_index(point_scalars, fewer, 4, false));
+        write_binary_section(path, SECTION_INTERVALS, data.data(), data.size());
+        bool threw = false;
+        try { write_isosurfaces_as_binary(path, { 0.5 }, surface_path); }
+        catch (const std::runtime_error &) { threw = true; }
+        CHECK(threw);
+
+        std::filesystem::remove(path);
+        std::filesystem::remove(surface_path);
+    }
+
+    return test_result("TestIntervalIndex");
+}
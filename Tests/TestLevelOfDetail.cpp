@@ -0,0 +1,94 @@
+/* Level of detail files: coarsened levels written coarsest first, each readable on its own */
+#include "TestCommon.hxx"
+
+/* A linear field, which vertex clustering keeps exact since clusters take the
+   mean of both positions and scalars */
+static double linear_field(double x, double y, double z) { return 0.5 + x - 0.25 * y + 2.0 * z; }
+
+/* Six times the signed volume of a tetrahedron */
+static double tet_volume(const std::vector<double> &points, const uint32_t *tet)
+{
+    const double *p0 = &points[tet[0] * 3], *p1 = &points[tet[1] * 3], *p2 = &points[tet[2] * 3], *p3 = &points[tet[3] * 3];
+    double a[3], b[3], c[3];
+    for (int i = 0; i < 3; ++i) {
+        a[i] = p1[i] - p0[i];
+        b[i] = p2[i] - p0[i];
+        c[i] = p3[i] - p0[i];
+    }
+    return a[0] * (b[1] * c[2] - b[2] * c[1]) - a[1] * (b[0] * c[2] - b[2] * c[0]) + a[2] * (b[0] * c[1] - b[1] * c[0]);
+}
+
+int main()
+{
+    std::string path = (std::filesystem::temp_directory_path() / "TestLevelOfDetail.bin").string();
+
+    std::vector<double> points, scalars;
+    std::vector<uint32_t> indices;
+    make_grid_mesh(12, points, indices);
+    shuffle_vertices(points, indices, 11);
+    for (size_t v = 0; v < points.size() / 3; ++v) scalars.push_back(linear_field(points[v * 3], points[v * 3 + 1], points[v * 3 + 2]));
+
+    uint32_t num_levels = write_lod_binary(points, scalars, indices, 4, false, path, 4);
+    CHECK(num_levels == 4);
+    CHECK(count_lod_levels(path) == num_levels);
+    std::vector<BinaryHeader> headers = read_lod_headers(path);
+    CHECK(headers.size() == num_levels);
+
+    /* Every level reads back on its own, with more tetrahedra than the one before,
+       all of them positively oriented and the scalars still on the field */
+    size_t previous_tetrahedra = 0;
+    for (uint32_t level = 0; level < num_levels; ++level) {
+        std::vector<double> level_points, level_scalars;
+        std::vector<uint32_t> level_indices;
+        bool data_is_per_cell = true;
+        CHECK(read_lod_level(path, level, level_points, level_scalars, level_indices, data_is_per_cell) == 4);
+        CHECK(!data_is_per_cell);
+        CHECK(level_indices.size() == headers[level].num_indices);
+        CHECK(level_points.size() / 3 == level_scalars.size());
+        CHECK(level_indices.size() / 4 > previous_tetrahedra);
+        previous_tetrahedra = level_indices.size() / 4;
+
+        size_t num_points = level_points.size() / 3;
+        bool in_range = true, positive = true, on_field = true;
+        for (uint32_t index : level_indices) in_range = in_range && index < num_points;
+        CHECK(in_range);
+        if (!in_range) continue;
+        for (size_t t = 0; t < level_indices.size() / 4; ++t) positive = positive && tet_volume(level_points, &level_indices[t * 4]) > 0.0;
+        CHECK(positive);
+        for (size_t v = 0; v < num_points; ++v)
+            on_field = on_field && std::abs(level_scalars[v] - linear_field(level_points[v * 3], level_points[v * 3 + 1], level_points[v * 3 + 2])) < 1e-9;
+        CHECK(on_field);
+
+        /* The finest level is the mesh as given */
+        if (level + 1 == num_levels) CHECK(level_points == points && level_scalars == scalars && level_indices == indices);
+    }
+
+    /* Level 0 is what readers which know nothing of levels see */
+    {
+        std::vector<double> lod_points, lod_scalars, plain_points, plain_scalars;
+        std::vector<uint32_t> lod_indices, plain_indices;
+        bool lod_per_cell, plain_per_cell;
+        CHECK(read_lod_level(path, 0, lod_points, lod_scalars, lod_indices, lod_per_cell) == 4);
+        CHECK(read_binary(path, plain_points, plain_scalars, plain_indices, plain_per_cell) == 4);
+        CHECK(lod_points == plain_points && lod_scalars == plain_scalars && lod_indices == plain_indices && lod_per_cell == plain_per_cell);
+        CHECK(plain_indices.size() / 4 < indices.size() / 4);
+    }
+
+    bool threw = false;
+    try {
+        std::vector<double> level_points, level_scalars;
+        std::vector<uint32_t> level_indices;
+        bool data_is_per_cell;
+        read_lod_level(path, num_levels, level_points, level_scalars, level_indices, data_is_per_cell);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    /* A single level is a plain binary file */
+    CHECK(write_lod_binary(points, scalars, indices, 4, false, path, 1) == 1);
+    CHECK(count_lod_levels(path) == 1);
+
+    std::filesystem::remove(path);
+    return test_result("TestLevelOfDetail");
+}
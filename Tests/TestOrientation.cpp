@@ -0,0 +1,153 @@
+/* Expansion arithmetic, the filtered orient3d predicate and orientation normalization */
+#include "TestCommon.hxx"
+
+/* Sum of an expansion whose components are all integers, as an exact integer */
+static int64_t integer_value(const Expansion &e)
+{
+    int64_t sum = 0;
+    for (double component : e) sum += (int64_t) component;
+    return sum;
+}
+
+/* Checks that the components are non-overlapping and in increasing magnitude */
+static bool is_expansion(const Expansion &e)
+{
+    for (size_t i = 1; i < e.size(); ++i)
+        if (e[i - 1] != 0.0 && std::abs(e[i - 1]) >= std::abs(e[i])) return false;
+    return true;
+}
+
+/* Exact orientation of integer points, which needs 63 bits for coordinates below 2^19 */
+static int integer_orient3d(const int64_t a[3], const int64_t b[3], const int64_t c[3], const int64_t d[3])
+{
+    int64_t u[3], v[3], w[3];
+    for (int i = 0; i < 3; ++i) {
+        u[i] = b[i] - a[i];
+        v[i] = c[i] - a[i];
+        w[i] = d[i] - a[i];
+    }
+    int64_t det = u[0] * (v[1] * w[2] - v[2] * w[1]) + u[1] * (v[2] * w[0] - v[0] * w[2]) + u[2] * (v[0] * w[1] - v[1] * w[0]);
+    return (det > 0) - (det < 0);
+}
+
+int main()
+{
+    std::mt19937_64 random(6);
+
+    /* Products and sums of integers are exact, and stay valid expansions */
+    for (int i = 0; i < 1000; ++i) {
+        int64_t a = (int64_t) (random() >> 36) - (1ll << 27), b = (int64_t) (random() >> 36) - (1ll << 27);
+        int64_t c = (int64_t) (random() >> 58) - 32;
+        Expansion product = expansion_product(Expansion(1, (double) a), Expansion(1, (double) b));
+        CHECK(is_expansion(product));
+        CHECK(integer_value(product) == a * b);
+
+        Expansion grown = grow_expansion(product, (double) c);
+        CHECK(is_expansion(grown));
+        CHECK(integer_value(grown) == a * b + c);
+
+        Expansion scaled = scale_expansion(grown, (double) c);
+        CHECK(is_expansion(scaled));
+        CHECK(integer_value(scaled) == (a * b + c) * c);
+
+        Expansion difference = expansion_difference(product, scaled);
+        CHECK(integer_value(difference) == a * b - (a * b + c) * c);
+        CHECK(expansion_sign(difference) == ((a * b - (a * b + c) * c > 0) - (a * b - (a * b + c) * c < 0)));
+    }
+    CHECK(expansion_sign(expansion_difference(Expansion(1, 3.0), Expansion(1, 3.0))) == 0);
+
+    /* Near-degenerate tetrahedra. u = b - a and v = c - a take consecutive Fibonacci
+       numbers near 2^18 on two axes, so (u x v) has a component of +-1 on the third,
+       and d = a + alpha u + beta v + gamma along that axis gives a determinant of
+       +-gamma against terms near 2^55. Coordinates are scaled by 2^-30 and offset, so
+       they are not integers. */
+    const int64_t FIBONACCI[4] = { 121393, 196418, 317811, 514229 };
+    uint64_t undecided = 0;
+    double hard[4][3] = {};
+    int hard_sign = 0;
+    for (int i = 0; i < 20000; ++i) {
+        int axes[3] = { 0, 1, 2 };
+        std::shuffle(axes, axes + 3, random);
+        int f = (int) (random() % 2);
+        int64_t a[3], u[3], v[3], b[3], c[3], d[3];
+        for (int k = 0; k < 3; ++k) a[k] = (int64_t) (random() >> 47) - (1ll << 16);
+        u[axes[0]] = FIBONACCI[f + 1];
+        u[axes[1]] = FIBONACCI[f];
+        v[axes[0]] = FIBONACCI[f + 2];
+        v[axes[1]] = FIBONACCI[f + 1];
+        u[axes[2]] = (int64_t) (random() >> 46) - (1ll << 17);
+        v[axes[2]] = (int64_t) (random() >> 46) - (1ll << 17);
+        if (random() & 1) std::swap(u, v);
+        int64_t alpha = (int64_t) (random() % 3) - 1, beta = (int64_t) (random() % 3) - 1, gamma = (int64_t) (random() % 5) - 2;
+        for (int k = 0; k < 3; ++k) {
+            b[k] = a[k] + u[k];
+            c[k] = a[k] + v[k];
+            d[k] = a[k] + alpha * u[k] + beta * v[k] + (k == axes[2] ? gamma : 0);
+        }
+
+        const double scale = std::ldexp(1.0, -30), offset = 1024.0;
+        double fa[3], fb[3], fc[3], fd[3];
+        for (int k = 0; k < 3; ++k) {
+            fa[k] = offset + a[k] * scale;
+            fb[k] = offset + b[k] * scale;
+            fc[k] = offset + c[k] * scale;
+            fd[k] = offset + d[k] * scale;
+        }
+        int expected = integer_orient3d(a, b, c, d);
+        CHECK((expected == 0) == (gamma == 0));
+        CHECK(orient3d_exact(fa, fb, fc, fd) == expected);
+        CHECK(orient3d(fa, fb, fc, fd) == expected);
+        CHECK(orient3d(fb, fa, fc, fd) == -expected);
+
+        double naive = tet_signed_volume6(fa, fb, fc, fd);
+        if ((naive > 0.0) - (naive < 0.0) != expected) {
+            undecided++;
+            if (expected != 0 && hard_sign == 0) {
+                hard_sign = expected;
+                for (int k = 0; k < 3; ++k) {
+                    hard[0][k] = fa[k];
+                    hard[1][k] = fb[k];
+                    hard[2][k] = fc[k];
+                    hard[3][k] = fd[k];
+                }
+            }
+        }
+    }
+    /* The inputs really were beyond plain floating point */
+    CHECK(undecided > 100);
+
+    /* normalize_orientation flips exactly the negative tetrahedra, and counts the
+       flat and the exactly evaluated ones */
+    {
+        std::vector<double> points;
+        std::vector<uint32_t> indices;
+        make_grid_mesh(3, points, indices);
+        size_t num_tetrahedra = indices.size() / 4;
+        std::vector<uint32_t> original = indices;
+        size_t inverted = 0;
+        for (size_t t = 0; t < num_tetrahedra; t += 2, ++inverted) std::swap(indices[t * 4 + 2], indices[t * 4 + 3]);
+
+        /* One of the slivers above whose plain determinant had the wrong sign, and a
+           flat tetrahedron */
+        CHECK(hard_sign != 0);
+        size_t base = points.size() / 3;
+        for (int c = 0; c < 4; ++c)
+            for (int k = 0; k < 3; ++k) points.push_back(hard[c][k]);
+        int sliver_sign = hard_sign;
+        indices.insert(indices.end(), { (uint32_t) base, (uint32_t) base + 1, (uint32_t) base + 2, (uint32_t) base + 3 });
+        indices.insert(indices.end(), { (uint32_t) base, (uint32_t) base + 1, (uint32_t) base + 2, (uint32_t) base });
+
+        OrientationReport report = normalize_orientation(points, indices, 4);
+        CHECK(report.num_tetrahedra == num_tetrahedra + 2);
+        CHECK(report.degenerate == 1);
+        CHECK(report.exact_evaluations >= 2);
+        CHECK(report.flipped == inverted + (sliver_sign < 0 ? 1 : 0));
+        CHECK(std::equal(original.begin(), original.end(), indices.begin()));
+        for (size_t t = 0; t <= num_tetrahedra; ++t) {
+            const uint32_t *tet = &indices[t * 4];
+            CHECK(orient3d(&points[tet[0] * 3], &points[tet[1] * 3], &points[tet[2] * 3], &points[tet[3] * 3]) == 1);
+        }
+    }
+
+    return test_result("TestOrientation");
+}
@@ -0,0 +1,91 @@
+/* Partitioning binary meshes into parts with ghost layers */
+#include "TestCommon.hxx"
+
+int main()
+{
+    std::string path = (std::filesystem::temp_directory_path() / "TestPartitioning.bin").string();
+    std::string prefix = (std::filesystem::temp_directory_path() / "TestPartitioning_part").string();
+
+    std::vector<double> points, scalars;
+    std::vector<uint32_t> indices;
+    make_grid_mesh(5, points, indices);
+    shuffle_vertices(points, indices, 23);
+    for (size_t v = 0; v < points.size() / 3; ++v) scalars.push_back(points[v * 3] - 2.0 * points[v * 3 + 1] + 0.5 * points[v * 3 + 2]);
+    write_to_binary(points, scalars, indices, 4, false, path);
+    size_t num_points = points.size() / 3, num_tetrahedra = indices.size() / 4;
+
+    const uint32_t num_parts = 4;
+    for (uint32_t ghost_layers : { 0u, 1u, 2u }) {
+        PartitionReport report = partition_binary(path, prefix, num_parts, ghost_layers);
+        CHECK(report.num_parts == num_parts && report.owned_tets.size() == num_parts);
+
+        std::vector<uint32_t> owner(num_tetrahedra, 0);
+        for (uint32_t part = 0; part < num_parts; ++part) {
+            std::string part_path = partition_part_path(prefix, part);
+            std::vector<double> part_points, part_scalars;
+            std::vector<uint32_t> part_indices, global_vertices, global_tets;
+            std::vector<uint8_t> layers;
+            bool data_is_per_cell;
+            CHECK(read_binary(part_path, part_points, part_scalars, part_indices, data_is_per_cell) == 4);
+            CHECK(read_partition_maps(part_path, global_vertices, global_tets, layers));
+            CHECK(global_vertices.size() == part_points.size() / 3 && global_vertices.size() == report.points[part]);
+            CHECK(global_tets.size() == part_indices.size() / 4 && layers.size() == global_tets.size());
+            CHECK(global_tets.size() == report.owned_tets[part] + report.ghost_tets[part]);
+
+            /* The maps lead back to the global points, scalars and connectivity */
+            bool same_points = true, same_indices = true;
+            for (size_t v = 0; v < global_vertices.size(); ++v) {
+                uint32_t g = global_vertices[v];
+                same_points = same_points && g < num_points && part_scalars[v] == scalars[g];
+                for (int a = 0; a < 3 && same_points; ++a) same_points = part_points[v * 3 + a] == points[(size_t) g * 3 + a];
+            }
+            CHECK(same_points);
+            for (size_t n = 0; n < global_tets.size(); ++n) {
+                same_indices = same_indices && global_tets[n] < num_tetrahedra;
+                for (int c = 0; c < 4 && same_indices; ++c)
+                    same_indices = global_vertices[part_indices[n * 4 + c]] == indices[(size_t) global_tets[n] * 4 + c];
+            }
+            CHECK(same_indices);
+            if (!same_points || !same_indices) continue;
+
+            /* Owned tetrahedra come first, then the ghosts layer by layer */
+            CHECK(std::is_sorted(layers.begin(), layers.end()));
+            CHECK((size_t) std::count(layers.begin(), layers.end(), 0) == report.owned_tets[part]);
+            CHECK(layers.empty() || layers.back() <= ghost_layers);
+            for (size_t n = 0; n < report.owned_tets[part]; ++n) owner[global_tets[n]]++;
+
+            /* A ghost is in layer L when its nearest owned tetrahedron is L vertex
+               sharing steps away, found here by relaxing over the global mesh */
+            const uint32_t FAR = std::numeric_limits<uint32_t>::max();
+            std::vector<uint32_t> tet_distance(num_tetrahedra, FAR), vertex_distance(num_points);
+            for (size_t n = 0; n < report.owned_tets[part]; ++n) tet_distance[global_tets[n]] = 0;
+            for (uint32_t step = 0; step < ghost_layers; ++step) {
+                std::fill(vertex_distance.begin(), vertex_distance.end(), FAR);
+                for (size_t t = 0; t < num_tetrahedra; ++t)
+                    for (int c = 0; c < 4; ++c) vertex_distance[indices[t * 4 + c]] = std::min(vertex_distance[indices[t * 4 + c]], tet_distance[t]);
+                for (size_t t = 0; t < num_tetrahedra; ++t)
+                    for (int c = 0; c < 4; ++c)
+                        if (vertex_distance[indices[t * 4 + c]] != FAR) tet_distance[t] = std::min(tet_distance[t], vertex_distance[indices[t * 4 + c]] + 1);
+            }
+            std::vector<uint32_t> expected, found(global_tets);
+            for (size_t t = 0; t < num_tetrahedra; ++t)
+                if (tet_distance[t] <= ghost_layers) expected.push_back((uint32_t) t);
+            std::sort(found.begin(), found.end());
+            CHECK(found == expected);
+            bool same_layers = true;
+            for (size_t n = 0; n < global_tets.size(); ++n) same_layers = same_layers && layers[n] == tet_distance[global_tets[n]];
+            CHECK(same_layers);
+            if (ghost_layers > 0) CHECK(report.ghost_tets[part] > 0);
+            else CHECK(report.ghost_tets[part] == 0);
+        }
+
+        /* The owned tetrahedra partition the mesh, in balanced parts */
+        CHECK(std::all_of(owner.begin(), owner.end(), [](uint32_t count) { return count == 1; }));
+        for (uint32_t part = 0; part < num_parts; ++part)
+            CHECK(report.owned_tets[part] == num_tetrahedra * (part + 1) / num_parts - num_tetrahedra * part / num_parts);
+    }
+
+    for (uint32_t part = 0; part < num_parts; ++part) std::filesystem::remove(partition_part_path(prefix, part));
+    std::filesystem::remove(path);
+    return test_result("TestPartitioning");
+}
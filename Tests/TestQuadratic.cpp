@@ -0,0 +1,142 @@
+/* Edge node order of quadratic tetrahedra and their split into 8 linear ones */
+#include "TestCommon.hxx"
+
+/* A 10 node tetrahedron as TetGen (-o2) and VTK write it: corners 0 to 3, then
+   the midpoints of edges 0-1, 1-2, 2-0, 0-3, 1-3 and 2-3 */
+static const double TETGEN_NODES[10][3] = {
+    { 0, 0, 0 }, { 2, 0, 0 }, { 0, 2, 0 }, { 0, 0, 2 },
+    { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 1 }, { 0, 1, 1 },
+};
+
+/* An arbitrary quadratic polynomial */
+static double quadratic_field(const double p[3])
+{
+    return 1.0 + 2.0 * p[0] - p[1] + 0.5 * p[2] + 3.0 * p[0] * p[1] - p[1] * p[2] + 0.25 * p[0] * p[0] - 2.0 * p[2] * p[2];
+}
+
+int main()
+{
+    /* Edge e joins the corners TetGen puts around node 4 + e */
+    const uint32_t tetgen_edges[6][2] = { { 0, 1 }, { 1, 2 }, { 2, 0 }, { 0, 3 }, { 1, 3 }, { 2, 3 } };
+    for (int e = 0; e < 6; ++e) {
+        CHECK(TET_EDGE_CORNERS[e][0] == tetgen_edges[e][0]);
+        CHECK(TET_EDGE_CORNERS[e][1] == tetgen_edges[e][1]);
+    }
+
+    /* The shape functions are one at their own node and zero at the others, and
+       reproduce a quadratic field from its values at the TetGen nodes */
+    {
+        const double corners[4][3] = { { 0, 0, 0 }, { 2, 0, 0 }, { 0, 2, 0 }, { 0, 0, 2 } };
+        for (int n = 0; n < 10; ++n) {
+            /* Barycentric coordinates of node n, with corner 0 taking the rest */
+            double l[4] = { 1.0, TETGEN_NODES[n][0] / 2.0, TETGEN_NODES[n][1] / 2.0, TETGEN_NODES[n][2] / 2.0 };
+            l[0] -= l[1] + l[2] + l[3];
+            double weights[10];
+            quadratic_tet_shape_functions(l, weights);
+            for (int m = 0; m < 10; ++m) CHECK(std::abs(weights[m] - (m == n ? 1.0 : 0.0)) < 1e-12);
+        }
+
+        std::mt19937_64 random(43);
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::vector<double> scalars(10), barycentric, values(100);
+        std::vector<uint32_t> indices(10), sample_tets(100, 0);
+        for (int n = 0; n < 10; ++n) {
+            indices[n] = n;
+            scalars[n] = quadratic_field(TETGEN_NODES[n]);
+        }
+        for (int s = 0; s < 100; ++s) {
+            double l[4], sum = 0.0;
+            for (double &c : l) sum += (c = unit(random));
+            for (double &c : l) barycentric.push_back(c / sum);
+        }
+        interpolate_quadratic(scalars.data(), indices.data(), sample_tets.data(), barycentric.data(), 100, values.data());
+        for (int s = 0; s < 100; ++s) {
+            double p[3] = { 0, 0, 0 };
+            for (int c = 0; c < 4; ++c)
+                for (int a = 0; a < 3; ++a) p[a] += barycentric[s * 4 + c] * corners[c][a];
+            CHECK(std::abs(values[s] - quadratic_field(p)) < 1e-12);
+        }
+    }
+
+    /* extract_edges numbers the edges of a tetrahedron in the same order */
+    {
+        std::vector<uint32_t> indices = { 7, 3, 9, 1 }, edges, tet_edges;
+        extract_edges(indices.data(), 1, 4, 10, edges, tet_edges);
+        for (int e = 0; e < 6; ++e) {
+            uint32_t a = indices[TET_EDGE_CORNERS[e][0]], b = indices[TET_EDGE_CORNERS[e][1]];
+            const uint32_t *edge = &edges[tet_edges[e] * 2];
+            CHECK(edge[0] == std::min(a, b) && edge[1] == std::max(a, b));
+        }
+    }
+
+    /* Every child of the 1 to 8 split, around each of the three octahedron
+       diagonals, keeps the orientation of its parent and an eighth of its volume */
+    {
+        std::mt19937_64 random(8);
+        std::uniform_real_distribution<double> coordinate(-1.0, 1.0);
+        for (int i = 0; i < 200; ++i) {
+            double nodes[10][3];
+            for (int c = 0; c < 4; ++c)
+                for (int a = 0; a < 3; ++a) nodes[c][a] = (i == 0) ? TETGEN_NODES[c][a] : coordinate(random);
+            double parent = tet_signed_volume6(nodes[0], nodes[1], nodes[2], nodes[3]);
+            if (std::abs(parent) < 1e-3) continue;
+            if (parent < 0.0) {
+                std::swap(nodes[2], nodes[3]);
+                parent = -parent;
+            }
+            for (int e = 0; e < 6; ++e)
+                for (int a = 0; a < 3; ++a) nodes[4 + e][a] = 0.5 * (nodes[TET_EDGE_CORNERS[e][0]][a] + nodes[TET_EDGE_CORNERS[e][1]][a]);
+
+            auto check_child = [&](const uint32_t child[4]) {
+                double volume = tet_signed_volume6(nodes[child[0]], nodes[child[1]], nodes[child[2]], nodes[child[3]]);
+                CHECK(volume > 0.0);
+                CHECK(std::abs(volume - parent / 8.0) < 1e-12 * parent + 1e-15);
+            };
+            for (int c = 0; c < 4; ++c) check_child(QUADRATIC_CORNER_TETS[c]);
+            for (int d = 0; d < 3; ++d)
+                for (int c = 0; c < 4; ++c) check_child(QUADRATIC_OCTAHEDRON_TETS[d][c]);
+        }
+    }
+
+    /* The octahedron is split along its shortest diagonal. Its three diagonals
+       4-9, 6-8 and 7-5 are equally long in the TetGen tetrahedron, so pull the
+       ends of one of them together. */
+    {
+        const uint32_t diagonals[3][2] = { { 4, 9 }, { 6, 8 }, { 7, 5 } };
+        for (uint32_t d = 0; d < 3; ++d) {
+            std::vector<double> points;
+            std::vector<uint32_t> indices;
+            for (int n = 0; n < 10; ++n) {
+                indices.push_back(n);
+                for (int a = 0; a < 3; ++a) points.push_back(TETGEN_NODES[n][a]);
+            }
+            for (int a = 0; a < 3; ++a)
+                points[diagonals[d][1] * 3 + a] = 0.5 * (points[diagonals[d][0] * 3 + a] + points[diagonals[d][1] * 3 + a]);
+            std::vector<uint32_t> linear = linearize_quadratic_tets(points.data(), indices.data(), 1);
+            for (int c = 0; c < 4; ++c)
+                for (int k = 0; k < 4; ++k) CHECK(linear[16 + c * 4 + k] == QUADRATIC_OCTAHEDRON_TETS[d][c][k]);
+        }
+    }
+
+    /* Uniform refinement keeps every tetrahedron positive and the total volume */
+    {
+        std::vector<double> points, scalars;
+        std::vector<uint32_t> indices;
+        make_grid_mesh(2, points, indices);
+        size_t num_tetrahedra = indices.size() / 4;
+        scalars.assign(points.size() / 3, 0.0);
+        CHECK(refine_uniform(points, scalars, indices, 4, false, 2) == 4);
+        CHECK(indices.size() / 4 == num_tetrahedra * 64);
+        double total = 0.0;
+        for (size_t t = 0; t < indices.size() / 4; ++t) {
+            const uint32_t *tet = &indices[t * 4];
+            double volume = tet_signed_volume6(&points[tet[0] * 3], &points[tet[1] * 3], &points[tet[2] * 3], &points[tet[3] * 3]);
+            CHECK(volume > 0.0);
+            total += volume / 6.0;
+        }
+        CHECK(std::abs(total - 8.0) < 1e-9);
+        CHECK(scalars.size() == points.size() / 3);
+    }
+
+    return test_result("TestQuadratic");
+}
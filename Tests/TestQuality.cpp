@@ -0,0 +1,136 @@
+/* Batched tetrahedron quality metrics */
+#include "TestCommon.hxx"
+
+/* One tetrahedron at a time, straight from the definitions */
+static TetQuality reference_quality(const double p[4][3])
+{
+    auto sub = [](const double *a, const double *b, double *r) { for (int i = 0; i < 3; ++i) r[i] = a[i] - b[i]; };
+    auto dot = [](const double *a, const double *b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; };
+    auto cross = [](const double *a, const double *b, double *r) {
+        r[0] = a[1] * b[2] - a[2] * b[1];
+        r[1] = a[2] * b[0] - a[0] * b[2];
+        r[2] = a[0] * b[1] - a[1] * b[0];
+    };
+    double ab[3], ac[3], ad[3], w[3];
+    sub(p[1], p[0], ab);
+    sub(p[2], p[0], ac);
+    sub(p[3], p[0], ad);
+    cross(ac, ad, w);
+    double volume = dot(ab, w) / 6.0;
+
+    /* Face f is opposite corner f; its outward normal points away from corner f */
+    const int faces[4][3] = { { 1, 2, 3 }, { 0, 2, 3 }, { 0, 1, 3 }, { 0, 1, 2 } };
+    double normals[4][3], area = 0.0;
+    for (int f = 0; f < 4; ++f) {
+        double u[3], v[3], to_corner[3];
+        sub(p[faces[f][1]], p[faces[f][0]], u);
+        sub(p[faces[f][2]], p[faces[f][0]], v);
+        cross(u, v, normals[f]);
+        sub(p[f], p[faces[f][0]], to_corner);
+        if (dot(normals[f], to_corner) > 0.0)
+            for (int i = 0; i < 3; ++i) normals[f][i] = -normals[f][i];
+        area += std::sqrt(dot(normals[f], normals[f])) / 2.0;
+    }
+    double inradius = 3.0 * std::abs(volume) / area;
+
+    double longest = 0.0;
+    for (int a = 0; a < 4; ++a)
+        for (int b = a + 1; b < 4; ++b) {
+            double edge[3];
+            sub(p[b], p[a], edge);
+            longest = std::max(longest, std::sqrt(dot(edge, edge)));
+        }
+
+    /* Circumcenter c solves 2 (p_i - p_0) . c = |p_i|^2 - |p_0|^2, by Cramer's rule */
+    double rows[3][3], rhs[3];
+    for (int i = 0; i < 3; ++i) {
+        for (int a = 0; a < 3; ++a) rows[i][a] = 2.0 * (p[i + 1][a] - p[0][a]);
+        rhs[i] = dot(p[i + 1], p[i + 1]) - dot(p[0], p[0]);
+    }
+    auto det = [](const double m[3][3]) {
+        return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    };
+    double center[3], d = det(rows);
+    for (int a = 0; a < 3; ++a) {
+        double m[3][3];
+        for (int i = 0; i < 3; ++i)
+            for (int b = 0; b < 3; ++b) m[i][b] = (b == a) ? rhs[i] : rows[i][b];
+        center[a] = det(m) / d;
+    }
+    double offset[3];
+    sub(center, p[0], offset);
+    double circumradius = std::sqrt(dot(offset, offset));
+
+    TetQuality q;
+    q.volume = volume;
+    q.aspect_ratio = longest / (2.0 * std::sqrt(6.0) * inradius);
+    q.radius_ratio = circumradius / (3.0 * inradius);
+    q.min_dihedral = 180.0;
+    q.max_dihedral = 0.0;
+    for (int f = 0; f < 4; ++f)
+        for (int g = f + 1; g < 4; ++g) {
+            double c = -dot(normals[f], normals[g]) / std::sqrt(dot(normals[f], normals[f]) * dot(normals[g], normals[g]));
+            double angle = std::acos(std::max(-1.0, std::min(1.0, c))) * 180.0 / 3.14159265358979323846;
+            q.min_dihedral = std::min(q.min_dihedral, angle);
+            q.max_dihedral = std::max(q.max_dihedral, angle);
+        }
+    return q;
+}
+
+static bool close(double a, double b) { return std::abs(a - b) <= 1e-9 * std::max(1.0, std::abs(b)); }
+
+int main()
+{
+    /* A regular tetrahedron scores 1, with dihedral angles of acos(1/3) */
+    {
+        std::vector<double> points = { 1, 1, 1, 1, -1, -1, -1, 1, -1, -1, -1, 1 };
+        std::vector<uint32_t> indices = { 0, 1, 2, 3 };
+        std::vector<TetQuality> quality = compute_tet_quality(points, indices, 4);
+        double dihedral = std::acos(1.0 / 3.0) * 180.0 / 3.14159265358979323846;
+        CHECK(close(std::abs(quality[0].volume), 8.0 / 3.0));
+        CHECK(close(quality[0].aspect_ratio, 1.0));
+        CHECK(close(quality[0].radius_ratio, 1.0));
+        CHECK(close(quality[0].min_dihedral, dihedral));
+        CHECK(close(quality[0].max_dihedral, dihedral));
+    }
+
+    /* Random tetrahedra, some inverted, in blocks with a partial last one */
+    {
+        std::mt19937 random(5);
+        std::uniform_real_distribution<double> coordinate(-1.0, 1.0);
+        const size_t num_tetrahedra = 8 * 37 + 5;
+        std::vector<double> points;
+        std::vector<uint32_t> indices;
+        for (size_t i = 0; i < num_tetrahedra * 4; ++i) {
+            for (int a = 0; a < 3; ++a) points.push_back(coordinate(random));
+            indices.push_back((uint32_t) i);
+        }
+        std::vector<TetQuality> quality = compute_tet_quality(points, indices, 4);
+        size_t inverted = 0;
+        for (size_t t = 0; t < num_tetrahedra; ++t) {
+            double p[4][3];
+            for (int c = 0; c < 4; ++c)
+                for (int a = 0; a < 3; ++a) p[c][a] = points[(t * 4 + c) * 3 + a];
+            TetQuality expected = reference_quality(p);
+            inverted += expected.volume < 0.0;
+            CHECK(close(quality[t].volume, expected.volume));
+            CHECK(std::abs(quality[t].aspect_ratio - expected.aspect_ratio) <= 1e-6 * expected.aspect_ratio);
+            CHECK(std::abs(quality[t].radius_ratio - expected.radius_ratio) <= 1e-6 * expected.radius_ratio);
+            CHECK(std::abs(quality[t].min_dihedral - expected.min_dihedral) < 1e-6);
+            CHECK(std::abs(quality[t].max_dihedral - expected.max_dihedral) < 1e-6);
+        }
+        CHECK(inverted > 0 && inverted < num_tetrahedra);
+    }
+
+    /* Flat tetrahedra */
+    {
+        std::vector<double> points = { 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 0 };
+        std::vector<uint32_t> indices = { 0, 1, 2, 3 };
+        std::vector<TetQuality> quality = compute_tet_quality(points, indices, 4);
+        CHECK(quality[0].volume == 0.0);
+        CHECK(std::isinf(quality[0].aspect_ratio) && std::isinf(quality[0].radius_ratio));
+        CHECK(quality[0].min_dihedral == 0.0 && quality[0].max_dihedral == 180.0);
+    }
+
+    return test_result("TestQuality");
+}
@@ -0,0 +1,138 @@
+/* Plane slicing into triangle meshes and images */
+#include "TestCommon.hxx"
+
+#include <array>
+
+/* A linear field, exactly reproduced by linear interpolation */
+static double linear_field(const double *p) { return 1.0 + 0.5 * p[0] - 0.75 * p[1] + 0.25 * p[2]; }
+
+/* Slices the mesh, checks the triangles and returns the area of the section */
+static double check_slice(const std::vector<double> &points, const std::vector<double> &scalars, const std::vector<uint32_t> &indices,
+                          const std::vector<double> &plane, const BVH *bvh)
+{
+    std::vector<double> out_points, out_scalars;
+    std::vector<uint32_t> out_indices;
+    slice_mesh(points, scalars, indices, 4, false, plane, out_points, out_scalars, out_indices, bvh);
+    size_t num_vertices = out_points.size() / 3;
+    CHECK(out_scalars.size() == num_vertices);
+    CHECK(out_indices.size() % 3 == 0);
+
+    /* Vertices lie on the plane, carry the field and are welded */
+    double length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+    std::vector<std::array<double, 3>> positions;
+    for (size_t v = 0; v < num_vertices; ++v) {
+        const double *p = &out_points[v * 3];
+        CHECK(std::abs(plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2] - plane[3]) < 1e-12 * length);
+        CHECK(std::abs(out_scalars[v] - linear_field(p)) < 1e-12);
+        positions.push_back({ p[0], p[1], p[2] });
+    }
+    std::sort(positions.begin(), positions.end());
+    CHECK(std::adjacent_find(positions.begin(), positions.end()) == positions.end());
+
+    /* Triangles are not degenerate, face along the normal and cover no area twice */
+    double area = 0.0;
+    std::vector<std::array<uint32_t, 3>> triangles;
+    for (size_t t = 0; t < out_indices.size() / 3; ++t) {
+        const uint32_t *tri = &out_indices[t * 3];
+        CHECK(tri[0] < num_vertices && tri[1] < num_vertices && tri[2] < num_vertices);
+        if (tri[0] >= num_vertices || tri[1] >= num_vertices || tri[2] >= num_vertices) continue;
+        double a[3], b[3];
+        for (int c = 0; c < 3; ++c) {
+            a[c] = out_points[tri[1] * 3 + c] - out_points[tri[0] * 3 + c];
+            b[c] = out_points[tri[2] * 3 + c] - out_points[tri[0] * 3 + c];
+        }
+        double normal[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+        double facing = (normal[0] * plane[0] + normal[1] * plane[1] + normal[2] * plane[2]) / length;
+        CHECK(facing > 1e-9);
+        area += 0.5 * facing;
+        std::array<uint32_t, 3> sorted = { tri[0], tri[1], tri[2] };
+        std::sort(sorted.begin(), sorted.end());
+        triangles.push_back(sorted);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    CHECK(std::adjacent_find(triangles.begin(), triangles.end()) == triangles.end());
+    return area;
+}
+
+int main()
+{
+    std::vector<double> points, scalars;
+    std::vector<uint32_t> indices;
+    make_grid_mesh(4, points, indices);
+    shuffle_vertices(points, indices, 5);
+    for (size_t v = 0; v < points.size() / 3; ++v) scalars.push_back(linear_field(&points[v * 3]));
+    BVH bvh = build_bvh(points, indices, 4);
+
+    /* Planes between the vertices, through a layer of vertices and faces, along
+       the boundary and diagonally through vertices and edges */
+    const BVH *bvhs[2] = { nullptr, &bvh };
+    for (const BVH *with_bvh : bvhs) {
+        CHECK(std::abs(check_slice(points, scalars, indices, { 0.0, 0.0, 1.0, 1.3 }, with_bvh) - 16.0) < 1e-9);
+        CHECK(std::abs(check_slice(points, scalars, indices, { 0.0, 0.0, 1.0, 2.0 }, with_bvh) - 16.0) < 1e-9);
+        CHECK(std::abs(check_slice(points, scalars, indices, { 0.0, -2.0, 0.0, -6.0 }, with_bvh) - 16.0) < 1e-9);
+        CHECK(std::abs(check_slice(points, scalars, indices, { 1.0, 0.0, 0.0, 0.0 }, with_bvh) - 16.0) < 1e-9);
+        CHECK(std::abs(check_slice(points, scalars, indices, { 1.0, 1.0, 1.0, 6.0 }, with_bvh) - 12.0 * std::sqrt(3.0)) < 1e-9);
+        CHECK(std::abs(check_slice(points, scalars, indices, { 1.0, -1.0, 0.0, 0.0 }, with_bvh) - 16.0 * std::sqrt(2.0)) < 1e-9);
+        CHECK(check_slice(points, scalars, indices, { 0.0, 0.0, 1.0, 5.0 }, with_bvh) == 0.0);
+    }
+
+    /* With cell scalars, every triangle keeps the scalar of a tetrahedron it lies in */
+    {
+        std::vector<double> cell_scalars(indices.size() / 4), out_points, out_scalars;
+        std::vector<uint32_t> out_indices;
+        for (size_t t = 0; t < cell_scalars.size(); ++t) cell_scalars[t] = (double) t;
+        slice_mesh(points, cell_scalars, indices, 4, true, { 0.0, 1.0, 0.0, 2.5 }, out_points, out_scalars, out_indices);
+        CHECK(out_scalars.size() == out_indices.size() / 3 && !out_scalars.empty());
+        for (size_t t = 0; t < out_scalars.size(); ++t) {
+            double centre[3] = { 0.0, 0.0, 0.0 };
+            for (int c = 0; c < 3; ++c)
+                for (int a = 0; a < 3; ++a) centre[a] += out_points[out_indices[t * 3 + c] * 3 + a] / 3.0;
+            const uint32_t *tet = &indices[(size_t) out_scalars[t] * 4];
+            double lower[3], upper[3];
+            for (int a = 0; a < 3; ++a) {
+                lower[a] = upper[a] = points[tet[0] * 3 + a];
+                for (int c = 1; c < 4; ++c) {
+                    lower[a] = std::min(lower[a], points[tet[c] * 3 + a]);
+                    upper[a] = std::max(upper[a], points[tet[c] * 3 + a]);
+                }
+            }
+            bool inside = true;
+            for (int a = 0; a < 3; ++a) inside = inside && centre[a] >= lower[a] && centre[a] <= upper[a];
+            CHECK(inside);
+        }
+    }
+
+    /* Images sample the field inside the mesh, and come out the same whatever the thread count */
+    for (const std::vector<double> &plane : { std::vector<double>{ 0.0, 0.0, 1.0, 1.3 }, std::vector<double>{ 0.0, 0.0, 1.0, 2.0 },
+                                             std::vector<double>{ 1.0, 1.0, 1.0, 6.0 } }) {
+        SliceImage image = fit_slice_image(points, plane, 37, 29);
+        std::vector<float> pixels = slice_to_image(points, scalars, indices, 4, false, image);
+        size_t inside = 0;
+        for (uint32_t j = 0; j < image.height; ++j)
+            for (uint32_t i = 0; i < image.width; ++i) {
+                double p[3];
+                for (int a = 0; a < 3; ++a) p[a] = image.origin[a] + i * image.u[a] + j * image.v[a];
+                float value = pixels[(size_t) j * image.width + i];
+                bool strictly_inside = true, outside = false;
+                for (int a = 0; a < 3; ++a) {
+                    strictly_inside = strictly_inside && p[a] > 1e-9 && p[a] < 4.0 - 1e-9;
+                    outside = outside || p[a] < -1e-9 || p[a] > 4.0 + 1e-9;
+                }
+                if (strictly_inside) {
+                    CHECK(std::abs(value - linear_field(p)) < 1e-5);
+                    inside++;
+                }
+                if (outside) CHECK(std::isnan(value));
+            }
+        CHECK(inside > image.num_pixels() / 4);
+
+        for (uint32_t threads : { 1u, 3u, 16u }) {
+            set_num_worker_threads(threads);
+            std::vector<float> threaded = slice_to_image(points, scalars, indices, 4, false, image);
+            CHECK(std::memcmp(threaded.data(), pixels.data(), pixels.size() * sizeof(float)) == 0);
+        }
+        set_num_worker_threads(0);
+    }
+
+    return test_result("TestSlicing");
+}
@@ -0,0 +1,158 @@
+/* Scalar statistics of binary files, stored as a section after the indices */
+#include "TestCommon.hxx"
+
+int main()
+{
+    /* The summary skips values which are not finite, whatever lane they land in */
+    {
+        std::vector<double> values;
+        double sum = 0.0, count = 0.0, lo = std::numeric_limits<double>::max(), hi = std::numeric_limits<double>::lowest();
+        std::mt19937_64 random(42);
+        std::uniform_real_distribution<double> value(-100.0, 100.0);
+        for (int i = 0; i < 1003; ++i) {
+            double v = value(random);
+            if (i % 17 == 3) v = std::numeric_limits<double>::quiet_NaN();
+            if (i % 29 == 5) v = std::numeric_limits<double>::infinity();
+            if (i % 31 == 7) v = -std::numeric_limits<double>::infinity();
+            values.push_back(v);
+            if (!std::isfinite(v)) continue;
+            sum += v;
+            count += 1.0;
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+        }
+        ValueSummary summary;
+        summarize_values(values.data(), values.size(), summary);
+        CHECK(summary.count == count);
+        CHECK(summary.min == lo);
+        CHECK(summary.max == hi);
+        CHECK(std::abs(summary.sum - sum) < 1e-9);
+    }
+
+    std::string path = (std::filesystem::temp_directory_path() / "TestStatistics.bin").string();
+    std::string merged_path = (std::filesystem::temp_directory_path() / "TestStatistics_merged.bin").string();
+
+    std::vector<double> points, scalars;
+    std::vector<uint32_t> indices;
+    make_grid_mesh(4, points, indices);
+    for (size_t v = 0; v < points.size() / 3; ++v) scalars.push_back(points[v * 3] + 0.1 * points[v * 3 + 2]);
+    scalars[5] = std::numeric_limits<double>::quiet_NaN();
+    scalars[9] = std::numeric_limits<double>::infinity();
+
+    for (bool store_as_float : { false, true }) {
+        write_to_binary(points, scalars, indices, 4, false, path, store_as_float);
+
+        /* The header is still the 13 bytes old readers expect, with only the
+           flags they know, and the points follow it directly */
+        std::ifstream file(path, std::ios::binary);
+        char header[BINARY_HEADER_SIZE];
+        file.read(header, BINARY_HEADER_SIZE);
+        CHECK((uint8_t) header[12] == (store_as_float ? 0 : BINARY_DOUBLE_PRECISION));
+        double first[3];
+        if (store_as_float) {
+            float stored[3];
+            file.read((char*) stored, sizeof(stored));
+            std::copy_n(stored, 3, first);
+        } else {
+            file.read((char*) first, sizeof(first));
+        }
+        CHECK(first[0] == points[0] && first[1] == points[1] && first[2] == points[2]);
+        file.close();
+
+        std::vector<BinarySection> sections = list_binary_sections(path);
+        CHECK(sections.size() == 1 && sections[0].tag == SECTION_STATISTICS && sections[0].size == BINARY_STATISTICS_SIZE);
+
+        BinaryStatistics statistics;
+        CHECK(read_binary_statistics(path, statistics));
+        for (int a = 0; a < 3; ++a) {
+            CHECK(statistics.lower[a] == 0.0);
+            CHECK(statistics.upper[a] == 4.0);
+        }
+        double sum = 0.0, count = 0.0, lo = std::numeric_limits<double>::max(), hi = std::numeric_limits<double>::lowest();
+        for (double s : scalars) {
+            double v = store_as_float ? (double) (float) s : s;
+            if (!std::isfinite(v)) continue;
+            sum += v;
+            count += 1.0;
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+        }
+        double mean = sum / count, squares = 0.0;
+        for (double s : scalars) {
+            double v = store_as_float ? (double) (float) s : s;
+            if (std::isfinite(v)) squares += (v - mean) * (v - mean);
+        }
+        CHECK(statistics.scalar_min == lo);
+        CHECK(statistics.scalar_max == hi);
+        CHECK(std::abs(statistics.scalar_mean - mean) < 1e-12);
+        CHECK(std::abs(statistics.scalar_variance - squares / count) < 1e-12);
+        uint64_t total = 0;
+        for (uint64_t bin : statistics.histogram) total += bin;
+        CHECK(total == (uint64_t) count);
+        CHECK(statistics.histogram[0] > 0 && statistics.histogram[BINARY_STATISTICS_BINS - 1] > 0);
+
+        /* The data reads back as before */
+        std::vector<double> read_points, read_scalars;
+        std::vector<uint32_t> read_indices;
+        bool data_is_per_cell;
+        CHECK(read_binary(path, read_points, read_scalars, read_indices, data_is_per_cell) == 4);
+        CHECK(read_indices == indices && !data_is_per_cell);
+        CHECK(read_points.size() == points.size() && read_points[3] == points[3]);
+    }
+
+    /* Bounds are those of the points as stored */
+    {
+        std::vector<double> shifted = points;
+        for (double &x : shifted) x = x * 0.1 + 0.3;
+        for (bool store_as_float : { false, true }) {
+            write_to_binary(shifted, scalars, indices, 4, false, path, store_as_float);
+            BinaryStatistics statistics;
+            CHECK(read_binary_statistics(path, statistics));
+            for (int a = 0; a < 3; ++a) {
+                double lower = 0.3, upper = 4.0 * 0.1 + 0.3;
+                CHECK(statistics.lower[a] == (store_as_float ? (double) (float) lower : lower));
+                CHECK(statistics.upper[a] == (store_as_float ? (double) (float) upper : upper));
+            }
+        }
+
+        /* Enough points to be written in several chunks, with the extremes of each
+           axis in different ones */
+        std::vector<double> large_points, large_scalars;
+        std::vector<uint32_t> large_indices;
+        make_grid_mesh(30, large_points, large_indices);
+        for (size_t v = 0; v < large_points.size(); v += 3) large_points[v + 1] = -large_points[v + 1];
+        large_scalars.assign(large_points.size() / 3, 1.0);
+        for (bool store_as_float : { false, true }) {
+            write_to_binary(large_points, large_scalars, large_indices, 4, false, path, store_as_float);
+            BinaryStatistics statistics;
+            CHECK(read_binary_statistics(path, statistics));
+            CHECK(statistics.lower[0] == 0.0 && statistics.lower[1] == -30.0 && statistics.lower[2] == 0.0);
+            CHECK(statistics.upper[0] == 30.0 && statistics.upper[1] == 0.0 && statistics.upper[2] == 30.0);
+        }
+        write_to_binary(points, scalars, indices, 4, false, path);
+    }
+
+    /* Merged files get statistics of their own, and the statistics section does
+       not stand in the way of adding a compact topology */
+    merge_binaries({ path, path }, merged_path);
+    BinaryStatistics merged;
+    CHECK(read_binary_statistics(merged_path, merged));
+    BinaryStatistics single;
+    read_binary_statistics(path, single);
+    uint64_t merged_total = 0, single_total = 0;
+    for (uint32_t b = 0; b < BINARY_STATISTICS_BINS; ++b) {
+        merged_total += merged.histogram[b];
+        single_total += single.histogram[b];
+    }
+    CHECK(merged_total == single_total);
+    CHECK(merged.scalar_min == single.scalar_min && merged.scalar_max == single.scalar_max);
+
+    add_compact_topology_to_binary(path);
+    std::vector<BinarySection> sections = list_binary_sections(path);
+    CHECK(sections.size() == 2);
+    CHECK(read_binary_statistics(path, single));
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(merged_path);
+    return test_result("TestStatistics");
+}
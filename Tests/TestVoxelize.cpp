@@ -0,0 +1,64 @@
+/* Voxelization onto a regular grid, slab by slab and tile by tile */
+#include "TestCommon.hxx"
+
+/* A linear field, exactly reproduced by linear interpolation */
+static double linear_field(double x, double y, double z) { return 1.0 + 0.5 * x - 0.75 * y + 0.25 * z; }
+
+/* Runs voxelize and gathers its slabs into one volume */
+static std::vector<float> voxelize_volume(const std::vector<double> &points, const std::vector<double> &scalars, const std::vector<uint32_t> &indices,
+                                          const RegularGrid &grid, size_t max_slab_bytes)
+{
+    std::vector<float> volume(grid.num_samples(), -1.0f);
+    size_t plane_size = (size_t) grid.dims[0] * grid.dims[1];
+    uint32_t next_plane = 0;
+    voxelize(points.data(), scalars.data(), indices.data(), indices.size() / 4, 4, false, grid, std::numeric_limits<float>::quiet_NaN(),
+        [&](uint32_t first, uint32_t depth, const float *values) {
+            CHECK(first == next_plane);
+            next_plane = first + depth;
+            std::copy(values, values + plane_size * depth, &volume[(size_t) first * plane_size]);
+        }, max_slab_bytes);
+    CHECK(next_plane == grid.dims[2]);
+    return volume;
+}
+
+int main()
+{
+    std::vector<double> points, scalars;
+    std::vector<uint32_t> indices;
+    make_grid_mesh(4, points, indices);
+    shuffle_vertices(points, indices, 37);
+    for (size_t v = 0; v < points.size() / 3; ++v) scalars.push_back(linear_field(points[v * 3], points[v * 3 + 1], points[v * 3 + 2]));
+
+    /* Samples a quarter apart land on mesh vertices, edges and faces, and some lie outside */
+    RegularGrid grid;
+    const uint32_t dims[3] = { 21, 19, 23 };
+    for (int a = 0; a < 3; ++a) {
+        grid.origin[a] = -0.5;
+        grid.spacing[a] = 0.25;
+        grid.dims[a] = dims[a];
+    }
+    size_t plane_bytes = (size_t) dims[0] * dims[1] * sizeof(float);
+
+    std::vector<float> reference = voxelize_volume(points, scalars, indices, grid, VOXELIZE_SLAB_BYTES);
+    for (uint32_t k = 0; k < dims[2]; ++k)
+        for (uint32_t j = 0; j < dims[1]; ++j)
+            for (uint32_t i = 0; i < dims[0]; ++i) {
+                double p[3] = { grid.origin[0] + i * grid.spacing[0], grid.origin[1] + j * grid.spacing[1], grid.origin[2] + k * grid.spacing[2] };
+                float value = reference[((size_t) k * dims[1] + j) * dims[0] + i];
+                bool inside = true;
+                for (int a = 0; a < 3; ++a) inside = inside && p[a] >= 0.0 && p[a] <= 4.0;
+                if (inside) CHECK(std::abs(value - linear_field(p[0], p[1], p[2])) < 1e-5);
+                else CHECK(std::isnan(value));
+            }
+
+    /* The samples do not depend on the thread count (and so the tiling) or the slab size */
+    for (uint32_t threads : { 1u, 3u, 16u })
+        for (size_t max_slab_bytes : { plane_bytes, 3 * plane_bytes, VOXELIZE_SLAB_BYTES }) {
+            set_num_worker_threads(threads);
+            std::vector<float> volume = voxelize_volume(points, scalars, indices, grid, max_slab_bytes);
+            CHECK(std::memcmp(volume.data(), reference.data(), volume.size() * sizeof(float)) == 0);
+        }
+    set_num_worker_threads(0);
+
+    return test_result("TestVoxelize");
+}
@@ -7,7 +7,12 @@
 // |  for faster reads                                                |
 // └──────────────────────────────────────────────────────────────────┘
 
+#pragma once
+
 #include <exception>
+#include <stdexcept>
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <fstream>
 #include <sstream>
@@ -16,33 +21,133 @@
 #include <algorithm> 
 #include <cctype>
 #include <locale>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* SIMD code paths follow the instruction set the compiler targets. Defining
+   TETRATOOLS_NO_SIMD selects the portable scalar paths instead, e.g. to test them. */
+#if !defined(TETRATOOLS_NO_SIMD) && defined(__AVX__)
+#define TETRATOOLS_AVX
+#include <immintrin.h>
+#elif !defined(TETRATOOLS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define TETRATOOLS_SSE2
+#include <emmintrin.h>
+#endif
 
 struct GridItem {
     float point [3];
     float attribute;
 };
 
-struct Ele {
+/* Points and attributes are stored with the precision T (float or double).
+   Node indices are always 32 bit. */
+template <typename T>
+struct TEle {
     uint32_t num_tetrahedra;
     uint32_t nodes_per_tetrahedron;
     uint32_t num_attributes;
 
     std::vector<uint32_t> nodes;
-    std::vector<float> attributes;
+    std::vector<T> attributes;
 };
 
-struct Node {
+template <typename T>
+struct TNode {
     uint32_t num_points;
     // Must be 3
     uint32_t dimension;
     uint32_t num_attributes;
     // Must be 0 or 1
     uint32_t num_boundary_markers;
-    std::vector<float> points;
-    std::vector<float> attributes;
-    std::vector<float> boundary_markers;
+    std::vector<T> points;
+    std::vector<T> attributes;
+    std::vector<T> boundary_markers;
+};
+
+typedef TEle<float> Ele;
+typedef TNode<float> Node;
+typedef TEle<double> EleD;
+typedef TNode<double> NodeD;
+
+/* Bits of the flags byte which follows the counts in the binary header.
+   Older files only ever stored 0 or 1 there, so they read as single precision. */
+enum BinaryFlags : uint8_t {
+    BINARY_DATA_IS_PER_CELL = 1 << 0,
+    BINARY_DOUBLE_PRECISION = 1 << 1
+};
+
+struct BinaryHeader {
+    uint32_t points_per_primitive;
+    uint32_t num_points;
+    uint32_t num_indices;
+    uint8_t flags;
+};
+
+const uint32_t BINARY_HEADER_SIZE = 3 * sizeof(uint32_t) + sizeof(uint8_t);
+
+/* After the indices, a binary file may carry any number of optional sections, such
+   as neighbours or acceleration structures. Each section starts at a multiple of 8
+   bytes (zero padded) with a 16 byte header: a uint32_t tag, a uint32_t reserved
+   for future use, and the uint64_t size of the payload which follows. Readers skip
+   sections they do not know, and older readers stop after the indices. */
+struct BinarySection {
+    uint32_t tag;
+    /* Offset of the payload from the start of the file */
+    uint64_t offset;
+    uint64_t size;
+};
+
+const uint32_t BINARY_SECTION_HEADER_SIZE = 16;
+const uint32_t BINARY_SECTION_ALIGNMENT = 8;
+
+/* Builds a section tag from four characters */
+constexpr uint32_t binary_section_tag(char a, char b, char c, char d)
+{
+    return (uint32_t) (uint8_t) a | ((uint32_t) (uint8_t) b << 8) | ((uint32_t) (uint8_t) c << 16) | ((uint32_t) (uint8_t) d << 24);
+}
+
+const uint32_t BINARY_STATISTICS_BINS = 32;
+
+/* Bounds and scalar statistics, which the binary writers store in a section
+   right after the indices, so viewers need not scan the data. The histogram
+   splits [scalar_min, scalar_max] into equal bins. NaN and infinite scalars are
+   left out of the scalar statistics, so the scalars minus the histogram total
+   is how many of them there are. */
+struct BinaryStatistics {
+    double lower[3];
+    double upper[3];
+    double scalar_min;
+    double scalar_max;
+    double scalar_mean;
+    double scalar_variance;
+    uint64_t histogram[BINARY_STATISTICS_BINS];
+
+    std::vector<double> bounding_box() const { return { lower[0], lower[1], lower[2], upper[0], upper[1], upper[2] }; }
+    std::vector<uint64_t> histogram_counts() const { return std::vector<uint64_t>(histogram, histogram + BINARY_STATISTICS_BINS); }
 };
 
+const uint32_t BINARY_STATISTICS_SIZE = 10 * sizeof(double) + BINARY_STATISTICS_BINS * sizeof(uint64_t);
+static_assert(sizeof(BinaryStatistics) == BINARY_STATISTICS_SIZE, "statistics are stored as they are laid out in memory");
+
+const uint32_t SECTION_STATISTICS = binary_section_tag('S', 'T', 'A', 'T');
+
 // trim from start (in place)
 static inline void ltrim(std::string &s) {
     s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](int ch) {
@@ -70,12 +175,169 @@ inline void throw_if_file_does_not_exist(std::string path)
         throw std::runtime_error( std::string(path + " does not exist!"));
 }
 
+/* Converts doubles to floats, eight (AVX) or four (SSE2) at a time */
+inline void convert_to_float(const double *src, float *dst, size_t count)
+{
+    size_t i = 0;
+#if defined(TETRATOOLS_AVX)
+    for (; i + 8 <= count; i += 8) {
+        __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i));
+        __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i + 4));
+        _mm256_storeu_ps(dst + i, _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1));
+    }
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(dst + i, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i)));
+#elif defined(TETRATOOLS_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src + i));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+        _mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = (float) src[i];
+}
+
+/* Number of values converted per chunk when the stored precision differs from memory */
+const size_t BINARY_CONVERSION_CHUNK = 1 << 16;
+
+/* Values written per chunk when they are summarized, a whole number of xyz points */
+const size_t BINARY_SUMMARY_CHUNK = BINARY_CONVERSION_CHUNK / 3 * 3;
+
+/* Range, sum and count of the finite values passed through write_values */
+struct ValueSummary {
+    double min = std::numeric_limits<double>::max();
+    double max = std::numeric_limits<double>::lowest();
+    double sum = 0.0;
+    double count = 0.0;
+};
+
+/* Adds count values to a summary, in fixed width lanes. Rather than branching
+   around values which are not finite, the lanes turn them into NaN (v + (v - v)),
+   which std::min and std::max ignore as their second argument and which is
+   masked to 0 for the sum and count, so the lane loop vectorizes. */
+template <typename V>
+void summarize_values(const V *values, size_t count, ValueSummary &summary)
+{
+    const uint32_t LANES = 8;
+    double lo[LANES], hi[LANES], sum[LANES], num[LANES];
+    for (uint32_t lane = 0; lane < LANES; ++lane) {
+        lo[lane] = std::numeric_limits<double>::max();
+        hi[lane] = std::numeric_limits<double>::lowest();
+        sum[lane] = 0.0;
+        num[lane] = 0.0;
+    }
+    auto add = [&](uint32_t lane, double value) {
+        double finite = value + (value - value);
+        lo[lane] = std::min(lo[lane], finite);
+        hi[lane] = std::max(hi[lane], finite);
+        sum[lane] += std::max(0.0, finite) + std::min(0.0, finite);
+        num[lane] += std::max(0.0, (finite - finite) + 1.0);
+    };
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES)
+        for (uint32_t lane = 0; lane < LANES; ++lane) add(lane, (double) values[i + lane]);
+    for (; i < count; ++i) add(0, (double) values[i]);
+    for (uint32_t lane = 0; lane < LANES; ++lane) {
+        summary.min = std::min(summary.min, lo[lane]);
+        summary.max = std::max(summary.max, hi[lane]);
+        summary.sum += sum[lane];
+        summary.count += num[lane];
+    }
+}
+
+/* Per axis bounds of the xyz points passed through write_values */
+struct BoundsSummary {
+    double lower[3] = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+    double upper[3] = { std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+};
+
+/* Adds count values, a whole number of xyz points, to per axis bounds. The lanes
+   span eight points of contiguous values, so lane l always holds axis l % 3 and
+   the lane loop vectorizes without gathering. */
+template <typename V>
+void summarize_values(const V *values, size_t count, BoundsSummary &summary)
+{
+    const uint32_t LANES = 24;
+    double lo[LANES], hi[LANES];
+    for (uint32_t lane = 0; lane < LANES; ++lane) {
+        lo[lane] = std::numeric_limits<double>::max();
+        hi[lane] = std::numeric_limits<double>::lowest();
+    }
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES)
+        for (uint32_t lane = 0; lane < LANES; ++lane) {
+            lo[lane] = std::min(lo[lane], (double) values[i + lane]);
+            hi[lane] = std::max(hi[lane], (double) values[i + lane]);
+        }
+    for (uint32_t lane = 0; i + lane < count; ++lane) {
+        lo[lane] = std::min(lo[lane], (double) values[i + lane]);
+        hi[lane] = std::max(hi[lane], (double) values[i + lane]);
+    }
+    for (uint32_t lane = 0; lane < LANES; ++lane) {
+        summary.lower[lane % 3] = std::min(summary.lower[lane % 3], lo[lane]);
+        summary.upper[lane % 3] = std::max(summary.upper[lane % 3], hi[lane]);
+    }
+}
+
+/* Writes count values, converting them to Stored on the way out. Given a
+   summary (a ValueSummary, or a BoundsSummary for xyz points), the stored
+   values are added to it chunk by chunk as they go. */
+template <typename Stored, typename T, typename Summary = ValueSummary>
+void write_values(std::fstream &file, const T *values, size_t count, Summary *summary = nullptr)
+{
+    if (std::is_same<Stored, T>::value) {
+        if (!summary) {
+            file.write((char*) values, count * sizeof(T));
+            return;
+        }
+        for (size_t first = 0; first < count; first += BINARY_SUMMARY_CHUNK) {
+            size_t n = std::min(BINARY_SUMMARY_CHUNK, count - first);
+            summarize_values(values + first, n, *summary);
+            file.write((char*) (values + first), n * sizeof(T));
+        }
+        return;
+    }
+
+    std::vector<Stored> chunk(std::min(count, BINARY_SUMMARY_CHUNK));
+    for (size_t first = 0; first < count; first += chunk.size()) {
+        size_t n = std::min(chunk.size(), count - first);
+        if (std::is_same<Stored, float>::value && std::is_same<T, double>::value)
+            convert_to_float((const double*) (values + first), (float*) chunk.data(), n);
+        else
+            for (size_t i = 0; i < n; ++i) chunk[i] = (Stored) values[first + i];
+        if (summary) summarize_values(chunk.data(), n, *summary);
+        file.write((char*) chunk.data(), n * sizeof(Stored));
+    }
+}
+
+/* Reads count values stored as Stored, converting them into T */
+template <typename Stored, typename T>
+void read_values(std::fstream &file, T *values, size_t count)
+{
+    if (std::is_same<Stored, T>::value) {
+        file.read((char*) values, count * sizeof(T));
+        return;
+    }
+
+    std::vector<Stored> chunk(std::min(count, BINARY_CONVERSION_CHUNK));
+    for (size_t first = 0; first < count; first += chunk.size()) {
+        size_t n = std::min(chunk.size(), count - first);
+        file.read((char*) chunk.data(), n * sizeof(Stored));
+        if (std::is_same<Stored, double>::value && std::is_same<T, float>::value)
+            convert_to_float((const double*) chunk.data(), (float*) (values + first), n);
+        else
+            for (size_t i = 0; i < n; ++i) values[first + i] = (T) chunk[i];
+    }
+}
+
 /* Reads an ASCII node file */
-Node read_node(std::string node_path)
+template <typename T = float>
+TNode<T> read_node(std::string node_path)
 {
     throw_if_file_does_not_exist(node_path);
     
-    Node node;
+    TNode<T> node;
 
     std::fstream file;
     file.open(node_path, std::ios::in);
@@ -122,27 +384,31 @@ Node read_node(std::string node_path)
             if (!((node.num_boundary_markers == 1) || (node.num_boundary_markers == 0)))
                 throw std::runtime_error( std::string("Line " + std::to_string(line_number) + " : " + node_path + " number of boundary markers must be 0 or 1"));
 
+            node.points.reserve((size_t) node.num_points * node.dimension);
+            node.attributes.reserve((size_t) node.num_points * node.num_attributes);
+            node.boundary_markers.reserve((size_t) node.num_points * node.num_boundary_markers);
+
             header_read = true;            
         }
         /* Read points and attributes */
         else {
-            float n;
-            std::vector<float> floats;
-            while (iss >> n) floats.push_back(n);
+            T n;
+            std::vector<T> numbers;
+            while (iss >> n) numbers.push_back(n);
 
-            if (floats.size() != (1 + node.dimension + node.num_attributes + node.num_boundary_markers))
+            if (numbers.size() != (1 + node.dimension + node.num_attributes + node.num_boundary_markers))
                 throw std::runtime_error( std::string("Line " + std::to_string(line_number) + " : " + node_path + " must contain " + 
                     std::to_string(1 + node.dimension + node.num_attributes + node.num_boundary_markers) + " numbers "));
 
             int offset = 1;
             for (int i = 0; i < node.dimension; ++i, ++offset)
-                node.points.push_back(floats[offset]);
+                node.points.push_back(numbers[offset]);
 
             for (int i = 0; i < node.num_attributes; ++i, ++offset)
-                node.attributes.push_back(floats[offset]);
+                node.attributes.push_back(numbers[offset]);
             
             for (int i = 0; i < node.num_boundary_markers; ++i, ++offset)
-                node.boundary_markers.push_back(floats[offset]);
+                node.boundary_markers.push_back(numbers[offset]);
         }
     }
     file.close();
@@ -151,7 +417,8 @@ Node read_node(std::string node_path)
 }
 
 /* Reads an ASCII ele file */
-Ele read_ele(std::string ele_path)
+template <typename T = float>
+TEle<T> read_ele(std::string ele_path)
 {
     throw_if_file_does_not_exist(ele_path);
 
@@ -161,7 +428,7 @@ Ele read_ele(std::string ele_path)
     if (!file.is_open())
         std::cout<< std::string("Unable to open " + ele_path ) << std::endl;
 
-    Ele ele;
+    TEle<T> ele;
 
     bool header_read = false;
     int line_number = 0;
@@ -198,23 +465,27 @@ Ele read_ele(std::string ele_path)
             if (ele.num_attributes < 0)
                 throw std::runtime_error( std::string("Line " + std::to_string(line_number) + " : " + ele_path + " number of attributes must be greater than or equal to 0"));
             
+            ele.nodes.reserve((size_t) ele.num_tetrahedra * ele.nodes_per_tetrahedron);
+            ele.attributes.reserve((size_t) ele.num_tetrahedra * ele.num_attributes);
+
             header_read = true;            
         }
         /* Read node indices */
         else {
-            float n;
-            std::vector<float> floats;
-            while (iss >> n) floats.push_back(n);
+            /* Doubles hold every 32 bit index exactly, which floats do not */
+            double n;
+            std::vector<double> numbers;
+            while (iss >> n) numbers.push_back(n);
 
-            if (floats.size() != (1 + ele.nodes_per_tetrahedron + ele.num_attributes))
+            if (numbers.size() != (1 + ele.nodes_per_tetrahedron + ele.num_attributes))
                 throw std::runtime_error( std::string("Line " + std::to_string(line_number) + " : " + ele_path + " must contain " + std::to_string(1 + ele.nodes_per_tetrahedron + ele.num_attributes) + " numbers "));
             
             int offset = 1;
             for (int i = 0; i < ele.nodes_per_tetrahedron; ++i, ++offset)
-                ele.nodes.push_back(((uint32_t) floats[offset]) - 1);
+                ele.nodes.push_back(((uint32_t) numbers[offset]) - 1);
 
             for (int i = 0; i < ele.num_attributes; ++i, ++offset)
-                ele.attributes.push_back(floats[offset]);
+                ele.attributes.push_back((T) numbers[offset]);
         }
     }
     file.close();
@@ -223,7 +494,8 @@ Ele read_ele(std::string ele_path)
 }
 
 /* Writes an ASCII node file */
-void write_node(std::string node_path, Node &node)
+template <typename T>
+void write_node(std::string node_path, TNode<T> &node)
 {
     /* Create/open the file */
     std::fstream file;
@@ -250,6 +522,9 @@ void write_node(std::string node_path, Node &node)
     if (node.attributes.size() < (node.num_points * node.num_attributes))
         throw std::runtime_error( std::string("node.attributes must equal (node.num_points * node.num_attributes)"));
     
+    /* Keep enough digits for the values to survive a round trip */
+    file.precision(std::numeric_limits<T>::max_digits10);
+
     /* Write the header */
     file << node.num_points << " " << node.dimension << " " << node.num_attributes << " " << node.num_boundary_markers << std::endl;
     for (uint32_t i = 0; i < node.num_points; ++i)
@@ -274,7 +549,8 @@ void write_node(std::string node_path, Node &node)
 }
 
 /* Writes an ASCII ele file */
-void write_ele(std::string ele_path, Ele &ele)
+template <typename T>
+void write_ele(std::string ele_path, TEle<T> &ele)
 {
     /* Create/open the file */
     std::fstream file;
@@ -298,6 +574,8 @@ void write_ele(std::string ele_path, Ele &ele)
     if (ele.attributes.size() < (ele.num_tetrahedra * ele.num_attributes))
         throw std::runtime_error( std::string("ele.attributes must equal (ele.num_tetrahedra * ele.num_attributes)"));
     
+    file.precision(std::numeric_limits<T>::max_digits10);
+
     /* Write the header */
     file << ele.num_tetrahedra << " " << ele.nodes_per_tetrahedron << " " << ele.num_attributes << std::endl;
     for (uint32_t i = 0; i < ele.num_tetrahedra; ++i)
@@ -319,11 +597,543 @@ void write_ele(std::string ele_path, Ele &ele)
 
 }
 
-/* Converts a node/ele file pair into a simple binary format */
-void write_node_ele_as_binary(std::string node_path, std::string ele_path, uint32_t attribute_idx, std::string binary_path)
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Parallel helpers                                                |
+// └──────────────────────────────────────────────────────────────────┘
+
+inline uint32_t &worker_thread_setting()
+{
+    static uint32_t count = 0;
+    return count;
+}
+
+/* Limits the number of threads used by the parallel passes below.
+   0 (the default) uses one thread per hardware thread. */
+inline void set_num_worker_threads(uint32_t count)
+{
+    worker_thread_setting() = count;
+}
+
+/* Number of threads used by the parallel passes below */
+inline uint32_t num_worker_threads()
+{
+    uint32_t count = worker_thread_setting();
+    if (count == 0) count = std::thread::hardware_concurrency();
+    return (count == 0) ? 1 : count;
+}
+
+/* Splits [0, count) into one contiguous range per worker, and calls
+   fn(begin, end, worker) for each range on its own thread. Small ranges
+   run on the calling thread. */
+template <typename F>
+void parallel_for(size_t count, F fn, size_t min_items_per_worker = 4096)
+{
+    size_t workers = std::min<size_t>(num_worker_threads(), (count + min_items_per_worker - 1) / min_items_per_worker);
+    if (workers <= 1) {
+        if (count > 0) fn((size_t) 0, count, (uint32_t) 0);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> errors(workers);
+    size_t per_worker = (count + workers - 1) / workers;
+    for (size_t w = 0; w < workers; ++w) {
+        size_t begin = std::min(count, w * per_worker);
+        size_t end = std::min(count, begin + per_worker);
+        auto run = [&fn, &errors, begin, end, w]() {
+            try { fn(begin, end, (uint32_t) w); }
+            catch (...) { errors[w] = std::current_exception(); }
+        };
+        if (w + 1 == workers) run();
+        else threads.emplace_back(run);
+    }
+    for (auto &thread : threads) thread.join();
+    for (auto &error : errors)
+        if (error) std::rethrow_exception(error);
+}
+
+/* Returns the number of ranges parallel_for will split count items into */
+inline uint32_t parallel_for_workers(size_t count, size_t min_items_per_worker = 4096)
+{
+    size_t workers = std::min<size_t>(num_worker_threads(), (count + min_items_per_worker - 1) / min_items_per_worker);
+    return (uint32_t) std::max<size_t>(workers, 1);
+}
+
+/* Stable LSD radix sort of keys, carrying values along. Only the lowest
+   key_bits bits of each key are considered. Every pass histograms one
+   digit per thread, then scatters each thread's range to its own offsets. */
+inline void parallel_radix_sort(std::vector<uint64_t> &keys, std::vector<uint32_t> &values, uint32_t key_bits = 64)
+{
+    if (keys.size() != values.size())
+        throw std::runtime_error( std::string("radix sort needs one value per key"));
+
+    const uint32_t RADIX_BITS = 8;
+    const uint32_t RADIX = 1 << RADIX_BITS;
+    size_t count = keys.size();
+    uint32_t workers = parallel_for_workers(count);
+
+    std::vector<uint64_t> keys_tmp(count);
+    std::vector<uint32_t> values_tmp(count);
+    std::vector<size_t> histograms((size_t) workers * RADIX);
+
+    for (uint32_t shift = 0; shift < key_bits; shift += RADIX_BITS) {
+        std::fill(histograms.begin(), histograms.end(), 0);
+        parallel_for(count, [&](size_t begin, size_t end, uint32_t worker) {
+            size_t *histogram = &histograms[(size_t) worker * RADIX];
+            for (size_t i = begin; i < end; ++i)
+                histogram[(keys[i] >> shift) & (RADIX - 1)]++;
+        });
+
+        /* Digit major, worker minor, so each worker's items stay in order */
+        size_t offset = 0;
+        bool single_digit = false;
+        for (uint32_t digit = 0; digit < RADIX; ++digit) {
+            size_t digit_count = 0;
+            for (uint32_t worker = 0; worker < workers; ++worker) {
+                size_t c = histograms[(size_t) worker * RADIX + digit];
+                histograms[(size_t) worker * RADIX + digit] = offset;
+                offset += c;
+                digit_count += c;
+            }
+            if (digit_count == count) single_digit = true;
+        }
+        if (single_digit) continue;
+
+        parallel_for(count, [&](size_t begin, size_t end, uint32_t worker) {
+            size_t *offsets = &histograms[(size_t) worker * RADIX];
+            for (size_t i = begin; i < end; ++i) {
+                size_t dst = offsets[(keys[i] >> shift) & (RADIX - 1)]++;
+                keys_tmp[dst] = keys[i];
+                values_tmp[dst] = values[i];
+            }
+        });
+        keys.swap(keys_tmp);
+        values.swap(values_tmp);
+    }
+}
+
+/* Replaces each value with the sum of the values before it, and returns the total */
+template <typename V>
+V parallel_exclusive_scan(std::vector<V> &values)
+{
+    uint32_t workers = parallel_for_workers(values.size());
+    std::vector<V> partial(workers + 1, 0);
+    parallel_for(values.size(), [&](size_t begin, size_t end, uint32_t worker) {
+        V sum = 0;
+        for (size_t i = begin; i < end; ++i) sum += values[i];
+        partial[worker + 1] = sum;
+    });
+    for (uint32_t w = 0; w < workers; ++w) partial[w + 1] += partial[w];
+    parallel_for(values.size(), [&](size_t begin, size_t end, uint32_t worker) {
+        V sum = partial[worker];
+        for (size_t i = begin; i < end; ++i) {
+            V value = values[i];
+            values[i] = sum;
+            sum += value;
+        }
+    });
+    return partial[workers];
+}
+
+/* Lowers an atomic to value, if value is smaller */
+template <typename V>
+void atomic_min(std::atomic<V> &target, V value)
+{
+    V current = target.load(std::memory_order_relaxed);
+    while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+/* Raises an atomic to value, if value is larger */
+template <typename V>
+void atomic_max(std::atomic<V> &target, V value)
+{
+    V current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+/* Gathers data[order[i]] into slot i, for records of the given stride */
+template <typename V>
+void permute_records(std::vector<V> &data, size_t stride, const std::vector<uint32_t> &order)
+{
+    if (stride == 0 || data.size() < order.size() * stride) return;
+    std::vector<V> permuted(data.size());
+    parallel_for(order.size(), [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i)
+            for (size_t j = 0; j < stride; ++j)
+                permuted[i * stride + j] = data[(size_t) order[i] * stride + j];
+    });
+    data.swap(permuted);
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Space filling curves                                            |
+// └──────────────────────────────────────────────────────────────────┘
+
+enum SpaceFillingCurve {
+    CURVE_NONE = 0,
+    CURVE_MORTON = 1,
+    CURVE_HILBERT = 2
+};
+
+/* Bits per axis of a curve key, so that three axes fit into 64 bits */
+const uint32_t CURVE_BITS = 21;
+
+/* Inserts two zero bits between each of the lower 21 bits of x */
+inline uint64_t spread_bits_by_3(uint32_t x)
+{
+    uint64_t v = x & 0x1fffff;
+    v = (v | (v << 32)) & 0x1f00000000ffffull;
+    v = (v | (v << 16)) & 0x1f0000ff0000ffull;
+    v = (v | (v << 8)) & 0x100f00f00f00f00full;
+    v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+    v = (v | (v << 2)) & 0x1249249249249249ull;
+    return v;
+}
+
+inline uint64_t morton_code(uint32_t x, uint32_t y, uint32_t z)
+{
+    return spread_bits_by_3(x) | (spread_bits_by_3(y) << 1) | (spread_bits_by_3(z) << 2);
+}
+
+/* Skilling's "Programming the Hilbert curve" (2004) transform, followed by
+   interleaving the transposed bits */
+inline uint64_t hilbert_code(uint32_t x, uint32_t y, uint32_t z)
+{
+    uint32_t X[3] = { x, y, z };
+    const uint32_t M = 1u << (CURVE_BITS - 1);
+
+    /* Inverse undo */
+    for (uint32_t Q = M; Q > 1; Q >>= 1) {
+        uint32_t P = Q - 1;
+        for (int i = 0; i < 3; ++i) {
+            if (X[i] & Q) X[0] ^= P;
+            else {
+                uint32_t t = (X[0] ^ X[i]) & P;
+                X[0] ^= t;
+                X[i] ^= t;
+            }
+        }
+    }
+
+    /* Gray encode */
+    for (int i = 1; i < 3; ++i) X[i] ^= X[i - 1];
+    uint32_t t = 0;
+    for (uint32_t Q = M; Q > 1; Q >>= 1)
+        if (X[2] & Q) t ^= Q - 1;
+    for (int i = 0; i < 3; ++i) X[i] ^= t;
+
+    /* X[0] holds the most significant bit of each triple */
+    return morton_code(X[2], X[1], X[0]);
+}
+
+/* Axis aligned bounds of a set of xyz points */
+template <typename T>
+void compute_bounds(const T *points, size_t num_points, double lower[3], double upper[3])
+{
+    uint32_t workers = parallel_for_workers(num_points);
+    std::vector<double> partial((size_t) workers * 6);
+    for (uint32_t w = 0; w < workers; ++w)
+        for (int a = 0; a < 3; ++a) {
+            partial[w * 6 + a] = std::numeric_limits<double>::max();
+            partial[w * 6 + 3 + a] = std::numeric_limits<double>::lowest();
+        }
+
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t worker) {
+        double *lo = &partial[(size_t) worker * 6], *hi = lo + 3;
+        for (size_t i = begin; i < end; ++i)
+            for (int a = 0; a < 3; ++a) {
+                lo[a] = std::min(lo[a], (double) points[i * 3 + a]);
+                hi[a] = std::max(hi[a], (double) points[i * 3 + a]);
+            }
+    });
+
+    for (int a = 0; a < 3; ++a) {
+        lower[a] = std::numeric_limits<double>::max();
+        upper[a] = std::numeric_limits<double>::lowest();
+        for (uint32_t w = 0; w < workers; ++w) {
+            lower[a] = std::min(lower[a], partial[w * 6 + a]);
+            upper[a] = std::max(upper[a], partial[w * 6 + 3 + a]);
+        }
+    }
+}
+
+/* Maps positions within some bounds onto a 2^21 grid, and from there to curve keys.
+   The grid is cubic so that the curve keeps the same locality along every axis. */
+struct CurveQuantizer {
+    double lower[3];
+    double scale;
+    SpaceFillingCurve curve;
+
+    CurveQuantizer(const double lower_[3], const double upper_[3], SpaceFillingCurve curve_) : curve(curve_)
+    {
+        double extent = 0.0;
+        for (int a = 0; a < 3; ++a) {
+            lower[a] = lower_[a];
+            extent = std::max(extent, upper_[a] - lower_[a]);
+        }
+        scale = (extent > 0.0) ? double((1u << CURVE_BITS) - 1) / extent : 0.0;
+    }
+
+    uint64_t key(double x, double y, double z) const
+    {
+        const uint32_t max_cell = (1u << CURVE_BITS) - 1;
+        uint32_t q[3];
+        double p[3] = { x, y, z };
+        for (int a = 0; a < 3; ++a) {
+            double c = (p[a] - lower[a]) * scale;
+            q[a] = (c <= 0.0) ? 0 : (c >= max_cell) ? max_cell : (uint32_t) c;
+        }
+        return (curve == CURVE_HILBERT) ? hilbert_code(q[0], q[1], q[2]) : morton_code(q[0], q[1], q[2]);
+    }
+};
+
+/* Computes the permutation which sorts points along the curve.
+   order[new index] = old index */
+template <typename T>
+std::vector<uint32_t> sort_points_along_curve(const T *points, size_t num_points, const CurveQuantizer &quantizer)
+{
+    std::vector<uint64_t> keys(num_points);
+    std::vector<uint32_t> order(num_points);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) {
+            keys[i] = quantizer.key(points[i * 3 + 0], points[i * 3 + 1], points[i * 3 + 2]);
+            order[i] = (uint32_t) i;
+        }
+    });
+    parallel_radix_sort(keys, order, 3 * CURVE_BITS);
+    return order;
+}
+
+/* Computes the permutation which sorts primitives by the curve key of their
+   centroid. Only the first four (corner) points of a primitive are averaged. */
+template <typename T>
+std::vector<uint32_t> sort_primitives_along_curve(const T *points, const uint32_t *indices, size_t num_primitives, uint32_t points_per_primitive, const CurveQuantizer &quantizer)
+{
+    uint32_t corners = std::min<uint32_t>(points_per_primitive, 4);
+    std::vector<uint64_t> keys(num_primitives);
+    std::vector<uint32_t> order(num_primitives);
+    parallel_for(num_primitives, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) {
+            double centroid[3] = { 0.0, 0.0, 0.0 };
+            for (uint32_t c = 0; c < corners; ++c) {
+                const T *p = &points[(size_t) indices[i * points_per_primitive + c] * 3];
+                for (int a = 0; a < 3; ++a) centroid[a] += p[a];
+            }
+            for (int a = 0; a < 3; ++a) centroid[a] /= corners;
+            keys[i] = quantizer.key(centroid[0], centroid[1], centroid[2]);
+            order[i] = (uint32_t) i;
+        }
+    });
+    parallel_radix_sort(keys, order, 3 * CURVE_BITS);
+    return order;
+}
+
+/* Renames every index through rank, where rank[old index] = new index */
+inline void remap_indices(std::vector<uint32_t> &indices, const std::vector<uint32_t> &rank)
+{
+    parallel_for(indices.size(), [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) indices[i] = rank[indices[i]];
+    });
+}
+
+/* Inverts a permutation given as order[new] = old into rank[old] = new */
+inline std::vector<uint32_t> invert_permutation(const std::vector<uint32_t> &order)
+{
+    std::vector<uint32_t> rank(order.size());
+    parallel_for(order.size(), [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) rank[order[i]] = (uint32_t) i;
+    });
+    return rank;
+}
+
+/* Reorders raw point/index data for locality. Vertices are sorted along the
+   curve and the indices renamed, then primitives are sorted by the curve key
+   of their centroid. Scalars follow either the vertices or the primitives. */
+template <typename T>
+void reorder_along_curve(std::vector<T> &points, std::vector<T> &scalars, std::vector<uint32_t> &indices, uint32_t points_per_primitive, bool data_is_per_cell, SpaceFillingCurve curve)
+{
+    if (curve == CURVE_NONE || points_per_primitive == 0) return;
+
+    size_t num_points = points.size() / 3;
+    size_t num_primitives = indices.size() / points_per_primitive;
+    double lower[3], upper[3];
+    compute_bounds(points.data(), num_points, lower, upper);
+    CurveQuantizer quantizer(lower, upper, curve);
+
+    std::vector<uint32_t> vertex_order = sort_points_along_curve(points.data(), num_points, quantizer);
+    permute_records(points, 3, vertex_order);
+    if (!data_is_per_cell) permute_records(scalars, 1, vertex_order);
+    remap_indices(indices, invert_permutation(vertex_order));
+
+    std::vector<uint32_t> primitive_order = sort_primitives_along_curve(points.data(), indices.data(), num_primitives, points_per_primitive, quantizer);
+    permute_records(indices, points_per_primitive, primitive_order);
+    if (data_is_per_cell) permute_records(scalars, 1, primitive_order);
+}
+
+/* Reorders a node/ele pair for locality, carrying along every attribute and boundary marker */
+template <typename T>
+void reorder_along_curve(TNode<T> &node, TEle<T> &ele, SpaceFillingCurve curve)
+{
+    if (curve == CURVE_NONE) return;
+
+    if (node.dimension != 3)
+        throw std::runtime_error( std::string("node dimension needs to be 3"));
+
+    double lower[3], upper[3];
+    compute_bounds(node.points.data(), node.num_points, lower, upper);
+    CurveQuantizer quantizer(lower, upper, curve);
+
+    std::vector<uint32_t> vertex_order = sort_points_along_curve(node.points.data(), node.num_points, quantizer);
+    permute_records(node.points, 3, vertex_order);
+    permute_records(node.attributes, node.num_attributes, vertex_order);
+    permute_records(node.boundary_markers, node.num_boundary_markers, vertex_order);
+    remap_indices(ele.nodes, invert_permutation(vertex_order));
+
+    std::vector<uint32_t> tet_order = sort_primitives_along_curve(node.points.data(), ele.nodes.data(), ele.num_tetrahedra, ele.nodes_per_tetrahedron, quantizer);
+    permute_records(ele.nodes, ele.nodes_per_tetrahedron, tet_order);
+    permute_records(ele.attributes, ele.num_attributes, tet_order);
+}
+
+/* Completes the statistics of a binary file from the bounds and summary
+   write_values gathered of its stored points and scalars. The variance and
+   histogram need the mean and range first, so they take a second pass over the
+   scalars, reduced per thread in fixed width lanes. store_as_float rounds the
+   scalars in that pass as they were stored. Values which are not finite (once
+   stored) are skipped. */
+template <typename T>
+BinaryStatistics compute_binary_statistics(const T *scalars, size_t num_scalars, const BoundsSummary &bounds, const ValueSummary &summary,
+                                           bool store_as_float = false)
+{
+    BinaryStatistics statistics = {};
+    if (bounds.lower[0] <= bounds.upper[0])
+        for (int a = 0; a < 3; ++a) {
+            statistics.lower[a] = bounds.lower[a];
+            statistics.upper[a] = bounds.upper[a];
+        }
+    if (num_scalars == 0 || summary.count == 0.0) return statistics;
+
+    const uint32_t LANES = 8;
+    auto stored = [&](T value) { return store_as_float ? (double) (float) value : (double) value; };
+    uint32_t workers = parallel_for_workers(num_scalars);
+    statistics.scalar_min = summary.min;
+    statistics.scalar_max = summary.max;
+    statistics.scalar_mean = summary.sum / summary.count;
+    double mean = statistics.scalar_mean, lower = statistics.scalar_min;
+    double scale = (statistics.scalar_max > lower) ? BINARY_STATISTICS_BINS / (statistics.scalar_max - lower) : 0.0;
+    std::vector<double> deviations(workers, 0.0);
+    std::vector<uint64_t> histograms((size_t) workers * BINARY_STATISTICS_BINS, 0);
+    parallel_for(num_scalars, [&](size_t begin, size_t end, uint32_t worker) {
+        double squares[LANES] = {};
+        uint64_t *histogram = &histograms[(size_t) worker * BINARY_STATISTICS_BINS];
+        size_t i = begin;
+        /* Deviations of values which are not finite become NaN, which std::max drops */
+        for (; i + LANES <= end; i += LANES)
+            for (uint32_t lane = 0; lane < LANES; ++lane) {
+                double d = stored(scalars[i + lane]) - mean;
+                d += d - d;
+                squares[lane] += std::max(0.0, d * d);
+            }
+        for (; i < end; ++i) {
+            double d = stored(scalars[i]) - mean;
+            d += d - d;
+            squares[0] += std::max(0.0, d * d);
+        }
+        for (uint32_t lane = 0; lane < LANES; ++lane) deviations[worker] += squares[lane];
+        for (i = begin; i < end; ++i) {
+            double value = stored(scalars[i]);
+            if (!std::isfinite(value)) continue;
+            /* Clamp before converting, as the top of the range lands one past the last bin */
+            histogram[(uint32_t) std::min((double) (BINARY_STATISTICS_BINS - 1), (value - lower) * scale)]++;
+        }
+    });
+    double squares = 0.0;
+    for (uint32_t w = 0; w < workers; ++w) {
+        squares += deviations[w];
+        for (uint32_t b = 0; b < BINARY_STATISTICS_BINS; ++b) statistics.histogram[b] += histograms[(size_t) w * BINARY_STATISTICS_BINS + b];
+    }
+    statistics.scalar_variance = squares / summary.count;
+    return statistics;
+}
+
+/* Writes the header which starts every binary file */
+inline void write_binary_header(std::fstream &file, const BinaryHeader &header)
+{
+    file.write((char*) &header.points_per_primitive, sizeof(uint32_t));
+    file.write((char*) &header.num_points, sizeof(uint32_t));
+    file.write((char*) &header.num_indices, sizeof(uint32_t));
+    file.write((char*) &header.flags, sizeof(uint8_t));
+}
+
+/* Reads the header which starts every binary file */
+inline BinaryHeader read_binary_header(std::fstream &file)
+{
+    BinaryHeader header;
+    file.read((char*) &header.points_per_primitive, sizeof(uint32_t));
+    file.read((char*) &header.num_points, sizeof(uint32_t));
+    file.read((char*) &header.num_indices, sizeof(uint32_t));
+    file.read((char*) &header.flags, sizeof(uint8_t));
+    return header;
+}
+
+/* Reads just the header of a binary file, eg to find its precision */
+inline BinaryHeader read_binary_header(std::string binary_path)
+{
+    throw_if_file_does_not_exist(binary_path);
+
+    std::fstream file;
+    file.open(binary_path, std::ios::in | std::ios::binary );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to open " + binary_path));
+
+    return read_binary_header(file);
+}
+
+inline uint64_t align_binary_section(uint64_t offset)
+{
+    return (offset + BINARY_SECTION_ALIGNMENT - 1) / BINARY_SECTION_ALIGNMENT * BINARY_SECTION_ALIGNMENT;
+}
+
+/* Writes a section header and payload at the current position, padded to the alignment */
+inline void append_binary_section(std::fstream &file, uint32_t tag, const void *data, uint64_t size)
+{
+    uint32_t reserved = 0;
+    file.write((char*) &tag, sizeof(uint32_t));
+    file.write((char*) &reserved, sizeof(uint32_t));
+    file.write((char*) &size, sizeof(uint64_t));
+    file.write((const char*) data, size);
+    uint64_t padding = align_binary_section(size) - size;
+    const char zeros[BINARY_SECTION_ALIGNMENT] = {};
+    file.write(zeros, padding);
+}
+
+/* Pads the file with zeros up to where the next section may start */
+inline void pad_binary_section(std::fstream &file)
+{
+    const char zeros[BINARY_SECTION_ALIGNMENT] = {};
+    uint64_t end = file.tellp();
+    file.write(zeros, align_binary_section(end) - end);
+}
+
+/* Completes the statistics of the points and scalars just written with
+   write_values, and appends them as a section after the indices */
+template <typename T>
+void append_binary_statistics(std::fstream &file, const T *scalars, size_t num_scalars, const BoundsSummary &bounds, const ValueSummary &summary,
+                              bool store_as_float = false)
+{
+    BinaryStatistics statistics = compute_binary_statistics(scalars, num_scalars, bounds, summary, store_as_float);
+    pad_binary_section(file);
+    append_binary_section(file, SECTION_STATISTICS, &statistics, BINARY_STATISTICS_SIZE);
+}
+
+/* Converts a node/ele file pair into a simple binary format.
+   Points and scalars are stored with precision T, unless store_as_float is set.
+   Quadratic (10 node) tetrahedra are stored with all ten nodes. */
+template <typename T = float>
+void write_node_ele_as_binary(std::string node_path, std::string ele_path, uint32_t attribute_idx, std::string binary_path, bool store_as_float = false, SpaceFillingCurve reorder = CURVE_NONE)
 {
-    Ele ele = read_ele(ele_path);
-    Node node = read_node(node_path);
+    TEle<T> ele = read_ele<T>(ele_path);
+    TNode<T> node = read_node<T>(node_path);
 
     /* Create/open the file */
     std::fstream file;
@@ -335,104 +1145,6376 @@ void write_node_ele_as_binary(std::string node_path, std::string ele_path, uint3
     if (node.dimension != 3)
         throw std::runtime_error( std::string("node dimension needs to be 3"));
     
-    if (ele.nodes_per_tetrahedron != 4)
-        throw std::runtime_error( std::string("nodes per tetrahedron needs to be 4"));
+    if (ele.nodes_per_tetrahedron != 4 && ele.nodes_per_tetrahedron != 10)
+        throw std::runtime_error( std::string("nodes per tetrahedron needs to be 4 or 10"));
     
     if (!file.is_open()) 
         throw std::runtime_error( std::string("Unable to create " + binary_path));
         
-    /* Write out the points per primitive */
-    uint32_t points_per_primitive = 4;
-    file.write((char*) &points_per_primitive, sizeof(uint32_t));
-
-    /* Write out the number of points */
-    file.write((char*) &node.num_points, sizeof(uint32_t));
+    /* Optionally sort vertices and tetrahedra along a space filling curve */
+    reorder_along_curve(node, ele, reorder);
 
-    /* Write out the number of indices */
-    uint32_t num_indices = ele.num_tetrahedra * 4;
-    file.write((char*) &num_indices, sizeof(uint32_t));
+    /* Write out the header. Scalars come from the nodes, so they are per vertex */
+    bool store_as_double = std::is_same<T, double>::value && !store_as_float;
+    BinaryHeader header;
+    header.points_per_primitive = ele.nodes_per_tetrahedron;
+    header.num_points = node.num_points;
+    header.num_indices = ele.num_tetrahedra * ele.nodes_per_tetrahedron;
+    header.flags = (store_as_double) ? BINARY_DOUBLE_PRECISION : 0;
 
-    /* Write out the point data */
-    file.write((char*) node.points.data(), node.num_points * 3 * sizeof(float));
+    write_binary_header(file, header);
 
-    /* Write out the scalar data */
-    std::vector<float> scalars(node.num_points);
+    /* Gather the scalars */
+    std::vector<T> scalars(node.num_points);
     for (uint32_t i = 0; i < node.num_points; ++i) {
-        scalars[i] = (node.num_attributes > 0) ? node.attributes[i * node.num_attributes + attribute_idx] : 0.0f;
+        scalars[i] = (node.num_attributes > 0) ? node.attributes[i * node.num_attributes + attribute_idx] : T(0);
+    }
+
+    /* Write out the point and scalar data, summarizing them as they go */
+    BoundsSummary bounds;
+    ValueSummary summary;
+    if (store_as_double) {
+        write_values<double>(file, node.points.data(), (size_t) node.num_points * 3, &bounds);
+        write_values<double>(file, scalars.data(), node.num_points, &summary);
+    } else {
+        write_values<float>(file, node.points.data(), (size_t) node.num_points * 3, &bounds);
+        write_values<float>(file, scalars.data(), node.num_points, &summary);
     }
-    file.write((char*) scalars.data(), node.num_points * sizeof(float));
     
-    /* Write indices */
-    file.write((char*) ele.nodes.data(), ele.num_tetrahedra * 4 * sizeof(uint32_t));
+    /* Write indices, followed by the statistics */
+    file.write((char*) ele.nodes.data(), (size_t) ele.num_tetrahedra * ele.nodes_per_tetrahedron * sizeof(uint32_t));
+    append_binary_statistics(file, scalars.data(), scalars.size(), bounds, summary, !store_as_double);
     file.close();
 }
 
-/* Writes raw point/index data to a binary file */
-void write_to_binary(std::vector<float> &points, std::vector<float> &scalars, std::vector<uint32_t> &indices, uint32_t points_per_primitive, bool data_is_per_cell, std::string binary_path)
+/* Writes the header, points, scalars and indices of a binary file at the current
+   position, followed by its statistics section */
+template <typename T>
+void write_binary_data(std::fstream &file, const std::vector<T> &points, const std::vector<T> &scalars, const std::vector<uint32_t> &indices, uint32_t points_per_primitive, bool data_is_per_cell, bool store_as_float = false)
 {
+    /* Write out the points per primitive, the number of points and indices, and
+       whether or not data is per cell or per vertex */
+    bool store_as_double = std::is_same<T, double>::value && !store_as_float;
+    BinaryHeader header;
+    header.points_per_primitive = points_per_primitive;
+    header.num_points = (uint32_t) (points.size() / 3);
+    header.num_indices = (uint32_t) indices.size();
+    header.flags = (data_is_per_cell) ? BINARY_DATA_IS_PER_CELL : 0;
+    if (store_as_double) header.flags |= BINARY_DOUBLE_PRECISION;
+    write_binary_header(file, header);
+
+    /* Write out point and scalar data, summarizing them as they go */
+    BoundsSummary bounds;
+    ValueSummary summary;
+    if (store_as_double) {
+        write_values<double>(file, points.data(), points.size(), &bounds);
+        write_values<double>(file, scalars.data(), scalars.size(), &summary);
+    } else {
+        write_values<float>(file, points.data(), points.size(), &bounds);
+        write_values<float>(file, scalars.data(), scalars.size(), &summary);
+    }
+
+    /* Write indices, followed by the statistics */
+    file.write((char*) indices.data(), indices.size() * sizeof(uint32_t));
+    append_binary_statistics(file, scalars.data(), scalars.size(), bounds, summary, !store_as_double);
+}
+
+/* Writes raw point/index data to a binary file.
+   Double precision data can be narrowed to floats on the way out with store_as_float,
+   and the data can be sorted along a space filling curve before it is written. */
+template <typename T>
+void write_to_binary(std::vector<T> &points, std::vector<T> &scalars, std::vector<uint32_t> &indices, uint32_t points_per_primitive, bool data_is_per_cell, std::string binary_path, bool store_as_float = false, SpaceFillingCurve reorder = CURVE_NONE)
+{
+    if (reorder != CURVE_NONE) {
+        /* Sort copies, so that the caller's data is left untouched */
+        std::vector<T> sorted_points = points, sorted_scalars = scalars;
+        std::vector<uint32_t> sorted_indices = indices;
+        reorder_along_curve(sorted_points, sorted_scalars, sorted_indices, points_per_primitive, data_is_per_cell, reorder);
+        write_to_binary(sorted_points, sorted_scalars, sorted_indices, points_per_primitive, data_is_per_cell, binary_path, store_as_float);
+        return;
+    }
+
     /* Create/open the file */
     std::fstream file;
     file.open(binary_path, std::ios::out | std::ios::trunc | std::ios::binary );
 
-    /* Write out the points per primitive */
-    file.write((char*) &points_per_primitive, sizeof(uint32_t));
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to create " + binary_path));
 
-    /* Write out the number of points */
-    uint32_t num_points = points.size() / 3;
-    file.write((char*) &num_points, sizeof(uint32_t));
+    write_binary_data(file, points, scalars, indices, points_per_primitive, data_is_per_cell, store_as_float);
+    file.close();
+}
 
-    /* Write out the number of indices */
-    uint32_t num_indices = indices.size();
-    file.write((char*) &num_indices, sizeof(uint32_t));
 
-    /* Write out whether or not data is per cell or per vertex */
-    file.write((char*) &data_is_per_cell, sizeof(uint8_t));
+/* Reads the header, points, scalars and indices of a binary file from the current position */
+template <typename T>
+uint32_t read_binary_data(std::fstream &file, std::vector<T> &points, std::vector<T> &scalars, std::vector<uint32_t> &indices, bool &data_is_per_cell)
+{
+    BinaryHeader header = read_binary_header(file);
+    data_is_per_cell = (header.flags & BINARY_DATA_IS_PER_CELL) != 0;
+    bool stored_as_double = (header.flags & BINARY_DOUBLE_PRECISION) != 0;
 
-    /* Write out point data */
-    file.write((char*) points.data(), points.size() * sizeof(float));
+    uint32_t num_scalars = (data_is_per_cell) ? header.num_indices / header.points_per_primitive : header.num_points;
+    points.resize((size_t) header.num_points * 3);
+    scalars.resize(num_scalars);
+    if (stored_as_double) {
+        read_values<double>(file, points.data(), points.size());
+        read_values<double>(file, scalars.data(), scalars.size());
+    } else {
+        read_values<float>(file, points.data(), points.size());
+        read_values<float>(file, scalars.data(), scalars.size());
+    }
 
-    /* Write out scalar data */
-    file.write((char*) scalars.data(), scalars.size() * sizeof(float));
+    indices.resize(header.num_indices);
+    file.read((char*)(indices.data()), (size_t) header.num_indices * sizeof(uint32_t));
 
-    /* Write indices */
-    file.write((char*) indices.data(), indices.size() * sizeof(uint32_t));
-    file.close();
+    return header.points_per_primitive;
 }
 
-
-/* Reads points and indices from a binary format */
-uint32_t read_binary(std::string binary_path, std::vector<float> &points, std::vector<float> &scalars, std::vector<uint32_t> &indices, bool &data_is_per_cell)
+/* Reads points and indices from a binary format. Values are converted to T
+   if the file was written with a different precision. */
+template <typename T>
+uint32_t read_binary(std::string binary_path, std::vector<T> &points, std::vector<T> &scalars, std::vector<uint32_t> &indices, bool &data_is_per_cell)
 {
     throw_if_file_does_not_exist(binary_path);
 
-    uint32_t points_per_primitive;
     std::fstream file;
     file.open(binary_path, std::ios::in | std::ios::binary );
 
     if (!file.is_open()) 
         throw std::runtime_error( std::string("Unable to open " + binary_path));
 
-    file.read((char*)(&points_per_primitive), sizeof(uint32_t));
-    
-    uint32_t num_points;
-    file.read((char*)(&num_points), sizeof(uint32_t));
+    uint32_t points_per_primitive = read_binary_data(file, points, scalars, indices, data_is_per_cell);
+    file.close();
 
-    uint32_t num_indices;
-    file.read((char*)(&num_indices), sizeof(uint32_t));
+    return points_per_primitive;
+}
 
-    file.read((char*)(&data_is_per_cell), sizeof(uint8_t));
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Optional binary sections                                        |
+// └──────────────────────────────────────────────────────────────────┘
 
-    points.resize(num_points * 3);
-    file.read((char*)points.data(), num_points * 3 * sizeof(float));
+const uint32_t SECTION_NEIGHBORS = binary_section_tag('N', 'E', 'I', 'G');
 
-    uint32_t num_scalars = (data_is_per_cell) ? num_indices / points_per_primitive : num_points;
-    scalars.resize(num_scalars);
-    file.read((char*)scalars.data(), num_scalars * sizeof(float));
+/* Size in bytes of the header, points, scalars and indices, ie where the sections begin */
+inline uint64_t binary_core_size(const BinaryHeader &header)
+{
+    uint64_t value_size = (header.flags & BINARY_DOUBLE_PRECISION) ? sizeof(double) : sizeof(float);
+    uint64_t num_scalars = (header.flags & BINARY_DATA_IS_PER_CELL) ? header.num_indices / header.points_per_primitive : header.num_points;
+    return BINARY_HEADER_SIZE + ((uint64_t) header.num_points * 3 + num_scalars) * value_size + (uint64_t) header.num_indices * sizeof(uint32_t);
+}
 
-    indices.resize(num_indices);
-    file.read((char*)(indices.data()), num_indices * sizeof(uint32_t));
 
-    file.close();
+/* Reads only the indices of a binary file, skipping its points and scalars */
+inline BinaryHeader read_binary_indices(std::string binary_path, std::vector<uint32_t> &indices)
+{
+    throw_if_file_does_not_exist(binary_path);
 
-    return points_per_primitive;
-}
\ No newline at end of file
+    std::fstream file;
+    file.open(binary_path, std::ios::in | std::ios::binary );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to open " + binary_path));
+
+    BinaryHeader header = read_binary_header(file);
+    indices.resize(header.num_indices);
+    file.seekg(binary_core_size(header) - (uint64_t) header.num_indices * sizeof(uint32_t));
+    file.read((char*) indices.data(), indices.size() * sizeof(uint32_t));
+    return header;
+}
+
+/* Lists the optional sections of a binary file */
+inline std::vector<BinarySection> list_binary_sections(std::string binary_path)
+{
+    throw_if_file_does_not_exist(binary_path);
+
+    std::fstream file;
+    file.open(binary_path, std::ios::in | std::ios::binary );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to open " + binary_path));
+
+    BinaryHeader header = read_binary_header(file);
+    file.seekg(0, std::ios::end);
+    uint64_t file_size = file.tellg();
+
+    std::vector<BinarySection> sections;
+    uint64_t offset = align_binary_section(binary_core_size(header));
+    while (offset + BINARY_SECTION_HEADER_SIZE <= file_size) {
+        BinarySection section;
+        uint32_t reserved;
+        file.seekg(offset);
+        file.read((char*) &section.tag, sizeof(uint32_t));
+        file.read((char*) &reserved, sizeof(uint32_t));
+        file.read((char*) &section.size, sizeof(uint64_t));
+        section.offset = offset + BINARY_SECTION_HEADER_SIZE;
+        if (section.offset + section.size > file_size)
+            throw std::runtime_error( std::string(binary_path + " has a truncated section"));
+        sections.push_back(section);
+        offset = align_binary_section(section.offset + section.size);
+    }
+    return sections;
+}
+
+/* Removes the section with the given tag from a binary file, keeping the others.
+   Returns false if there is none. */
+inline bool remove_binary_section(std::string binary_path, uint32_t tag)
+{
+    std::vector<BinarySection> sections = list_binary_sections(binary_path);
+
+    /* Keep the sections after the one being removed, and cut the file there */
+    std::vector<std::pair<uint32_t, std::vector<char>>> kept;
+    uint64_t end = align_binary_section(binary_core_size(read_binary_header(binary_path)));
+    bool removing = false;
+    {
+        std::fstream file;
+        file.open(binary_path, std::ios::in | std::ios::binary );
+        for (const BinarySection &section : sections) {
+            if (section.tag == tag) removing = true;
+            else if (removing) {
+                std::vector<char> payload(section.size);
+                file.seekg(section.offset);
+                file.read(payload.data(), section.size);
+                kept.push_back(std::make_pair(section.tag, std::move(payload)));
+                continue;
+            }
+            if (!removing) end = align_binary_section(section.offset + section.size);
+        }
+    }
+    if (!removing) return false;
+    std::filesystem::resize_file(binary_path, end);
+
+    std::fstream file;
+    file.open(binary_path, std::ios::in | std::ios::out | std::ios::binary );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to open " + binary_path));
+
+    file.seekp(end);
+    for (auto &section : kept) append_binary_section(file, section.first, section.second.data(), section.second.size());
+    file.close();
+    return true;
+}
+
+/* Adds a section to the end of a binary file, replacing any section with the same tag */
+inline void write_binary_section(std::string binary_path, uint32_t tag, const void *data, uint64_t size)
+{
+    remove_binary_section(binary_path, tag);
+    std::vector<BinarySection> sections = list_binary_sections(binary_path);
+    uint64_t end = align_binary_section(binary_core_size(read_binary_header(binary_path)));
+    if (!sections.empty()) end = align_binary_section(sections.back().offset + sections.back().size);
+    std::filesystem::resize_file(binary_path, end);
+
+    std::fstream file;
+    file.open(binary_path, std::ios::in | std::ios::out | std::ios::binary );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to open " + binary_path));
+
+    file.seekp(end);
+    append_binary_section(file, tag, data, size);
+    file.close();
+}
+
+template <typename V>
+void write_binary_section(std::string binary_path, uint32_t tag, const std::vector<V> &values)
+{
+    write_binary_section(binary_path, tag, values.data(), values.size() * sizeof(V));
+}
+
+/* Reads the section with the given tag into values. Returns false if there is none */
+template <typename V>
+bool read_binary_section(std::string binary_path, uint32_t tag, std::vector<V> &values)
+{
+    for (const BinarySection &section : list_binary_sections(binary_path)) {
+        if (section.tag != tag) continue;
+
+        std::fstream file;
+        file.open(binary_path, std::ios::in | std::ios::binary );
+        values.resize(section.size / sizeof(V));
+        file.seekg(section.offset);
+        file.read((char*) values.data(), values.size() * sizeof(V));
+        return true;
+    }
+    return false;
+}
+
+/* Reads the statistics section of a binary file. Returns false if it has none */
+inline bool read_binary_statistics(std::string binary_path, BinaryStatistics &statistics)
+{
+    std::vector<BinaryStatistics> values;
+    if (!read_binary_section(binary_path, SECTION_STATISTICS, values) || values.size() != 1) return false;
+    statistics = values[0];
+    return true;
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Memory mapped binaries                                          |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Read only memory mapping of a whole file */
+class MappedFile {
+public:
+    MappedFile() {}
+    explicit MappedFile(std::string path) { open(path); }
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    void open(std::string path)
+    {
+        close();
+        throw_if_file_does_not_exist(path);
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file_ == INVALID_HANDLE_VALUE)
+            throw std::runtime_error( std::string("Unable to open " + path));
+        LARGE_INTEGER size;
+        GetFileSizeEx(file_, &size);
+        size_ = (uint64_t) size.QuadPart;
+        if (size_ > 0) {
+            mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping_ != NULL) data_ = (const char*) MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error( std::string("Unable to open " + path));
+        struct stat st;
+        fstat(fd, &st);
+        size_ = (uint64_t) st.st_size;
+        if (size_ > 0) {
+            void *data = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED) data_ = (const char*) data;
+        }
+        ::close(fd);
+#endif
+        if (size_ > 0 && data_ == nullptr)
+            throw std::runtime_error( std::string("Unable to map " + path));
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_ != NULL) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = NULL;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) munmap((void*) data_, size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const char *data() const { return data_; }
+    uint64_t size() const { return size_; }
+
+private:
+    const char *data_ = nullptr;
+    uint64_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = NULL;
+#endif
+};
+
+/* A binary file mapped into memory, so that its points, scalars, indices and
+   sections can be used in place without being read into vectors */
+struct MappedBinary {
+    std::shared_ptr<MappedFile> file;
+    BinaryHeader header;
+    /* The arrays follow the 13 byte header, so none of them is aligned; read
+       their values with memcpy (see load_unaligned) */
+    const char *points;
+    const char *scalars;
+    const char *indices;
+    uint64_t num_scalars;
+    std::vector<BinarySection> sections;
+
+    explicit MappedBinary(std::string binary_path) : file(std::make_shared<MappedFile>(binary_path))
+    {
+        const char *data = file->data();
+        uint64_t size = file->size();
+        if (size < BINARY_HEADER_SIZE)
+            throw std::runtime_error( std::string(binary_path + " is too small to be a binary mesh"));
+
+        std::memcpy(&header.points_per_primitive, data + 0, sizeof(uint32_t));
+        std::memcpy(&header.num_points, data + 4, sizeof(uint32_t));
+        std::memcpy(&header.num_indices, data + 8, sizeof(uint32_t));
+        std::memcpy(&header.flags, data + 12, sizeof(uint8_t));
+        uint64_t core_size = binary_core_size(header);
+        if (size < core_size)
+            throw std::runtime_error( std::string(binary_path + " is truncated"));
+
+        uint64_t value_size = is_double() ? sizeof(double) : sizeof(float);
+        num_scalars = (header.flags & BINARY_DATA_IS_PER_CELL) ? header.num_indices / header.points_per_primitive : header.num_points;
+        points = data + BINARY_HEADER_SIZE;
+        scalars = points + (uint64_t) header.num_points * 3 * value_size;
+        indices = scalars + num_scalars * value_size;
+
+        uint64_t offset = align_binary_section(core_size);
+        while (offset + BINARY_SECTION_HEADER_SIZE <= size) {
+            BinarySection section;
+            std::memcpy(&section.tag, data + offset, sizeof(uint32_t));
+            std::memcpy(&section.size, data + offset + 8, sizeof(uint64_t));
+            section.offset = offset + BINARY_SECTION_HEADER_SIZE;
+            if (section.offset + section.size > size)
+                throw std::runtime_error( std::string(binary_path + " has a truncated section"));
+            sections.push_back(section);
+            offset = align_binary_section(section.offset + section.size);
+        }
+    }
+
+    bool is_double() const { return (header.flags & BINARY_DOUBLE_PRECISION) != 0; }
+    bool data_is_per_cell() const { return (header.flags & BINARY_DATA_IS_PER_CELL) != 0; }
+
+    /* Returns the payload of the section with the given tag, or nullptr if there is none */
+    const char *section(uint32_t tag, uint64_t &size) const
+    {
+        for (const BinarySection &s : sections) {
+            if (s.tag != tag) continue;
+            size = s.size;
+            return file->data() + s.offset;
+        }
+        size = 0;
+        return nullptr;
+    }
+};
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Vertex graphs and bandwidth reduction                           |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Compressed sparse row graph. The neighbours of vertex v are
+   neighbors[offsets[v]] up to (but not including) neighbors[offsets[v + 1]] */
+struct CSRGraph {
+    std::vector<uint64_t> offsets;
+    std::vector<uint32_t> neighbors;
+};
+
+/* Builds the vertex to primitive incidence of a set of primitives, ie the primitives
+   touching each vertex, in increasing order. A parallel counting pass sizes each
+   row, and a parallel scatter fills them. */
+inline CSRGraph build_vertex_to_primitive(const uint32_t *indices, size_t num_primitives, uint32_t points_per_primitive, size_t num_points)
+{
+    CSRGraph graph;
+    size_t num_indices = num_primitives * points_per_primitive;
+
+    std::vector<std::atomic<uint32_t>> counts(num_points);
+    parallel_for(num_indices, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) counts[indices[i]].fetch_add(1, std::memory_order_relaxed);
+    });
+    graph.offsets.assign(num_points + 1, 0);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t v = begin; v < end; ++v) {
+            graph.offsets[v] = counts[v].load(std::memory_order_relaxed);
+            counts[v].store(0, std::memory_order_relaxed);
+        }
+    });
+    graph.offsets[num_points] = parallel_exclusive_scan(graph.offsets);
+
+    graph.neighbors.resize(num_indices);
+    parallel_for(num_indices, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t v = indices[i];
+            graph.neighbors[graph.offsets[v] + counts[v].fetch_add(1, std::memory_order_relaxed)] = (uint32_t) (i / points_per_primitive);
+        }
+    });
+
+    /* The scatter order depends on the threads, sorting keeps the result deterministic */
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t v = begin; v < end; ++v)
+            std::sort(graph.neighbors.begin() + graph.offsets[v], graph.neighbors.begin() + graph.offsets[v + 1]);
+    });
+    return graph;
+}
+
+inline CSRGraph build_vertex_to_primitive(const std::vector<uint32_t> &indices, uint32_t points_per_primitive, size_t num_points)
+{
+    return build_vertex_to_primitive(indices.data(), indices.size() / points_per_primitive, points_per_primitive, num_points);
+}
+
+/* Builds the vertex to tetrahedron incidence of a node/ele pair */
+template <typename T>
+CSRGraph build_vertex_to_tet(TNode<T> &node, TEle<T> &ele)
+{
+    return build_vertex_to_primitive(ele.nodes.data(), ele.num_tetrahedra, ele.nodes_per_tetrahedron, node.num_points);
+}
+
+/* Builds the vertex adjacency graph of a set of primitives, where every pair
+   of points in a primitive is connected. Each row is sorted and free of duplicates.
+   Rows are gathered through the vertex to primitive incidence, once to count them
+   and once to fill them, so no more than the final graph is ever allocated. */
+inline CSRGraph build_vertex_adjacency(const uint32_t *indices, size_t num_primitives, uint32_t points_per_primitive, size_t num_points)
+{
+    CSRGraph incidence = build_vertex_to_primitive(indices, num_primitives, points_per_primitive, num_points);
+
+    /* Collects the sorted, unique neighbours of v into row, skipping v itself */
+    auto gather = [&](size_t v, std::vector<uint32_t> &row) {
+        row.clear();
+        for (uint64_t e = incidence.offsets[v]; e < incidence.offsets[v + 1]; ++e) {
+            const uint32_t *primitive = &indices[(size_t) incidence.neighbors[e] * points_per_primitive];
+            for (uint32_t c = 0; c < points_per_primitive; ++c)
+                if (primitive[c] != v) row.push_back(primitive[c]);
+        }
+        std::sort(row.begin(), row.end());
+        row.erase(std::unique(row.begin(), row.end()), row.end());
+    };
+
+    CSRGraph graph;
+    graph.offsets.assign(num_points + 1, 0);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        std::vector<uint32_t> row;
+        for (size_t v = begin; v < end; ++v) {
+            gather(v, row);
+            graph.offsets[v] = row.size();
+        }
+    }, 1024);
+    graph.offsets[num_points] = parallel_exclusive_scan(graph.offsets);
+
+    graph.neighbors.resize(graph.offsets[num_points]);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        std::vector<uint32_t> row;
+        for (size_t v = begin; v < end; ++v) {
+            gather(v, row);
+            std::copy(row.begin(), row.end(), graph.neighbors.begin() + graph.offsets[v]);
+        }
+    }, 1024);
+    return graph;
+}
+
+inline CSRGraph build_vertex_adjacency(const std::vector<uint32_t> &indices, uint32_t points_per_primitive, size_t num_points)
+{
+    return build_vertex_adjacency(indices.data(), indices.size() / points_per_primitive, points_per_primitive, num_points);
+}
+
+/* Builds the vertex adjacency graph of a node/ele pair */
+template <typename T>
+CSRGraph build_vertex_adjacency(TNode<T> &node, TEle<T> &ele)
+{
+    return build_vertex_adjacency(ele.nodes.data(), ele.num_tetrahedra, ele.nodes_per_tetrahedron, node.num_points);
+}
+
+/* Builds the vertex to primitive incidence and vertex adjacency of a binary file,
+   straight from its indices */
+inline void build_binary_graphs(std::string binary_path, CSRGraph &vertex_to_primitive, CSRGraph &vertex_adjacency)
+{
+    std::vector<uint32_t> indices;
+    BinaryHeader header = read_binary_indices(binary_path, indices);
+    vertex_to_primitive = build_vertex_to_primitive(indices, header.points_per_primitive, header.num_points);
+    vertex_adjacency = build_vertex_adjacency(indices, header.points_per_primitive, header.num_points);
+}
+
+struct BandwidthReport {
+    uint64_t bandwidth_before;
+    uint64_t profile_before;
+    uint64_t bandwidth_after;
+    uint64_t profile_after;
+};
+
+/* Measures the bandwidth (largest |i - j| over all edges) and the profile
+   (sum over rows of the distance from the diagonal to the first entry) of a graph.
+   If rank is given, vertex v is numbered rank[v]. */
+inline void measure_bandwidth(const CSRGraph &graph, const std::vector<uint32_t> *rank, uint64_t &bandwidth, uint64_t &profile)
+{
+    size_t num_points = graph.offsets.size() - 1;
+    uint32_t workers = parallel_for_workers(num_points);
+    std::vector<uint64_t> bandwidths(workers, 0), profiles(workers, 0);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t worker) {
+        for (size_t v = begin; v < end; ++v) {
+            uint64_t row = (rank) ? (*rank)[v] : v;
+            uint64_t first = row;
+            for (uint64_t e = graph.offsets[v]; e < graph.offsets[v + 1]; ++e) {
+                uint64_t column = (rank) ? (*rank)[graph.neighbors[e]] : graph.neighbors[e];
+                first = std::min(first, column);
+                bandwidths[worker] = std::max(bandwidths[worker], (column > row) ? column - row : row - column);
+            }
+            profiles[worker] += row - first;
+        }
+    });
+    bandwidth = *std::max_element(bandwidths.begin(), bandwidths.end());
+    profile = 0;
+    for (uint64_t p : profiles) profile += p;
+}
+
+/* Breadth first search which visits the graph one level at a time, and appends
+   each level to order. Every level is built in parallel, but matches a serial
+   queue exactly: a vertex is claimed by the first vertex of the previous level
+   that reaches it, and (if sort_by_degree is set) the children of a vertex are
+   appended by increasing degree, as Cuthill-McKee requires.
+   visited must hold a value other than stamp for every vertex not yet reached.
+   Returns the number of levels. */
+inline uint32_t parallel_level_search(const CSRGraph &graph, uint32_t start, std::vector<uint32_t> &visited, uint32_t stamp,
+    std::vector<std::atomic<uint64_t>> &claims, bool sort_by_degree, std::vector<uint32_t> &order, size_t &last_level_begin)
+{
+    const uint64_t UNCLAIMED = std::numeric_limits<uint64_t>::max();
+    auto degree = [&](uint32_t v) { return graph.offsets[v + 1] - graph.offsets[v]; };
+
+    size_t level_begin = order.size();
+    order.push_back(start);
+    visited[start] = stamp;
+    uint32_t levels = 0;
+    std::vector<uint64_t> child_offsets;
+
+    while (level_begin < order.size()) {
+        levels++;
+        last_level_begin = level_begin;
+        size_t level_end = order.size();
+        size_t level_size = level_end - level_begin;
+
+        /* Each unvisited neighbour is claimed by the earliest vertex of this level */
+        parallel_for(level_size, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t p = begin; p < end; ++p) {
+                uint32_t v = order[level_begin + p];
+                for (uint64_t e = graph.offsets[v]; e < graph.offsets[v + 1]; ++e)
+                    if (visited[graph.neighbors[e]] != stamp)
+                        atomic_min(claims[graph.neighbors[e]], (uint64_t) p);
+            }
+        }, 256);
+
+        /* Count each vertex's children, and find where they go in the next level */
+        child_offsets.assign(level_size + 1, 0);
+        parallel_for(level_size, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t p = begin; p < end; ++p) {
+                uint32_t v = order[level_begin + p];
+                for (uint64_t e = graph.offsets[v]; e < graph.offsets[v + 1]; ++e)
+                    if (claims[graph.neighbors[e]].load(std::memory_order_relaxed) == p)
+                        child_offsets[p]++;
+            }
+        }, 256);
+        uint64_t next_size = parallel_exclusive_scan(child_offsets);
+        order.resize(level_end + next_size);
+
+        /* Write out the children */
+        parallel_for(level_size, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t p = begin; p < end; ++p) {
+                uint32_t v = order[level_begin + p];
+                uint32_t *children = &order[level_end + child_offsets[p]];
+                uint32_t count = 0;
+                for (uint64_t e = graph.offsets[v]; e < graph.offsets[v + 1]; ++e)
+                    if (claims[graph.neighbors[e]].load(std::memory_order_relaxed) == p)
+                        children[count++] = graph.neighbors[e];
+                if (sort_by_degree)
+                    std::sort(children, children + count, [&](uint32_t a, uint32_t b) {
+                        return (degree(a) != degree(b)) ? degree(a) < degree(b) : a < b;
+                    });
+            }
+        }, 256);
+
+        /* Mark the next level as visited and release its claims */
+        parallel_for(next_size, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t v = order[level_end + i];
+                visited[v] = stamp;
+                claims[v].store(UNCLAIMED, std::memory_order_relaxed);
+            }
+        }, 256);
+
+        level_begin = level_end;
+    }
+    return levels;
+}
+
+/* Computes the reverse Cuthill-McKee ordering of a graph. Each connected
+   component starts from a pseudo-peripheral vertex, found with the
+   George-Liu algorithm. Returns order, where order[new index] = old index. */
+inline std::vector<uint32_t> reverse_cuthill_mckee(const CSRGraph &graph)
+{
+    size_t num_points = graph.offsets.size() - 1;
+    auto degree = [&](uint32_t v) { return graph.offsets[v + 1] - graph.offsets[v]; };
+
+    /* Visit components starting from their lowest degree vertices */
+    std::vector<uint32_t> by_degree(num_points);
+    for (size_t v = 0; v < num_points; ++v) by_degree[v] = (uint32_t) v;
+    std::stable_sort(by_degree.begin(), by_degree.end(), [&](uint32_t a, uint32_t b) { return degree(a) < degree(b); });
+
+    std::vector<uint32_t> order;
+    order.reserve(num_points);
+    std::vector<uint32_t> numbered(num_points, 0), searched(num_points, 0);
+    std::vector<std::atomic<uint64_t>> claims(num_points);
+    for (auto &claim : claims) claim.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+
+    uint32_t search = 0;
+    std::vector<uint32_t> scratch;
+    for (uint32_t seed : by_degree) {
+        if (numbered[seed]) continue;
+
+        /* Walk towards a pseudo-peripheral vertex, until the eccentricity stops growing */
+        uint32_t root = seed;
+        size_t last_level_begin = 0;
+        scratch.clear();
+        uint32_t eccentricity = parallel_level_search(graph, root, searched, ++search, claims, false, scratch, last_level_begin);
+        while (true) {
+            uint32_t candidate = scratch[last_level_begin];
+            for (size_t i = last_level_begin; i < scratch.size(); ++i)
+                if (degree(scratch[i]) < degree(candidate)) candidate = scratch[i];
+
+            scratch.clear();
+            uint32_t candidate_eccentricity = parallel_level_search(graph, candidate, searched, ++search, claims, false, scratch, last_level_begin);
+            if (candidate_eccentricity <= eccentricity) break;
+            root = candidate;
+            eccentricity = candidate_eccentricity;
+        }
+
+        size_t component_begin = order.size();
+        parallel_level_search(graph, root, numbered, 1, claims, true, order, last_level_begin);
+        /* Reversing each component on its own keeps the components in the order they were found */
+        std::reverse(order.begin() + component_begin, order.end());
+    }
+    return order;
+}
+
+/* Renumbers the vertices of raw point/index data with reverse Cuthill-McKee,
+   and reports the bandwidth and profile before and after */
+template <typename T>
+BandwidthReport renumber_rcm(std::vector<T> &points, std::vector<T> &scalars, std::vector<uint32_t> &indices, uint32_t points_per_primitive, bool data_is_per_cell)
+{
+    BandwidthReport report;
+    size_t num_points = points.size() / 3;
+    CSRGraph graph = build_vertex_adjacency(indices.data(), indices.size() / points_per_primitive, points_per_primitive, num_points);
+    measure_bandwidth(graph, nullptr, report.bandwidth_before, report.profile_before);
+
+    std::vector<uint32_t> order = reverse_cuthill_mckee(graph);
+    std::vector<uint32_t> rank = invert_permutation(order);
+    measure_bandwidth(graph, &rank, report.bandwidth_after, report.profile_after);
+
+    permute_records(points, 3, order);
+    if (!data_is_per_cell) permute_records(scalars, 1, order);
+    remap_indices(indices, rank);
+    return report;
+}
+
+/* Renumbers the vertices of a node/ele pair with reverse Cuthill-McKee, carrying
+   along every attribute and boundary marker, and reports the bandwidth and profile
+   before and after */
+template <typename T>
+BandwidthReport renumber_rcm(TNode<T> &node, TEle<T> &ele)
+{
+    if (node.dimension != 3)
+        throw std::runtime_error( std::string("node dimension needs to be 3"));
+
+    BandwidthReport report;
+    CSRGraph graph = build_vertex_adjacency(ele.nodes.data(), ele.num_tetrahedra, ele.nodes_per_tetrahedron, node.num_points);
+    measure_bandwidth(graph, nullptr, report.bandwidth_before, report.profile_before);
+
+    std::vector<uint32_t> order = reverse_cuthill_mckee(graph);
+    std::vector<uint32_t> rank = invert_permutation(order);
+    measure_bandwidth(graph, &rank, report.bandwidth_after, report.profile_after);
+
+    permute_records(node.points, 3, order);
+    permute_records(node.attributes, node.num_attributes, order);
+    permute_records(node.boundary_markers, node.num_boundary_markers, order);
+    remap_indices(ele.nodes, rank);
+    return report;
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Mesh cleanup                                                    |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Six times the signed volume of the tetrahedron abcd. Positive when d lies on
+   the side of abc that (b - a) x (c - a) points to */
+template <typename T>
+inline double tet_signed_volume6(const T *a, const T *b, const T *c, const T *d)
+{
+    double ab[3], ac[3], ad[3];
+    for (int i = 0; i < 3; ++i) {
+        ab[i] = (double) b[i] - a[i];
+        ac[i] = (double) c[i] - a[i];
+        ad[i] = (double) d[i] - a[i];
+    }
+    return ab[0] * (ac[1] * ad[2] - ac[2] * ad[1])
+         - ab[1] * (ac[0] * ad[2] - ac[2] * ad[0])
+         + ab[2] * (ac[0] * ad[1] - ac[1] * ad[0]);
+}
+
+/* Mixes the integer coordinates of a grid cell into a 64 bit key. The all ones
+   key is reserved to mark empty hash table slots. */
+inline uint64_t hash_grid_cell(int64_t x, int64_t y, int64_t z)
+{
+    uint64_t h = (uint64_t) x * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t) y * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+    h ^= (uint64_t) z * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+    h ^= h >> 29;
+    return (h == std::numeric_limits<uint64_t>::max()) ? 0 : h;
+}
+
+/* Buckets points into a uniform grid. Points are sorted by cell key, and an open
+   addressing table maps each occupied cell to its run of points, so that finding
+   the points of a cell is O(1) expected. Different cells may collide on a key, in
+   which case their points share a run; callers check distances anyway. */
+struct PointHashGrid {
+    double cell_size;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> points;
+    std::vector<uint64_t> run_offsets;
+    std::vector<uint64_t> table_keys;
+    std::vector<uint32_t> table_runs;
+
+    int64_t cell_of(double x) const { return (int64_t) std::floor(x / cell_size); }
+
+    template <typename T>
+    void build(const T *xyz, size_t num_points, double cell_size_)
+    {
+        cell_size = cell_size_;
+        keys.resize(num_points);
+        points.resize(num_points);
+        parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t i = begin; i < end; ++i) {
+                keys[i] = hash_grid_cell(cell_of(xyz[i * 3 + 0]), cell_of(xyz[i * 3 + 1]), cell_of(xyz[i * 3 + 2]));
+                points[i] = (uint32_t) i;
+            }
+        });
+        parallel_radix_sort(keys, points);
+
+        /* Find where each run of equal keys starts */
+        std::vector<uint64_t> run_starts(num_points + 1, 0);
+        parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t i = begin; i < end; ++i) run_starts[i] = (i == 0 || keys[i] != keys[i - 1]) ? 1 : 0;
+        });
+        uint64_t num_runs = parallel_exclusive_scan(run_starts);
+        run_offsets.resize(num_runs + 1);
+        run_offsets[num_runs] = num_points;
+        parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t i = begin; i < end; ++i)
+                if (i == 0 || keys[i] != keys[i - 1]) run_offsets[run_starts[i]] = i;
+        });
+
+        /* Insert the runs into a table at most half full */
+        size_t table_size = 16;
+        while (table_size < 2 * num_runs) table_size *= 2;
+        std::vector<std::atomic<uint64_t>> slots(table_size);
+        for (auto &slot : slots) slot.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+        table_runs.resize(table_size);
+        parallel_for(num_runs, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t run = begin; run < end; ++run) {
+                uint64_t key = keys[run_offsets[run]];
+                size_t slot = key & (table_size - 1);
+                while (true) {
+                    uint64_t expected = std::numeric_limits<uint64_t>::max();
+                    if (slots[slot].compare_exchange_strong(expected, key)) break;
+                    slot = (slot + 1) & (table_size - 1);
+                }
+                table_runs[slot] = (uint32_t) run;
+            }
+        });
+        table_keys.resize(table_size);
+        for (size_t i = 0; i < table_size; ++i) table_keys[i] = slots[i].load(std::memory_order_relaxed);
+    }
+
+    /* Calls fn(point) for every point bucketed into the cell (x, y, z) or a cell sharing its key */
+    template <typename F>
+    void for_each_in_cell(int64_t x, int64_t y, int64_t z, F fn) const
+    {
+        uint64_t key = hash_grid_cell(x, y, z);
+        size_t mask = table_keys.size() - 1;
+        for (size_t slot = key & mask; table_keys[slot] != std::numeric_limits<uint64_t>::max(); slot = (slot + 1) & mask) {
+            if (table_keys[slot] != key) continue;
+            uint32_t run = table_runs[slot];
+            for (uint64_t i = run_offsets[run]; i < run_offsets[run + 1]; ++i) fn(points[i]);
+            return;
+        }
+    }
+};
+
+/* Bit pattern of a coordinate, with -0 and +0 made equal as they compare equal */
+inline int64_t coordinate_bits(double x)
+{
+    x += 0.0;
+    int64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+/* Maps every vertex to the lowest numbered vertex with exactly the same coordinates.
+   Vertices are sorted by a hash of their coordinate bits, so only vertices
+   colliding on the hash are compared, and the stable sort keeps each run in
+   increasing order, so the first equal vertex in a run is the lowest one. */
+template <typename T>
+std::vector<uint32_t> weld_identical_vertices(const T *points, size_t num_points)
+{
+    std::vector<uint64_t> keys(num_points);
+    std::vector<uint32_t> order(num_points);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) {
+            const T *p = &points[i * 3];
+            keys[i] = hash_grid_cell(coordinate_bits(p[0]), coordinate_bits(p[1]), coordinate_bits(p[2]));
+            order[i] = (uint32_t) i;
+        }
+    });
+    parallel_radix_sort(keys, order);
+
+    /* Where the run of every key starts */
+    std::vector<uint64_t> run_starts(num_points + 1, 0);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) run_starts[i] = (i == 0 || keys[i] != keys[i - 1]) ? 1 : 0;
+    });
+    uint64_t num_runs = parallel_exclusive_scan(run_starts);
+    std::vector<uint64_t> run_offsets(num_runs);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i)
+            if (run_starts[i + 1] != run_starts[i]) run_offsets[run_starts[i]] = i;
+    });
+
+    std::vector<uint32_t> representative(num_points);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) {
+            const T *p = &points[(size_t) order[i] * 3];
+            uint32_t best = order[i];
+            for (size_t j = run_offsets[run_starts[i + 1] - 1]; j < i; ++j) {
+                const T *q = &points[(size_t) order[j] * 3];
+                if (p[0] == q[0] && p[1] == q[1] && p[2] == q[2]) {
+                    best = order[j];
+                    break;
+                }
+            }
+            representative[order[i]] = best;
+        }
+    });
+    return representative;
+}
+
+/* Finds coincident vertices. Each vertex maps to the lowest numbered vertex within
+   tolerance of it, and chains of such vertices are then collapsed onto their root,
+   so representative[v] <= v and representative[representative[v]] == representative[v].
+   A tolerance of 0 welds only identical vertices, through weld_identical_vertices.
+   Otherwise the hash grid cells are at least the tolerance, and never finer than
+   the extent of the points over their count, so that the cell coordinates stay
+   in range for tiny tolerances. */
+template <typename T>
+std::vector<uint32_t> weld_vertices(const T *points, size_t num_points, double tolerance)
+{
+    if (!(tolerance > 0.0)) return weld_identical_vertices(points, num_points);
+
+    double lower[3], upper[3];
+    compute_bounds(points, num_points, lower, upper);
+    double extent = std::max(std::max(upper[0] - lower[0], upper[1] - lower[1]), upper[2] - lower[2]);
+    PointHashGrid grid;
+    grid.build(points, num_points, std::max(tolerance, extent / std::max<size_t>(num_points, 1)));
+    double tolerance2 = tolerance * tolerance;
+
+    std::vector<uint32_t> representative(num_points);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) {
+            const T *p = &points[i * 3];
+            int64_t cx = grid.cell_of(p[0]), cy = grid.cell_of(p[1]), cz = grid.cell_of(p[2]);
+            uint32_t best = (uint32_t) i;
+            for (int64_t dz = -1; dz <= 1; ++dz)
+                for (int64_t dy = -1; dy <= 1; ++dy)
+                    for (int64_t dx = -1; dx <= 1; ++dx)
+                        grid.for_each_in_cell(cx + dx, cy + dy, cz + dz, [&](uint32_t j) {
+                            if (j >= best) return;
+                            const T *q = &points[(size_t) j * 3];
+                            double d0 = (double) p[0] - q[0], d1 = (double) p[1] - q[1], d2 = (double) p[2] - q[2];
+                            if (d0 * d0 + d1 * d1 + d2 * d2 <= tolerance2) best = j;
+                        });
+            representative[i] = best;
+        }
+    }, 1024);
+
+    /* Pointer jumping, double buffered so that every round reads a consistent array */
+    std::vector<uint32_t> jumped(num_points);
+    std::atomic<bool> changed(true);
+    while (changed) {
+        changed = false;
+        parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+            bool local_change = false;
+            for (size_t i = begin; i < end; ++i) {
+                jumped[i] = representative[representative[i]];
+                local_change |= (jumped[i] != representative[i]);
+            }
+            if (local_change) changed = true;
+        });
+        representative.swap(jumped);
+    }
+    return representative;
+}
+
+/* Finds which primitives to keep. A primitive is dropped if it uses the same
+   vertex twice, or if it is a tetrahedron whose absolute volume is at most
+   volume_epsilon. Returns the kept primitive count and fills new_index with
+   each kept primitive's new position. */
+template <typename T>
+uint64_t find_valid_primitives(const T *points, const uint32_t *indices, size_t num_primitives, uint32_t points_per_primitive, double volume_epsilon, std::vector<uint64_t> &new_index)
+{
+    uint32_t corners = std::min<uint32_t>(points_per_primitive, 4);
+    new_index.assign(num_primitives + 1, 0);
+    parallel_for(num_primitives, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t p = begin; p < end; ++p) {
+            const uint32_t *primitive = &indices[p * points_per_primitive];
+            bool valid = true;
+            for (uint32_t a = 0; a < points_per_primitive && valid; ++a)
+                for (uint32_t b = a + 1; b < points_per_primitive && valid; ++b)
+                    valid = primitive[a] != primitive[b];
+            if (valid && corners == 4) {
+                double volume = std::fabs(tet_signed_volume6(&points[(size_t) primitive[0] * 3], &points[(size_t) primitive[1] * 3],
+                    &points[(size_t) primitive[2] * 3], &points[(size_t) primitive[3] * 3])) / 6.0;
+                valid = volume > volume_epsilon;
+            }
+            new_index[p] = valid ? 1 : 0;
+        }
+    });
+    return parallel_exclusive_scan(new_index);
+}
+
+/* Moves the kept records of data to their new positions. new_index is the exclusive
+   prefix sum of keep flags, with one extra entry holding the total */
+template <typename V>
+void compact_records(std::vector<V> &data, size_t stride, const std::vector<uint64_t> &new_index, uint64_t kept)
+{
+    size_t count = new_index.size() - 1;
+    if (stride == 0 || data.size() < count * stride) return;
+    std::vector<V> compacted(kept * stride);
+    parallel_for(count, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i)
+            if (new_index[i + 1] != new_index[i])
+                for (size_t j = 0; j < stride; ++j) compacted[new_index[i] * stride + j] = data[i * stride + j];
+    });
+    data.swap(compacted);
+}
+
+struct CleanupReport {
+    uint64_t welded_vertices;
+    uint64_t unreferenced_vertices;
+    uint64_t degenerate_primitives;
+};
+
+/* Welds vertices, drops degenerate primitives and then unreferenced vertices,
+   calling the given functions to compact whatever data follows the vertices and
+   primitives */
+template <typename T, typename CompactVertices, typename CompactPrimitives>
+CleanupReport cleanup_connectivity(std::vector<T> &points, std::vector<uint32_t> &indices, uint32_t points_per_primitive,
+    double weld_tolerance, double volume_epsilon, CompactVertices compact_vertices, CompactPrimitives compact_primitives)
+{
+    CleanupReport report;
+    size_t num_points = points.size() / 3;
+    size_t num_primitives = indices.size() / points_per_primitive;
+
+    /* Point every index at its representative vertex */
+    std::vector<uint32_t> representative = weld_vertices(points.data(), num_points, weld_tolerance);
+    std::atomic<uint64_t> welded(0);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        uint64_t count = 0;
+        for (size_t v = begin; v < end; ++v) count += (representative[v] != v);
+        welded += count;
+    });
+    report.welded_vertices = welded;
+    remap_indices(indices, representative);
+
+    /* Drop primitives which collapsed or have no volume */
+    std::vector<uint64_t> primitive_index;
+    uint64_t kept_primitives = find_valid_primitives(points.data(), indices.data(), num_primitives, points_per_primitive, volume_epsilon, primitive_index);
+    report.degenerate_primitives = num_primitives - kept_primitives;
+    compact_records(indices, points_per_primitive, primitive_index, kept_primitives);
+    compact_primitives(primitive_index, kept_primitives);
+
+    /* Drop vertices which nothing refers to any more, welded ones included */
+    std::vector<std::atomic<uint8_t>> referenced(num_points);
+    parallel_for(indices.size(), [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) referenced[indices[i]].store(1, std::memory_order_relaxed);
+    });
+    std::vector<uint64_t> vertex_index(num_points + 1, 0);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t v = begin; v < end; ++v) vertex_index[v] = referenced[v].load(std::memory_order_relaxed);
+    });
+    uint64_t kept_vertices = parallel_exclusive_scan(vertex_index);
+    report.unreferenced_vertices = num_points - kept_vertices - report.welded_vertices;
+
+    compact_records(points, 3, vertex_index, kept_vertices);
+    compact_vertices(vertex_index, kept_vertices);
+    parallel_for(indices.size(), [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) indices[i] = (uint32_t) vertex_index[indices[i]];
+    });
+    return report;
+}
+
+/* Cleans up raw point/index data: welds vertices closer than weld_tolerance, drops
+   primitives which collapsed or whose volume is at most volume_epsilon, and removes
+   vertices that are no longer referenced. Welded vertices keep the scalar of the
+   lowest numbered vertex they were welded into. */
+template <typename T>
+CleanupReport cleanup_mesh(std::vector<T> &points, std::vector<T> &scalars, std::vector<uint32_t> &indices, uint32_t points_per_primitive, bool data_is_per_cell, double weld_tolerance, double volume_epsilon = 0.0)
+{
+    return cleanup_connectivity(points, indices, points_per_primitive, weld_tolerance, volume_epsilon,
+        [&](const std::vector<uint64_t> &new_index, uint64_t kept) { if (!data_is_per_cell) compact_records(scalars, 1, new_index, kept); },
+        [&](const std::vector<uint64_t> &new_index, uint64_t kept) { if (data_is_per_cell) compact_records(scalars, 1, new_index, kept); });
+}
+
+/* Cleans up a node/ele pair, carrying along every attribute and boundary marker */
+template <typename T>
+CleanupReport cleanup_mesh(TNode<T> &node, TEle<T> &ele, double weld_tolerance, double volume_epsilon = 0.0)
+{
+    if (node.dimension != 3)
+        throw std::runtime_error( std::string("node dimension needs to be 3"));
+
+    CleanupReport report = cleanup_connectivity(node.points, ele.nodes, ele.nodes_per_tetrahedron, weld_tolerance, volume_epsilon,
+        [&](const std::vector<uint64_t> &new_index, uint64_t kept) {
+            compact_records(node.attributes, node.num_attributes, new_index, kept);
+            compact_records(node.boundary_markers, node.num_boundary_markers, new_index, kept);
+        },
+        [&](const std::vector<uint64_t> &new_index, uint64_t kept) { compact_records(ele.attributes, ele.num_attributes, new_index, kept); });
+    node.num_points = (uint32_t) (node.points.size() / 3);
+    ele.num_tetrahedra = (uint32_t) (ele.nodes.size() / ele.nodes_per_tetrahedron);
+    return report;
+}
+
+/* Cleans up a binary file, writing the result with the same precision */
+inline CleanupReport cleanup_binary(std::string input_path, std::string output_path, double weld_tolerance, double volume_epsilon = 0.0)
+{
+    BinaryHeader header = read_binary_header(input_path);
+    std::vector<uint32_t> indices;
+    bool data_is_per_cell;
+    CleanupReport report;
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        uint32_t points_per_primitive = read_binary(input_path, points, scalars, indices, data_is_per_cell);
+        report = cleanup_mesh(points, scalars, indices, points_per_primitive, data_is_per_cell, weld_tolerance, volume_epsilon);
+        write_to_binary(points, scalars, indices, points_per_primitive, data_is_per_cell, output_path);
+    } else {
+        std::vector<float> points, scalars;
+        uint32_t points_per_primitive = read_binary(input_path, points, scalars, indices, data_is_per_cell);
+        report = cleanup_mesh(points, scalars, indices, points_per_primitive, data_is_per_cell, weld_tolerance, volume_epsilon);
+        write_to_binary(points, scalars, indices, points_per_primitive, data_is_per_cell, output_path);
+    }
+    return report;
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Faces and boundary extraction                                   |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Face f of a tetrahedron is the face opposite its corner f, as in TetGen's .neigh files */
+const uint32_t TET_FACE_CORNERS[4][3] = { { 1, 2, 3 }, { 0, 3, 2 }, { 0, 1, 3 }, { 0, 2, 1 } };
+
+/* Pairs up the faces of tetrahedra which share the same three vertices. Face slot
+   4 * t + f is face f of tetrahedron t, and mates[slot] is the slot of the other
+   face with the same vertices, or -1 on the boundary. Faces are bucketed by their
+   smallest vertex with a parallel counting sort, then matched within each bucket.
+   Only the four corners of each primitive are considered. */
+inline std::vector<int64_t> match_tet_faces(const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive, size_t num_points)
+{
+    size_t num_faces = num_tetrahedra * 4;
+    auto face_vertices = [&](uint64_t slot, uint32_t sorted[3]) {
+        const uint32_t *tet = &indices[(slot / 4) * points_per_primitive];
+        const uint32_t *corners = TET_FACE_CORNERS[slot % 4];
+        sorted[0] = tet[corners[0]]; sorted[1] = tet[corners[1]]; sorted[2] = tet[corners[2]];
+        if (sorted[0] > sorted[1]) std::swap(sorted[0], sorted[1]);
+        if (sorted[1] > sorted[2]) std::swap(sorted[1], sorted[2]);
+        if (sorted[0] > sorted[1]) std::swap(sorted[0], sorted[1]);
+    };
+
+    /* Bucket face slots by their smallest vertex */
+    std::vector<std::atomic<uint32_t>> counts(num_points);
+    parallel_for(num_faces, [&](size_t begin, size_t end, uint32_t) {
+        uint32_t sorted[3];
+        for (size_t slot = begin; slot < end; ++slot) {
+            face_vertices(slot, sorted);
+            counts[sorted[0]].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    std::vector<uint64_t> offsets(num_points + 1, 0);
+    for (size_t v = 0; v < num_points; ++v) {
+        offsets[v] = counts[v].load(std::memory_order_relaxed);
+        counts[v].store(0, std::memory_order_relaxed);
+    }
+    offsets[num_points] = parallel_exclusive_scan(offsets);
+
+    std::vector<uint64_t> buckets(num_faces);
+    parallel_for(num_faces, [&](size_t begin, size_t end, uint32_t) {
+        uint32_t sorted[3];
+        for (size_t slot = begin; slot < end; ++slot) {
+            face_vertices(slot, sorted);
+            buckets[offsets[sorted[0]] + counts[sorted[0]].fetch_add(1, std::memory_order_relaxed)] = slot;
+        }
+    });
+
+    /* Within a bucket, equal faces end up next to each other once sorted */
+    std::vector<int64_t> mates(num_faces, -1);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        std::vector<std::pair<uint64_t, uint64_t>> bucket;
+        for (size_t v = begin; v < end; ++v) {
+            bucket.clear();
+            uint32_t sorted[3];
+            for (uint64_t i = offsets[v]; i < offsets[v + 1]; ++i) {
+                face_vertices(buckets[i], sorted);
+                bucket.push_back(std::make_pair(((uint64_t) sorted[1] << 32) | sorted[2], buckets[i]));
+            }
+            std::sort(bucket.begin(), bucket.end());
+            for (size_t i = 0; i + 1 < bucket.size(); ++i) {
+                if (bucket[i].first != bucket[i + 1].first) continue;
+                /* More than two tetrahedra on a face is non-manifold, leave the rest unpaired */
+                bool paired_before = (i > 0) && (bucket[i - 1].first == bucket[i].first);
+                if (paired_before) continue;
+                mates[bucket[i].second] = (int64_t) bucket[i + 1].second;
+                mates[bucket[i + 1].second] = (int64_t) bucket[i].second;
+                ++i;
+            }
+        }
+    }, 1024);
+    return mates;
+}
+
+/* Finds the faces which belong to a single tetrahedron. Each boundary triangle
+   is wound so that its normal points out of its tetrahedron. Triangles refer to
+   the original vertex numbering; cells[i] is the tetrahedron triangle i came from. */
+template <typename T>
+void extract_boundary_faces(const T *points, const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive, size_t num_points,
+    std::vector<uint32_t> &triangles, std::vector<uint32_t> &cells)
+{
+    std::vector<int64_t> mates = match_tet_faces(indices, num_tetrahedra, points_per_primitive, num_points);
+
+    std::vector<uint64_t> offsets(num_tetrahedra + 1, 0);
+    parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t t = begin; t < end; ++t)
+            for (uint32_t f = 0; f < 4; ++f) offsets[t] += (mates[t * 4 + f] < 0);
+    });
+    uint64_t num_triangles = parallel_exclusive_scan(offsets);
+
+    triangles.resize(num_triangles * 3);
+    cells.resize(num_triangles);
+    parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t t = begin; t < end; ++t) {
+            const uint32_t *tet = &indices[t * points_per_primitive];
+            uint64_t triangle = offsets[t];
+            for (uint32_t f = 0; f < 4; ++f) {
+                if (mates[t * 4 + f] >= 0) continue;
+                uint32_t a = tet[TET_FACE_CORNERS[f][0]], b = tet[TET_FACE_CORNERS[f][1]], c = tet[TET_FACE_CORNERS[f][2]];
+
+                /* The opposite corner must lie behind the triangle */
+                if (tet_signed_volume6(&points[(size_t) a * 3], &points[(size_t) b * 3], &points[(size_t) c * 3], &points[(size_t) tet[f] * 3]) > 0.0)
+                    std::swap(b, c);
+                triangles[triangle * 3 + 0] = a;
+                triangles[triangle * 3 + 1] = b;
+                triangles[triangle * 3 + 2] = c;
+                cells[triangle] = (uint32_t) t;
+                triangle++;
+            }
+        }
+    });
+}
+
+/* Extracts the boundary surface of raw tetrahedral point/index data as a triangle
+   mesh. Only the vertices the surface uses are kept. Per-vertex scalars follow
+   their vertices, and per-cell scalars are copied from each triangle's tetrahedron. */
+template <typename T>
+void extract_boundary(const std::vector<T> &points, const std::vector<T> &scalars, const std::vector<uint32_t> &indices, uint32_t points_per_primitive, bool data_is_per_cell,
+    std::vector<T> &boundary_points, std::vector<T> &boundary_scalars, std::vector<uint32_t> &boundary_indices)
+{
+    if (points_per_primitive != 4 && points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+
+    size_t num_points = points.size() / 3;
+    std::vector<uint32_t> cells;
+    extract_boundary_faces(points.data(), indices.data(), indices.size() / points_per_primitive, points_per_primitive, num_points, boundary_indices, cells);
+
+    /* Compact the vertices the surface uses */
+    std::vector<std::atomic<uint8_t>> used(num_points);
+    parallel_for(boundary_indices.size(), [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) used[boundary_indices[i]].store(1, std::memory_order_relaxed);
+    });
+    std::vector<uint64_t> new_index(num_points + 1, 0);
+    for (size_t v = 0; v < num_points; ++v) new_index[v] = used[v].load(std::memory_order_relaxed);
+    uint64_t kept = parallel_exclusive_scan(new_index);
+
+    boundary_points = points;
+    compact_records(boundary_points, 3, new_index, kept);
+    parallel_for(boundary_indices.size(), [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) boundary_indices[i] = (uint32_t) new_index[boundary_indices[i]];
+    });
+
+    if (data_is_per_cell) {
+        boundary_scalars.resize(cells.size());
+        parallel_for(cells.size(), [&](size_t begin, size_t end, uint32_t) {
+            for (size_t i = begin; i < end; ++i) boundary_scalars[i] = scalars[cells[i]];
+        });
+    } else {
+        boundary_scalars = scalars;
+        compact_records(boundary_scalars, 1, new_index, kept);
+    }
+}
+
+/* Writes the boundary surface of a binary tetrahedral mesh as a binary triangle mesh
+   (points_per_primitive = 3), with the same precision and scalars */
+inline void write_boundary_as_binary(std::string binary_path, std::string boundary_path)
+{
+    BinaryHeader header = read_binary_header(binary_path);
+    std::vector<uint32_t> indices, boundary_indices;
+    bool data_is_per_cell;
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars, boundary_points, boundary_scalars;
+        uint32_t points_per_primitive = read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        extract_boundary(points, scalars, indices, points_per_primitive, data_is_per_cell, boundary_points, boundary_scalars, boundary_indices);
+        write_to_binary(boundary_points, boundary_scalars, boundary_indices, 3, data_is_per_cell, boundary_path);
+    } else {
+        std::vector<float> points, scalars, boundary_points, boundary_scalars;
+        uint32_t points_per_primitive = read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        extract_boundary(points, scalars, indices, points_per_primitive, data_is_per_cell, boundary_points, boundary_scalars, boundary_indices);
+        write_to_binary(boundary_points, boundary_scalars, boundary_indices, 3, data_is_per_cell, boundary_path);
+    }
+}
+
+/* Writes an ASCII face file. Triangles use the same (0 based) vertex numbering as the
+   .node file they belong to, and are written 1 based like the .ele nodes */
+inline void write_face(std::string face_path, const std::vector<uint32_t> &triangles)
+{
+    /* Create/open the file */
+    std::fstream file;
+    file.open(face_path, std::ios::out | std::ios::trunc );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to create " + face_path));
+
+    /* Write the header, without boundary markers */
+    size_t num_faces = triangles.size() / 3;
+    file << num_faces << " " << 0 << std::endl;
+    for (size_t i = 0; i < num_faces; ++i)
+        file << i << " " << triangles[i * 3 + 0] + 1 << " " << triangles[i * 3 + 1] + 1 << " " << triangles[i * 3 + 2] + 1 << std::endl;
+
+    file.close();
+}
+
+/* Writes the boundary surface of a node/ele pair as a .face file for the same .node file */
+template <typename T>
+void write_boundary_as_face(TNode<T> &node, TEle<T> &ele, std::string face_path)
+{
+    if (node.dimension != 3)
+        throw std::runtime_error( std::string("node dimension needs to be 3"));
+
+    std::vector<uint32_t> triangles, cells;
+    extract_boundary_faces(node.points.data(), ele.nodes.data(), ele.num_tetrahedra, ele.nodes_per_tetrahedron, node.num_points, triangles, cells);
+    write_face(face_path, triangles);
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Neighbours                                                      |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Number of points an index array refers to, ie its largest index plus one */
+inline size_t count_referenced_points(const uint32_t *indices, size_t num_indices)
+{
+    std::atomic<uint32_t> largest(0);
+    parallel_for(num_indices, [&](size_t begin, size_t end, uint32_t) {
+        uint32_t local = 0;
+        for (size_t i = begin; i < end; ++i) local = std::max(local, indices[i]);
+        atomic_max(largest, local);
+    });
+    return (num_indices == 0) ? 0 : (size_t) largest + 1;
+}
+
+/* Computes the face neighbours of each tetrahedron. neighbors[4 * t + i] is the
+   tetrahedron across the face opposite corner i of tetrahedron t, or -1 on the
+   boundary, following TetGen's .neigh convention. */
+inline std::vector<int32_t> compute_neighbors(const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive, size_t num_points)
+{
+    std::vector<int64_t> mates = match_tet_faces(indices, num_tetrahedra, points_per_primitive, num_points);
+    std::vector<int32_t> neighbors(mates.size());
+    parallel_for(mates.size(), [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) neighbors[i] = (mates[i] < 0) ? -1 : (int32_t) (mates[i] / 4);
+    });
+    return neighbors;
+}
+
+inline std::vector<int32_t> compute_neighbors(const std::vector<uint32_t> &indices, uint32_t points_per_primitive)
+{
+    return compute_neighbors(indices.data(), indices.size() / points_per_primitive, points_per_primitive, count_referenced_points(indices.data(), indices.size()));
+}
+
+template <typename T>
+std::vector<int32_t> compute_neighbors(TEle<T> &ele)
+{
+    return compute_neighbors(ele.nodes.data(), ele.num_tetrahedra, ele.nodes_per_tetrahedron, count_referenced_points(ele.nodes.data(), ele.nodes.size()));
+}
+
+/* Reads an ASCII neigh file. Neighbours are numbered from 1 like the .ele nodes,
+   and are returned 0 based, with -1 kept for missing neighbours */
+inline std::vector<int32_t> read_neigh(std::string neigh_path)
+{
+    throw_if_file_does_not_exist(neigh_path);
+
+    std::fstream file;
+    file.open(neigh_path, std::ios::in);
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to open " + neigh_path));
+
+    std::vector<int32_t> neighbors;
+    uint32_t num_tetrahedra = 0;
+    bool header_read = false;
+    int line_number = 0;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line_number++;
+
+        /* Clean up the line, remove comments */
+        trim(line);
+        if (line.empty()) continue;
+        if (line[0] == '#') continue;
+
+        std::istringstream iss(line);
+        int64_t n;
+        std::vector<int64_t> integers;
+        while (iss >> n) integers.push_back(n);
+
+        /* Read the header */
+        if (!header_read) {
+            if (integers.size() != 2)
+                throw std::runtime_error( std::string("Line " + std::to_string(line_number) + " : " + neigh_path + " must contain 2 integers "));
+
+            if (integers[0] <= 0)
+                throw std::runtime_error( std::string("Line " + std::to_string(line_number) + " : " + neigh_path + " number of tetrahedron must be greater than 0"));
+
+            if (integers[1] != 4)
+                throw std::runtime_error( std::string("Line " + std::to_string(line_number) + " : " + neigh_path + " number of neighbors must be 4"));
+
+            num_tetrahedra = (uint32_t) integers[0];
+            neighbors.reserve((size_t) num_tetrahedra * 4);
+            header_read = true;
+        }
+        /* Read neighbors */
+        else {
+            if (integers.size() != 5)
+                throw std::runtime_error( std::string("Line " + std::to_string(line_number) + " : " + neigh_path + " must contain 5 numbers "));
+
+            for (int i = 1; i < 5; ++i)
+                neighbors.push_back((integers[i] <= 0) ? -1 : (int32_t) (integers[i] - 1));
+        }
+    }
+    file.close();
+
+    if (neighbors.size() != (size_t) num_tetrahedra * 4)
+        throw std::runtime_error( std::string(neigh_path + " must contain " + std::to_string(num_tetrahedra) + " tetrahedra"));
+
+    return neighbors;
+}
+
+/* Writes an ASCII neigh file */
+inline void write_neigh(std::string neigh_path, const std::vector<int32_t> &neighbors)
+{
+    /* Create/open the file */
+    std::fstream file;
+    file.open(neigh_path, std::ios::out | std::ios::trunc );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to create " + neigh_path));
+
+    /* Write the header */
+    size_t num_tetrahedra = neighbors.size() / 4;
+    file << num_tetrahedra << " " << 4 << std::endl;
+    for (size_t i = 0; i < num_tetrahedra; ++i)
+    {
+        file << i << " ";
+        for (size_t j = 0; j < 4; ++j) {
+            int32_t neighbor = neighbors[i * 4 + j];
+            file << ((neighbor < 0) ? -1 : (int64_t) neighbor + 1) << " ";
+        }
+        file << std::endl;
+    }
+
+    file.close();
+}
+
+/* Stores neighbours as an optional section of a binary file */
+inline void write_neighbors_to_binary(std::string binary_path, const std::vector<int32_t> &neighbors)
+{
+    write_binary_section(binary_path, SECTION_NEIGHBORS, neighbors);
+}
+
+/* Reads the neighbours section of a binary file. Returns false if there is none */
+inline bool read_neighbors_from_binary(std::string binary_path, std::vector<int32_t> &neighbors)
+{
+    return read_binary_section(binary_path, SECTION_NEIGHBORS, neighbors);
+}
+
+/* Computes the neighbours of a binary tetrahedral mesh and stores them in the file */
+inline void add_neighbors_to_binary(std::string binary_path)
+{
+    BinaryHeader header = read_binary_header(binary_path);
+    if (header.points_per_primitive != 4 && header.points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+
+    std::vector<uint32_t> indices;
+    read_binary_indices(binary_path, indices);
+    std::vector<int32_t> neighbors = compute_neighbors(indices.data(), indices.size() / header.points_per_primitive, header.points_per_primitive, header.num_points);
+    write_neighbors_to_binary(binary_path, neighbors);
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Edges                                                           |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Edge e of a tetrahedron joins these two corners. This is also the order of the
+   six edge nodes of a quadratic (10 node) tetrahedron, as used by VTK and TetGen */
+const uint32_t TET_EDGE_CORNERS[6][2] = { { 0, 1 }, { 1, 2 }, { 2, 0 }, { 0, 3 }, { 1, 3 }, { 2, 3 } };
+
+/* Shape functions of a quadratic tetrahedron at barycentric coordinates l. Corner c
+   has l_c (2 l_c - 1), and the node on edge e has 4 l_a l_b for the corners a, b of e. */
+inline void quadratic_tet_shape_functions(const double l[4], double weights[10])
+{
+    for (int c = 0; c < 4; ++c) weights[c] = l[c] * (2.0 * l[c] - 1.0);
+    for (int e = 0; e < 6; ++e) weights[4 + e] = 4.0 * l[TET_EDGE_CORNERS[e][0]] * l[TET_EDGE_CORNERS[e][1]];
+}
+
+/* Finds the unique edges of a set of tetrahedra. edges holds two vertices per edge,
+   smallest first, sorted by (first, second) vertex. tet_edges[6 * t + e] is the
+   edge joining the corners TET_EDGE_CORNERS[e] of tetrahedron t. Edge slots are
+   bucketed by their smallest vertex with a parallel counting sort, deduplicated
+   within each bucket, and numbered with a prefix sum over the buckets. */
+inline void extract_edges(const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive, size_t num_points,
+    std::vector<uint32_t> &edges, std::vector<uint32_t> &tet_edges)
+{
+    size_t num_slots = num_tetrahedra * 6;
+    auto edge_vertices = [&](uint64_t slot, uint32_t &a, uint32_t &b) {
+        const uint32_t *tet = &indices[(slot / 6) * points_per_primitive];
+        a = tet[TET_EDGE_CORNERS[slot % 6][0]];
+        b = tet[TET_EDGE_CORNERS[slot % 6][1]];
+        if (a > b) std::swap(a, b);
+    };
+
+    /* Bucket edge slots by their smallest vertex */
+    std::vector<std::atomic<uint32_t>> counts(num_points);
+    parallel_for(num_slots, [&](size_t begin, size_t end, uint32_t) {
+        uint32_t a, b;
+        for (size_t slot = begin; slot < end; ++slot) {
+            edge_vertices(slot, a, b);
+            counts[a].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    std::vector<uint64_t> offsets(num_points + 1, 0);
+    for (size_t v = 0; v < num_points; ++v) {
+        offsets[v] = counts[v].load(std::memory_order_relaxed);
+        counts[v].store(0, std::memory_order_relaxed);
+    }
+    offsets[num_points] = parallel_exclusive_scan(offsets);
+
+    std::vector<uint64_t> buckets(num_slots);
+    parallel_for(num_slots, [&](size_t begin, size_t end, uint32_t) {
+        uint32_t a, b;
+        for (size_t slot = begin; slot < end; ++slot) {
+            edge_vertices(slot, a, b);
+            buckets[offsets[a] + counts[a].fetch_add(1, std::memory_order_relaxed)] = slot;
+        }
+    });
+
+    /* Sort each bucket by the other vertex, and count its unique edges */
+    std::vector<uint64_t> first_edge(num_points + 1, 0);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t v = begin; v < end; ++v) {
+            auto other = [&](uint64_t slot) { uint32_t a, b; edge_vertices(slot, a, b); return b; };
+            std::sort(buckets.begin() + offsets[v], buckets.begin() + offsets[v + 1], [&](uint64_t x, uint64_t y) {
+                uint32_t ox = other(x), oy = other(y);
+                return (ox != oy) ? ox < oy : x < y;
+            });
+            uint64_t unique = 0;
+            for (uint64_t i = offsets[v]; i < offsets[v + 1]; ++i)
+                unique += (i == offsets[v] || other(buckets[i]) != other(buckets[i - 1]));
+            first_edge[v] = unique;
+        }
+    }, 1024);
+    uint64_t num_edges = parallel_exclusive_scan(first_edge);
+
+    /* Number the edges and point every slot at its edge */
+    edges.resize(num_edges * 2);
+    tet_edges.resize(num_slots);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t v = begin; v < end; ++v) {
+            uint64_t edge = first_edge[v];
+            uint32_t previous = 0;
+            for (uint64_t i = offsets[v]; i < offsets[v + 1]; ++i) {
+                uint32_t a, b;
+                edge_vertices(buckets[i], a, b);
+                if (i != offsets[v] && b != previous) edge++;
+                edges[edge * 2 + 0] = a;
+                edges[edge * 2 + 1] = b;
+                tet_edges[buckets[i]] = (uint32_t) edge;
+                previous = b;
+            }
+        }
+    }, 1024);
+}
+
+inline void extract_edges(const std::vector<uint32_t> &indices, uint32_t points_per_primitive, std::vector<uint32_t> &edges, std::vector<uint32_t> &tet_edges)
+{
+    extract_edges(indices.data(), indices.size() / points_per_primitive, points_per_primitive, count_referenced_points(indices.data(), indices.size()), edges, tet_edges);
+}
+
+template <typename T>
+void extract_edges(TNode<T> &node, TEle<T> &ele, std::vector<uint32_t> &edges, std::vector<uint32_t> &tet_edges)
+{
+    extract_edges(ele.nodes.data(), ele.num_tetrahedra, ele.nodes_per_tetrahedron, node.num_points, edges, tet_edges);
+}
+
+/* Writes an ASCII edge file, with vertices numbered from 1 like the .ele nodes */
+inline void write_edge(std::string edge_path, const std::vector<uint32_t> &edges)
+{
+    /* Create/open the file */
+    std::fstream file;
+    file.open(edge_path, std::ios::out | std::ios::trunc );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to create " + edge_path));
+
+    /* Write the header, without boundary markers */
+    size_t num_edges = edges.size() / 2;
+    file << num_edges << " " << 0 << std::endl;
+    for (size_t i = 0; i < num_edges; ++i)
+        file << i << " " << edges[i * 2 + 0] + 1 << " " << edges[i * 2 + 1] + 1 << std::endl;
+
+    file.close();
+}
+
+const uint32_t SECTION_EDGES = binary_section_tag('E', 'D', 'G', 'E');
+const uint32_t SECTION_TET_EDGES = binary_section_tag('T', 'E', 'D', 'G');
+
+/* Stores edges and the tetrahedron to edge map as optional sections of a binary file */
+inline void write_edges_to_binary(std::string binary_path, const std::vector<uint32_t> &edges, const std::vector<uint32_t> &tet_edges)
+{
+    write_binary_section(binary_path, SECTION_EDGES, edges);
+    write_binary_section(binary_path, SECTION_TET_EDGES, tet_edges);
+}
+
+/* Reads the edge sections of a binary file. Returns false if there are none */
+inline bool read_edges_from_binary(std::string binary_path, std::vector<uint32_t> &edges, std::vector<uint32_t> &tet_edges)
+{
+    return read_binary_section(binary_path, SECTION_EDGES, edges) && read_binary_section(binary_path, SECTION_TET_EDGES, tet_edges);
+}
+
+/* Extracts the edges of a binary tetrahedral mesh and stores them in the file */
+inline void add_edges_to_binary(std::string binary_path)
+{
+    std::vector<uint32_t> indices, edges, tet_edges;
+    BinaryHeader header = read_binary_indices(binary_path, indices);
+    if (header.points_per_primitive != 4 && header.points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+
+    extract_edges(indices.data(), indices.size() / header.points_per_primitive, header.points_per_primitive, header.num_points, edges, tet_edges);
+    write_edges_to_binary(binary_path, edges, tet_edges);
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Compact topology                                                |
+// └──────────────────────────────────────────────────────────────────┘
+
+const uint32_t SECTION_COMPACT_TOPOLOGY = binary_section_tag('S', 'O', 'T', 'T');
+
+/* Compact tetrahedral topology in the spirit of the Sorted Opposite Table (SOT) of
+   Gurung and Rossignac. Instead of storing four vertices and four neighbours per
+   tetrahedron (32 bytes), it stores only the opposite corner of each of the four
+   corners, plus about one byte per tetrahedron and four bytes per vertex.
+
+   Corner c = 4 * t + i is corner i of tetrahedron t. opposite(c) is the corner of
+   the neighbouring tetrahedron facing corner c across the face opposite c.
+   Tetrahedra are sorted by their smallest ("leading") vertex, which is stored in
+   corner 0, with the other three corners in increasing vertex order. Because the
+   corners of both tetrahedra on a face are sorted, the face's vertices line up
+   between them without being stored.
+
+   The vertex of corner 0 is found from the per-vertex offsets of the sorted
+   tetrahedra. Any other corner's vertex is found by walking around its vertex
+   star (through opposite()) until reaching a tetrahedron that vertex leads. That
+   usually takes a few steps, but can visit the whole star, so vertex() and face()
+   cost up to the size of the star. Vertices which lead no tetrahedron in some part
+   of their star get an explicit anchor corner in a small hash table instead.
+
+   The byte per tetrahedron holds the permutation from sorted to original corners,
+   so queries taking a corner i (neighbor, vertex, face, tet_vertices) use the
+   corner order the tetrahedra were built with, as compute_neighbors does. Only
+   opposite() works on corners in sorted order.
+
+   Star walks mark the tetrahedra they reach in a StarScratch. Queries without one
+   use a scratch per calling thread.
+
+   Limited to fewer than 2^30 tetrahedra, so that corners fit in 32 bits. */
+
+/* The tetrahedra reached by a set of star walks, in an open addressing set that
+   grows with the largest star walked rather than with the mesh. Slots hold the
+   walk's stamp above the tetrahedron, so a slot with an older stamp is empty and
+   starting a new set of walks clears nothing. */
+struct StarScratch {
+    std::vector<uint64_t> visited;
+    std::vector<uint64_t> stack;
+    uint64_t count = 0;
+    uint32_t stamp = 0;
+
+    /* Forgets the tetrahedra visited so far */
+    void clear()
+    {
+        if (visited.empty()) visited.assign(64, 0);
+        if (++stamp == 0) {
+            std::fill(visited.begin(), visited.end(), 0);
+            stamp = 1;
+        }
+        count = 0;
+    }
+
+    bool contains(uint32_t tet) const
+    {
+        uint64_t mask = visited.size() - 1, key = ((uint64_t) stamp << 32) | tet;
+        for (uint64_t slot = hash(tet) & mask; (visited[slot] >> 32) == stamp; slot = (slot + 1) & mask)
+            if (visited[slot] == key) return true;
+        return false;
+    }
+
+    /* Adds a tetrahedron, returning false if it was already there */
+    bool insert(uint32_t tet)
+    {
+        if ((count + 1) * 2 > visited.size()) grow();
+        uint64_t mask = visited.size() - 1, key = ((uint64_t) stamp << 32) | tet;
+        uint64_t slot = hash(tet) & mask;
+        for (; (visited[slot] >> 32) == stamp; slot = (slot + 1) & mask)
+            if (visited[slot] == key) return false;
+        visited[slot] = key;
+        count++;
+        return true;
+    }
+
+    /* Bytes held by the scratch */
+    uint64_t memory_bytes() const { return (visited.capacity() + stack.capacity()) * sizeof(uint64_t); }
+
+private:
+    static uint64_t hash(uint32_t tet)
+    {
+        uint64_t h = tet * 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 32);
+    }
+
+    void grow()
+    {
+        std::vector<uint64_t> old(visited.size() * 2, 0);
+        old.swap(visited);
+        count = 0;
+        for (uint64_t entry : old)
+            if ((entry >> 32) == stamp) insert((uint32_t) entry);
+    }
+};
+
+class CompactTetTopology {
+public:
+    static constexpr uint32_t BOUNDARY = 0xffffffffu;
+
+    uint64_t num_tetrahedra() const { return num_tetrahedra_; }
+    uint64_t num_points() const { return num_points_; }
+
+    /* Bytes used by the whole structure */
+    uint64_t memory_bytes() const { return size_; }
+
+    /* The corner facing corner c across the face opposite c, or BOUNDARY. Both
+       corners are in sorted order: corner 4 * t + k holds the k-th smallest vertex of t. */
+    uint32_t opposite(uint64_t corner) const { return opposite_[corner]; }
+
+    /* Position among the built corners of the k-th smallest vertex of tetrahedron t */
+    uint32_t built_corner(uint64_t t, uint32_t k) const
+    {
+        uint32_t info = info_[t];
+        if (k < 3) return (info >> (2 * k)) & 3;
+        return 6 - (info & 3) - ((info >> 2) & 3) - ((info >> 4) & 3);
+    }
+
+    /* Sorted position of corner i of tetrahedron t, the inverse of built_corner */
+    uint32_t sorted_corner(uint64_t t, uint32_t i) const
+    {
+        uint32_t k = 0;
+        while (k < 3 && built_corner(t, k) != i) k++;
+        return k;
+    }
+
+    /* The tetrahedron across the face opposite corner i of tetrahedron t, or -1 */
+    int64_t neighbor(uint64_t t, uint32_t i) const
+    {
+        uint32_t o = opposite_[t * 4 + sorted_corner(t, i)];
+        return (o == BOUNDARY) ? -1 : (int64_t) (o >> 2);
+    }
+
+    /* The smallest vertex of tetrahedron t, which sits in its corner 0 */
+    uint32_t leader(uint64_t t) const
+    {
+        uint32_t v = block_leaders_[t / LEADER_BLOCK];
+        while (leader_offsets_[v + 1] <= t) v++;
+        return v;
+    }
+
+    /* The vertex of corner i of tetrahedron t */
+    uint32_t vertex(uint64_t t, uint32_t i, StarScratch &scratch) const
+    {
+        return sorted_vertex(t, sorted_corner(t, i), scratch);
+    }
+
+    uint32_t vertex(uint64_t t, uint32_t i) const { return vertex(t, i, thread_scratch()); }
+
+    /* The four vertices of tetrahedron t, in the order they were built with */
+    void tet_vertices(uint64_t t, uint32_t vertices[4], StarScratch &scratch) const
+    {
+        for (uint32_t k = 0; k < 4; ++k) vertices[built_corner(t, k)] = sorted_vertex(t, k, scratch);
+    }
+
+    void tet_vertices(uint64_t t, uint32_t vertices[4]) const { tet_vertices(t, vertices, thread_scratch()); }
+
+    /* The vertices of the face opposite corner i of tetrahedron t, in increasing order */
+    void face(uint64_t t, uint32_t i, uint32_t vertices[3], StarScratch &scratch) const
+    {
+        uint32_t skipped = sorted_corner(t, i), count = 0;
+        for (uint32_t k = 0; k < 4; ++k)
+            if (k != skipped) vertices[count++] = sorted_vertex(t, k, scratch);
+    }
+
+    void face(uint64_t t, uint32_t i, uint32_t vertices[3]) const { face(t, i, vertices, thread_scratch()); }
+
+    /* The tetrahedra around vertex v, in no particular order */
+    void vertex_star(uint32_t v, std::vector<uint32_t> &tets, StarScratch &scratch) const
+    {
+        tets.clear();
+        visit_vertex_star(v, scratch, [&](uint64_t tet, uint32_t) { tets.push_back((uint32_t) tet); });
+    }
+
+    void vertex_star(uint32_t v, std::vector<uint32_t> &tets) const { vertex_star(v, tets, thread_scratch()); }
+
+    /* Rebuilds the connectivity, four vertices per tetrahedron in the order they were built with */
+    std::vector<uint32_t> to_indices() const
+    {
+        /* Every corner is in the star of its own vertex, so walking each star once
+           from the vertex's offsets and anchors fills every corner exactly once */
+        std::vector<uint32_t> indices(num_tetrahedra_ * 4);
+        std::vector<StarScratch> scratches(parallel_for_workers(num_points_, 1024));
+        parallel_for(num_points_, [&](size_t begin, size_t end, uint32_t worker) {
+            for (size_t v = begin; v < end; ++v)
+                visit_vertex_star((uint32_t) v, scratches[worker], [&](uint64_t tet, uint32_t k) { indices[tet * 4 + k] = (uint32_t) v; });
+        }, 1024);
+
+        /* Put the corners back in the order they were built with */
+        parallel_for(num_tetrahedra_, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t t = begin; t < end; ++t) {
+                uint32_t sorted[4];
+                std::copy(&indices[t * 4], &indices[t * 4] + 4, sorted);
+                for (uint32_t k = 0; k < 4; ++k) indices[t * 4 + built_corner(t, k)] = sorted[k];
+            }
+        });
+        return indices;
+    }
+
+    /* Builds the structure. tet_order receives the new order of the tetrahedra,
+       where tet_order[new index] = old index. Only the four corners of each
+       primitive are used. */
+    static CompactTetTopology build(const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive, size_t num_points, std::vector<uint32_t> &tet_order)
+    {
+        if (num_tetrahedra >= (1u << 30))
+            throw std::runtime_error( std::string("compact topology supports fewer than 2^30 tetrahedra"));
+
+        /* Sort tetrahedra by their smallest vertex */
+        std::vector<uint64_t> keys(num_tetrahedra);
+        tet_order.resize(num_tetrahedra);
+        parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t t = begin; t < end; ++t) {
+                const uint32_t *tet = &indices[t * points_per_primitive];
+                keys[t] = std::min(std::min(tet[0], tet[1]), std::min(tet[2], tet[3]));
+                tet_order[t] = (uint32_t) t;
+            }
+        });
+        parallel_radix_sort(keys, tet_order, 32);
+
+        /* Sort the corners of each tetrahedron, remembering where each came from
+           (two bits each for the first three, the last is what remains) */
+        std::vector<uint32_t> sorted(num_tetrahedra * 4);
+        std::vector<uint8_t> info(num_tetrahedra);
+        parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t t = begin; t < end; ++t) {
+                uint32_t *corners = &sorted[t * 4];
+                std::copy(&indices[(size_t) tet_order[t] * points_per_primitive], &indices[(size_t) tet_order[t] * points_per_primitive] + 4, corners);
+                uint32_t built[4] = { 0, 1, 2, 3 };
+                for (int a = 0; a < 3; ++a)
+                    for (int b = 0; b < 3 - a; ++b)
+                        if (corners[b] > corners[b + 1]) {
+                            std::swap(corners[b], corners[b + 1]);
+                            std::swap(built[b], built[b + 1]);
+                        }
+                info[t] = (uint8_t) (built[0] | (built[1] << 2) | (built[2] << 4));
+            }
+        });
+
+        /* Opposite corners come straight from matching faces */
+        std::vector<int64_t> mates = match_tet_faces(sorted.data(), num_tetrahedra, 4, num_points);
+
+        /* Find the parts of vertex stars that no tetrahedron is led from */
+        CSRGraph incidence = build_vertex_to_primitive(sorted.data(), num_tetrahedra, 4, num_points);
+        uint32_t workers = parallel_for_workers(num_points, 1024);
+        std::vector<std::vector<uint32_t>> worker_anchors(workers);
+        parallel_for(num_points, [&](size_t begin, size_t end, uint32_t worker) {
+            std::vector<uint32_t> parent;
+            for (size_t v = begin; v < end; ++v) {
+                const uint32_t *star = &incidence.neighbors[incidence.offsets[v]];
+                size_t star_size = incidence.offsets[v + 1] - incidence.offsets[v];
+                auto find = [&](uint32_t x) { while (parent[x] != x) x = parent[x] = parent[parent[x]]; return x; };
+                auto local_corner = [&](uint32_t t) { uint32_t i = 0; while (sorted[(size_t) t * 4 + i] != v) i++; return i; };
+
+                parent.resize(star_size);
+                for (size_t a = 0; a < star_size; ++a) parent[a] = (uint32_t) a;
+                for (size_t a = 0; a < star_size; ++a) {
+                    uint32_t i = local_corner(star[a]);
+                    for (uint32_t j = 0; j < 4; ++j) {
+                        if (j == i || mates[(size_t) star[a] * 4 + j] < 0) continue;
+                        uint32_t across = (uint32_t) (mates[(size_t) star[a] * 4 + j] / 4);
+                        size_t b = std::lower_bound(star, star + star_size, across) - star;
+                        parent[find((uint32_t) a)] = find((uint32_t) b);
+                    }
+                }
+
+                /* A component is covered if v leads one of its tetrahedra */
+                std::vector<uint8_t> covered(star_size, 0), seen(star_size, 0);
+                for (size_t a = 0; a < star_size; ++a)
+                    if (sorted[(size_t) star[a] * 4] == v) covered[find((uint32_t) a)] = 1;
+                for (size_t a = 0; a < star_size; ++a) {
+                    uint32_t root = find((uint32_t) a);
+                    if (covered[root] || seen[root]) continue;
+                    seen[root] = 1;
+                    worker_anchors[worker].push_back((uint32_t) v);
+                    worker_anchors[worker].push_back(star[a] * 4 + local_corner(star[a]));
+                }
+            }
+        }, 1024);
+        std::vector<uint32_t> anchors;
+        for (auto &list : worker_anchors) anchors.insert(anchors.end(), list.begin(), list.end());
+        uint64_t num_anchors = anchors.size() / 2;
+        uint64_t table_size = 16;
+        while (table_size < 2 * num_anchors) table_size *= 2;
+
+        /* Lay out the serialized structure */
+        uint64_t num_blocks = (num_tetrahedra + LEADER_BLOCK - 1) / LEADER_BLOCK;
+        Layout layout(num_tetrahedra, num_points, num_anchors, table_size, num_blocks);
+        CompactTetTopology topology;
+        topology.storage_ = std::make_shared<std::vector<uint64_t>>((layout.size + 7) / 8, 0);
+        char *data = (char*) topology.storage_->data();
+        uint64_t counts[5] = { num_tetrahedra, num_points, num_anchors, table_size, num_blocks };
+        std::memcpy(data, counts, sizeof(counts));
+
+        uint32_t *opposite = (uint32_t*) (data + layout.opposite);
+        parallel_for(mates.size(), [&](size_t begin, size_t end, uint32_t) {
+            for (size_t c = begin; c < end; ++c) opposite[c] = (mates[c] < 0) ? BOUNDARY : (uint32_t) mates[c];
+        });
+        std::copy(info.begin(), info.end(), (uint8_t*) (data + layout.info));
+
+        uint32_t *leader_offsets = (uint32_t*) (data + layout.leader_offsets);
+        std::vector<uint64_t> leads(num_points + 1, 0);
+        for (size_t t = 0; t < num_tetrahedra; ++t) leads[sorted[t * 4]]++;
+        parallel_exclusive_scan(leads);
+        for (size_t v = 0; v <= num_points; ++v) leader_offsets[v] = (uint32_t) leads[v];
+
+        uint32_t *block_leaders = (uint32_t*) (data + layout.block_leaders);
+        for (uint64_t b = 0; b < num_blocks; ++b) block_leaders[b] = sorted[b * LEADER_BLOCK * 4];
+
+        std::copy(anchors.begin(), anchors.end(), (uint32_t*) (data + layout.anchors));
+        uint32_t *table = (uint32_t*) (data + layout.table);
+        std::fill(table, table + 2 * table_size, BOUNDARY);
+        for (uint64_t a = 0; a < num_anchors; ++a) {
+            uint64_t slot = hash_corner(anchors[a * 2 + 1]) & (table_size - 1);
+            while (table[slot * 2] != BOUNDARY) slot = (slot + 1) & (table_size - 1);
+            table[slot * 2] = anchors[a * 2 + 1];
+            table[slot * 2 + 1] = anchors[a * 2];
+        }
+
+        topology.attach(data, layout.size);
+        return topology;
+    }
+
+    /* The serialized structure, as stored in a binary section */
+    const char *data() const { return data_; }
+
+    /* Uses a serialized structure in place. owner keeps the memory alive. */
+    static CompactTetTopology from_data(const char *data, uint64_t size, std::shared_ptr<MappedFile> owner = nullptr)
+    {
+        CompactTetTopology topology;
+        topology.mapping_ = owner;
+        topology.attach(data, size);
+        return topology;
+    }
+
+private:
+    static constexpr uint64_t LEADER_BLOCK = 64;
+
+    /* Byte offsets of each array, each aligned to 8 bytes */
+    struct Layout {
+        uint64_t opposite, info, leader_offsets, block_leaders, anchors, table, size;
+        Layout(uint64_t num_tetrahedra, uint64_t num_points, uint64_t num_anchors, uint64_t table_size, uint64_t num_blocks)
+        {
+            auto align = [](uint64_t x) { return (x + 7) / 8 * 8; };
+            opposite = 5 * sizeof(uint64_t);
+            info = align(opposite + num_tetrahedra * 4 * sizeof(uint32_t));
+            leader_offsets = align(info + num_tetrahedra);
+            block_leaders = align(leader_offsets + (num_points + 1) * sizeof(uint32_t));
+            anchors = align(block_leaders + num_blocks * sizeof(uint32_t));
+            table = align(anchors + num_anchors * 2 * sizeof(uint32_t));
+            size = align(table + table_size * 2 * sizeof(uint32_t));
+        }
+    };
+
+    static uint64_t hash_corner(uint32_t corner)
+    {
+        uint64_t h = corner * 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 32);
+    }
+
+    void attach(const char *data, uint64_t size)
+    {
+        uint64_t counts[5];
+        if (size < sizeof(counts))
+            throw std::runtime_error( std::string("compact topology data is truncated"));
+        std::memcpy(counts, data, sizeof(counts));
+        num_tetrahedra_ = counts[0];
+        num_points_ = counts[1];
+        num_anchors_ = counts[2];
+        table_size_ = counts[3];
+        Layout layout(counts[0], counts[1], counts[2], counts[3], counts[4]);
+        if (size < layout.size)
+            throw std::runtime_error( std::string("compact topology data is truncated"));
+
+        data_ = data;
+        size_ = layout.size;
+        opposite_ = (const uint32_t*) (data + layout.opposite);
+        info_ = (const uint8_t*) (data + layout.info);
+        leader_offsets_ = (const uint32_t*) (data + layout.leader_offsets);
+        block_leaders_ = (const uint32_t*) (data + layout.block_leaders);
+        anchors_ = (const uint32_t*) (data + layout.anchors);
+        table_ = (const uint32_t*) (data + layout.table);
+    }
+
+    uint32_t find_anchor(uint32_t corner) const
+    {
+        for (uint64_t slot = hash_corner(corner) & (table_size_ - 1); table_[slot * 2] != BOUNDARY; slot = (slot + 1) & (table_size_ - 1))
+            if (table_[slot * 2] == corner) return table_[slot * 2 + 1];
+        return BOUNDARY;
+    }
+
+    /* Corners are sorted by vertex, so a face's corners keep the same relative
+       order in both tetrahedra. Moving from corner i of t across the face opposite
+       corner j (j != i) lands on the corner of the neighbour in the same position. */
+    static uint32_t corner_across(uint32_t i, uint32_t j, uint32_t j_across)
+    {
+        uint32_t position = i - (j < i ? 1 : 0);
+        return position + (j_across <= position ? 1 : 0);
+    }
+
+    /* The vertex of the k-th smallest corner of tetrahedron t */
+    uint32_t sorted_vertex(uint64_t t, uint32_t k, StarScratch &scratch) const
+    {
+        if (k == 0) return leader(t);
+
+        /* Walk the star of the vertex until it is found in corner 0 or at an anchor */
+        uint32_t found = BOUNDARY;
+        begin_walks(scratch);
+        walk_star(t, k, scratch, [&](uint64_t tet, uint32_t corner) {
+            if (corner == 0) found = leader(tet);
+            else found = find_anchor(tet * 4 + corner);
+            return found != BOUNDARY;
+        });
+        return found;
+    }
+
+    static StarScratch &thread_scratch()
+    {
+        thread_local StarScratch scratch;
+        return scratch;
+    }
+
+    /* Starts a new set of walks: tetrahedra visited before count as unvisited */
+    void begin_walks(StarScratch &scratch) const { scratch.clear(); }
+
+    /* Calls visit(tet, corner) for every tetrahedron around vertex v, with the
+       sorted corner v sits in */
+    template <typename F>
+    void visit_vertex_star(uint32_t v, StarScratch &scratch, F visit) const
+    {
+        begin_walks(scratch);
+        auto add_component = [&](uint64_t t, uint32_t corner) {
+            if (scratch.contains((uint32_t) t)) return;
+            walk_star(t, corner, scratch, [&](uint64_t tet, uint32_t k) { visit(tet, k); return false; });
+        };
+        for (uint64_t t = leader_offsets_[v]; t < leader_offsets_[v + 1]; ++t) add_component(t, 0);
+
+        /* Anchors are (vertex, corner) pairs sorted by vertex */
+        uint64_t first = 0, last = num_anchors_;
+        while (first < last) {
+            uint64_t middle = (first + last) / 2;
+            if (anchors_[middle * 2] < v) first = middle + 1;
+            else last = middle;
+        }
+        for (uint64_t a = first; a < num_anchors_ && anchors_[a * 2] == v; ++a)
+            add_component(anchors_[a * 2 + 1] / 4, anchors_[a * 2 + 1] % 4);
+    }
+
+    /* Visits the tetrahedra around the vertex of sorted corner k of t, calling
+       visit(tet, corner) until it returns true. Skips and marks tetrahedra
+       visited since the last begin_walks. */
+    template <typename F>
+    void walk_star(uint64_t t, uint32_t k, StarScratch &scratch, F visit) const
+    {
+        std::vector<uint64_t> &stack = scratch.stack;
+        stack.clear();
+        stack.push_back(t * 4 + k);
+        scratch.insert((uint32_t) t);
+        while (!stack.empty()) {
+            uint64_t corner = stack.back();
+            stack.pop_back();
+            uint64_t tet = corner / 4;
+            uint32_t local = corner % 4;
+            if (visit(tet, local)) return;
+            for (uint32_t j = 0; j < 4; ++j) {
+                if (j == local) continue;
+                uint32_t o = opposite_[tet * 4 + j];
+                if (o == BOUNDARY) continue;
+                uint64_t across = o >> 2;
+                if (!scratch.insert((uint32_t) across)) continue;
+                stack.push_back(across * 4 + corner_across(local, j, o & 3));
+            }
+        }
+    }
+
+    uint64_t num_tetrahedra_ = 0, num_points_ = 0, num_anchors_ = 0, table_size_ = 0;
+    const char *data_ = nullptr;
+    uint64_t size_ = 0;
+    const uint32_t *opposite_ = nullptr;
+    const uint8_t *info_ = nullptr;
+    const uint32_t *leader_offsets_ = nullptr;
+    const uint32_t *block_leaders_ = nullptr;
+    const uint32_t *anchors_ = nullptr;
+    const uint32_t *table_ = nullptr;
+    std::shared_ptr<std::vector<uint64_t>> storage_;
+    std::shared_ptr<MappedFile> mapping_;
+};
+
+/* Builds the compact topology of a binary tetrahedral mesh and stores it in the file.
+   The tetrahedra (and per-cell scalars) are rewritten in the structure's sorted
+   order, so that tetrahedron t means the same thing in both. Since other sections
+   refer to the old order, files carrying any (besides an older compact topology)
+   are refused; add those sections again afterwards. */
+inline void add_compact_topology_to_binary(std::string binary_path)
+{
+    BinaryHeader header = read_binary_header(binary_path);
+    if (header.points_per_primitive != 4 && header.points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+    for (const BinarySection &section : list_binary_sections(binary_path))
+        if (section.tag != SECTION_COMPACT_TOPOLOGY && section.tag != SECTION_STATISTICS)
+            throw std::runtime_error( std::string(binary_path + " has sections which depend on the order of its tetrahedra, add the compact topology first"));
+
+    auto rewrite = [&](auto &points, auto &scalars) {
+        std::vector<uint32_t> indices, tet_order;
+        bool data_is_per_cell;
+        uint32_t points_per_primitive = read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        CompactTetTopology topology = CompactTetTopology::build(indices.data(), indices.size() / points_per_primitive, points_per_primitive, points.size() / 3, tet_order);
+        permute_records(indices, points_per_primitive, tet_order);
+        if (data_is_per_cell) permute_records(scalars, 1, tet_order);
+        write_to_binary(points, scalars, indices, points_per_primitive, data_is_per_cell, binary_path);
+        write_binary_section(binary_path, SECTION_COMPACT_TOPOLOGY, topology.data(), topology.memory_bytes());
+    };
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        rewrite(points, scalars);
+    } else {
+        std::vector<float> points, scalars;
+        rewrite(points, scalars);
+    }
+}
+
+/* Maps a binary file and uses its compact topology in place, without reading it */
+inline CompactTetTopology open_compact_topology(std::string binary_path)
+{
+    MappedBinary binary(binary_path);
+    uint64_t size;
+    const char *data = binary.section(SECTION_COMPACT_TOPOLOGY, size);
+    if (!data)
+        throw std::runtime_error( std::string(binary_path + " has no compact topology, see add_compact_topology_to_binary"));
+    return CompactTetTopology::from_data(data, size, binary.file);
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Bounding volume hierarchy                                       |
+// └──────────────────────────────────────────────────────────────────┘
+
+const uint32_t SECTION_BVH = binary_section_tag('B', 'V', 'H', ' ');
+
+/* 32 byte BVH node, stored in depth first order. Inner nodes have count == 0,
+   their left child directly follows them and offset is their right child.
+   Leaves hold count primitives, starting at primitives[offset]. */
+struct BVHNode {
+    float lower[3];
+    uint32_t offset;
+    float upper[3];
+    uint32_t count;
+};
+
+struct BVH {
+    std::vector<BVHNode> nodes;
+    std::vector<uint32_t> primitives;
+};
+
+/* Leaves hold at most this many primitives, so that they can be tested together */
+const uint32_t BVH_MAX_LEAF_SIZE = 8;
+const uint32_t BVH_NUM_BINS = 16;
+
+/* Leaves are at most this deep (the root is at depth 0), which bounds the
+   traversal stack. Below BVH_MEDIAN_DEPTH the builder stops using SAH and splits
+   ranges in half, so that even 2^32 primitives stay within the limit. */
+const uint32_t BVH_MAX_DEPTH = 64;
+const uint32_t BVH_MEDIAN_DEPTH = BVH_MAX_DEPTH - 32;
+
+/* Ranges of at least this many primitives are binned in parallel, and split
+   into subtrees which are built on their own threads */
+const size_t BVH_PARALLEL_THRESHOLD = 1 << 16;
+
+struct BVHBounds {
+    float lower[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    float upper[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+
+    void grow(const BVHBounds &b)
+    {
+        for (int a = 0; a < 3; ++a) {
+            lower[a] = std::min(lower[a], b.lower[a]);
+            upper[a] = std::max(upper[a], b.upper[a]);
+        }
+    }
+
+    void grow(const float p[3])
+    {
+        for (int a = 0; a < 3; ++a) {
+            lower[a] = std::min(lower[a], p[a]);
+            upper[a] = std::max(upper[a], p[a]);
+        }
+    }
+
+    float half_area() const
+    {
+        if (lower[0] > upper[0]) return 0.0f;
+        float d[3] = { upper[0] - lower[0], upper[1] - lower[1], upper[2] - lower[2] };
+        return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+    }
+};
+
+/* Builds a BVH over primitive bounds with binned SAH */
+class BVHBuilder {
+public:
+    BVHBuilder(const std::vector<BVHBounds> &boxes) : boxes_(boxes)
+    {
+        centroids_.resize(boxes.size() * 3);
+        parallel_for(boxes.size(), [&](size_t begin, size_t end, uint32_t) {
+            for (size_t i = begin; i < end; ++i)
+                for (int a = 0; a < 3; ++a) centroids_[i * 3 + a] = 0.5f * (boxes[i].lower[a] + boxes[i].upper[a]);
+        });
+    }
+
+    BVH build()
+    {
+        BVH bvh;
+        if (boxes_.empty()) return bvh;
+        bvh.primitives.resize(boxes_.size());
+        for (size_t i = 0; i < boxes_.size(); ++i) bvh.primitives[i] = (uint32_t) i;
+        primitives_ = bvh.primitives.data();
+        build_subtree(0, boxes_.size(), bvh.nodes, num_worker_threads(), 0);
+        return bvh;
+    }
+
+private:
+    struct Bin {
+        BVHBounds bounds;
+        size_t count = 0;
+    };
+
+    /* Bounds of the primitives and of their centroids over a range */
+    void range_bounds(size_t begin, size_t end, BVHBounds &bounds, BVHBounds &centroid_bounds)
+    {
+        auto accumulate = [&](size_t b, size_t e, BVHBounds &box, BVHBounds &centroids) {
+            for (size_t i = b; i < e; ++i) {
+                box.grow(boxes_[primitives_[i]]);
+                centroids.grow(&centroids_[(size_t) primitives_[i] * 3]);
+            }
+        };
+        if (end - begin < BVH_PARALLEL_THRESHOLD) {
+            accumulate(begin, end, bounds, centroid_bounds);
+            return;
+        }
+        std::vector<BVHBounds> partial(parallel_for_workers(end - begin) * 2);
+        parallel_for(end - begin, [&](size_t b, size_t e, uint32_t worker) {
+            accumulate(begin + b, begin + e, partial[worker * 2], partial[worker * 2 + 1]);
+        });
+        for (size_t w = 0; w < partial.size(); w += 2) {
+            bounds.grow(partial[w]);
+            centroid_bounds.grow(partial[w + 1]);
+        }
+    }
+
+    /* Drops primitives into bins along an axis */
+    void fill_bins(size_t begin, size_t end, int axis, float lower, float scale, Bin bins[BVH_NUM_BINS])
+    {
+        auto bin_range = [&](size_t b, size_t e, Bin *target) {
+            for (size_t i = b; i < e; ++i) {
+                uint32_t primitive = primitives_[i];
+                uint32_t bin = std::min(BVH_NUM_BINS - 1, (uint32_t) ((centroids_[(size_t) primitive * 3 + axis] - lower) * scale));
+                target[bin].count++;
+                target[bin].bounds.grow(boxes_[primitive]);
+            }
+        };
+        if (end - begin < BVH_PARALLEL_THRESHOLD) {
+            bin_range(begin, end, bins);
+            return;
+        }
+        uint32_t workers = parallel_for_workers(end - begin);
+        std::vector<Bin> partial((size_t) workers * BVH_NUM_BINS);
+        parallel_for(end - begin, [&](size_t b, size_t e, uint32_t worker) {
+            bin_range(begin + b, begin + e, &partial[(size_t) worker * BVH_NUM_BINS]);
+        });
+        for (uint32_t w = 0; w < workers; ++w)
+            for (uint32_t b = 0; b < BVH_NUM_BINS; ++b) {
+                bins[b].count += partial[(size_t) w * BVH_NUM_BINS + b].count;
+                bins[b].bounds.grow(partial[(size_t) w * BVH_NUM_BINS + b].bounds);
+            }
+    }
+
+    /* Appends the subtree over primitives_[begin, end), whose root is at depth, to
+       nodes in depth first order. Offsets are relative to the start of nodes. */
+    void build_subtree(size_t begin, size_t end, std::vector<BVHNode> &nodes, uint32_t threads, uint32_t depth)
+    {
+        BVHBounds bounds, centroid_bounds;
+        range_bounds(begin, end, bounds, centroid_bounds);
+
+        size_t node_index = nodes.size();
+        nodes.emplace_back();
+        for (int a = 0; a < 3; ++a) {
+            nodes[node_index].lower[a] = bounds.lower[a];
+            nodes[node_index].upper[a] = bounds.upper[a];
+        }
+
+        size_t count = end - begin;
+        auto make_leaf = [&]() {
+            nodes[node_index].offset = (uint32_t) begin;
+            nodes[node_index].count = (uint32_t) count;
+        };
+        if (count <= 1) return make_leaf();
+
+        /* Deep down, split at the median centroid along the widest axis instead */
+        if (depth >= BVH_MEDIAN_DEPTH) {
+            if (count <= BVH_MAX_LEAF_SIZE) return make_leaf();
+            int axis = 0;
+            for (int a = 1; a < 3; ++a)
+                if (centroid_bounds.upper[a] - centroid_bounds.lower[a] > centroid_bounds.upper[axis] - centroid_bounds.lower[axis]) axis = a;
+            size_t middle = begin + count / 2;
+            std::nth_element(primitives_ + begin, primitives_ + middle, primitives_ + end, [&](uint32_t a, uint32_t b) {
+                return centroids_[(size_t) a * 3 + axis] < centroids_[(size_t) b * 3 + axis];
+            });
+            return split(node_index, begin, middle, end, nodes, threads, depth);
+        }
+
+        /* Find the cheapest binned split along any axis */
+        float best_cost = std::numeric_limits<float>::max();
+        int best_axis = -1;
+        uint32_t best_bin = 0;
+        float best_lower = 0.0f, best_scale = 0.0f;
+        for (int axis = 0; axis < 3; ++axis) {
+            float extent = centroid_bounds.upper[axis] - centroid_bounds.lower[axis];
+            if (!(extent > 0.0f)) continue;
+            float scale = BVH_NUM_BINS / extent;
+            Bin bins[BVH_NUM_BINS];
+            fill_bins(begin, end, axis, centroid_bounds.lower[axis], scale, bins);
+
+            /* Sweep from the right to get the cost of every right side, then from the left */
+            float right_area[BVH_NUM_BINS];
+            size_t right_count[BVH_NUM_BINS];
+            BVHBounds right;
+            size_t right_total = 0;
+            for (uint32_t b = BVH_NUM_BINS - 1; b > 0; --b) {
+                right.grow(bins[b].bounds);
+                right_total += bins[b].count;
+                right_area[b] = right.half_area();
+                right_count[b] = right_total;
+            }
+            BVHBounds left;
+            size_t left_total = 0;
+            for (uint32_t b = 1; b < BVH_NUM_BINS; ++b) {
+                left.grow(bins[b - 1].bounds);
+                left_total += bins[b - 1].count;
+                if (left_total == 0 || right_count[b] == 0) continue;
+                float cost = left.half_area() * left_total + right_area[b] * right_count[b];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = b;
+                    best_lower = centroid_bounds.lower[axis];
+                    best_scale = scale;
+                }
+            }
+        }
+
+        /* A leaf is cheaper if intersecting everything beats traversing both children */
+        float leaf_cost = bounds.half_area() * count;
+        size_t middle;
+        if (best_axis >= 0 && (best_cost < leaf_cost || count > BVH_MAX_LEAF_SIZE)) {
+            uint32_t *split = std::partition(primitives_ + begin, primitives_ + end, [&](uint32_t primitive) {
+                uint32_t bin = std::min(BVH_NUM_BINS - 1, (uint32_t) ((centroids_[(size_t) primitive * 3 + best_axis] - best_lower) * best_scale));
+                return bin < best_bin;
+            });
+            middle = split - primitives_;
+        }
+        else if (count <= BVH_MAX_LEAF_SIZE) return make_leaf();
+        /* Every centroid is in the same place, split the list in half */
+        else middle = begin + count / 2;
+
+        split(node_index, begin, middle, end, nodes, threads, depth);
+    }
+
+    /* Makes nodes[node_index] an inner node over the children [begin, middle) and [middle, end) */
+    void split(size_t node_index, size_t begin, size_t middle, size_t end, std::vector<BVHNode> &nodes, uint32_t threads, uint32_t depth)
+    {
+        nodes[node_index].count = 0;
+        if (threads > 1 && end - begin >= BVH_PARALLEL_THRESHOLD) {
+            std::vector<BVHNode> right_nodes;
+            std::exception_ptr error;
+            std::thread right_thread([&]() {
+                try { build_subtree(middle, end, right_nodes, threads / 2, depth + 1); }
+                catch (...) { error = std::current_exception(); }
+            });
+            build_subtree(begin, middle, nodes, threads - threads / 2, depth + 1);
+            right_thread.join();
+            if (error) std::rethrow_exception(error);
+
+            /* Shift the right subtree's links to where it lands */
+            uint32_t base = (uint32_t) nodes.size();
+            for (BVHNode &node : right_nodes)
+                if (node.count == 0) node.offset += base;
+            nodes[node_index].offset = base;
+            nodes.insert(nodes.end(), right_nodes.begin(), right_nodes.end());
+        } else {
+            build_subtree(begin, middle, nodes, 1, depth + 1);
+            nodes[node_index].offset = (uint32_t) nodes.size();
+            build_subtree(middle, end, nodes, 1, depth + 1);
+        }
+    }
+
+    const std::vector<BVHBounds> &boxes_;
+    std::vector<float> centroids_;
+    uint32_t *primitives_ = nullptr;
+};
+
+/* Rounds a double outwards to the nearest float, so boxes stay conservative */
+inline float round_down_to_float(double x)
+{
+    float f = (float) x;
+    return ((double) f > x) ? std::nextafter(f, std::numeric_limits<float>::lowest()) : f;
+}
+
+inline float round_up_to_float(double x)
+{
+    float f = (float) x;
+    return ((double) f < x) ? std::nextafter(f, std::numeric_limits<float>::max()) : f;
+}
+
+/* Builds a BVH over the bounding boxes of tetrahedra (their four corners) */
+template <typename T>
+BVH build_bvh(const T *points, const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive)
+{
+    std::vector<BVHBounds> boxes(num_tetrahedra);
+    parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t t = begin; t < end; ++t)
+            for (uint32_t c = 0; c < 4; ++c) {
+                const T *p = &points[(size_t) indices[t * points_per_primitive + c] * 3];
+                for (int a = 0; a < 3; ++a) {
+                    boxes[t].lower[a] = std::min(boxes[t].lower[a], round_down_to_float(p[a]));
+                    boxes[t].upper[a] = std::max(boxes[t].upper[a], round_up_to_float(p[a]));
+                }
+            }
+    });
+    return BVHBuilder(boxes).build();
+}
+
+template <typename T>
+BVH build_bvh(const std::vector<T> &points, const std::vector<uint32_t> &indices, uint32_t points_per_primitive)
+{
+    return build_bvh(points.data(), indices.data(), indices.size() / points_per_primitive, points_per_primitive);
+}
+
+/* Calls visit(first, count) for every leaf whose box passes test(node), descending
+   only into the inner nodes which pass it. The leaf's primitives are
+   bvh.primitives[first, first + count). The stack holds one node per level, so
+   trees deeper than BVH_MAX_DEPTH (which neither the builder nor deserialize_bvh
+   produce) are rejected. */
+template <typename P, typename F>
+void traverse_bvh_where(const BVH &bvh, P test, F visit)
+{
+    if (bvh.nodes.empty()) return;
+    uint32_t stack[BVH_MAX_DEPTH];
+    uint32_t stack_size = 0;
+    uint32_t node_index = 0;
+    while (true) {
+        const BVHNode &node = bvh.nodes[node_index];
+        bool overlaps = test(node);
+        if (overlaps && node.count == 0) {
+            if (stack_size == BVH_MAX_DEPTH)
+                throw std::runtime_error( std::string("BVH is deeper than BVH_MAX_DEPTH"));
+            stack[stack_size++] = node.offset;
+            node_index = node_index + 1;
+            continue;
+        }
+        if (overlaps) visit(node.offset, node.count);
+        if (stack_size == 0) return;
+        node_index = stack[--stack_size];
+    }
+}
+
+/* Calls visit(first, count) for every leaf whose box overlaps [lower, upper] */
+template <typename F>
+void traverse_bvh(const BVH &bvh, const float lower[3], const float upper[3], F visit)
+{
+    traverse_bvh_where(bvh, [&](const BVHNode &node) {
+        return node.lower[0] <= upper[0] && node.upper[0] >= lower[0]
+            && node.lower[1] <= upper[1] && node.upper[1] >= lower[1]
+            && node.lower[2] <= upper[2] && node.upper[2] >= lower[2];
+    }, visit);
+}
+
+/* Finds the tetrahedra whose boxes overlap [lower, upper] */
+inline void query_bvh_box(const BVH &bvh, const float lower[3], const float upper[3], std::vector<uint32_t> &tets)
+{
+    tets.clear();
+    traverse_bvh(bvh, lower, upper, [&](uint32_t first, uint32_t count) {
+        tets.insert(tets.end(), bvh.primitives.begin() + first, bvh.primitives.begin() + first + count);
+    });
+}
+
+/* Returns true if p is inside (or on the boundary of) the tetrahedron abcd */
+template <typename T>
+bool tet_contains_point(const T *a, const T *b, const T *c, const T *d, const double p[3])
+{
+    double v[4][3];
+    for (int i = 0; i < 3; ++i) {
+        v[0][i] = a[i];
+        v[1][i] = b[i];
+        v[2][i] = c[i];
+        v[3][i] = d[i];
+    }
+    double volume = tet_signed_volume6(v[0], v[1], v[2], v[3]);
+    if (volume == 0.0) return false;
+    double w[4] = { tet_signed_volume6(p, v[1], v[2], v[3]), tet_signed_volume6(v[0], p, v[2], v[3]),
+                    tet_signed_volume6(v[0], v[1], p, v[3]), tet_signed_volume6(v[0], v[1], v[2], p) };
+    for (int i = 0; i < 4; ++i)
+        if (w[i] * volume < 0.0) return false;
+    return true;
+}
+
+/* Returns the tetrahedron containing p, or -1 */
+template <typename T>
+int64_t locate_point(const BVH &bvh, const T *points, const uint32_t *indices, uint32_t points_per_primitive, const double p[3])
+{
+    float lower[3] = { round_down_to_float(p[0]), round_down_to_float(p[1]), round_down_to_float(p[2]) };
+    float upper[3] = { round_up_to_float(p[0]), round_up_to_float(p[1]), round_up_to_float(p[2]) };
+    int64_t found = -1;
+    traverse_bvh(bvh, lower, upper, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count && found < 0; ++i) {
+            const uint32_t *tet = &indices[(size_t) bvh.primitives[i] * points_per_primitive];
+            if (tet_contains_point(&points[(size_t) tet[0] * 3], &points[(size_t) tet[1] * 3], &points[(size_t) tet[2] * 3], &points[(size_t) tet[3] * 3], p))
+                found = bvh.primitives[i];
+        }
+    });
+    return found;
+}
+
+/* Serializes a BVH as two counts followed by its nodes and primitives */
+inline std::vector<char> serialize_bvh(const BVH &bvh)
+{
+    uint64_t counts[2] = { bvh.nodes.size(), bvh.primitives.size() };
+    std::vector<char> data(sizeof(counts) + counts[0] * sizeof(BVHNode) + counts[1] * sizeof(uint32_t));
+    std::memcpy(data.data(), counts, sizeof(counts));
+    std::memcpy(data.data() + sizeof(counts), bvh.nodes.data(), counts[0] * sizeof(BVHNode));
+    std::memcpy(data.data() + sizeof(counts) + counts[0] * sizeof(BVHNode), bvh.primitives.data(), counts[1] * sizeof(uint32_t));
+    return data;
+}
+
+/* Checks that a BVH is laid out as the builder lays it out: children after their
+   parent, leaves within the primitives and no larger than BVH_MAX_LEAF_SIZE, every
+   node reached once and no leaf deeper than BVH_MAX_DEPTH. Throws if not. */
+inline void validate_bvh(const BVH &bvh)
+{
+    if (bvh.nodes.empty()) {
+        if (!bvh.primitives.empty())
+            throw std::runtime_error( std::string("BVH is corrupt: primitives without nodes"));
+        return;
+    }
+
+    /* Walking the left children first, every node must be the next one in order */
+    std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0u, 0u } };
+    uint64_t expected = 0;
+    while (!stack.empty()) {
+        uint32_t node_index = stack.back().first, depth = stack.back().second;
+        stack.pop_back();
+        const BVHNode &node = bvh.nodes[node_index];
+        if (node_index != expected++ || depth > BVH_MAX_DEPTH)
+            throw std::runtime_error( std::string("BVH is corrupt or deeper than BVH_MAX_DEPTH"));
+        if (node.count == 0) {
+            if (node.offset <= node_index + 1 || node.offset >= bvh.nodes.size())
+                throw std::runtime_error( std::string("BVH is corrupt: bad child offset"));
+            stack.push_back(std::make_pair(node.offset, depth + 1));
+            stack.push_back(std::make_pair(node_index + 1, depth + 1));
+        } else if (node.count > BVH_MAX_LEAF_SIZE || (uint64_t) node.offset + node.count > bvh.primitives.size())
+            throw std::runtime_error( std::string("BVH is corrupt: bad leaf"));
+    }
+    if (expected != bvh.nodes.size())
+        throw std::runtime_error( std::string("BVH is corrupt: unreachable nodes"));
+}
+
+/* Reads a serialized BVH, checking it with validate_bvh */
+inline BVH deserialize_bvh(const char *data, uint64_t size)
+{
+    BVH bvh;
+    uint64_t counts[2];
+    if (size < sizeof(counts))
+        throw std::runtime_error( std::string("BVH data is truncated"));
+    std::memcpy(counts, data, sizeof(counts));
+    if (size < sizeof(counts) + counts[0] * sizeof(BVHNode) + counts[1] * sizeof(uint32_t))
+        throw std::runtime_error( std::string("BVH data is truncated"));
+    bvh.nodes.resize(counts[0]);
+    bvh.primitives.resize(counts[1]);
+    std::memcpy(bvh.nodes.data(), data + sizeof(counts), counts[0] * sizeof(BVHNode));
+    std::memcpy(bvh.primitives.data(), data + sizeof(counts) + counts[0] * sizeof(BVHNode), counts[1] * sizeof(uint32_t));
+    validate_bvh(bvh);
+    return bvh;
+}
+
+/* Stores a BVH as an optional section of a binary file */
+inline void write_bvh_to_binary(std::string binary_path, const BVH &bvh)
+{
+    std::vector<char> data = serialize_bvh(bvh);
+    write_binary_section(binary_path, SECTION_BVH, data.data(), data.size());
+}
+
+/* Reads the BVH section of a binary file. Returns false if there is none */
+inline bool read_bvh_from_binary(std::string binary_path, BVH &bvh)
+{
+    std::vector<char> data;
+    if (!read_binary_section(binary_path, SECTION_BVH, data)) return false;
+    bvh = deserialize_bvh(data.data(), data.size());
+    return true;
+}
+
+/* Writes a BVH to a sidecar file of its own, for meshes that should stay untouched */
+inline void write_bvh(std::string bvh_path, const BVH &bvh)
+{
+    std::fstream file;
+    file.open(bvh_path, std::ios::out | std::ios::trunc | std::ios::binary );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to create " + bvh_path));
+
+    std::vector<char> data = serialize_bvh(bvh);
+    file.write(data.data(), data.size());
+    file.close();
+}
+
+inline BVH read_bvh(std::string bvh_path)
+{
+    MappedFile file(bvh_path);
+    return deserialize_bvh(file.data(), file.size());
+}
+
+/* Reads the BVH section of a mapped binary file. Returns false if there is none */
+inline bool read_bvh_from_binary(const MappedBinary &binary, BVH &bvh)
+{
+    uint64_t size;
+    const char *data = binary.section(SECTION_BVH, size);
+    if (!data) return false;
+    bvh = deserialize_bvh(data, size);
+    return true;
+}
+
+/* Builds a BVH over a binary tetrahedral mesh and stores it in the file */
+inline void add_bvh_to_binary(std::string binary_path)
+{
+    BinaryHeader header = read_binary_header(binary_path);
+    if (header.points_per_primitive != 4 && header.points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+
+    std::vector<uint32_t> indices;
+    BVH bvh;
+    bool data_is_per_cell;
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        bvh = build_bvh(points, indices, header.points_per_primitive);
+    } else {
+        std::vector<float> points, scalars;
+        read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        bvh = build_bvh(points, indices, header.points_per_primitive);
+    }
+    write_bvh_to_binary(binary_path, bvh);
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Point location and interpolation                                |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Barycentric coordinates down to -BARYCENTRIC_TOLERANCE still count as inside,
+   so points on shared faces are not lost to rounding */
+const double BARYCENTRIC_TOLERANCE = 1e-9;
+
+/* Up to one BVH leaf of tetrahedra in structure of arrays layout. Corner a and
+   the edges from a to b, c and d, padded with empty lanes. */
+struct TetBlock {
+    alignas(32) double a[3][BVH_MAX_LEAF_SIZE];
+    alignas(32) double ab[3][BVH_MAX_LEAF_SIZE];
+    alignas(32) double ac[3][BVH_MAX_LEAF_SIZE];
+    alignas(32) double ad[3][BVH_MAX_LEAF_SIZE];
+
+    template <typename T>
+    void gather(const T *points, const uint32_t *indices, uint32_t points_per_primitive, const uint32_t *tets, uint32_t count)
+    {
+        for (uint32_t lane = 0; lane < BVH_MAX_LEAF_SIZE; ++lane) {
+            if (lane >= count) {
+                for (int i = 0; i < 3; ++i) a[i][lane] = ab[i][lane] = ac[i][lane] = ad[i][lane] = 0.0;
+                continue;
+            }
+            const uint32_t *tet = &indices[(size_t) tets[lane] * points_per_primitive];
+            const T *p[4] = { &points[(size_t) tet[0] * 3], &points[(size_t) tet[1] * 3], &points[(size_t) tet[2] * 3], &points[(size_t) tet[3] * 3] };
+            for (int i = 0; i < 3; ++i) {
+                a[i][lane] = p[0][i];
+                ab[i][lane] = (double) p[1][i] - p[0][i];
+                ac[i][lane] = (double) p[2][i] - p[0][i];
+                ad[i][lane] = (double) p[3][i] - p[0][i];
+            }
+        }
+    }
+
+    /* Barycentric coordinates of q in every lane, as weights[corner][lane].
+       Returns a bit mask of the lanes that contain q; empty lanes never do.
+       Lanes are tested four at a time with AVX, or two at a time with SSE2
+       (always there on x86-64), falling back to one at a time elsewhere. */
+    uint32_t locate(const double q[3], double weights[4][BVH_MAX_LEAF_SIZE]) const
+    {
+        uint32_t inside = 0;
+        uint32_t lane = 0;
+#if defined(TETRATOOLS_AVX)
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d low = _mm256_set1_pd(-BARYCENTRIC_TOLERANCE);
+        for (; lane < BVH_MAX_LEAF_SIZE; lane += 4) {
+            __m256d qa[3], b[3], c[3], d[3];
+            for (int i = 0; i < 3; ++i) {
+                qa[i] = _mm256_sub_pd(_mm256_set1_pd(q[i]), _mm256_load_pd(&a[i][lane]));
+                b[i] = _mm256_load_pd(&ab[i][lane]);
+                c[i] = _mm256_load_pd(&ac[i][lane]);
+                d[i] = _mm256_load_pd(&ad[i][lane]);
+            }
+            auto cross_dot = [](const __m256d u[3], const __m256d v[3], const __m256d w[3]) {
+                /* u . (v x w) */
+                __m256d x = _mm256_sub_pd(_mm256_mul_pd(v[1], w[2]), _mm256_mul_pd(v[2], w[1]));
+                __m256d y = _mm256_sub_pd(_mm256_mul_pd(v[2], w[0]), _mm256_mul_pd(v[0], w[2]));
+                __m256d z = _mm256_sub_pd(_mm256_mul_pd(v[0], w[1]), _mm256_mul_pd(v[1], w[0]));
+                return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(u[0], x), _mm256_mul_pd(u[1], y)), _mm256_mul_pd(u[2], z));
+            };
+            __m256d volume = cross_dot(b, c, d);
+            __m256d valid = _mm256_cmp_pd(volume, zero, _CMP_NEQ_OQ);
+            __m256d inverse = _mm256_div_pd(one, volume);
+            __m256d w1 = _mm256_mul_pd(cross_dot(qa, c, d), inverse);
+            __m256d w2 = _mm256_mul_pd(cross_dot(b, qa, d), inverse);
+            __m256d w3 = _mm256_mul_pd(cross_dot(b, c, qa), inverse);
+            __m256d w0 = _mm256_sub_pd(_mm256_sub_pd(_mm256_sub_pd(one, w1), w2), w3);
+            __m256d mask = _mm256_and_pd(valid, _mm256_and_pd(
+                _mm256_and_pd(_mm256_cmp_pd(w0, low, _CMP_GE_OQ), _mm256_cmp_pd(w1, low, _CMP_GE_OQ)),
+                _mm256_and_pd(_mm256_cmp_pd(w2, low, _CMP_GE_OQ), _mm256_cmp_pd(w3, low, _CMP_GE_OQ))));
+            _mm256_storeu_pd(&weights[0][lane], w0);
+            _mm256_storeu_pd(&weights[1][lane], w1);
+            _mm256_storeu_pd(&weights[2][lane], w2);
+            _mm256_storeu_pd(&weights[3][lane], w3);
+            inside |= (uint32_t) _mm256_movemask_pd(mask) << lane;
+        }
+#elif defined(TETRATOOLS_SSE2)
+        const __m128d one = _mm_set1_pd(1.0);
+        const __m128d low = _mm_set1_pd(-BARYCENTRIC_TOLERANCE);
+        for (; lane < BVH_MAX_LEAF_SIZE; lane += 2) {
+            __m128d qa[3], b[3], c[3], d[3];
+            for (int i = 0; i < 3; ++i) {
+                qa[i] = _mm_sub_pd(_mm_set1_pd(q[i]), _mm_load_pd(&a[i][lane]));
+                b[i] = _mm_load_pd(&ab[i][lane]);
+                c[i] = _mm_load_pd(&ac[i][lane]);
+                d[i] = _mm_load_pd(&ad[i][lane]);
+            }
+            auto cross_dot = [](const __m128d u[3], const __m128d v[3], const __m128d w[3]) {
+                /* u . (v x w) */
+                __m128d x = _mm_sub_pd(_mm_mul_pd(v[1], w[2]), _mm_mul_pd(v[2], w[1]));
+                __m128d y = _mm_sub_pd(_mm_mul_pd(v[2], w[0]), _mm_mul_pd(v[0], w[2]));
+                __m128d z = _mm_sub_pd(_mm_mul_pd(v[0], w[1]), _mm_mul_pd(v[1], w[0]));
+                return _mm_add_pd(_mm_add_pd(_mm_mul_pd(u[0], x), _mm_mul_pd(u[1], y)), _mm_mul_pd(u[2], z));
+            };
+            __m128d volume = cross_dot(b, c, d);
+            __m128d valid = _mm_cmpneq_pd(volume, _mm_setzero_pd());
+            __m128d inverse = _mm_div_pd(one, volume);
+            __m128d w1 = _mm_mul_pd(cross_dot(qa, c, d), inverse);
+            __m128d w2 = _mm_mul_pd(cross_dot(b, qa, d), inverse);
+            __m128d w3 = _mm_mul_pd(cross_dot(b, c, qa), inverse);
+            __m128d w0 = _mm_sub_pd(_mm_sub_pd(_mm_sub_pd(one, w1), w2), w3);
+            __m128d mask = _mm_and_pd(valid, _mm_and_pd(
+                _mm_and_pd(_mm_cmpge_pd(w0, low), _mm_cmpge_pd(w1, low)),
+                _mm_and_pd(_mm_cmpge_pd(w2, low), _mm_cmpge_pd(w3, low))));
+            _mm_storeu_pd(&weights[0][lane], w0);
+            _mm_storeu_pd(&weights[1][lane], w1);
+            _mm_storeu_pd(&weights[2][lane], w2);
+            _mm_storeu_pd(&weights[3][lane], w3);
+            inside |= (uint32_t) _mm_movemask_pd(mask) << lane;
+        }
+#endif
+        for (; lane < BVH_MAX_LEAF_SIZE; ++lane) {
+            double qa[3] = { q[0] - a[0][lane], q[1] - a[1][lane], q[2] - a[2][lane] };
+            auto cross_dot = [&](const double u[3], const double v[3], const double w[3]) {
+                return u[0] * (v[1] * w[2] - v[2] * w[1]) + u[1] * (v[2] * w[0] - v[0] * w[2]) + u[2] * (v[0] * w[1] - v[1] * w[0]);
+            };
+            double b[3] = { ab[0][lane], ab[1][lane], ab[2][lane] };
+            double c[3] = { ac[0][lane], ac[1][lane], ac[2][lane] };
+            double d[3] = { ad[0][lane], ad[1][lane], ad[2][lane] };
+            double volume = cross_dot(b, c, d);
+            if (volume == 0.0) continue;
+            weights[1][lane] = cross_dot(qa, c, d) / volume;
+            weights[2][lane] = cross_dot(b, qa, d) / volume;
+            weights[3][lane] = cross_dot(b, c, qa) / volume;
+            weights[0][lane] = 1.0 - weights[1][lane] - weights[2][lane] - weights[3][lane];
+            if (weights[0][lane] >= -BARYCENTRIC_TOLERANCE && weights[1][lane] >= -BARYCENTRIC_TOLERANCE
+             && weights[2][lane] >= -BARYCENTRIC_TOLERANCE && weights[3][lane] >= -BARYCENTRIC_TOLERANCE)
+                inside |= 1u << lane;
+        }
+        return inside;
+    }
+};
+
+/* Locates a batch of query points (xyz triples) and interpolates the scalars at them.
+   tets receives the containing tetrahedron of every query, or -1 if it is outside
+   the mesh, and values the interpolated scalar (NaN outside). Point scalars are
+   interpolated linearly from the four corners, or with the quadratic shape
+   functions for 10 node tetrahedra (located by their corners, ie assuming
+   straight edges); per-cell scalars are taken as is.
+   Either output may be null. */
+template <typename T>
+void interpolate_points(const BVH &bvh, const T *points, const T *scalars, const uint32_t *indices, uint32_t points_per_primitive, bool data_is_per_cell,
+                        const double *queries, size_t num_queries, int64_t *tets, double *values)
+{
+    parallel_for(num_queries, [&](size_t begin, size_t end, uint32_t) {
+        TetBlock block;
+        double weights[4][BVH_MAX_LEAF_SIZE];
+        for (size_t i = begin; i < end; ++i) {
+            const double *q = &queries[i * 3];
+            float lower[3] = { round_down_to_float(q[0]), round_down_to_float(q[1]), round_down_to_float(q[2]) };
+            float upper[3] = { round_up_to_float(q[0]), round_up_to_float(q[1]), round_up_to_float(q[2]) };
+            int64_t found = -1;
+            double value = std::numeric_limits<double>::quiet_NaN();
+            traverse_bvh(bvh, lower, upper, [&](uint32_t first, uint32_t count) {
+                if (found >= 0) return;
+                const uint32_t *leaf = &bvh.primitives[first];
+                block.gather(points, indices, points_per_primitive, leaf, count);
+                uint32_t inside = block.locate(q, weights);
+                if (!inside) return;
+
+                uint32_t lane = 0;
+                while (!(inside & (1u << lane))) ++lane;
+                found = leaf[lane];
+                if (!scalars) return;
+                if (data_is_per_cell) {
+                    value = scalars[found];
+                    return;
+                }
+                const uint32_t *tet = &indices[(size_t) found * points_per_primitive];
+                value = 0.0;
+                if (points_per_primitive == 10) {
+                    double l[4] = { weights[0][lane], weights[1][lane], weights[2][lane], weights[3][lane] };
+                    double shape[10];
+                    quadratic_tet_shape_functions(l, shape);
+                    for (int n = 0; n < 10; ++n) value += shape[n] * scalars[tet[n]];
+                }
+                else for (int c = 0; c < 4; ++c) value += weights[c][lane] * scalars[tet[c]];
+            });
+            if (tets) tets[i] = found;
+            if (values) values[i] = value;
+        }
+    }, 256);
+}
+
+/* Checked form for callers passing sized buffers (such as NumPy arrays from Python) */
+template <typename T>
+void interpolate_points(const BVH &bvh, const std::vector<T> &points, const std::vector<T> &scalars, const std::vector<uint32_t> &indices,
+                        uint32_t points_per_primitive, bool data_is_per_cell, const double *queries, size_t num_queries,
+                        int64_t *tets, size_t num_tets, double *values, size_t num_values)
+{
+    if (num_tets != num_queries || num_values != num_queries)
+        throw std::runtime_error( std::string("Output buffers need one entry per query point"));
+    interpolate_points(bvh, points.data(), scalars.empty() ? nullptr : scalars.data(), indices.data(), points_per_primitive, data_is_per_cell,
+                       queries, num_queries, tets, values);
+}
+
+/* Samples a binary mesh at a batch of query points, using its BVH section if
+   it has one (see add_bvh_to_binary) and building a hierarchy otherwise */
+inline void interpolate_binary(std::string binary_path, const double *queries, size_t num_queries, int64_t *tets, size_t num_tets, double *values, size_t num_values)
+{
+    BinaryHeader header = read_binary_header(binary_path);
+    if (header.points_per_primitive != 4 && header.points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+
+    auto sample = [&](auto &points, auto &scalars) {
+        std::vector<uint32_t> indices;
+        bool data_is_per_cell;
+        read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        BVH bvh;
+        if (!read_bvh_from_binary(binary_path, bvh)) bvh = build_bvh(points, indices, header.points_per_primitive);
+        interpolate_points(bvh, points, scalars, indices, header.points_per_primitive, data_is_per_cell, queries, num_queries, tets, num_tets, values, num_values);
+    };
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        sample(points, scalars);
+    } else {
+        std::vector<float> points, scalars;
+        sample(points, scalars);
+    }
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Voxelization                                                    |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* A regular grid of samples. Sample (i, j, k) sits at origin + (i, j, k) * spacing,
+   and samples are stored with i varying fastest. */
+struct RegularGrid {
+    double origin[3];
+    double spacing[3];
+    uint32_t dims[3];
+
+    uint64_t num_samples() const { return (uint64_t) dims[0] * dims[1] * dims[2]; }
+};
+
+/* A grid of the given size spanning the bounds of the points */
+template <typename T>
+RegularGrid fit_regular_grid(const std::vector<T> &points, uint32_t nx, uint32_t ny, uint32_t nz)
+{
+    RegularGrid grid;
+    double lower[3], upper[3];
+    compute_bounds(points.data(), points.size() / 3, lower, upper);
+    grid.dims[0] = nx;
+    grid.dims[1] = ny;
+    grid.dims[2] = nz;
+    for (int a = 0; a < 3; ++a) {
+        grid.origin[a] = lower[a];
+        grid.spacing[a] = (grid.dims[a] > 1) ? (upper[a] - lower[a]) / (grid.dims[a] - 1) : 1.0;
+    }
+    return grid;
+}
+
+/* Slabs of z planes are sized to stay within this many bytes, unless a single plane is larger */
+const size_t VOXELIZE_SLAB_BYTES = (size_t) 1 << 28;
+
+/* Rasterizes tetrahedron t onto the samples of a grid in planes [k_begin, k_end)
+   and rows [j_begin, j_end), calling fill_row(j, k, first, last, value, value_step) for every run of samples
+   first <= i <= last of row (j, k) inside it, where sample i has value + i * value_step.
+   Along each row of samples the barycentric coordinates are linear, so the row
+   is clipped to the tetrahedron analytically. */
+template <typename T, typename F>
+void rasterize_tetrahedron(const T *points, const T *scalars, const uint32_t *indices, size_t t, uint32_t points_per_primitive, bool data_is_per_cell,
+                           const RegularGrid &grid, int64_t k_begin, int64_t k_end, int64_t j_begin, int64_t j_end, F fill_row)
+{
+    /* Barycentric coordinate c at p is offset[c] + gradient[c] . (p - a) */
+    const uint32_t *tet = &indices[t * points_per_primitive];
+    double p[4][3];
+    for (int c = 0; c < 4; ++c)
+        for (int a = 0; a < 3; ++a) p[c][a] = points[(size_t) tet[c] * 3 + a];
+
+    double z_lo = std::min(std::min(p[0][2], p[1][2]), std::min(p[2][2], p[3][2]));
+    double z_hi = std::max(std::max(p[0][2], p[1][2]), std::max(p[2][2], p[3][2]));
+    int64_t k0 = std::max(k_begin, (int64_t) std::max(0.0, std::ceil((z_lo - grid.origin[2]) / grid.spacing[2])));
+    int64_t k1 = std::min(k_end - 1, (int64_t) std::min((double) grid.dims[2] - 1, std::floor((z_hi - grid.origin[2]) / grid.spacing[2])));
+    if (k0 > k1) return;
+
+    double e1[3], e2[3], e3[3];
+    for (int a = 0; a < 3; ++a) {
+        e1[a] = p[1][a] - p[0][a];
+        e2[a] = p[2][a] - p[0][a];
+        e3[a] = p[3][a] - p[0][a];
+    }
+    double gradient[4][3];
+    auto cross = [](const double u[3], const double v[3], double w[3]) {
+        w[0] = u[1] * v[2] - u[2] * v[1];
+        w[1] = u[2] * v[0] - u[0] * v[2];
+        w[2] = u[0] * v[1] - u[1] * v[0];
+    };
+    cross(e2, e3, gradient[1]);
+    cross(e3, e1, gradient[2]);
+    cross(e1, e2, gradient[3]);
+    double volume = e1[0] * gradient[1][0] + e1[1] * gradient[1][1] + e1[2] * gradient[1][2];
+    if (volume == 0.0) return;
+    for (int a = 0; a < 3; ++a) {
+        for (int c = 1; c < 4; ++c) gradient[c][a] /= volume;
+        gradient[0][a] = -gradient[1][a] - gradient[2][a] - gradient[3][a];
+    }
+    double corner_values[4];
+    for (int c = 0; c < 4; ++c) corner_values[c] = (double) scalars[data_is_per_cell ? t : tet[c]];
+
+    double y_lo = std::min(std::min(p[0][1], p[1][1]), std::min(p[2][1], p[3][1]));
+    double y_hi = std::max(std::max(p[0][1], p[1][1]), std::max(p[2][1], p[3][1]));
+    int64_t j0 = std::max(j_begin, (int64_t) std::max(0.0, std::ceil((y_lo - grid.origin[1]) / grid.spacing[1])));
+    int64_t j1 = std::min(j_end - 1, (int64_t) std::min((double) grid.dims[1] - 1, std::floor((y_hi - grid.origin[1]) / grid.spacing[1])));
+    double dx = grid.spacing[0];
+
+    for (int64_t k = k0; k <= k1; ++k) {
+        double z = grid.origin[2] + k * grid.spacing[2] - p[0][2];
+        for (int64_t j = j0; j <= j1; ++j) {
+            double y = grid.origin[1] + j * grid.spacing[1] - p[0][1];
+            double x = grid.origin[0] - p[0][0];
+
+            /* Coordinate c along the row is base + i * step; clip i to where all are >= 0 */
+            double lo = 0.0, hi = grid.dims[0] - 1.0;
+            double base[4], step[4];
+            for (int c = 1; c < 4; ++c) base[c] = gradient[c][0] * x + gradient[c][1] * y + gradient[c][2] * z;
+            base[0] = 1.0 - base[1] - base[2] - base[3];
+            for (int c = 0; c < 4; ++c) step[c] = gradient[c][0] * dx;
+            for (int c = 0; c < 4; ++c) {
+                double limit = -BARYCENTRIC_TOLERANCE - base[c];
+                if (step[c] > 0.0) lo = std::max(lo, std::ceil(limit / step[c]));
+                else if (step[c] < 0.0) hi = std::min(hi, std::floor(limit / step[c]));
+                else if (base[c] < -BARYCENTRIC_TOLERANCE) hi = -1.0;
+            }
+            if (lo > hi) continue;
+
+            double value = 0.0, value_step = 0.0;
+            for (int c = 0; c < 4; ++c) {
+                value += corner_values[c] * base[c];
+                value_step += corner_values[c] * step[c];
+            }
+            fill_row(j, k, (int64_t) lo, (int64_t) hi, value, value_step);
+        }
+    }
+}
+
+/* Rasterizes the scalars of a tetrahedral mesh onto a regular grid, one slab of
+   z planes at a time. Samples outside the mesh get background. Each slab is
+   passed to write_slab(first_plane, num_planes, values) once it is complete.
+   Each slab is split into tiles of planes and, when it has fewer planes than
+   there are threads, of rows too. The slab's tetrahedra are bucketed by the
+   tiles they overlap, and each thread fills the runs of samples
+   rasterize_tetrahedron finds in its tiles by stepping the value along them. */
+template <typename T, typename F>
+void voxelize(const T *points, const T *scalars, const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive, bool data_is_per_cell,
+              const RegularGrid &grid, float background, F write_slab, size_t max_slab_bytes = VOXELIZE_SLAB_BYTES)
+{
+    const uint32_t nx = grid.dims[0], ny = grid.dims[1], nz = grid.dims[2];
+    if (nx == 0 || ny == 0 || nz == 0) return;
+    for (int a = 0; a < 3; ++a)
+        if (!(grid.spacing[a] > 0.0))
+            throw std::runtime_error( std::string("Grid spacing needs to be positive"));
+
+    size_t plane_size = (size_t) nx * ny;
+    uint32_t slab_depth = (uint32_t) std::max<size_t>(1, std::min<size_t>(nz, max_slab_bytes / (plane_size * sizeof(float))));
+    uint32_t num_slabs = (nz + slab_depth - 1) / slab_depth;
+
+    /* Plane range of every tetrahedron, or an empty range if it misses the grid */
+    std::vector<int64_t> plane_range(num_tetrahedra * 2);
+    std::vector<std::atomic<uint64_t>> slab_counts(num_slabs + 1);
+    parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t t = begin; t < end; ++t) {
+            double lo = std::numeric_limits<double>::max(), hi = std::numeric_limits<double>::lowest();
+            for (uint32_t c = 0; c < 4; ++c) {
+                double z = points[(size_t) indices[t * points_per_primitive + c] * 3 + 2];
+                lo = std::min(lo, z);
+                hi = std::max(hi, z);
+            }
+            int64_t first = (int64_t) std::max(0.0, std::ceil((lo - grid.origin[2]) / grid.spacing[2]));
+            int64_t last = (int64_t) std::min((double) nz - 1, std::floor((hi - grid.origin[2]) / grid.spacing[2]));
+            plane_range[t * 2] = first;
+            plane_range[t * 2 + 1] = last;
+            for (int64_t s = first / slab_depth; first <= last && s <= last / slab_depth; ++s)
+                slab_counts[s]++;
+        }
+    });
+
+    /* Tetrahedra overlapping each slab, in compressed sparse row form */
+    std::vector<uint64_t> slab_offsets(num_slabs + 1);
+    for (uint32_t s = 0; s <= num_slabs; ++s) slab_offsets[s] = slab_counts[s];
+    parallel_exclusive_scan(slab_offsets);
+    std::vector<uint32_t> slab_tets(slab_offsets[num_slabs]);
+    for (uint32_t s = 0; s < num_slabs; ++s) slab_counts[s] = slab_offsets[s];
+    parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t t = begin; t < end; ++t)
+            for (int64_t s = plane_range[t * 2] / slab_depth; plane_range[t * 2] <= plane_range[t * 2 + 1] && s <= plane_range[t * 2 + 1] / slab_depth; ++s)
+                slab_tets[slab_counts[s]++] = (uint32_t) t;
+    });
+    /* Where tetrahedra share samples the last one wins, so keep a fixed order */
+    parallel_for(num_slabs, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t s = begin; s < end; ++s)
+            std::sort(slab_tets.begin() + slab_offsets[s], slab_tets.begin() + slab_offsets[s + 1]);
+    }, 1);
+
+    std::vector<float> slab(plane_size * slab_depth);
+    for (uint32_t s = 0; s < num_slabs; ++s) {
+        uint32_t slab_first = s * slab_depth;
+        uint32_t depth = std::min(slab_depth, nz - slab_first);
+        std::fill(slab.begin(), slab.begin() + plane_size * depth, background);
+
+        /* Bands of planes, and bands of rows when the planes alone cannot keep every thread busy */
+        uint32_t num_tiles = parallel_for_workers(plane_size * depth, 1);
+        uint32_t band_planes = (depth + std::min(depth, num_tiles) - 1) / std::min(depth, num_tiles);
+        uint32_t num_plane_bands = (depth + band_planes - 1) / band_planes;
+        uint32_t num_row_bands = std::min(ny, (num_tiles + num_plane_bands - 1) / num_plane_bands);
+        uint32_t band_rows = (ny + num_row_bands - 1) / num_row_bands;
+        num_row_bands = (ny + band_rows - 1) / band_rows;
+        num_tiles = num_plane_bands * num_row_bands;
+
+        /* Tetrahedra of the slab overlapping each tile, in compressed sparse row form.
+           tile_range holds the first and last plane band and row band, or an empty range. */
+        uint64_t slab_begin = slab_offsets[s], slab_size = slab_offsets[s + 1] - slab_offsets[s];
+        std::vector<uint32_t> tile_range(slab_size * 4);
+        std::vector<std::atomic<uint64_t>> tile_counts(num_tiles + 1);
+        parallel_for(slab_size, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t e = begin; e < end; ++e) {
+                uint32_t t = slab_tets[slab_begin + e];
+                double lo = std::numeric_limits<double>::max(), hi = std::numeric_limits<double>::lowest();
+                for (uint32_t c = 0; c < 4; ++c) {
+                    double y = points[(size_t) indices[(size_t) t * points_per_primitive + c] * 3 + 1];
+                    lo = std::min(lo, y);
+                    hi = std::max(hi, y);
+                }
+                double first_row = std::max(0.0, std::floor((lo - grid.origin[1]) / grid.spacing[1]));
+                double last_row = std::min((double) ny - 1, std::ceil((hi - grid.origin[1]) / grid.spacing[1]));
+                uint32_t *range = &tile_range[e * 4];
+                range[0] = 1;
+                range[1] = 0;
+                if (!(first_row <= last_row)) continue;
+                range[0] = (uint32_t) (std::max<int64_t>(plane_range[(size_t) t * 2], slab_first) - slab_first) / band_planes;
+                range[1] = (uint32_t) (std::min<int64_t>(plane_range[(size_t) t * 2 + 1], slab_first + depth - 1) - slab_first) / band_planes;
+                range[2] = (uint32_t) first_row / band_rows;
+                range[3] = (uint32_t) last_row / band_rows;
+                for (uint32_t pb = range[0]; pb <= range[1]; ++pb)
+                    for (uint32_t rb = range[2]; rb <= range[3]; ++rb) tile_counts[pb * num_row_bands + rb]++;
+            }
+        });
+        std::vector<uint64_t> tile_offsets(num_tiles + 1);
+        for (uint32_t b = 0; b <= num_tiles; ++b) tile_offsets[b] = tile_counts[b];
+        parallel_exclusive_scan(tile_offsets);
+        std::vector<uint32_t> tile_tets(tile_offsets[num_tiles]);
+        for (uint32_t b = 0; b < num_tiles; ++b) tile_counts[b] = tile_offsets[b];
+        parallel_for(slab_size, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t e = begin; e < end; ++e) {
+                const uint32_t *range = &tile_range[e * 4];
+                for (uint32_t pb = range[0]; pb <= range[1]; ++pb)
+                    for (uint32_t rb = range[2]; rb <= range[3]; ++rb)
+                        tile_tets[tile_counts[pb * num_row_bands + rb]++] = slab_tets[slab_begin + e];
+            }
+        });
+        std::vector<uint32_t>().swap(tile_range);
+        /* Where tetrahedra share samples the last one wins, so keep a fixed order */
+        parallel_for(num_tiles, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t b = begin; b < end; ++b)
+                std::sort(tile_tets.begin() + tile_offsets[b], tile_tets.begin() + tile_offsets[b + 1]);
+        }, 1);
+
+        parallel_for(num_tiles, [&](size_t tile_begin, size_t tile_end, uint32_t) {
+            for (size_t b = tile_begin; b < tile_end; ++b) {
+                int64_t k_begin = slab_first + (int64_t) (b / num_row_bands) * band_planes, k_end = std::min<int64_t>(slab_first + depth, k_begin + band_planes);
+                int64_t j_begin = (int64_t) (b % num_row_bands) * band_rows, j_end = std::min<int64_t>(ny, j_begin + band_rows);
+                for (uint64_t e = tile_offsets[b]; e < tile_offsets[b + 1]; ++e) {
+                    rasterize_tetrahedron(points, scalars, indices, tile_tets[e], points_per_primitive, data_is_per_cell, grid, k_begin, k_end, j_begin, j_end,
+                        [&](int64_t j, int64_t k, int64_t first, int64_t last, double value, double value_step) {
+                            float *row = &slab[(size_t) (k - slab_first) * plane_size + (size_t) j * nx];
+                            for (int64_t i = first; i <= last; ++i)
+                                row[i] = (float) (value + i * value_step);
+                        });
+                }
+            }
+        }, 1);
+
+        write_slab(slab_first, depth, (const float*) slab.data());
+    }
+}
+
+/* Voxelizes a binary mesh and streams the samples to a file as raw little endian
+   float32, optionally preceded by an NRRD header describing the grid */
+inline void voxelize_binary(std::string binary_path, const RegularGrid &grid, std::string volume_path, bool nrrd_header = false,
+                            float background = std::numeric_limits<float>::quiet_NaN(), size_t max_slab_bytes = VOXELIZE_SLAB_BYTES)
+{
+    BinaryHeader header = read_binary_header(binary_path);
+    if (header.points_per_primitive != 4 && header.points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+
+    std::fstream file;
+    file.open(volume_path, std::ios::out | std::ios::trunc | std::ios::binary );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to create " + volume_path));
+
+    if (nrrd_header) {
+        file.precision(std::numeric_limits<double>::max_digits10);
+        file << "NRRD0004\n"
+             << "type: float\n"
+             << "dimension: 3\n"
+             << "space dimension: 3\n"
+             << "sizes: " << grid.dims[0] << " " << grid.dims[1] << " " << grid.dims[2] << "\n"
+             << "space directions: (" << grid.spacing[0] << ",0,0) (0," << grid.spacing[1] << ",0) (0,0," << grid.spacing[2] << ")\n"
+             << "space origin: (" << grid.origin[0] << "," << grid.origin[1] << "," << grid.origin[2] << ")\n"
+             << "kinds: domain domain domain\n"
+             << "endian: little\n"
+             << "encoding: raw\n\n";
+    }
+
+    size_t plane_size = (size_t) grid.dims[0] * grid.dims[1];
+    auto write_slab = [&](uint32_t, uint32_t depth, const float *values) {
+        file.write((const char*) values, plane_size * depth * sizeof(float));
+    };
+    auto rasterize = [&](auto &points, auto &scalars) {
+        std::vector<uint32_t> indices;
+        bool data_is_per_cell;
+        read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        voxelize(points.data(), scalars.data(), indices.data(), indices.size() / header.points_per_primitive, header.points_per_primitive,
+                 data_is_per_cell, grid, background, write_slab, max_slab_bytes);
+    };
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        rasterize(points, scalars);
+    } else {
+        std::vector<float> points, scalars;
+        rasterize(points, scalars);
+    }
+
+    if (!file)
+        throw std::runtime_error( std::string("Unable to write " + volume_path));
+    file.close();
+}
+
+/* Voxelizes a mesh into an in-memory array of grid items, with i varying fastest */
+template <typename T>
+std::vector<GridItem> voxelize_to_grid_items(const std::vector<T> &points, const std::vector<T> &scalars, const std::vector<uint32_t> &indices,
+                                             uint32_t points_per_primitive, bool data_is_per_cell, const RegularGrid &grid,
+                                             float background = std::numeric_limits<float>::quiet_NaN())
+{
+    std::vector<GridItem> items(grid.num_samples());
+    size_t plane_size = (size_t) grid.dims[0] * grid.dims[1];
+    auto write_slab = [&](uint32_t first, uint32_t depth, const float *values) {
+        parallel_for(plane_size * depth, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t v = begin; v < end; ++v) {
+                size_t n = (size_t) first * plane_size + v;
+                GridItem &item = items[n];
+                item.point[0] = (float) (grid.origin[0] + (n % grid.dims[0]) * grid.spacing[0]);
+                item.point[1] = (float) (grid.origin[1] + ((n / grid.dims[0]) % grid.dims[1]) * grid.spacing[1]);
+                item.point[2] = (float) (grid.origin[2] + (n / plane_size) * grid.spacing[2]);
+                item.attribute = values[v];
+            }
+        });
+    };
+    voxelize(points.data(), scalars.data(), indices.data(), indices.size() / points_per_primitive, points_per_primitive,
+             data_is_per_cell, grid, background, write_slab);
+    return items;
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Isosurfaces                                                     |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Key of the isosurface vertex on the edge ab. A surface passing exactly through
+   a mesh vertex is keyed by that vertex alone, so every tetrahedron around it
+   shares one surface vertex. */
+inline uint64_t isosurface_vertex_key(uint32_t a, uint32_t b)
+{
+    return ((uint64_t) std::min(a, b) << 32) | std::max(a, b);
+}
+
+/* Cuts tetrahedron tet at the level value of the field s (one value per corner)
+   with marching tetrahedra. Fills keys with the isosurface vertex keys of the
+   section's corners, in cyclic order and facing towards increasing s, and returns
+   how many there are: 0 if the level misses the tetrahedron, else 3 or 4. */
+template <typename T>
+int march_tetrahedron(const T *points, const uint32_t *tet, const double s[4], double value, uint64_t keys[4])
+{
+    double lowest = std::min(std::min(s[0], s[1]), std::min(s[2], s[3]));
+    double highest = std::max(std::max(s[0], s[1]), std::max(s[2], s[3]));
+    if (!(value >= lowest && value < highest)) return 0;
+
+    int above[4], below[4], num_above = 0, num_below = 0;
+    for (int c = 0; c < 4; ++c) {
+        if (s[c] > value) above[num_above++] = c;
+        else below[num_below++] = c;
+    }
+
+    /* Crossing edges as (below, above) corners, in cyclic order around the section */
+    int edges[4][2];
+    int num_edges = 0;
+    if (num_above == 1)
+        for (int i = 0; i < 3; ++i) { edges[num_edges][0] = below[i]; edges[num_edges++][1] = above[0]; }
+    else if (num_below == 1)
+        for (int i = 0; i < 3; ++i) { edges[num_edges][0] = below[0]; edges[num_edges++][1] = above[i]; }
+    else {
+        int cycle[4][2] = { { below[0], above[0] }, { below[0], above[1] }, { below[1], above[1] }, { below[1], above[0] } };
+        for (int i = 0; i < 4; ++i) { edges[i][0] = cycle[i][0]; edges[i][1] = cycle[i][1]; }
+        num_edges = 4;
+    }
+
+    double position[4][3];
+    for (int e = 0; e < num_edges; ++e) {
+        int lo = edges[e][0], hi = edges[e][1];
+        keys[e] = (s[lo] == value) ? isosurface_vertex_key(tet[lo], tet[lo]) : isosurface_vertex_key(tet[lo], tet[hi]);
+        double f = (value - s[lo]) / (s[hi] - s[lo]);
+        for (int a = 0; a < 3; ++a)
+            position[e][a] = points[(size_t) tet[lo] * 3 + a] + f * ((double) points[(size_t) tet[hi] * 3 + a] - points[(size_t) tet[lo] * 3 + a]);
+    }
+
+    /* Orient the section so its normal points from the corners below to the corners above */
+    double direction[3] = { 0.0, 0.0, 0.0 };
+    for (int a = 0; a < 3; ++a) {
+        for (int i = 0; i < num_above; ++i) direction[a] += (double) points[(size_t) tet[above[i]] * 3 + a] / num_above;
+        for (int i = 0; i < num_below; ++i) direction[a] -= (double) points[(size_t) tet[below[i]] * 3 + a] / num_below;
+    }
+    double u[3], v[3];
+    for (int a = 0; a < 3; ++a) {
+        u[a] = position[1][a] - position[0][a];
+        v[a] = position[2][a] - position[0][a];
+    }
+    double normal_dot = direction[0] * (u[1] * v[2] - u[2] * v[1]) + direction[1] * (u[2] * v[0] - u[0] * v[2]) + direction[2] * (u[0] * v[1] - u[1] * v[0]);
+    if (num_edges == 4 && normal_dot == 0.0) {
+        for (int a = 0; a < 3; ++a) u[a] = position[3][a] - position[0][a];
+        normal_dot = direction[0] * (v[1] * u[2] - v[2] * u[1]) + direction[1] * (v[2] * u[0] - v[0] * u[2]) + direction[2] * (v[0] * u[1] - v[1] * u[0]);
+    }
+    if (normal_dot < 0.0) std::reverse(keys, keys + num_edges);
+    return num_edges;
+}
+
+/* Welds the corners of a batch of section triangles, given by their vertex keys.
+   Corners with the same key become one vertex, numbered from vertex_base in key
+   order, and emit_vertex(vertex, a, b) is called once per vertex with the mesh
+   edge ab it lies on (a == b for a mesh vertex, and a < b otherwise). Triangles
+   which collapsed onto fewer than three vertices are dropped. Returns the number
+   of vertices, and fills triangles with three vertices per kept triangle and
+   new_index with the kept position of every input triangle (see compact_records). */
+template <typename F>
+uint64_t weld_section_corners(const std::vector<uint64_t> &keys, uint64_t vertex_base, std::vector<uint32_t> &triangles, std::vector<uint64_t> &new_index, F emit_vertex)
+{
+    size_t num_corners = keys.size();
+
+    /* Sort the corner keys, so corners on the same edge become neighbours */
+    std::vector<uint32_t> corner_order(num_corners);
+    for (size_t i = 0; i < num_corners; ++i) corner_order[i] = (uint32_t) i;
+    std::vector<uint64_t> sorted_keys = keys;
+    parallel_radix_sort(sorted_keys, corner_order);
+
+    std::vector<uint64_t> first_of_run(num_corners + 1);
+    parallel_for(num_corners, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) first_of_run[i] = (i == 0 || sorted_keys[i] != sorted_keys[i - 1]) ? 1 : 0;
+    });
+    uint64_t num_vertices = parallel_exclusive_scan(first_of_run);
+
+    triangles.resize(num_corners);
+    parallel_for(num_corners, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) {
+            uint64_t vertex = vertex_base + first_of_run[i + 1] - 1;
+            triangles[corner_order[i]] = (uint32_t) vertex;
+            if (first_of_run[i + 1] != first_of_run[i])
+                emit_vertex(vertex, (uint32_t) (sorted_keys[i] >> 32), (uint32_t) sorted_keys[i]);
+        }
+    });
+
+    /* Drop triangles collapsed by sections passing through mesh vertices */
+    size_t num_triangles = num_corners / 3;
+    new_index.assign(num_triangles + 1, 0);
+    parallel_for(num_triangles, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t t = begin; t < end; ++t) {
+            const uint32_t *v = &triangles[t * 3];
+            new_index[t] = (v[0] != v[1] && v[1] != v[2] && v[2] != v[0]) ? 1 : 0;
+        }
+    });
+    uint64_t kept = parallel_exclusive_scan(new_index);
+    compact_records(triangles, 3, new_index, kept);
+    return num_vertices;
+}
+
+/* Extracts isosurfaces of point scalars with marching tetrahedra, for every
+   isovalue in one pass over the mesh. Triangles face towards increasing scalars.
+   Surface vertices are welded on their mesh edge, so every surface is watertight
+   inside the mesh. The output is a triangle mesh (3 points per primitive) whose
+   point scalars hold the isovalue of their surface. Surfaces follow each other
+   in the order of the isovalues. */
+template <typename T>
+void extract_isosurfaces(const T *points, const T *scalars, const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive,
+                         const std::vector<double> &isovalues, std::vector<T> &out_points, std::vector<T> &out_scalars, std::vector<uint32_t> &out_indices)
+{
+    size_t num_isovalues = isovalues.size();
+    uint32_t workers = parallel_for_workers(num_tetrahedra);
+
+    /* Every worker keeps the vertex keys of its triangles, per isovalue */
+    std::vector<std::vector<uint64_t>> buffers((size_t) workers * num_isovalues);
+    parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t worker) {
+        for (size_t t = begin; t < end; ++t) {
+            const uint32_t *tet = &indices[t * points_per_primitive];
+            double s[4];
+            for (int c = 0; c < 4; ++c) s[c] = scalars[tet[c]];
+
+            for (size_t iso = 0; iso < num_isovalues; ++iso) {
+                uint64_t keys[4];
+                int num_keys = march_tetrahedron(points, tet, s, isovalues[iso], keys);
+                if (num_keys == 0) continue;
+
+                std::vector<uint64_t> &buffer = buffers[(size_t) worker * num_isovalues + iso];
+                buffer.insert(buffer.end(), { keys[0], keys[1], keys[2] });
+                if (num_keys == 4) buffer.insert(buffer.end(), { keys[0], keys[2], keys[3] });
+            }
+        }
+    });
+
+    out_points.clear();
+    out_scalars.clear();
+    out_indices.clear();
+    for (size_t iso = 0; iso < num_isovalues; ++iso) {
+        std::vector<uint64_t> keys;
+        for (uint32_t w = 0; w < workers; ++w) {
+            std::vector<uint64_t> &buffer = buffers[(size_t) w * num_isovalues + iso];
+            keys.insert(keys.end(), buffer.begin(), buffer.end());
+            std::vector<uint64_t>().swap(buffer);
+        }
+        if (keys.empty()) continue;
+
+        /* Vertex storage has to exist before the vertices are emitted, so size it for the worst case */
+        uint64_t vertex_base = out_points.size() / 3;
+        out_points.resize((vertex_base + keys.size()) * 3);
+        double value = isovalues[iso];
+        std::vector<uint32_t> triangles;
+        std::vector<uint64_t> new_index;
+        uint64_t num_vertices = weld_section_corners(keys, vertex_base, triangles, new_index, [&](uint64_t vertex, uint32_t a, uint32_t b) {
+            /* Interpolate from the lower numbered point, so the position does not depend on the tetrahedron */
+            double f = (a == b || scalars[b] == scalars[a]) ? 0.0 : (value - scalars[a]) / ((double) scalars[b] - scalars[a]);
+            for (int c = 0; c < 3; ++c)
+                out_points[vertex * 3 + c] = (T) (points[(size_t) a * 3 + c] + f * ((double) points[(size_t) b * 3 + c] - points[(size_t) a * 3 + c]));
+        });
+        out_points.resize((vertex_base + num_vertices) * 3);
+        out_scalars.resize(vertex_base + num_vertices, (T) value);
+        out_indices.insert(out_indices.end(), triangles.begin(), triangles.end());
+    }
+}
+
+template <typename T>
+void extract_isosurfaces(const std::vector<T> &points, const std::vector<T> &scalars, const std::vector<uint32_t> &indices, uint32_t points_per_primitive,
+                         const std::vector<double> &isovalues, std::vector<T> &out_points, std::vector<T> &out_scalars, std::vector<uint32_t> &out_indices)
+{
+    if (scalars.size() != points.size() / 3)
+        throw std::runtime_error( std::string("Isosurfaces need one scalar per point"));
+    extract_isosurfaces(points.data(), scalars.data(), indices.data(), indices.size() / points_per_primitive, points_per_primitive,
+                        isovalues, out_points, out_scalars, out_indices);
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Scalar range index                                              |
+// └──────────────────────────────────────────────────────────────────┘
+
+const uint32_t SECTION_INTERVALS = binary_section_tag('I', 'V', 'A', 'L');
+
+/* Tetrahedra are summarized in blocks of this many consecutive tetrahedra, which
+   are spatially coherent once the mesh is sorted along a curve */
+const uint32_t INTERVAL_BLOCK_SIZE = 256;
+
+/* Node of a centered interval tree. The blocks whose range contains center are
+   stored at by_min[first, first + count) by increasing minimum and at
+   by_max[first, first + count) by decreasing maximum. Missing children are NO_CHILD. */
+struct IntervalNode {
+    double center;
+    uint32_t left;
+    uint32_t right;
+    uint32_t first;
+    uint32_t count;
+
+    static const uint32_t NO_CHILD = 0xFFFFFFFFu;
+};
+
+/* Scalar ranges of blocks of tetrahedra, with an interval tree over them. Block b
+   covers the values block_ranges[2b] up to block_ranges[2b + 1]. */
+struct IntervalIndex {
+    uint32_t block_size = INTERVAL_BLOCK_SIZE;
+    uint64_t num_tetrahedra = 0;
+    std::vector<double> block_ranges;
+    std::vector<IntervalNode> nodes;
+    std::vector<uint32_t> by_min;
+    std::vector<uint32_t> by_max;
+};
+
+/* Range of scalars over a tetrahedron */
+template <typename T>
+inline void tet_scalar_range(const T *scalars, const uint32_t *tet, size_t t, bool data_is_per_cell, double &lo, double &hi)
+{
+    if (data_is_per_cell) {
+        lo = hi = scalars[t];
+        return;
+    }
+    lo = std::min(std::min((double) scalars[tet[0]], (double) scalars[tet[1]]), std::min((double) scalars[tet[2]], (double) scalars[tet[3]]));
+    hi = std::max(std::max((double) scalars[tet[0]], (double) scalars[tet[1]]), std::max((double) scalars[tet[2]], (double) scalars[tet[3]]));
+}
+
+/* Builds the interval tree over the blocks listed in blocks and returns its root */
+inline uint32_t build_interval_node(IntervalIndex &index, std::vector<uint32_t> &blocks)
+{
+    if (blocks.empty()) return IntervalNode::NO_CHILD;
+
+    /* Split at the median midpoint */
+    std::vector<double> midpoints(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i) midpoints[i] = 0.5 * (index.block_ranges[blocks[i] * 2] + index.block_ranges[blocks[i] * 2 + 1]);
+    std::nth_element(midpoints.begin(), midpoints.begin() + midpoints.size() / 2, midpoints.end());
+    double center = midpoints[midpoints.size() / 2];
+
+    std::vector<uint32_t> left, right, here;
+    for (uint32_t b : blocks) {
+        if (index.block_ranges[b * 2 + 1] < center) left.push_back(b);
+        else if (index.block_ranges[b * 2] > center) right.push_back(b);
+        else here.push_back(b);
+    }
+    std::vector<uint32_t>().swap(blocks);
+
+    uint32_t node_index = (uint32_t) index.nodes.size();
+    index.nodes.push_back({ center, IntervalNode::NO_CHILD, IntervalNode::NO_CHILD, (uint32_t) index.by_min.size(), (uint32_t) here.size() });
+    std::sort(here.begin(), here.end(), [&](uint32_t a, uint32_t b) { return index.block_ranges[a * 2] < index.block_ranges[b * 2]; });
+    index.by_min.insert(index.by_min.end(), here.begin(), here.end());
+    std::sort(here.begin(), here.end(), [&](uint32_t a, uint32_t b) { return index.block_ranges[a * 2 + 1] > index.block_ranges[b * 2 + 1]; });
+    index.by_max.insert(index.by_max.end(), here.begin(), here.end());
+
+    uint32_t left_child = build_interval_node(index, left);
+    uint32_t right_child = build_interval_node(index, right);
+    index.nodes[node_index].left = left_child;
+    index.nodes[node_index].right = right_child;
+    return node_index;
+}
+
+/* Summarizes the scalar ranges of blocks of tetrahedra and builds an interval tree over them */
+template <typename T>
+IntervalIndex build_interval_index(const T *scalars, const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive, bool data_is_per_cell,
+                                   uint32_t block_size = INTERVAL_BLOCK_SIZE)
+{
+    IntervalIndex index;
+    index.block_size = std::max<uint32_t>(block_size, 1);
+    index.num_tetrahedra = num_tetrahedra;
+    size_t num_blocks = (num_tetrahedra + index.block_size - 1) / index.block_size;
+    index.block_ranges.resize(num_blocks * 2);
+    parallel_for(num_blocks, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t b = begin; b < end; ++b) {
+            double block_lo = std::numeric_limits<double>::max(), block_hi = std::numeric_limits<double>::lowest();
+            for (size_t t = b * index.block_size; t < std::min(num_tetrahedra, (b + 1) * index.block_size); ++t) {
+                double lo, hi;
+                tet_scalar_range(scalars, &indices[t * points_per_primitive], t, data_is_per_cell, lo, hi);
+                block_lo = std::min(block_lo, lo);
+                block_hi = std::max(block_hi, hi);
+            }
+            index.block_ranges[b * 2] = block_lo;
+            index.block_ranges[b * 2 + 1] = block_hi;
+        }
+    }, 64);
+
+    std::vector<uint32_t> blocks(num_blocks);
+    for (size_t b = 0; b < num_blocks; ++b) blocks[b] = (uint32_t) b;
+    build_interval_node(index, blocks);
+    return index;
+}
+
+template <typename T>
+IntervalIndex build_interval_index(const std::vector<T> &scalars, const std::vector<uint32_t> &indices, uint32_t points_per_primitive, bool data_is_per_cell,
+                                   uint32_t block_size = INTERVAL_BLOCK_SIZE)
+{
+    return build_interval_index(scalars.data(), indices.data(), indices.size() / points_per_primitive, points_per_primitive, data_is_per_cell, block_size);
+}
+
+/* Finds the blocks whose scalar range overlaps [lo, hi], in increasing order.
+   An isovalue query is lo == hi. */
+inline void query_interval_index(const IntervalIndex &index, double lo, double hi, std::vector<uint32_t> &blocks)
+{
+    blocks.clear();
+    if (index.nodes.empty()) return;
+    std::vector<uint32_t> stack(1, 0);
+    while (!stack.empty()) {
+        const IntervalNode &node = index.nodes[stack.back()];
+        stack.pop_back();
+        const uint32_t *by_min = &index.by_min[node.first], *by_max = &index.by_max[node.first];
+        if (hi < node.center) {
+            /* Every block here reaches past hi, so only the minimum decides */
+            for (uint32_t i = 0; i < node.count && index.block_ranges[by_min[i] * 2] <= hi; ++i) blocks.push_back(by_min[i]);
+            if (node.left != IntervalNode::NO_CHILD) stack.push_back(node.left);
+        } else if (lo > node.center) {
+            for (uint32_t i = 0; i < node.count && index.block_ranges[by_max[i] * 2 + 1] >= lo; ++i) blocks.push_back(by_max[i]);
+            if (node.right != IntervalNode::NO_CHILD) stack.push_back(node.right);
+        } else {
+            blocks.insert(blocks.end(), by_min, by_min + node.count);
+            if (node.left != IntervalNode::NO_CHILD) stack.push_back(node.left);
+            if (node.right != IntervalNode::NO_CHILD) stack.push_back(node.right);
+        }
+    }
+    std::sort(blocks.begin(), blocks.end());
+}
+
+/* Finds the tetrahedra whose scalar range overlaps [lo, hi], in increasing order,
+   testing only the tetrahedra of the blocks the index returns */
+template <typename T>
+void find_active_tets(const IntervalIndex &index, const T *scalars, const uint32_t *indices, uint32_t points_per_primitive, bool data_is_per_cell,
+                      double lo, double hi, std::vector<uint32_t> &tets)
+{
+    std::vector<uint32_t> blocks;
+    query_interval_index(index, lo, hi, blocks);
+
+    uint32_t workers = parallel_for_workers(blocks.size(), 16);
+    std::vector<std::vector<uint32_t>> found(workers);
+    parallel_for(blocks.size(), [&](size_t begin, size_t end, uint32_t worker) {
+        for (size_t i = begin; i < end; ++i) {
+            uint64_t first = (uint64_t) blocks[i] * index.block_size;
+            uint64_t last = std::min(index.num_tetrahedra, first + index.block_size);
+            for (uint64_t t = first; t < last; ++t) {
+                double tet_lo, tet_hi;
+                tet_scalar_range(scalars, &indices[t * points_per_primitive], t, data_is_per_cell, tet_lo, tet_hi);
+                if (tet_lo <= hi && tet_hi >= lo) found[worker].push_back((uint32_t) t);
+            }
+        }
+    }, 16);
+
+    /* Workers cover increasing runs of blocks, so concatenating keeps the order */
+    tets.clear();
+    for (auto &f : found) tets.insert(tets.end(), f.begin(), f.end());
+}
+
+template <typename T>
+void find_active_tets(const IntervalIndex &index, const std::vector<T> &scalars, const std::vector<uint32_t> &indices, uint32_t points_per_primitive,
+                      bool data_is_per_cell, double lo, double hi, std::vector<uint32_t> &tets)
+{
+    find_active_tets(index, scalars.data(), indices.data(), points_per_primitive, data_is_per_cell, lo, hi, tets);
+}
+
+/* Serializes an interval index as block size, tetrahedron count and counts,
+   followed by the block ranges, nodes and both block orders */
+inline std::vector<char> serialize_interval_index(const IntervalIndex &index)
+{
+    uint64_t counts[4] = { index.block_size, index.num_tetrahedra, index.block_ranges.size() / 2, index.nodes.size() };
+    std::vector<char> data(sizeof(counts) + counts[2] * 2 * sizeof(double) + counts[3] * sizeof(IntervalNode) + index.by_min.size() * 2 * sizeof(uint32_t));
+    char *out = data.data();
+    auto append = [&](const void *values, size_t bytes) {
+        std::memcpy(out, values, bytes);
+        out += bytes;
+    };
+    append(counts, sizeof(counts));
+    append(index.block_ranges.data(), index.block_ranges.size() * sizeof(double));
+    append(index.nodes.data(), index.nodes.size() * sizeof(IntervalNode));
+    append(index.by_min.data(), index.by_min.size() * sizeof(uint32_t));
+    append(index.by_max.data(), index.by_max.size() * sizeof(uint32_t));
+    return data;
+}
+
+/* Checks that an interval index is laid out as the builder lays it out: blocks
+   covering the tetrahedra, children after their parent, every node reached once
+   from the root and every block stored in exactly one node. Throws if not. */
+inline void validate_interval_index(const IntervalIndex &index)
+{
+    if (index.block_size == 0)
+        throw std::runtime_error( std::string("Interval index is corrupt: zero block size"));
+    uint64_t num_blocks = index.block_ranges.size() / 2;
+    if (num_blocks != (index.num_tetrahedra + index.block_size - 1) / index.block_size || index.by_min.size() != num_blocks || index.by_max.size() != num_blocks)
+        throw std::runtime_error( std::string("Interval index is corrupt: blocks do not cover the tetrahedra"));
+    for (uint64_t i = 0; i < num_blocks; ++i)
+        if (index.by_min[i] >= num_blocks || index.by_max[i] >= num_blocks)
+            throw std::runtime_error( std::string("Interval index is corrupt: bad block"));
+    if (index.nodes.empty()) {
+        if (num_blocks != 0)
+            throw std::runtime_error( std::string("Interval index is corrupt: blocks without nodes"));
+        return;
+    }
+
+    /* Children come after their parent, so walking from the root cannot cycle */
+    std::vector<uint8_t> reached(index.nodes.size(), 0);
+    std::vector<uint32_t> stack(1, 0);
+    uint64_t num_reached = 0, num_stored = 0;
+    while (!stack.empty()) {
+        uint32_t node_index = stack.back();
+        stack.pop_back();
+        if (reached[node_index])
+            throw std::runtime_error( std::string("Interval index is corrupt: node reached twice"));
+        reached[node_index] = 1;
+        num_reached++;
+        const IntervalNode &node = index.nodes[node_index];
+        if ((uint64_t) node.first + node.count > num_blocks)
+            throw std::runtime_error( std::string("Interval index is corrupt: bad node blocks"));
+        num_stored += node.count;
+        for (uint32_t child : { node.left, node.right }) {
+            if (child == IntervalNode::NO_CHILD) continue;
+            if (child <= node_index || child >= index.nodes.size())
+                throw std::runtime_error( std::string("Interval index is corrupt: bad child"));
+            stack.push_back(child);
+        }
+    }
+    if (num_reached != index.nodes.size() || num_stored != num_blocks)
+        throw std::runtime_error( std::string("Interval index is corrupt: unreachable nodes or blocks"));
+}
+
+/* Reads a serialized interval index, checking it with validate_interval_index */
+inline IntervalIndex deserialize_interval_index(const char *data, uint64_t size)
+{
+    IntervalIndex index;
+    uint64_t counts[4];
+    if (size < sizeof(counts))
+        throw std::runtime_error( std::string("Interval index data is truncated"));
+    std::memcpy(counts, data, sizeof(counts));
+    if (counts[0] > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error( std::string("Interval index is corrupt: bad block size"));
+    /* Every block is stored in exactly one node. Bound the counts first, so the size cannot overflow. */
+    const uint64_t block_bytes = 2 * sizeof(double) + 2 * sizeof(uint32_t);
+    if (counts[2] > size / block_bytes || counts[3] > size / sizeof(IntervalNode) ||
+        size != sizeof(counts) + counts[2] * block_bytes + counts[3] * sizeof(IntervalNode))
+        throw std::runtime_error( std::string("Interval index data is truncated"));
+
+    index.block_size = (uint32_t) counts[0];
+    index.num_tetrahedra = counts[1];
+    index.block_ranges.resize(counts[2] * 2);
+    index.nodes.resize(counts[3]);
+    index.by_min.resize(counts[2]);
+    index.by_max.resize(counts[2]);
+    const char *in = data + sizeof(counts);
+    auto extract = [&](void *values, size_t bytes) {
+        std::memcpy(values, in, bytes);
+        in += bytes;
+    };
+    extract(index.block_ranges.data(), index.block_ranges.size() * sizeof(double));
+    extract(index.nodes.data(), index.nodes.size() * sizeof(IntervalNode));
+    extract(index.by_min.data(), index.by_min.size() * sizeof(uint32_t));
+    extract(index.by_max.data(), index.by_max.size() * sizeof(uint32_t));
+    validate_interval_index(index);
+    return index;
+}
+
+/* Builds the interval index of a binary mesh and stores it in the file */
+inline void add_interval_index_to_binary(std::string binary_path, uint32_t block_size = INTERVAL_BLOCK_SIZE)
+{
+    BinaryHeader header = read_binary_header(binary_path);
+    IntervalIndex index;
+    auto build = [&](auto &points, auto &scalars) {
+        std::vector<uint32_t> indices;
+        bool data_is_per_cell;
+        read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        index = build_interval_index(scalars, indices, header.points_per_primitive, data_is_per_cell, block_size);
+    };
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        build(points, scalars);
+    } else {
+        std::vector<float> points, scalars;
+        build(points, scalars);
+    }
+    std::vector<char> data = serialize_interval_index(index);
+    write_binary_section(binary_path, SECTION_INTERVALS, data.data(), data.size());
+}
+
+/* Reads the interval index of a binary file. Returns false if there is none, and
+   throws if it is corrupt or was built for a different number of tetrahedra */
+inline bool read_interval_index_from_binary(std::string binary_path, IntervalIndex &index)
+{
+    std::vector<char> data;
+    if (!read_binary_section(binary_path, SECTION_INTERVALS, data)) return false;
+    index = deserialize_interval_index(data.data(), data.size());
+    BinaryHeader header = read_binary_header(binary_path);
+    if (index.num_tetrahedra != header.num_indices / header.points_per_primitive)
+        throw std::runtime_error( std::string("The interval index of " + binary_path + " does not match its tetrahedra, add it again"));
+    return true;
+}
+
+/* Extracts isosurfaces of a binary tetrahedral mesh into a binary triangle mesh
+   of the same precision. If the file has an interval index (see
+   add_interval_index_to_binary), only the tetrahedra it reports are visited. */
+inline void write_isosurfaces_as_binary(std::string binary_path, const std::vector<double> &isovalues, std::string surface_path)
+{
+    BinaryHeader header = read_binary_header(binary_path);
+    if (header.points_per_primitive != 4 && header.points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+    if (header.flags & BINARY_DATA_IS_PER_CELL)
+        throw std::runtime_error( std::string("Isosurfaces need point scalars, " + binary_path + " has cell scalars"));
+
+    auto extract = [&](auto &points, auto &scalars) {
+        std::vector<uint32_t> indices, surface_indices;
+        bool data_is_per_cell;
+        read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+
+        IntervalIndex index;
+        if (read_interval_index_from_binary(binary_path, index)) {
+            std::vector<uint32_t> active, tets;
+            for (double value : isovalues) {
+                find_active_tets(index, scalars, indices, header.points_per_primitive, false, value, value, tets);
+                active.insert(active.end(), tets.begin(), tets.end());
+            }
+            std::sort(active.begin(), active.end());
+            active.erase(std::unique(active.begin(), active.end()), active.end());
+
+            std::vector<uint32_t> active_indices(active.size() * header.points_per_primitive);
+            parallel_for(active.size(), [&](size_t begin, size_t end, uint32_t) {
+                for (size_t i = begin; i < end; ++i)
+                    std::copy_n(&indices[(size_t) active[i] * header.points_per_primitive], header.points_per_primitive, &active_indices[i * header.points_per_primitive]);
+            });
+            indices.swap(active_indices);
+        }
+
+        std::remove_reference_t<decltype(points)> surface_points, surface_scalars;
+        extract_isosurfaces(points, scalars, indices, header.points_per_primitive, isovalues, surface_points, surface_scalars, surface_indices);
+        write_to_binary(surface_points, surface_scalars, surface_indices, 3, false, surface_path);
+    };
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        extract(points, scalars);
+    } else {
+        std::vector<float> points, scalars;
+        extract(points, scalars);
+    }
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Element quality                                                 |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Per-tetrahedron quality, using the conventions of VTK's mesh quality filter.
+   aspect_ratio is the longest edge over 2 sqrt(6) times the inradius and
+   radius_ratio the circumradius over three times the inradius; both are 1 for
+   a regular tetrahedron and grow without bound as it degenerates. Dihedral
+   angles are in degrees. Shape metrics use the unsigned volume, and are
+   infinite for flat tetrahedra. */
+struct TetQuality {
+    double volume;
+    double aspect_ratio;
+    double radius_ratio;
+    double min_dihedral;
+    double max_dihedral;
+};
+
+enum QualityMetric {
+    QUALITY_VOLUME,
+    QUALITY_ASPECT_RATIO,
+    QUALITY_RADIUS_RATIO,
+    QUALITY_MIN_DIHEDRAL,
+    QUALITY_MAX_DIHEDRAL
+};
+
+/* How bad a tetrahedron is under a metric; larger is worse */
+inline double quality_badness(const TetQuality &quality, QualityMetric metric)
+{
+    switch (metric) {
+        case QUALITY_VOLUME: return -quality.volume;
+        case QUALITY_ASPECT_RATIO: return quality.aspect_ratio;
+        case QUALITY_RADIUS_RATIO: return quality.radius_ratio;
+        case QUALITY_MIN_DIHEDRAL: return -quality.min_dihedral;
+        case QUALITY_MAX_DIHEDRAL: return quality.max_dihedral;
+    }
+    return 0.0;
+}
+
+/* Number of tetrahedra evaluated together, in structure of arrays layout */
+const uint32_t QUALITY_BLOCK_SIZE = 8;
+
+/* A pack of doubles the quality kernel works on: four lanes with AVX, two with
+   SSE2, one otherwise. min and max follow std::min and std::max (NaN in b keeps a). */
+#if defined(TETRATOOLS_AVX)
+struct QualityPack {
+    static constexpr uint32_t WIDTH = 4;
+    __m256d v;
+    static QualityPack load(const double *p) { return { _mm256_loadu_pd(p) }; }
+    void store(double *p) const { _mm256_storeu_pd(p, v); }
+};
+inline QualityPack operator+(QualityPack a, QualityPack b) { return { _mm256_add_pd(a.v, b.v) }; }
+inline QualityPack operator-(QualityPack a, QualityPack b) { return { _mm256_sub_pd(a.v, b.v) }; }
+inline QualityPack operator*(QualityPack a, QualityPack b) { return { _mm256_mul_pd(a.v, b.v) }; }
+inline QualityPack operator/(QualityPack a, QualityPack b) { return { _mm256_div_pd(a.v, b.v) }; }
+inline QualityPack pack_of(double x) { return { _mm256_set1_pd(x) }; }
+inline QualityPack pack_sqrt(QualityPack a) { return { _mm256_sqrt_pd(a.v) }; }
+inline QualityPack pack_abs(QualityPack a) { return { _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v) }; }
+inline QualityPack pack_min(QualityPack a, QualityPack b) { return { _mm256_min_pd(b.v, a.v) }; }
+inline QualityPack pack_max(QualityPack a, QualityPack b) { return { _mm256_max_pd(b.v, a.v) }; }
+#elif defined(TETRATOOLS_SSE2)
+struct QualityPack {
+    static constexpr uint32_t WIDTH = 2;
+    __m128d v;
+    static QualityPack load(const double *p) { return { _mm_loadu_pd(p) }; }
+    void store(double *p) const { _mm_storeu_pd(p, v); }
+};
+inline QualityPack operator+(QualityPack a, QualityPack b) { return { _mm_add_pd(a.v, b.v) }; }
+inline QualityPack operator-(QualityPack a, QualityPack b) { return { _mm_sub_pd(a.v, b.v) }; }
+inline QualityPack operator*(QualityPack a, QualityPack b) { return { _mm_mul_pd(a.v, b.v) }; }
+inline QualityPack operator/(QualityPack a, QualityPack b) { return { _mm_div_pd(a.v, b.v) }; }
+inline QualityPack pack_of(double x) { return { _mm_set1_pd(x) }; }
+inline QualityPack pack_sqrt(QualityPack a) { return { _mm_sqrt_pd(a.v) }; }
+inline QualityPack pack_abs(QualityPack a) { return { _mm_andnot_pd(_mm_set1_pd(-0.0), a.v) }; }
+inline QualityPack pack_min(QualityPack a, QualityPack b) { return { _mm_min_pd(b.v, a.v) }; }
+inline QualityPack pack_max(QualityPack a, QualityPack b) { return { _mm_max_pd(b.v, a.v) }; }
+#else
+struct QualityPack {
+    static constexpr uint32_t WIDTH = 1;
+    double v;
+    static QualityPack load(const double *p) { return { *p }; }
+    void store(double *p) const { *p = v; }
+};
+inline QualityPack operator+(QualityPack a, QualityPack b) { return { a.v + b.v }; }
+inline QualityPack operator-(QualityPack a, QualityPack b) { return { a.v - b.v }; }
+inline QualityPack operator*(QualityPack a, QualityPack b) { return { a.v * b.v }; }
+inline QualityPack operator/(QualityPack a, QualityPack b) { return { a.v / b.v }; }
+inline QualityPack pack_of(double x) { return { x }; }
+inline QualityPack pack_sqrt(QualityPack a) { return { std::sqrt(a.v) }; }
+inline QualityPack pack_abs(QualityPack a) { return { std::fabs(a.v) }; }
+inline QualityPack pack_min(QualityPack a, QualityPack b) { return { std::min(a.v, b.v) }; }
+inline QualityPack pack_max(QualityPack a, QualityPack b) { return { std::max(a.v, b.v) }; }
+#endif
+
+/* Evaluates the quality of tetrahedra [first, first + count), count <= QUALITY_BLOCK_SIZE.
+   The corners are gathered into structure of arrays layout, and the metrics are
+   straight line code over QualityPack, so each instruction covers several tetrahedra. */
+template <typename T>
+void tet_quality_block(const T *points, const uint32_t *indices, uint32_t points_per_primitive, size_t first, uint32_t count, TetQuality *quality)
+{
+    typedef QualityPack P;
+    const uint32_t N = QUALITY_BLOCK_SIZE;
+    /* Edges from corner 0 to corners 1, 2 and 3, and the opposite edges 1-2, 2-3, 3-1 */
+    alignas(32) double e[6][3][N];
+    for (uint32_t lane = 0; lane < N; ++lane) {
+        size_t t = first + std::min(lane, count - 1);
+        const uint32_t *tet = &indices[t * points_per_primitive];
+        double p[4][3];
+        for (int c = 0; c < 4; ++c)
+            for (int a = 0; a < 3; ++a) p[c][a] = points[(size_t) tet[c] * 3 + a];
+        for (int a = 0; a < 3; ++a) {
+            e[0][a][lane] = p[1][a] - p[0][a];
+            e[1][a][lane] = p[2][a] - p[0][a];
+            e[2][a][lane] = p[3][a] - p[0][a];
+            e[3][a][lane] = p[2][a] - p[1][a];
+            e[4][a][lane] = p[3][a] - p[2][a];
+            e[5][a][lane] = p[1][a] - p[3][a];
+        }
+    }
+
+    alignas(32) double volume[N], aspect[N], radius[N], cos_min_dihedral[N], cos_max_dihedral[N];
+    for (uint32_t lane = 0; lane < N; lane += P::WIDTH) {
+        P e0x = P::load(&e[0][0][lane]), e0y = P::load(&e[0][1][lane]), e0z = P::load(&e[0][2][lane]);
+        P e1x = P::load(&e[1][0][lane]), e1y = P::load(&e[1][1][lane]), e1z = P::load(&e[1][2][lane]);
+        P e2x = P::load(&e[2][0][lane]), e2y = P::load(&e[2][1][lane]), e2z = P::load(&e[2][2][lane]);
+        P e3x = P::load(&e[3][0][lane]), e3y = P::load(&e[3][1][lane]), e3z = P::load(&e[3][2][lane]);
+        P e4x = P::load(&e[4][0][lane]), e4y = P::load(&e[4][1][lane]), e4z = P::load(&e[4][2][lane]);
+        P e5x = P::load(&e[5][0][lane]), e5y = P::load(&e[5][1][lane]), e5z = P::load(&e[5][2][lane]);
+
+        /* bc = e1 x e2, cd = e2 x e0, db = e0 x e1 */
+        P bcx = e1y * e2z - e1z * e2y, bcy = e1z * e2x - e1x * e2z, bcz = e1x * e2y - e1y * e2x;
+        P cdx = e2y * e0z - e2z * e0y, cdy = e2z * e0x - e2x * e0z, cdz = e2x * e0y - e2y * e0x;
+        P dbx = e0y * e1z - e0z * e1y, dby = e0z * e1x - e0x * e1z, dbz = e0x * e1y - e0y * e1x;
+        P volume6 = e0x * bcx + e0y * bcy + e0z * bcz;
+
+        /* Outward (for positive volume) face normals, with twice the face area as length.
+           Normals 1 to 3 are -bc, -cd and -db; the signs cancel in the products below. */
+        P n0x = bcx + cdx + dbx, n0y = bcy + cdy + dby, n0z = bcz + cdz + dbz;
+        P length0 = pack_sqrt(n0x * n0x + n0y * n0y + n0z * n0z);
+        P length1 = pack_sqrt(bcx * bcx + bcy * bcy + bcz * bcz);
+        P length2 = pack_sqrt(cdx * cdx + cdy * cdy + cdz * cdz);
+        P length3 = pack_sqrt(dbx * dbx + dby * dby + dbz * dbz);
+        P area2 = length0 + length1 + length2 + length3;
+
+        P squared0 = e0x * e0x + e0y * e0y + e0z * e0z;
+        P squared1 = e1x * e1x + e1y * e1y + e1z * e1z;
+        P squared2 = e2x * e2x + e2y * e2y + e2z * e2z;
+        P squared3 = e3x * e3x + e3y * e3y + e3z * e3z;
+        P squared4 = e4x * e4x + e4y * e4y + e4z * e4z;
+        P squared5 = e5x * e5x + e5y * e5y + e5z * e5z;
+        P longest2 = pack_max(pack_max(pack_max(squared0, squared1), pack_max(squared2, squared3)), pack_max(squared4, squared5));
+
+        /* Circumcenter relative to corner 0, times 2 volume6 */
+        P centerx = squared0 * bcx + squared1 * cdx + squared2 * dbx;
+        P centery = squared0 * bcy + squared1 * cdy + squared2 * dby;
+        P centerz = squared0 * bcz + squared1 * cdz + squared2 * dbz;
+        P center_length = pack_sqrt(centerx * centerx + centery * centery + centerz * centerz);
+
+        P abs_volume6 = pack_abs(volume6);
+        P inradius = abs_volume6 / area2;
+        P circumradius = center_length / (pack_of(2.0) * abs_volume6);
+        (volume6 / pack_of(6.0)).store(&volume[lane]);
+        (pack_sqrt(longest2) / (pack_of(2.0 * std::sqrt(6.0)) * inradius)).store(&aspect[lane]);
+        (circumradius / (pack_of(3.0) * inradius)).store(&radius[lane]);
+
+        /* The dihedral angle between faces f and g is 180 degrees minus the angle of their
+           normals. Flipping all normals of an inverted tetrahedron does not change it. */
+        P c01 = (n0x * bcx + n0y * bcy + n0z * bcz) / (length0 * length1);
+        P c02 = (n0x * cdx + n0y * cdy + n0z * cdz) / (length0 * length2);
+        P c03 = (n0x * dbx + n0y * dby + n0z * dbz) / (length0 * length3);
+        P c12 = pack_of(0.0) - (bcx * cdx + bcy * cdy + bcz * cdz) / (length1 * length2);
+        P c13 = pack_of(0.0) - (bcx * dbx + bcy * dby + bcz * dbz) / (length1 * length3);
+        P c23 = pack_of(0.0) - (cdx * dbx + cdy * dby + cdz * dbz) / (length2 * length3);
+        pack_max(pack_max(pack_max(pack_max(pack_max(pack_max(pack_of(-1.0), c01), c02), c03), c12), c13), c23).store(&cos_min_dihedral[lane]);
+        pack_min(pack_min(pack_min(pack_min(pack_min(pack_min(pack_of(1.0), c01), c02), c03), c12), c13), c23).store(&cos_max_dihedral[lane]);
+    }
+
+    const double DEGREES = 180.0 / 3.14159265358979323846;
+    for (uint32_t lane = 0; lane < count; ++lane) {
+        TetQuality &q = quality[lane];
+        q.volume = volume[lane];
+        bool flat = volume[lane] == 0.0 || !std::isfinite(aspect[lane]);
+        q.aspect_ratio = flat ? std::numeric_limits<double>::infinity() : aspect[lane];
+        q.radius_ratio = flat ? std::numeric_limits<double>::infinity() : radius[lane];
+        q.min_dihedral = flat ? 0.0 : std::acos(std::max(-1.0, std::min(1.0, cos_min_dihedral[lane]))) * DEGREES;
+        q.max_dihedral = flat ? 180.0 : std::acos(std::max(-1.0, std::min(1.0, cos_max_dihedral[lane]))) * DEGREES;
+    }
+}
+
+/* Evaluates the quality of every tetrahedron */
+template <typename T>
+std::vector<TetQuality> compute_tet_quality(const std::vector<T> &points, const std::vector<uint32_t> &indices, uint32_t points_per_primitive)
+{
+    size_t num_tetrahedra = indices.size() / points_per_primitive;
+    std::vector<TetQuality> quality(num_tetrahedra);
+    parallel_for((num_tetrahedra + QUALITY_BLOCK_SIZE - 1) / QUALITY_BLOCK_SIZE, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t b = begin; b < end; ++b) {
+            size_t first = b * QUALITY_BLOCK_SIZE;
+            uint32_t count = (uint32_t) std::min<size_t>(QUALITY_BLOCK_SIZE, num_tetrahedra - first);
+            tet_quality_block(points.data(), indices.data(), points_per_primitive, first, count, &quality[first]);
+        }
+    }, 512);
+    return quality;
+}
+
+/* Fixed range histogram. Values outside [lower, upper) land in the first or last bin. */
+struct QualityHistogram {
+    double lower;
+    double upper;
+    std::vector<uint64_t> counts;
+
+    void add(double value)
+    {
+        double f = (value - lower) / (upper - lower) * counts.size();
+        size_t bin = (f <= 0.0) ? 0 : (f >= (double) counts.size()) ? counts.size() - 1 : (size_t) f;
+        counts[bin]++;
+    }
+};
+
+const uint32_t QUALITY_HISTOGRAM_BINS = 20;
+
+struct QualityReport {
+    uint64_t num_tetrahedra = 0;
+    uint64_t inverted = 0;
+    uint64_t flat = 0;
+    double min_volume = std::numeric_limits<double>::max();
+    double max_volume = std::numeric_limits<double>::lowest();
+    double total_volume = 0.0;
+    QualityHistogram aspect_ratio = { 1.0, 5.0, std::vector<uint64_t>(QUALITY_HISTOGRAM_BINS) };
+    QualityHistogram radius_ratio = { 1.0, 5.0, std::vector<uint64_t>(QUALITY_HISTOGRAM_BINS) };
+    QualityHistogram min_dihedral = { 0.0, 90.0, std::vector<uint64_t>(QUALITY_HISTOGRAM_BINS) };
+    QualityHistogram max_dihedral = { 60.0, 180.0, std::vector<uint64_t>(QUALITY_HISTOGRAM_BINS) };
+    /* The worst tetrahedra under the chosen metric, worst first, with their values */
+    std::vector<uint32_t> worst_tets;
+    std::vector<double> worst_values;
+
+    void add(const TetQuality &q)
+    {
+        num_tetrahedra++;
+        if (q.volume < 0.0) inverted++;
+        if (q.volume == 0.0) flat++;
+        min_volume = std::min(min_volume, q.volume);
+        max_volume = std::max(max_volume, q.volume);
+        total_volume += q.volume;
+        aspect_ratio.add(q.aspect_ratio);
+        radius_ratio.add(q.radius_ratio);
+        min_dihedral.add(q.min_dihedral);
+        max_dihedral.add(q.max_dihedral);
+    }
+
+    void merge(const QualityReport &other)
+    {
+        num_tetrahedra += other.num_tetrahedra;
+        inverted += other.inverted;
+        flat += other.flat;
+        min_volume = std::min(min_volume, other.min_volume);
+        max_volume = std::max(max_volume, other.max_volume);
+        total_volume += other.total_volume;
+        for (uint32_t b = 0; b < QUALITY_HISTOGRAM_BINS; ++b) {
+            aspect_ratio.counts[b] += other.aspect_ratio.counts[b];
+            radius_ratio.counts[b] += other.radius_ratio.counts[b];
+            min_dihedral.counts[b] += other.min_dihedral.counts[b];
+            max_dihedral.counts[b] += other.max_dihedral.counts[b];
+        }
+    }
+};
+
+/* Measures the quality of every tetrahedron, reducing per thread into histograms
+   and lists of the num_worst worst tetrahedra under worst_by */
+template <typename T>
+QualityReport measure_quality(const T *points, const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive,
+                              QualityMetric worst_by = QUALITY_RADIUS_RATIO, uint32_t num_worst = 10)
+{
+    size_t num_blocks = (num_tetrahedra + QUALITY_BLOCK_SIZE - 1) / QUALITY_BLOCK_SIZE;
+    uint32_t workers = parallel_for_workers(num_blocks, 512);
+    std::vector<QualityReport> reports(workers);
+    /* Min heaps on badness, so the least bad of the worst is on top */
+    typedef std::pair<double, uint32_t> Ranked;
+    std::vector<std::vector<Ranked>> worst(workers);
+
+    parallel_for(num_blocks, [&](size_t begin, size_t end, uint32_t worker) {
+        TetQuality quality[QUALITY_BLOCK_SIZE];
+        QualityReport &report = reports[worker];
+        std::vector<Ranked> &heap = worst[worker];
+        for (size_t b = begin; b < end; ++b) {
+            size_t first = b * QUALITY_BLOCK_SIZE;
+            uint32_t count = (uint32_t) std::min<size_t>(QUALITY_BLOCK_SIZE, num_tetrahedra - first);
+            tet_quality_block(points, indices, points_per_primitive, first, count, quality);
+            for (uint32_t lane = 0; lane < count; ++lane) {
+                report.add(quality[lane]);
+                if (num_worst == 0) continue;
+                Ranked ranked(quality_badness(quality[lane], worst_by), (uint32_t) (first + lane));
+                if (heap.size() < num_worst) {
+                    heap.push_back(ranked);
+                    std::push_heap(heap.begin(), heap.end(), std::greater<Ranked>());
+                } else if (ranked.first > heap.front().first) {
+                    std::pop_heap(heap.begin(), heap.end(), std::greater<Ranked>());
+                    heap.back() = ranked;
+                    std::push_heap(heap.begin(), heap.end(), std::greater<Ranked>());
+                }
+            }
+        }
+    }, 512);
+
+    QualityReport report;
+    std::vector<Ranked> all;
+    for (uint32_t w = 0; w < workers; ++w) {
+        report.merge(reports[w]);
+        all.insert(all.end(), worst[w].begin(), worst[w].end());
+    }
+    /* Worst first, ties broken by lower index */
+    std::sort(all.begin(), all.end(), [](const Ranked &a, const Ranked &b) { return a.first > b.first || (a.first == b.first && a.second < b.second); });
+    all.resize(std::min<size_t>(all.size(), num_worst));
+    for (const Ranked &ranked : all) {
+        report.worst_tets.push_back(ranked.second);
+        bool negated = worst_by == QUALITY_VOLUME || worst_by == QUALITY_MIN_DIHEDRAL;
+        report.worst_values.push_back(negated ? -ranked.first : ranked.first);
+    }
+    return report;
+}
+
+template <typename T>
+QualityReport measure_quality(const std::vector<T> &points, const std::vector<uint32_t> &indices, uint32_t points_per_primitive,
+                              QualityMetric worst_by = QUALITY_RADIUS_RATIO, uint32_t num_worst = 10)
+{
+    return measure_quality(points.data(), indices.data(), indices.size() / points_per_primitive, points_per_primitive, worst_by, num_worst);
+}
+
+template <typename T>
+QualityReport measure_quality(const TNode<T> &node, const TEle<T> &ele, QualityMetric worst_by = QUALITY_RADIUS_RATIO, uint32_t num_worst = 10)
+{
+    return measure_quality(node.points, ele.nodes, ele.nodes_per_tetrahedron, worst_by, num_worst);
+}
+
+/* Measures the quality of a binary tetrahedral mesh */
+inline QualityReport measure_binary_quality(std::string binary_path, QualityMetric worst_by = QUALITY_RADIUS_RATIO, uint32_t num_worst = 10)
+{
+    BinaryHeader header = read_binary_header(binary_path);
+    if (header.points_per_primitive != 4 && header.points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+
+    QualityReport report;
+    auto measure = [&](auto &points, auto &scalars) {
+        std::vector<uint32_t> indices;
+        bool data_is_per_cell;
+        read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        report = measure_quality(points, indices, header.points_per_primitive, worst_by, num_worst);
+    };
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        measure(points, scalars);
+    } else {
+        std::vector<float> points, scalars;
+        measure(points, scalars);
+    }
+    return report;
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Orientation                                                     |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Expansion arithmetic after Shewchuk, "Adaptive Precision Floating-Point
+   Arithmetic and Fast Robust Geometric Predicates". An expansion is a sum of
+   non-overlapping doubles, stored in increasing order of magnitude. */
+typedef std::vector<double> Expansion;
+
+inline void two_sum(double a, double b, double &x, double &y)
+{
+    x = a + b;
+    double b_virtual = x - a;
+    double a_virtual = x - b_virtual;
+    y = (a - a_virtual) + (b - b_virtual);
+}
+
+inline void fast_two_sum(double a, double b, double &x, double &y)
+{
+    x = a + b;
+    y = b - (x - a);
+}
+
+inline void two_diff(double a, double b, double &x, double &y)
+{
+    x = a - b;
+    double b_virtual = a - x;
+    double a_virtual = x + b_virtual;
+    y = (a - a_virtual) + (b_virtual - b);
+}
+
+inline void two_product(double a, double b, double &x, double &y)
+{
+    x = a * b;
+    y = std::fma(a, b, -x);
+}
+
+inline Expansion grow_expansion(const Expansion &e, double b)
+{
+    Expansion h;
+    double q = b;
+    for (double component : e) {
+        double sum, error;
+        two_sum(q, component, sum, error);
+        q = sum;
+        if (error != 0.0) h.push_back(error);
+    }
+    if (q != 0.0 || h.empty()) h.push_back(q);
+    return h;
+}
+
+inline Expansion expansion_sum(const Expansion &e, const Expansion &f)
+{
+    Expansion h = e;
+    for (double component : f) h = grow_expansion(h, component);
+    return h;
+}
+
+inline Expansion scale_expansion(const Expansion &e, double b)
+{
+    Expansion h;
+    double q, error;
+    two_product(e[0], b, q, error);
+    if (error != 0.0) h.push_back(error);
+    for (size_t i = 1; i < e.size(); ++i) {
+        double product, product_error, sum;
+        two_product(e[i], b, product, product_error);
+        two_sum(q, product_error, sum, error);
+        if (error != 0.0) h.push_back(error);
+        fast_two_sum(product, sum, q, error);
+        if (error != 0.0) h.push_back(error);
+    }
+    if (q != 0.0 || h.empty()) h.push_back(q);
+    return h;
+}
+
+inline Expansion expansion_product(const Expansion &e, const Expansion &f)
+{
+    Expansion h(1, 0.0);
+    for (double component : f) h = expansion_sum(h, scale_expansion(e, component));
+    return h;
+}
+
+inline Expansion expansion_difference(const Expansion &e, const Expansion &f)
+{
+    Expansion negated = f;
+    for (double &component : negated) component = -component;
+    return expansion_sum(e, negated);
+}
+
+/* Sign of the most significant component */
+inline int expansion_sign(const Expansion &e)
+{
+    for (size_t i = e.size(); i-- > 0;)
+        if (e[i] != 0.0) return (e[i] > 0.0) ? 1 : -1;
+    return 0;
+}
+
+/* Exact sign of tet_signed_volume6(a, b, c, d) */
+inline int orient3d_exact(const double a[3], const double b[3], const double c[3], const double d[3])
+{
+    Expansion u[3], v[3], w[3];
+    for (int i = 0; i < 3; ++i) {
+        double x, y;
+        two_diff(b[i], a[i], x, y);
+        u[i] = { y, x };
+        two_diff(c[i], a[i], x, y);
+        v[i] = { y, x };
+        two_diff(d[i], a[i], x, y);
+        w[i] = { y, x };
+    }
+    Expansion vw_x = expansion_difference(expansion_product(v[1], w[2]), expansion_product(v[2], w[1]));
+    Expansion vw_y = expansion_difference(expansion_product(v[2], w[0]), expansion_product(v[0], w[2]));
+    Expansion vw_z = expansion_difference(expansion_product(v[0], w[1]), expansion_product(v[1], w[0]));
+    Expansion det = expansion_sum(expansion_sum(expansion_product(u[0], vw_x), expansion_product(u[1], vw_y)), expansion_product(u[2], vw_z));
+    return expansion_sign(det);
+}
+
+/* Relative error bound of the floating point determinant (Shewchuk's o3derrboundA) */
+const double ORIENT3D_ERROR_BOUND = (7.0 + 56.0 * std::numeric_limits<double>::epsilon() / 2) * std::numeric_limits<double>::epsilon() / 2;
+
+/* Sign of tet_signed_volume6(a, b, c, d), exact. The floating point determinant is
+   used when its error bound proves the sign, and expansions only otherwise. */
+inline int orient3d(const double a[3], const double b[3], const double c[3], const double d[3])
+{
+    double u[3], v[3], w[3];
+    for (int i = 0; i < 3; ++i) {
+        u[i] = b[i] - a[i];
+        v[i] = c[i] - a[i];
+        w[i] = d[i] - a[i];
+    }
+    double det = u[0] * (v[1] * w[2] - v[2] * w[1]) + u[1] * (v[2] * w[0] - v[0] * w[2]) + u[2] * (v[0] * w[1] - v[1] * w[0]);
+    double permanent = std::fabs(u[0]) * (std::fabs(v[1] * w[2]) + std::fabs(v[2] * w[1]))
+                     + std::fabs(u[1]) * (std::fabs(v[2] * w[0]) + std::fabs(v[0] * w[2]))
+                     + std::fabs(u[2]) * (std::fabs(v[0] * w[1]) + std::fabs(v[1] * w[0]));
+    double bound = ORIENT3D_ERROR_BOUND * permanent;
+    if (det > bound) return 1;
+    if (det < -bound) return -1;
+    return orient3d_exact(a, b, c, d);
+}
+
+struct OrientationReport {
+    uint64_t num_tetrahedra = 0;
+    uint64_t flipped = 0;
+    uint64_t degenerate = 0;
+    /* Tetrahedra the floating point filter could not decide */
+    uint64_t exact_evaluations = 0;
+};
+
+/* Number of tetrahedra the orientation filter evaluates together, in lane loops the compiler vectorizes */
+const uint32_t ORIENTATION_BLOCK_SIZE = 8;
+
+/* Turns tetrahedron t inside out by swapping corners 2 and 3, along with the
+   edge nodes of quadratic tetrahedra (edges 1-2 and 1-3, 2-0 and 0-3) */
+inline void flip_tet(uint32_t *tet, uint32_t points_per_primitive)
+{
+    std::swap(tet[2], tet[3]);
+    if (points_per_primitive == 10) {
+        std::swap(tet[5], tet[8]);
+        std::swap(tet[6], tet[7]);
+    }
+}
+
+/* Makes every tetrahedron positively oriented (tet_signed_volume6 > 0), or
+   negatively if positive is false, flipping inverted ones in place. Degenerate
+   tetrahedra are counted and left as they are. */
+template <typename T>
+OrientationReport normalize_orientation(const T *points, uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive, bool positive = true)
+{
+    const uint32_t N = ORIENTATION_BLOCK_SIZE;
+    size_t num_blocks = (num_tetrahedra + N - 1) / N;
+    uint32_t workers = parallel_for_workers(num_blocks, 512);
+    std::vector<OrientationReport> reports(workers);
+    int wanted = positive ? 1 : -1;
+
+    parallel_for(num_blocks, [&](size_t begin, size_t end, uint32_t worker) {
+        OrientationReport &report = reports[worker];
+        double u[3][N], v[3][N], w[3][N], det[N], bound[N];
+        for (size_t b = begin; b < end; ++b) {
+            size_t first = b * N;
+            uint32_t count = (uint32_t) std::min<size_t>(N, num_tetrahedra - first);
+            for (uint32_t lane = 0; lane < N; ++lane) {
+                const uint32_t *tet = &indices[(first + std::min(lane, count - 1)) * points_per_primitive];
+                for (int i = 0; i < 3; ++i) {
+                    double a = points[(size_t) tet[0] * 3 + i];
+                    u[i][lane] = points[(size_t) tet[1] * 3 + i] - a;
+                    v[i][lane] = points[(size_t) tet[2] * 3 + i] - a;
+                    w[i][lane] = points[(size_t) tet[3] * 3 + i] - a;
+                }
+            }
+            for (uint32_t lane = 0; lane < N; ++lane) {
+                double x = v[1][lane] * w[2][lane], y = v[2][lane] * w[1][lane];
+                double z = v[2][lane] * w[0][lane], s = v[0][lane] * w[2][lane];
+                double p = v[0][lane] * w[1][lane], q = v[1][lane] * w[0][lane];
+                det[lane] = u[0][lane] * (x - y) + u[1][lane] * (z - s) + u[2][lane] * (p - q);
+                bound[lane] = ORIENT3D_ERROR_BOUND * (std::fabs(u[0][lane]) * (std::fabs(x) + std::fabs(y))
+                                                    + std::fabs(u[1][lane]) * (std::fabs(z) + std::fabs(s))
+                                                    + std::fabs(u[2][lane]) * (std::fabs(p) + std::fabs(q)));
+            }
+            for (uint32_t lane = 0; lane < count; ++lane) {
+                uint32_t *tet = &indices[(first + lane) * points_per_primitive];
+                int sign = (det[lane] > bound[lane]) ? 1 : (det[lane] < -bound[lane]) ? -1 : 0;
+                if (sign == 0) {
+                    report.exact_evaluations++;
+                    double p[4][3];
+                    for (int c = 0; c < 4; ++c)
+                        for (int i = 0; i < 3; ++i) p[c][i] = points[(size_t) tet[c] * 3 + i];
+                    sign = orient3d_exact(p[0], p[1], p[2], p[3]);
+                }
+                report.num_tetrahedra++;
+                if (sign == 0) report.degenerate++;
+                else if (sign != wanted) {
+                    flip_tet(tet, points_per_primitive);
+                    report.flipped++;
+                }
+            }
+        }
+    }, 512);
+
+    OrientationReport report;
+    for (const OrientationReport &r : reports) {
+        report.num_tetrahedra += r.num_tetrahedra;
+        report.flipped += r.flipped;
+        report.degenerate += r.degenerate;
+        report.exact_evaluations += r.exact_evaluations;
+    }
+    return report;
+}
+
+template <typename T>
+OrientationReport normalize_orientation(const std::vector<T> &points, std::vector<uint32_t> &indices, uint32_t points_per_primitive, bool positive = true)
+{
+    return normalize_orientation(points.data(), indices.data(), indices.size() / points_per_primitive, points_per_primitive, positive);
+}
+
+template <typename T>
+OrientationReport normalize_orientation(const TNode<T> &node, TEle<T> &ele, bool positive = true)
+{
+    return normalize_orientation(node.points, ele.nodes, ele.nodes_per_tetrahedron, positive);
+}
+
+/* Normalizes the orientation of a binary tetrahedral mesh, rewriting its indices
+   in place. If any tetrahedron is flipped, the sections that depend on the
+   order of corners (neighbours, tetrahedron edges and the compact topology)
+   are removed. */
+inline OrientationReport normalize_binary_orientation(std::string binary_path, bool positive = true)
+{
+    BinaryHeader header = read_binary_header(binary_path);
+    if (header.points_per_primitive != 4 && header.points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+
+    std::vector<uint32_t> indices;
+    OrientationReport report;
+    bool data_is_per_cell;
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        report = normalize_orientation(points, indices, header.points_per_primitive, positive);
+    } else {
+        std::vector<float> points, scalars;
+        read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        report = normalize_orientation(points, indices, header.points_per_primitive, positive);
+    }
+    if (report.flipped == 0) return report;
+
+    std::fstream file;
+    file.open(binary_path, std::ios::in | std::ios::out | std::ios::binary );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to open " + binary_path));
+
+    file.seekp(binary_core_size(header) - (uint64_t) header.num_indices * sizeof(uint32_t));
+    file.write((const char*) indices.data(), indices.size() * sizeof(uint32_t));
+    file.close();
+
+    remove_binary_section(binary_path, SECTION_NEIGHBORS);
+    remove_binary_section(binary_path, SECTION_TET_EDGES);
+    remove_binary_section(binary_path, SECTION_COMPACT_TOPOLOGY);
+    return report;
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Quadratic tetrahedra                                            |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Linear tetrahedra at the corners of a quadratic tetrahedron, as local node numbers */
+const uint32_t QUADRATIC_CORNER_TETS[4][4] = { { 0, 4, 6, 7 }, { 4, 1, 5, 8 }, { 6, 5, 2, 9 }, { 7, 8, 9, 3 } };
+
+/* The inner octahedron split around each of its three diagonals (4-9, 6-8 and 7-5).
+   All tetrahedra keep the orientation of their parent. */
+const uint32_t QUADRATIC_OCTAHEDRON_TETS[3][4][4] = {
+    { { 4, 9, 5, 6 }, { 4, 9, 6, 7 }, { 4, 9, 7, 8 }, { 4, 9, 8, 5 } },
+    { { 6, 8, 4, 5 }, { 6, 8, 5, 9 }, { 6, 8, 9, 7 }, { 6, 8, 7, 4 } },
+    { { 7, 5, 4, 6 }, { 7, 5, 6, 9 }, { 7, 5, 9, 8 }, { 7, 5, 8, 4 } }
+};
+
+/* Splits every quadratic tetrahedron into 8 linear ones, using its edge nodes.
+   The inner octahedron is split along its shortest diagonal (the first one on
+   ties); the faces it creates are interior, so neighbours always conform.
+   Tetrahedron t becomes linear tetrahedra 8t to 8t + 7. */
+template <typename T>
+std::vector<uint32_t> linearize_quadratic_tets(const T *points, const uint32_t *indices, size_t num_tetrahedra)
+{
+    std::vector<uint32_t> linear(num_tetrahedra * 8 * 4);
+    parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t t = begin; t < end; ++t) {
+            const uint32_t *tet = &indices[t * 10];
+            uint32_t *out = &linear[t * 32];
+
+            const uint32_t diagonals[3][2] = { { 4, 9 }, { 6, 8 }, { 7, 5 } };
+            uint32_t shortest = 0;
+            double shortest_length = std::numeric_limits<double>::max();
+            for (uint32_t d = 0; d < 3; ++d) {
+                double length = 0.0;
+                for (int a = 0; a < 3; ++a) {
+                    double delta = (double) points[(size_t) tet[diagonals[d][0]] * 3 + a] - points[(size_t) tet[diagonals[d][1]] * 3 + a];
+                    length += delta * delta;
+                }
+                if (length < shortest_length) {
+                    shortest_length = length;
+                    shortest = d;
+                }
+            }
+
+            for (int i = 0; i < 4; ++i)
+                for (int c = 0; c < 4; ++c) {
+                    out[i * 4 + c] = tet[QUADRATIC_CORNER_TETS[i][c]];
+                    out[16 + i * 4 + c] = tet[QUADRATIC_OCTAHEDRON_TETS[shortest][i][c]];
+                }
+        }
+    });
+    return linear;
+}
+
+/* Linearizes a quadratic mesh in place. Per-cell scalars are repeated for the 8 children. */
+template <typename T>
+void linearize_quadratic_mesh(const std::vector<T> &points, std::vector<T> &scalars, std::vector<uint32_t> &indices, bool data_is_per_cell)
+{
+    size_t num_tetrahedra = indices.size() / 10;
+    indices = linearize_quadratic_tets(points.data(), indices.data(), num_tetrahedra);
+    if (!data_is_per_cell) return;
+
+    std::vector<T> child_scalars(num_tetrahedra * 8);
+    parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t t = begin; t < end; ++t) std::fill_n(&child_scalars[t * 8], 8, scalars[t]);
+    });
+    scalars.swap(child_scalars);
+}
+
+/* Writes a linear copy of a binary mesh of quadratic tetrahedra */
+inline void linearize_binary(std::string input_path, std::string output_path)
+{
+    BinaryHeader header = read_binary_header(input_path);
+    if (header.points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 10"));
+
+    auto linearize = [&](auto &points, auto &scalars) {
+        std::vector<uint32_t> indices;
+        bool data_is_per_cell;
+        read_binary(input_path, points, scalars, indices, data_is_per_cell);
+        linearize_quadratic_mesh(points, scalars, indices, data_is_per_cell);
+        write_to_binary(points, scalars, indices, 4, data_is_per_cell, output_path);
+    };
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        linearize(points, scalars);
+    } else {
+        std::vector<float> points, scalars;
+        linearize(points, scalars);
+    }
+}
+
+/* Evaluates the quadratic shape functions for a batch of barycentric coordinates
+   (4 per sample), writing 10 weights per sample. Samples are processed in blocks
+   in structure of arrays layout, so the arithmetic vectorizes. */
+inline void evaluate_quadratic_shape_functions(const double *barycentric, size_t num_samples, double *weights)
+{
+    const uint32_t LANES = 8;
+    parallel_for((num_samples + LANES - 1) / LANES, [&](size_t begin, size_t end, uint32_t) {
+        double l[4][LANES], w[10][LANES];
+        for (size_t b = begin; b < end; ++b) {
+            size_t first = b * LANES;
+            uint32_t count = (uint32_t) std::min<size_t>(LANES, num_samples - first);
+            for (uint32_t lane = 0; lane < LANES; ++lane)
+                for (int c = 0; c < 4; ++c) l[c][lane] = barycentric[(first + std::min(lane, count - 1)) * 4 + c];
+            for (int c = 0; c < 4; ++c)
+                for (uint32_t lane = 0; lane < LANES; ++lane) w[c][lane] = l[c][lane] * (2.0 * l[c][lane] - 1.0);
+            for (int e = 0; e < 6; ++e) {
+                const double *la = l[TET_EDGE_CORNERS[e][0]], *lb = l[TET_EDGE_CORNERS[e][1]];
+                for (uint32_t lane = 0; lane < LANES; ++lane) w[4 + e][lane] = 4.0 * la[lane] * lb[lane];
+            }
+            for (uint32_t lane = 0; lane < count; ++lane)
+                for (int n = 0; n < 10; ++n) weights[(first + lane) * 10 + n] = w[n][lane];
+        }
+    }, 512);
+}
+
+/* Interpolates the point scalars of quadratic tetrahedra at a batch of samples,
+   each given as a tetrahedron and barycentric coordinates within it */
+template <typename T>
+void interpolate_quadratic(const T *scalars, const uint32_t *indices, const uint32_t *sample_tets, const double *barycentric, size_t num_samples, double *values)
+{
+    const size_t CHUNK = 4096;
+    parallel_for((num_samples + CHUNK - 1) / CHUNK, [&](size_t begin, size_t end, uint32_t) {
+        std::vector<double> weights(CHUNK * 10);
+        for (size_t c = begin; c < end; ++c) {
+            size_t first = c * CHUNK, count = std::min(CHUNK, num_samples - first);
+            evaluate_quadratic_shape_functions(&barycentric[first * 4], count, weights.data());
+            for (size_t i = 0; i < count; ++i) {
+                const uint32_t *tet = &indices[(size_t) sample_tets[first + i] * 10];
+                double value = 0.0;
+                for (int n = 0; n < 10; ++n) value += weights[i * 10 + n] * scalars[tet[n]];
+                values[first + i] = value;
+            }
+        }
+    }, 1);
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Uniform refinement                                              |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Appends the midpoint value of every edge to per-vertex data with stride values per vertex */
+template <typename V>
+void append_edge_midpoints(std::vector<V> &data, size_t stride, const std::vector<uint32_t> &edges)
+{
+    if (stride == 0) return;
+    size_t num_points = data.size() / stride, num_edges = edges.size() / 2;
+    data.resize((num_points + num_edges) * stride);
+    parallel_for(num_edges, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t e = begin; e < end; ++e) {
+            const V *a = &data[(size_t) edges[e * 2] * stride], *b = &data[(size_t) edges[e * 2 + 1] * stride];
+            for (size_t j = 0; j < stride; ++j) data[(num_points + e) * stride + j] = (V) (0.5 * ((double) a[j] + (double) b[j]));
+        }
+    });
+}
+
+/* Repeats the data of every cell for its 8 children */
+template <typename V>
+void repeat_for_children(std::vector<V> &data, size_t stride)
+{
+    if (stride == 0) return;
+    size_t num_cells = data.size() / stride;
+    std::vector<V> children(num_cells * 8 * stride);
+    parallel_for(num_cells, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t t = begin; t < end; ++t)
+            for (size_t c = 0; c < 8; ++c) std::copy_n(&data[t * stride], stride, &children[(t * 8 + c) * stride]);
+    });
+    data.swap(children);
+}
+
+/* Checks that one more level of refinement still fits 32 bit indices and counts */
+inline void throw_if_refinement_overflows(size_t num_points, size_t num_edges, size_t num_tetrahedra)
+{
+    if (num_points + num_edges > std::numeric_limits<uint32_t>::max() || num_tetrahedra * 8 * 4 > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error( std::string("Refined mesh would not fit 32 bit indices"));
+}
+
+/* Refines a mesh uniformly, splitting every tetrahedron into 8 through its edge
+   midpoints, levels times. Edges are deduplicated with extract_edges, so every
+   midpoint is shared by all tetrahedra around its edge. A quadratic mesh has
+   its first level taken from its own edge nodes. Each call to midpoints(edges)
+   must extend the per-vertex data with the new vertices, and each call to
+   children() must repeat the per-cell data 8 times. */
+template <typename T, typename Midpoints, typename Children>
+void subdivide_tetrahedra(std::vector<T> &points, std::vector<uint32_t> &indices, uint32_t &points_per_primitive, uint32_t levels,
+                          Midpoints midpoints, Children children)
+{
+    if (points_per_primitive != 4 && points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+
+    if (points_per_primitive == 10 && levels > 0) {
+        throw_if_refinement_overflows(points.size() / 3, 0, indices.size() / 10);
+        indices = linearize_quadratic_tets(points.data(), indices.data(), indices.size() / 10);
+        points_per_primitive = 4;
+        children();
+        levels--;
+    }
+
+    for (uint32_t level = 0; level < levels; ++level) {
+        size_t num_points = points.size() / 3, num_tetrahedra = indices.size() / 4;
+        std::vector<uint32_t> edges, tet_edges;
+        extract_edges(indices.data(), num_tetrahedra, 4, num_points, edges, tet_edges);
+        throw_if_refinement_overflows(num_points, edges.size() / 2, num_tetrahedra);
+
+        append_edge_midpoints(points, 3, edges);
+        midpoints(edges);
+
+        /* View the tetrahedra as quadratic ones whose edge nodes are the midpoints */
+        std::vector<uint32_t> quadratic(num_tetrahedra * 10);
+        parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t t = begin; t < end; ++t) {
+                std::copy_n(&indices[t * 4], 4, &quadratic[t * 10]);
+                for (int e = 0; e < 6; ++e) quadratic[t * 10 + 4 + e] = (uint32_t) (num_points + tet_edges[t * 6 + e]);
+            }
+        });
+        std::vector<uint32_t>().swap(tet_edges);
+        indices = linearize_quadratic_tets(points.data(), quadratic.data(), num_tetrahedra);
+        children();
+    }
+}
+
+/* Refines a mesh with one scalar per point or per cell, returning the new points per primitive */
+template <typename T>
+uint32_t refine_uniform(std::vector<T> &points, std::vector<T> &scalars, std::vector<uint32_t> &indices, uint32_t points_per_primitive,
+                        bool data_is_per_cell, uint32_t levels)
+{
+    subdivide_tetrahedra(points, indices, points_per_primitive, levels,
+        [&](const std::vector<uint32_t> &edges) { if (!data_is_per_cell) append_edge_midpoints(scalars, 1, edges); },
+        [&]() { if (data_is_per_cell) repeat_for_children(scalars, 1); });
+    return points_per_primitive;
+}
+
+/* Refines a node/ele pair. Node attributes are interpolated and element attributes
+   inherited. A midpoint gets a boundary marker only if both ends of its edge share it. */
+template <typename T>
+void refine_uniform(TNode<T> &node, TEle<T> &ele, uint32_t levels)
+{
+    uint32_t points_per_primitive = ele.nodes_per_tetrahedron;
+    subdivide_tetrahedra(node.points, ele.nodes, points_per_primitive, levels,
+        [&](const std::vector<uint32_t> &edges) {
+            append_edge_midpoints(node.attributes, node.num_attributes, edges);
+            if (node.num_boundary_markers == 0) return;
+            size_t num_points = node.boundary_markers.size(), num_edges = edges.size() / 2;
+            node.boundary_markers.resize(num_points + num_edges);
+            parallel_for(num_edges, [&](size_t begin, size_t end, uint32_t) {
+                for (size_t e = begin; e < end; ++e) {
+                    T a = node.boundary_markers[edges[e * 2]], b = node.boundary_markers[edges[e * 2 + 1]];
+                    node.boundary_markers[num_points + e] = (a == b) ? a : 0;
+                }
+            });
+        },
+        [&]() { repeat_for_children(ele.attributes, ele.num_attributes); });
+    node.num_points = (uint32_t) (node.points.size() / 3);
+    ele.nodes_per_tetrahedron = points_per_primitive;
+    ele.num_tetrahedra = (uint32_t) (ele.nodes.size() / points_per_primitive);
+}
+
+/* Writes a uniformly refined copy of a binary mesh */
+inline void refine_binary(std::string input_path, std::string output_path, uint32_t levels)
+{
+    BinaryHeader header = read_binary_header(input_path);
+
+    auto refine = [&](auto &points, auto &scalars) {
+        std::vector<uint32_t> indices;
+        bool data_is_per_cell;
+        uint32_t points_per_primitive = read_binary(input_path, points, scalars, indices, data_is_per_cell);
+        points_per_primitive = refine_uniform(points, scalars, indices, points_per_primitive, data_is_per_cell, levels);
+        write_to_binary(points, scalars, indices, points_per_primitive, data_is_per_cell, output_path);
+    };
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        refine(points, scalars);
+    } else {
+        std::vector<float> points, scalars;
+        refine(points, scalars);
+    }
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Levels of detail                                                |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* A level of detail file is an ordinary binary file holding the coarsest level,
+   followed by one section per finer level, coarsest first, whose payload is a
+   complete binary (header, points, scalars and indices) of that level. The last
+   section holds the original mesh. Readers which know nothing of levels see the
+   coarsest mesh, and a viewer can show it after reading the first few percent of
+   the file, then refine as the later sections arrive. */
+const uint32_t SECTION_LEVEL_OF_DETAIL = binary_section_tag('L', 'O', 'D', ' ');
+
+/* Each coarser level has roughly this many times fewer vertices */
+const uint32_t LOD_REDUCTION = 8;
+
+/* Coarsens a tetrahedral mesh by vertex clustering: vertices are binned into
+   cubic cells of the given size, and each cell becomes one vertex at their
+   mean position (with their mean scalar). Tetrahedra whose corners land in
+   four different cells are kept, unless the clustering flattens them or turns
+   them inside out; flipping an inverted one back would fold it over its
+   neighbours, so it is dropped like a flat one. Tetrahedra which land on the
+   same four cells are merged, with the mean of their cell scalars, and cells
+   no tetrahedron uses are dropped. */
+template <typename T>
+void coarsen_mesh(std::vector<T> &points, std::vector<T> &scalars, std::vector<uint32_t> &indices, uint32_t points_per_primitive,
+                  bool data_is_per_cell, double cell_size)
+{
+    if (points_per_primitive != 4)
+        throw std::runtime_error( std::string("points per primitive needs to be 4"));
+    if (!(cell_size > 0.0))
+        throw std::runtime_error( std::string("cell size needs to be positive"));
+
+    size_t num_points = points.size() / 3, num_tetrahedra = indices.size() / 4;
+    if (num_points == 0) return;
+
+    /* Sort the vertices by cell, so that every cell is a run of vertices */
+    double lower[3], upper[3];
+    compute_bounds(points.data(), num_points, lower, upper);
+    const uint32_t max_cell = (1u << CURVE_BITS) - 1;
+    std::vector<uint64_t> keys(num_points);
+    std::vector<uint32_t> order(num_points);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t q[3];
+            for (int a = 0; a < 3; ++a) q[a] = (uint32_t) std::min<double>(max_cell, std::floor((points[i * 3 + a] - lower[a]) / cell_size));
+            keys[i] = morton_code(q[0], q[1], q[2]);
+            order[i] = (uint32_t) i;
+        }
+    });
+    parallel_radix_sort(keys, order, 3 * CURVE_BITS);
+
+    std::vector<uint64_t> first_in_cluster(num_points + 1, 0);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) first_in_cluster[i] = (i == 0 || keys[i] != keys[i - 1]);
+    });
+    size_t num_clusters = parallel_exclusive_scan(first_in_cluster);
+    std::vector<uint32_t> cluster(num_points), cluster_start(num_clusters + 1, (uint32_t) num_points);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) {
+            /* Only the first vertex of a cluster raises the prefix sum */
+            cluster[order[i]] = (uint32_t) (first_in_cluster[i + 1] - 1);
+            if (first_in_cluster[i + 1] != first_in_cluster[i]) cluster_start[first_in_cluster[i]] = (uint32_t) i;
+        }
+    });
+    std::vector<uint64_t>().swap(keys);
+    std::vector<uint64_t>().swap(first_in_cluster);
+
+    /* Average the vertices of every cluster */
+    std::vector<T> cluster_points(num_clusters * 3), cluster_scalars(data_is_per_cell ? 0 : num_clusters);
+    parallel_for(num_clusters, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t c = begin; c < end; ++c) {
+            double sum[4] = {};
+            for (uint32_t i = cluster_start[c]; i < cluster_start[c + 1]; ++i) {
+                for (int a = 0; a < 3; ++a) sum[a] += points[(size_t) order[i] * 3 + a];
+                if (!data_is_per_cell) sum[3] += scalars[order[i]];
+            }
+            double count = cluster_start[c + 1] - cluster_start[c];
+            for (int a = 0; a < 3; ++a) cluster_points[c * 3 + a] = (T) (sum[a] / count);
+            if (!data_is_per_cell) cluster_scalars[c] = (T) (sum[3] / count);
+        }
+    });
+
+    /* Keep the tetrahedra which still have volume and their orientation */
+    std::vector<uint32_t> clustered(num_tetrahedra * 4);
+    std::vector<uint64_t> tet_index(num_tetrahedra + 1, 0);
+    parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t t = begin; t < end; ++t) {
+            const uint32_t *tet = &indices[t * 4];
+            uint32_t *c = &clustered[t * 4];
+            for (int i = 0; i < 4; ++i) c[i] = cluster[tet[i]];
+            double before = tet_signed_volume6(&points[(size_t) tet[0] * 3], &points[(size_t) tet[1] * 3], &points[(size_t) tet[2] * 3], &points[(size_t) tet[3] * 3]);
+            double after = tet_signed_volume6(&cluster_points[(size_t) c[0] * 3], &cluster_points[(size_t) c[1] * 3], &cluster_points[(size_t) c[2] * 3], &cluster_points[(size_t) c[3] * 3]);
+            tet_index[t] = (after != 0.0 && (before < 0.0) == (after < 0.0));
+        }
+    });
+    uint64_t kept = parallel_exclusive_scan(tet_index);
+    compact_records(clustered, 4, tet_index, kept);
+    if (data_is_per_cell) compact_records(scalars, 1, tet_index, kept);
+    std::vector<uint64_t>().swap(tet_index);
+
+    /* Sort the kept tetrahedra by their sorted corners, with a stable sort by
+       the last two and then by the first two, so that duplicates form runs */
+    uint32_t cluster_bits = 1;
+    while (cluster_bits < 32 && ((size_t) 1 << cluster_bits) < num_clusters) cluster_bits++;
+    std::vector<uint64_t> high(kept), low(kept);
+    std::vector<uint32_t> tets(kept);
+    parallel_for(kept, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t t = begin; t < end; ++t) {
+            uint64_t c[4] = { clustered[t * 4], clustered[t * 4 + 1], clustered[t * 4 + 2], clustered[t * 4 + 3] };
+            std::sort(c, c + 4);
+            high[t] = (c[0] << cluster_bits) | c[1];
+            low[t] = (c[2] << cluster_bits) | c[3];
+            tets[t] = (uint32_t) t;
+        }
+    });
+    std::vector<uint64_t> sort_keys = low;
+    parallel_radix_sort(sort_keys, tets, 2 * cluster_bits);
+    parallel_for(kept, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) sort_keys[i] = high[tets[i]];
+    });
+    parallel_radix_sort(sort_keys, tets, 2 * cluster_bits);
+    std::vector<uint64_t>().swap(sort_keys);
+
+    /* Number the runs, and keep the first tetrahedron of each */
+    std::vector<uint64_t> run_index(kept + 1, 0);
+    parallel_for(kept, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i)
+            run_index[i] = (i == 0 || high[tets[i]] != high[tets[i - 1]] || low[tets[i]] != low[tets[i - 1]]);
+    });
+    uint64_t num_unique = parallel_exclusive_scan(run_index);
+    std::vector<uint32_t> unique_indices(num_unique * 4);
+    std::vector<T> unique_scalars(data_is_per_cell ? num_unique : 0);
+    parallel_for(kept, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) {
+            /* Only the start of a run raises the prefix sum */
+            uint64_t run = run_index[i];
+            if (run_index[i + 1] == run) continue;
+            std::copy_n(&clustered[(size_t) tets[i] * 4], 4, &unique_indices[run * 4]);
+            if (!data_is_per_cell) continue;
+            double sum = 0.0;
+            size_t j = i;
+            for (; j < kept && (j == i || run_index[j + 1] == run_index[j]); ++j) sum += scalars[tets[j]];
+            unique_scalars[run] = (T) (sum / (j - i));
+        }
+    });
+    std::vector<uint32_t>().swap(clustered);
+
+    /* Drop the clusters no tetrahedron uses any more */
+    std::vector<std::atomic<uint8_t>> referenced(num_clusters);
+    parallel_for(unique_indices.size(), [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) referenced[unique_indices[i]].store(1, std::memory_order_relaxed);
+    });
+    std::vector<uint64_t> cluster_index(num_clusters + 1, 0);
+    parallel_for(num_clusters, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t c = begin; c < end; ++c) cluster_index[c] = referenced[c].load(std::memory_order_relaxed);
+    });
+    uint64_t kept_clusters = parallel_exclusive_scan(cluster_index);
+    compact_records(cluster_points, 3, cluster_index, kept_clusters);
+    compact_records(cluster_scalars, 1, cluster_index, kept_clusters);
+    parallel_for(unique_indices.size(), [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) unique_indices[i] = (uint32_t) cluster_index[unique_indices[i]];
+    });
+
+    points.swap(cluster_points);
+    scalars.swap(data_is_per_cell ? unique_scalars : cluster_scalars);
+    indices.swap(unique_indices);
+}
+
+/* Cell size which clusters about LOD_REDUCTION vertices of an evenly spread mesh together */
+template <typename T>
+double lod_cell_size(const std::vector<T> &points)
+{
+    size_t num_points = points.size() / 3;
+    double lower[3], upper[3];
+    compute_bounds(points.data(), num_points, lower, upper);
+    double largest = std::max({ upper[0] - lower[0], upper[1] - lower[1], upper[2] - lower[2], std::numeric_limits<double>::min() });
+    double volume = 1.0;
+    for (int a = 0; a < 3; ++a) volume *= std::max(upper[a] - lower[a], largest * 1e-6);
+    return std::cbrt(volume * LOD_REDUCTION / std::max<size_t>(num_points, 1));
+}
+
+/* Writes a mesh together with up to num_levels - 1 coarser versions of it, each
+   coarsened from the one before with coarsen_mesh. Coarsening stops early once
+   it no longer removes tetrahedra. Quadratic meshes are linearized for their
+   coarser levels. Returns the number of levels written. */
+template <typename T>
+uint32_t write_lod_binary(const std::vector<T> &points, const std::vector<T> &scalars, const std::vector<uint32_t> &indices, uint32_t points_per_primitive,
+                          bool data_is_per_cell, std::string binary_path, uint32_t num_levels = 4, bool store_as_float = false)
+{
+    if (points_per_primitive != 4 && points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+
+    /* Coarsen, finest first */
+    struct Level {
+        std::vector<T> points, scalars;
+        std::vector<uint32_t> indices;
+    };
+    std::vector<Level> coarser;
+    for (uint32_t level = 1; level < num_levels; ++level) {
+        Level next;
+        if (coarser.empty()) {
+            next.points = points;
+            next.scalars = scalars;
+            next.indices = indices;
+            if (points_per_primitive == 10) linearize_quadratic_mesh(next.points, next.scalars, next.indices, data_is_per_cell);
+        } else {
+            next = coarser.back();
+        }
+        size_t num_tetrahedra = next.indices.size() / 4;
+        coarsen_mesh(next.points, next.scalars, next.indices, 4, data_is_per_cell, lod_cell_size(next.points));
+        if (next.indices.empty() || next.indices.size() / 4 >= num_tetrahedra) break;
+        coarser.push_back(std::move(next));
+    }
+
+    /* Create/open the file */
+    std::fstream file;
+    file.open(binary_path, std::ios::out | std::ios::trunc | std::ios::binary );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to create " + binary_path));
+
+    /* The coarsest level is the file itself, and every finer one a section after it */
+    auto write_level = [&](const std::vector<T> &level_points, const std::vector<T> &level_scalars, const std::vector<uint32_t> &level_indices,
+                           uint32_t level_points_per_primitive, bool as_section) {
+        if (!as_section) {
+            write_binary_data(file, level_points, level_scalars, level_indices, level_points_per_primitive, data_is_per_cell, store_as_float);
+            return;
+        }
+        pad_binary_section(file);
+        uint64_t header_offset = file.tellp();
+        uint32_t tag = SECTION_LEVEL_OF_DETAIL, reserved = 0;
+        uint64_t size = 0;
+        file.write((char*) &tag, sizeof(uint32_t));
+        file.write((char*) &reserved, sizeof(uint32_t));
+        file.write((char*) &size, sizeof(uint64_t));
+        write_binary_data(file, level_points, level_scalars, level_indices, level_points_per_primitive, data_is_per_cell, store_as_float);
+        uint64_t end = file.tellp();
+        size = end - header_offset - BINARY_SECTION_HEADER_SIZE;
+        file.seekp(header_offset + 2 * sizeof(uint32_t));
+        file.write((char*) &size, sizeof(uint64_t));
+        file.seekp(end);
+    };
+    for (size_t level = coarser.size(); level-- > 0;) {
+        write_level(coarser[level].points, coarser[level].scalars, coarser[level].indices, 4, level + 1 != coarser.size());
+        coarser[level] = Level();
+    }
+    write_level(points, scalars, indices, points_per_primitive, !coarser.empty());
+    file.close();
+    return (uint32_t) coarser.size() + 1;
+}
+
+/* Writes a binary file as a level of detail file, see write_lod_binary */
+inline uint32_t write_binary_as_lod(std::string input_path, std::string output_path, uint32_t num_levels = 4)
+{
+    BinaryHeader header = read_binary_header(input_path);
+
+    auto write = [&](auto &points, auto &scalars) {
+        std::vector<uint32_t> indices;
+        bool data_is_per_cell;
+        uint32_t points_per_primitive = read_binary(input_path, points, scalars, indices, data_is_per_cell);
+        return write_lod_binary(points, scalars, indices, points_per_primitive, data_is_per_cell, output_path, num_levels);
+    };
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        return write(points, scalars);
+    } else {
+        std::vector<float> points, scalars;
+        return write(points, scalars);
+    }
+}
+
+/* Finds the sections holding the finer levels of a level of detail file, coarsest first */
+inline std::vector<BinarySection> list_lod_sections(std::string binary_path)
+{
+    std::vector<BinarySection> sections;
+    for (const BinarySection &section : list_binary_sections(binary_path))
+        if (section.tag == SECTION_LEVEL_OF_DETAIL) sections.push_back(section);
+    return sections;
+}
+
+/* Number of levels in a binary file. Files without levels have just the one. */
+inline uint32_t count_lod_levels(std::string binary_path)
+{
+    return (uint32_t) list_lod_sections(binary_path).size() + 1;
+}
+
+/* Reads the headers of every level, coarsest first, eg to decide how many to load */
+inline std::vector<BinaryHeader> read_lod_headers(std::string binary_path)
+{
+    std::vector<BinaryHeader> headers = { read_binary_header(binary_path) };
+    std::fstream file;
+    file.open(binary_path, std::ios::in | std::ios::binary );
+    for (const BinarySection &section : list_lod_sections(binary_path)) {
+        file.seekg(section.offset);
+        headers.push_back(read_binary_header(file));
+    }
+    return headers;
+}
+
+/* Reads one level of a level of detail file, 0 being the coarsest. Values are
+   converted to T as with read_binary. Only the bytes of that level are read. */
+template <typename T>
+uint32_t read_lod_level(std::string binary_path, uint32_t level, std::vector<T> &points, std::vector<T> &scalars, std::vector<uint32_t> &indices, bool &data_is_per_cell)
+{
+    if (level == 0) return read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+
+    std::vector<BinarySection> sections = list_lod_sections(binary_path);
+    if (level > sections.size())
+        throw std::runtime_error( std::string(binary_path + " has only " + std::to_string(sections.size() + 1) + " levels"));
+
+    std::fstream file;
+    file.open(binary_path, std::ios::in | std::ios::binary );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to open " + binary_path));
+
+    file.seekg(sections[level - 1].offset);
+    return read_binary_data(file, points, scalars, indices, data_is_per_cell);
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Sparse brick octree                                             |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* A brick octree file stores a scalar pyramid of cubic voxels, level 0 being the
+   finest and every level having voxels twice as large as the one below, up to a
+   single brick. Voxels are grouped into bricks of brick_size³ float32 values
+   (x fastest), and only bricks which touch the mesh are stored. Each value is
+   the volume weighted average of the field over the part of its voxel inside
+   the mesh, or NaN if the voxel misses the mesh.
+
+   The file starts with a BrickOctreeHeader, followed by the bricks and then,
+   at table_offset, one table per level (finest first) of num_bricks[level]
+   BrickEntry records sorted by key, the Morton code of the brick coordinates.
+   Everything is 8 byte aligned, so the file can be used in place once mapped. */
+const uint32_t BRICK_OCTREE_MAGIC = binary_section_tag('T', 'B', 'R', 'K');
+const uint32_t BRICK_OCTREE_MAX_LEVELS = CURVE_BITS + 1;
+
+const uint32_t BRICK_SIZE = 16;
+/* Samples per axis within every finest voxel, from which its average is estimated */
+const uint32_t BRICK_SUPERSAMPLES = 2;
+/* Bricks are rasterized in batches sized to stay within this many bytes */
+const size_t BRICK_BATCH_BYTES = (size_t) 1 << 28;
+
+struct BrickOctreeHeader {
+    uint32_t magic;
+    uint32_t brick_size;
+    uint32_t num_levels;
+    uint32_t supersamples;
+    double origin[3];
+    /* Edge length of the voxels of level 0 */
+    double voxel_size;
+    /* Voxels of level 0 needed to cover the mesh */
+    uint32_t dims[3];
+    uint32_t reserved;
+    uint64_t table_offset;
+    uint64_t num_bricks[BRICK_OCTREE_MAX_LEVELS];
+};
+
+static_assert(sizeof(BrickOctreeHeader) % 8 == 0, "bricks follow the header at an aligned offset");
+
+struct BrickEntry {
+    uint64_t key;
+    /* Offset of the brick's values from the start of the file */
+    uint64_t offset;
+};
+
+/* Inverse of spread_bits_by_3 */
+inline uint32_t compact_bits_by_3(uint64_t v)
+{
+    v &= 0x1249249249249249ull;
+    v = (v | (v >> 2)) & 0x10c30c30c30c30c3ull;
+    v = (v | (v >> 4)) & 0x100f00f00f00f00full;
+    v = (v | (v >> 8)) & 0x1f0000ff0000ffull;
+    v = (v | (v >> 16)) & 0x1f00000000ffffull;
+    v = (v | (v >> 32)) & 0x1fffff;
+    return (uint32_t) v;
+}
+
+/* Writes bricks as they are completed, in Morton order, and averages every group
+   of 8 sibling bricks into their parent as soon as the last of them arrives, so
+   only one partial parent per level is held at a time */
+class BrickPyramidWriter {
+public:
+    std::vector<std::vector<BrickEntry>> tables;
+
+    BrickPyramidWriter(std::fstream &file, uint32_t brick_size, uint32_t num_levels)
+        : tables(num_levels), file_(file), brick_size_(brick_size), parents_(num_levels) {}
+
+    /* Writes a brick of the given level, and adds it to its parent. Voxels with no
+       coverage must hold NaN. */
+    void add(uint32_t level, uint64_t key, const float *values, const float *coverage)
+    {
+        size_t brick_voxels = (size_t) brick_size_ * brick_size_ * brick_size_;
+        tables[level].push_back({ key, (uint64_t) file_.tellp() });
+        file_.write((const char*) values, brick_voxels * sizeof(float));
+        if (level + 1 >= tables.size()) return;
+
+        Parent &parent = parents_[level + 1];
+        if (parent.active && parent.key != key >> 3) flush(level + 1);
+        if (!parent.active) {
+            parent.active = true;
+            parent.key = key >> 3;
+            parent.sums.assign(brick_voxels, 0.0);
+            parent.weights.assign(brick_voxels, 0.0);
+        }
+
+        /* The child covers one octant of its parent, and each of its 2³ voxels one parent voxel */
+        uint32_t b = brick_size_, octant = (uint32_t) (key & 7);
+        uint32_t ox = (octant & 1) * b, oy = ((octant >> 1) & 1) * b, oz = ((octant >> 2) & 1) * b;
+        for (uint32_t k = 0; k < b; ++k)
+            for (uint32_t j = 0; j < b; ++j)
+                for (uint32_t i = 0; i < b; ++i) {
+                    size_t child = ((size_t) k * b + j) * b + i;
+                    if (coverage[child] == 0.0f) continue;
+                    size_t voxel = ((size_t) ((oz + k) >> 1) * b + ((oy + j) >> 1)) * b + ((ox + i) >> 1);
+                    parent.sums[voxel] += (double) coverage[child] * values[child];
+                    parent.weights[voxel] += coverage[child];
+                }
+    }
+
+    /* Writes every parent still being accumulated, up to the root */
+    void finish()
+    {
+        for (uint32_t level = 1; level < parents_.size(); ++level)
+            if (parents_[level].active) flush(level);
+    }
+
+private:
+    struct Parent {
+        bool active = false;
+        uint64_t key = 0;
+        std::vector<double> sums, weights;
+    };
+
+    std::fstream &file_;
+    uint32_t brick_size_;
+    std::vector<Parent> parents_;
+
+    void flush(uint32_t level)
+    {
+        Parent &parent = parents_[level];
+        size_t brick_voxels = parent.sums.size();
+        std::vector<float> values(brick_voxels), coverage(brick_voxels);
+        for (size_t v = 0; v < brick_voxels; ++v) {
+            double weight = parent.weights[v];
+            values[v] = (weight > 0.0) ? (float) (parent.sums[v] / weight) : std::numeric_limits<float>::quiet_NaN();
+            coverage[v] = (float) (weight / 8.0);
+        }
+        parent.active = false;
+        add(level, parent.key, values.data(), coverage.data());
+    }
+};
+
+/* Builds a brick octree of the scalars of a mesh, whose finest level has resolution
+   voxels along the longest side of the bounds, and writes it to octree_path.
+   Bricks which the bounds of some tetrahedron touch are rasterized in parallel
+   batches, one brick per task, from the tetrahedra a BVH finds for them. Every
+   finest voxel is sampled supersamples³ times with rasterize_tetrahedron, and
+   its value and covered fraction are taken from the samples inside the mesh.
+   Coarser levels follow from the coverage weighted average of their children. */
+template <typename T>
+BrickOctreeHeader build_brick_octree(const std::vector<T> &points, const std::vector<T> &scalars, const std::vector<uint32_t> &indices,
+                                     uint32_t points_per_primitive, bool data_is_per_cell, std::string octree_path, uint32_t resolution,
+                                     uint32_t brick_size = BRICK_SIZE, uint32_t supersamples = BRICK_SUPERSAMPLES, size_t max_batch_bytes = BRICK_BATCH_BYTES)
+{
+    if (points_per_primitive != 4 && points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+    if (brick_size < 2 || brick_size % 2 != 0)
+        throw std::runtime_error( std::string("brick size needs to be even"));
+    if (resolution == 0 || supersamples == 0)
+        throw std::runtime_error( std::string("resolution and supersamples need to be positive"));
+
+    /* Fit the finest level around the mesh */
+    BrickOctreeHeader header = {};
+    header.magic = BRICK_OCTREE_MAGIC;
+    header.brick_size = brick_size;
+    header.supersamples = supersamples;
+    double lower[3] = { 0.0, 0.0, 0.0 }, upper[3] = { 0.0, 0.0, 0.0 };
+    if (!points.empty()) compute_bounds(points.data(), points.size() / 3, lower, upper);
+    double extent = std::max({ upper[0] - lower[0], upper[1] - lower[1], upper[2] - lower[2] });
+    header.voxel_size = (extent > 0.0) ? extent / resolution : 1.0;
+    uint32_t bricks[3], most_bricks = 1;
+    for (int a = 0; a < 3; ++a) {
+        header.origin[a] = lower[a];
+        header.dims[a] = std::max<uint32_t>(1, (uint32_t) std::ceil((upper[a] - lower[a]) / header.voxel_size));
+        bricks[a] = (header.dims[a] + brick_size - 1) / brick_size;
+        most_bricks = std::max(most_bricks, bricks[a]);
+    }
+    if (most_bricks > (1u << CURVE_BITS))
+        throw std::runtime_error( std::string("resolution is too high for the brick size"));
+    header.num_levels = 1;
+    while ((1u << (header.num_levels - 1)) < most_bricks) header.num_levels++;
+
+    /* Mark the finest bricks which the bounds of some tetrahedron overlap */
+    size_t num_tetrahedra = indices.size() / points_per_primitive;
+    double brick_extent = header.voxel_size * brick_size;
+    std::vector<std::atomic<uint8_t>> marked((size_t) bricks[0] * bricks[1] * bricks[2]);
+    parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t t = begin; t < end; ++t) {
+            uint32_t first[3], last[3];
+            for (int a = 0; a < 3; ++a) {
+                double lo = std::numeric_limits<double>::max(), hi = std::numeric_limits<double>::lowest();
+                for (uint32_t c = 0; c < 4; ++c) {
+                    double x = points[(size_t) indices[t * points_per_primitive + c] * 3 + a];
+                    lo = std::min(lo, x);
+                    hi = std::max(hi, x);
+                }
+                first[a] = (uint32_t) std::min<double>(bricks[a] - 1, std::floor((lo - header.origin[a]) / brick_extent));
+                last[a] = (uint32_t) std::min<double>(bricks[a] - 1, std::floor((hi - header.origin[a]) / brick_extent));
+            }
+            for (uint32_t z = first[2]; z <= last[2]; ++z)
+                for (uint32_t y = first[1]; y <= last[1]; ++y)
+                    for (uint32_t x = first[0]; x <= last[0]; ++x)
+                        marked[((size_t) z * bricks[1] + y) * bricks[0] + x].store(1, std::memory_order_relaxed);
+        }
+    });
+    std::vector<uint64_t> keys;
+    for (uint32_t z = 0; z < bricks[2]; ++z)
+        for (uint32_t y = 0; y < bricks[1]; ++y)
+            for (uint32_t x = 0; x < bricks[0]; ++x)
+                if (marked[((size_t) z * bricks[1] + y) * bricks[0] + x].load(std::memory_order_relaxed)) keys.push_back(morton_code(x, y, z));
+    std::vector<std::atomic<uint8_t>>().swap(marked);
+    std::vector<uint32_t> unused(keys.size());
+    parallel_radix_sort(keys, unused, 3 * CURVE_BITS);
+    std::vector<uint32_t>().swap(unused);
+
+    BVH bvh = build_bvh(points, indices, points_per_primitive);
+
+    /* Create/open the file */
+    std::fstream file;
+    file.open(octree_path, std::ios::out | std::ios::trunc | std::ios::binary );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to create " + octree_path));
+
+    file.write((const char*) &header, sizeof(BrickOctreeHeader));
+    BrickPyramidWriter writer(file, brick_size, header.num_levels);
+
+    size_t brick_voxels = (size_t) brick_size * brick_size * brick_size;
+    size_t samples_per_axis = (size_t) brick_size * supersamples;
+    size_t brick_samples = samples_per_axis * samples_per_axis * samples_per_axis;
+    size_t batch_size = std::max<size_t>(num_worker_threads(), max_batch_bytes / (brick_voxels * 2 * sizeof(float)));
+    std::vector<float> batch_values(std::min(batch_size, keys.size()) * brick_voxels), batch_coverage(batch_values.size());
+    std::vector<std::vector<float>> samples(num_worker_threads());
+    std::vector<std::vector<uint32_t>> candidates(num_worker_threads());
+    const float NaN = std::numeric_limits<float>::quiet_NaN();
+
+    for (size_t batch_first = 0; batch_first < keys.size(); batch_first += batch_size) {
+        size_t batch_count = std::min(batch_size, keys.size() - batch_first);
+        parallel_for(batch_count, [&](size_t begin, size_t end, uint32_t worker) {
+            std::vector<float> &sample = samples[worker];
+            sample.resize(brick_samples);
+            for (size_t n = begin; n < end; ++n) {
+                uint64_t key = keys[batch_first + n];
+                uint32_t brick[3] = { compact_bits_by_3(key), compact_bits_by_3(key >> 1), compact_bits_by_3(key >> 2) };
+
+                /* Supersamples sit at the centres of equal subdivisions of each voxel */
+                RegularGrid grid;
+                float box_lower[3], box_upper[3];
+                for (int a = 0; a < 3; ++a) {
+                    double brick_lower = header.origin[a] + brick[a] * brick_extent;
+                    grid.spacing[a] = header.voxel_size / supersamples;
+                    grid.origin[a] = brick_lower + 0.5 * grid.spacing[a];
+                    grid.dims[a] = (uint32_t) samples_per_axis;
+                    box_lower[a] = round_down_to_float(brick_lower);
+                    box_upper[a] = round_up_to_float(brick_lower + brick_extent);
+                }
+                query_bvh_box(bvh, box_lower, box_upper, candidates[worker]);
+                std::sort(candidates[worker].begin(), candidates[worker].end());
+
+                std::fill(sample.begin(), sample.end(), NaN);
+                for (uint32_t t : candidates[worker])
+                    rasterize_tetrahedron(points.data(), scalars.data(), indices.data(), t, points_per_primitive, data_is_per_cell, grid, 0, (int64_t) samples_per_axis, 0, (int64_t) samples_per_axis,
+                        [&](int64_t j, int64_t k, int64_t first, int64_t last, double value, double value_step) {
+                            float *row = &sample[((size_t) k * samples_per_axis + j) * samples_per_axis];
+                            for (int64_t i = first; i <= last; ++i)
+                                row[i] = (float) (value + i * value_step);
+                        });
+
+                float *values = &batch_values[n * brick_voxels], *coverage = &batch_coverage[n * brick_voxels];
+                for (size_t k = 0; k < brick_size; ++k)
+                    for (size_t j = 0; j < brick_size; ++j)
+                        for (size_t i = 0; i < brick_size; ++i) {
+                            double sum = 0.0;
+                            uint32_t count = 0;
+                            for (size_t sk = 0; sk < supersamples; ++sk)
+                                for (size_t sj = 0; sj < supersamples; ++sj)
+                                    for (size_t si = 0; si < supersamples; ++si) {
+                                        float value = sample[((k * supersamples + sk) * samples_per_axis + j * supersamples + sj) * samples_per_axis + i * supersamples + si];
+                                        if (std::isnan(value)) continue;
+                                        sum += value;
+                                        count++;
+                                    }
+                            size_t voxel = (k * brick_size + j) * brick_size + i;
+                            values[voxel] = (count > 0) ? (float) (sum / count) : NaN;
+                            coverage[voxel] = (float) count / (supersamples * supersamples * supersamples);
+                        }
+            }
+        }, 1);
+
+        /* Write in key order, skipping bricks whose tetrahedra only touched them with their bounds */
+        for (size_t n = 0; n < batch_count; ++n) {
+            const float *coverage = &batch_coverage[n * brick_voxels];
+            if (std::all_of(coverage, coverage + brick_voxels, [](float c) { return c == 0.0f; })) continue;
+            writer.add(0, keys[batch_first + n], &batch_values[n * brick_voxels], coverage);
+        }
+    }
+    writer.finish();
+
+    header.table_offset = file.tellp();
+    for (uint32_t level = 0; level < header.num_levels; ++level) {
+        header.num_bricks[level] = writer.tables[level].size();
+        file.write((const char*) writer.tables[level].data(), writer.tables[level].size() * sizeof(BrickEntry));
+    }
+    file.seekp(0);
+    file.write((const char*) &header, sizeof(BrickOctreeHeader));
+
+    if (!file)
+        throw std::runtime_error( std::string("Unable to write " + octree_path));
+    file.close();
+    return header;
+}
+
+/* Builds a brick octree from a binary mesh, see build_brick_octree */
+inline BrickOctreeHeader build_brick_octree_binary(std::string binary_path, std::string octree_path, uint32_t resolution,
+                                                   uint32_t brick_size = BRICK_SIZE, uint32_t supersamples = BRICK_SUPERSAMPLES)
+{
+    BinaryHeader header = read_binary_header(binary_path);
+
+    auto build = [&](auto &points, auto &scalars) {
+        std::vector<uint32_t> indices;
+        bool data_is_per_cell;
+        uint32_t points_per_primitive = read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        return build_brick_octree(points, scalars, indices, points_per_primitive, data_is_per_cell, octree_path, resolution, brick_size, supersamples);
+    };
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        return build(points, scalars);
+    } else {
+        std::vector<float> points, scalars;
+        return build(points, scalars);
+    }
+}
+
+/* A brick octree file mapped into memory. Bricks are found by binary search in
+   the table of their level, and their values used in place. Opening the file
+   checks the header and every table entry, and throws if they reach outside it. */
+class BrickOctree {
+public:
+    explicit BrickOctree(std::string octree_path) : file_(std::make_shared<MappedFile>(octree_path))
+    {
+        if (file_->size() < sizeof(BrickOctreeHeader))
+            throw std::runtime_error( std::string(octree_path + " is too small to be a brick octree"));
+        std::memcpy(&header_, file_->data(), sizeof(BrickOctreeHeader));
+        if (header_.magic != BRICK_OCTREE_MAGIC || header_.num_levels > BRICK_OCTREE_MAX_LEVELS)
+            throw std::runtime_error( std::string(octree_path + " is not a brick octree"));
+        if (header_.brick_size < 2 || header_.brick_size % 2 != 0 || header_.brick_size > (1u << 16))
+            throw std::runtime_error( std::string(octree_path + " is corrupt: bad brick size"));
+        if (header_.table_offset % alignof(BrickEntry) != 0 || header_.table_offset < sizeof(BrickOctreeHeader))
+            throw std::runtime_error( std::string(octree_path + " is corrupt: misaligned tables"));
+
+        /* Every table lies within the file, and every brick before the tables, aligned
+           for its floats and in increasing key order */
+        uint64_t offset = header_.table_offset, size = file_->size();
+        uint64_t brick_bytes = (uint64_t) header_.brick_size * header_.brick_size * header_.brick_size * sizeof(float);
+        for (uint32_t level = 0; level < header_.num_levels; ++level) {
+            if (offset > size || header_.num_bricks[level] > (size - offset) / sizeof(BrickEntry))
+                throw std::runtime_error( std::string(octree_path + " is truncated"));
+            const BrickEntry *table = (const BrickEntry*) (file_->data() + offset);
+            for (uint64_t n = 0; n < header_.num_bricks[level]; ++n) {
+                const BrickEntry &entry = table[n];
+                if (entry.offset < sizeof(BrickOctreeHeader) || entry.offset % alignof(float) != 0 || entry.offset > header_.table_offset ||
+                    brick_bytes > header_.table_offset - entry.offset)
+                    throw std::runtime_error( std::string(octree_path + " is corrupt: brick outside the file"));
+                if (n > 0 && table[n - 1].key >= entry.key)
+                    throw std::runtime_error( std::string(octree_path + " is corrupt: bricks out of order"));
+            }
+            tables_.push_back(table);
+            offset += header_.num_bricks[level] * sizeof(BrickEntry);
+        }
+    }
+
+    const BrickOctreeHeader &header() const { return header_; }
+    uint32_t num_levels() const { return header_.num_levels; }
+    uint32_t brick_size() const { return header_.brick_size; }
+    uint64_t num_bricks(uint32_t level) const { return header_.num_bricks[level]; }
+
+    /* Edge length of the voxels of a level */
+    double voxel_size(uint32_t level) const { return std::ldexp(header_.voxel_size, (int) level); }
+
+    /* Number of voxels of a level along an axis */
+    uint32_t dims(uint32_t level, uint32_t axis) const { return std::max<uint32_t>(1, (header_.dims[axis] + (1u << level) - 1) >> level); }
+
+    /* Coordinates of the nth stored brick of a level */
+    void brick_coordinates(uint32_t level, uint64_t n, uint32_t &x, uint32_t &y, uint32_t &z) const
+    {
+        uint64_t key = tables_[level][n].key;
+        x = compact_bits_by_3(key);
+        y = compact_bits_by_3(key >> 1);
+        z = compact_bits_by_3(key >> 2);
+    }
+
+    /* The brick_size³ values of a brick, or nullptr if it is empty */
+    const float *brick(uint32_t level, uint32_t x, uint32_t y, uint32_t z) const
+    {
+        if (level >= header_.num_levels) return nullptr;
+        uint64_t key = morton_code(x, y, z);
+        const BrickEntry *table = tables_[level], *table_end = table + header_.num_bricks[level];
+        const BrickEntry *entry = std::lower_bound(table, table_end, key, [](const BrickEntry &e, uint64_t k) { return e.key < k; });
+        if (entry == table_end || entry->key != key) return nullptr;
+        return (const float*) (file_->data() + entry->offset);
+    }
+
+    /* Value of voxel (i, j, k) of a level, NaN where the mesh is not */
+    float value(uint32_t level, uint32_t i, uint32_t j, uint32_t k) const
+    {
+        uint32_t b = header_.brick_size;
+        const float *values = brick(level, i / b, j / b, k / b);
+        if (values == nullptr) return std::numeric_limits<float>::quiet_NaN();
+        return values[((size_t) (k % b) * b + j % b) * b + i % b];
+    }
+
+private:
+    std::shared_ptr<MappedFile> file_;
+    BrickOctreeHeader header_;
+    std::vector<const BrickEntry*> tables_;
+};
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Partitioning                                                    |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Sections of a part written by partition_binary: the global index of every local
+   vertex and tetrahedron (uint32_t), and the ghost layer of every local
+   tetrahedron (uint8_t, 0 for the tetrahedra the part owns) */
+const uint32_t SECTION_LOCAL_TO_GLOBAL_VERTICES = binary_section_tag('L', '2', 'G', 'V');
+const uint32_t SECTION_LOCAL_TO_GLOBAL_TETS = binary_section_tag('L', '2', 'G', 'T');
+const uint32_t SECTION_GHOST_LAYERS = binary_section_tag('G', 'H', 'S', 'T');
+
+struct PartitionReport {
+    uint32_t num_parts;
+    std::vector<uint64_t> owned_tets;
+    std::vector<uint64_t> ghost_tets;
+    std::vector<uint64_t> points;
+};
+
+/* Reads value i of an array of Stored values which may not be aligned */
+template <typename Stored>
+inline double load_unaligned(const char *data, size_t i)
+{
+    Stored value;
+    std::memcpy(&value, data + i * sizeof(Stored), sizeof(Stored));
+    return (double) value;
+}
+
+/* Path of part p written by partition_binary */
+inline std::string partition_part_path(std::string part_prefix, uint32_t part)
+{
+    return part_prefix + "_" + std::to_string(part) + ".bin";
+}
+
+/* Splits a binary mesh into num_parts balanced parts, written to part_prefix_<p>.bin.
+   Tetrahedra are sorted along a Morton curve by centroid and the curve cut into
+   equal runs, so parts are compact. Each part also holds ghost_layers layers of
+   the tetrahedra around it: layer 1 shares a vertex with the part, layer 2 with
+   layer 1, and so on, found through the vertex to tetrahedron incidence. Parts
+   are renumbered locally, owned tetrahedra first, and store their local to
+   global maps as sections. The input is memory mapped rather than read, and its
+   points and scalars are only gathered a part at a time. Besides the current part,
+   memory holds the curve order of the tetrahedra (with their sort keys while
+   sorting), a stamp per tetrahedron, a stamp and local index per vertex and, with
+   ghost layers, the vertex to tetrahedron incidence, built from an aligned copy
+   of the indices which is dropped once it is done. */
+inline PartitionReport partition_binary(std::string binary_path, std::string part_prefix, uint32_t num_parts, uint32_t ghost_layers = 1)
+{
+    if (num_parts == 0)
+        throw std::runtime_error( std::string("number of parts needs to be positive"));
+    if (ghost_layers > std::numeric_limits<uint8_t>::max())
+        throw std::runtime_error( std::string("at most 255 ghost layers are supported"));
+
+    MappedBinary binary(binary_path);
+    const BinaryHeader &header = binary.header;
+    uint32_t points_per_primitive = header.points_per_primitive;
+    size_t num_points = header.num_points, num_tetrahedra = header.num_indices / points_per_primitive;
+    bool data_is_per_cell = binary.data_is_per_cell();
+    auto index = [&](size_t i) { return (uint32_t) load_unaligned<uint32_t>(binary.indices, i); };
+
+    PartitionReport report;
+    report.num_parts = num_parts;
+
+    auto partition = [&](auto zero) {
+        using Stored = decltype(zero);
+        auto coordinate = [&](size_t v, int a) { return load_unaligned<Stored>(binary.points, v * 3 + a); };
+
+        /* Sort the tetrahedra along the curve, within the bounds from the statistics section if there is one */
+        double lower[3], upper[3];
+        uint64_t statistics_size = 0;
+        const char *section = binary.section(SECTION_STATISTICS, statistics_size);
+        if (section && statistics_size == BINARY_STATISTICS_SIZE) {
+            BinaryStatistics statistics;
+            std::memcpy(&statistics, section, BINARY_STATISTICS_SIZE);
+            std::copy_n(statistics.lower, 3, lower);
+            std::copy_n(statistics.upper, 3, upper);
+        } else {
+            std::vector<double> corners((size_t) parallel_for_workers(num_points) * 6);
+            for (size_t w = 0; w < corners.size() / 6; ++w)
+                for (int a = 0; a < 3; ++a) {
+                    corners[w * 6 + a] = std::numeric_limits<double>::max();
+                    corners[w * 6 + 3 + a] = std::numeric_limits<double>::lowest();
+                }
+            parallel_for(num_points, [&](size_t begin, size_t end, uint32_t worker) {
+                for (size_t v = begin; v < end; ++v)
+                    for (int a = 0; a < 3; ++a) {
+                        corners[(size_t) worker * 6 + a] = std::min(corners[(size_t) worker * 6 + a], coordinate(v, a));
+                        corners[(size_t) worker * 6 + 3 + a] = std::max(corners[(size_t) worker * 6 + 3 + a], coordinate(v, a));
+                    }
+            });
+            for (int a = 0; a < 3; ++a) {
+                lower[a] = std::numeric_limits<double>::max();
+                upper[a] = std::numeric_limits<double>::lowest();
+                for (size_t w = 0; w < corners.size() / 6; ++w) {
+                    lower[a] = std::min(lower[a], corners[w * 6 + a]);
+                    upper[a] = std::max(upper[a], corners[w * 6 + 3 + a]);
+                }
+            }
+        }
+        CurveQuantizer quantizer(lower, upper, CURVE_MORTON);
+        std::vector<uint64_t> keys(num_tetrahedra);
+        std::vector<uint32_t> order(num_tetrahedra);
+        parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t t = begin; t < end; ++t) {
+                double centroid[3] = { 0.0, 0.0, 0.0 };
+                for (uint32_t c = 0; c < 4; ++c)
+                    for (int a = 0; a < 3; ++a) centroid[a] += coordinate(index(t * points_per_primitive + c), a) / 4.0;
+                keys[t] = quantizer.key(centroid[0], centroid[1], centroid[2]);
+                order[t] = (uint32_t) t;
+            }
+        });
+        parallel_radix_sort(keys, order, 3 * CURVE_BITS);
+        std::vector<uint64_t>().swap(keys);
+
+        /* The incidence is built from an aligned copy of the indices, which is dropped right after */
+        CSRGraph vertex_to_tet;
+        if (ghost_layers > 0) {
+            std::vector<uint32_t> aligned_indices(header.num_indices);
+            std::memcpy(aligned_indices.data(), binary.indices, aligned_indices.size() * sizeof(uint32_t));
+            vertex_to_tet = build_vertex_to_primitive(aligned_indices.data(), num_tetrahedra, points_per_primitive, num_points);
+        }
+
+        /* Stamps mark what already belongs to the current part, so they never need clearing */
+        std::vector<uint32_t> tet_stamp(num_tetrahedra, 0), vertex_stamp(num_points, 0), local_vertex(num_points);
+        for (uint32_t part = 0; part < num_parts; ++part) {
+            uint32_t stamp = part + 1;
+            size_t first = num_tetrahedra * part / num_parts, last = num_tetrahedra * (part + 1) / num_parts;
+
+            std::vector<uint32_t> tets(order.begin() + first, order.begin() + last), vertices;
+            std::vector<uint8_t> layers(tets.size(), 0);
+            auto add_vertices = [&](size_t tets_begin, std::vector<uint32_t> &added) {
+                for (size_t n = tets_begin; n < tets.size(); ++n)
+                    for (uint32_t c = 0; c < points_per_primitive; ++c) {
+                        uint32_t v = index((size_t) tets[n] * points_per_primitive + c);
+                        if (vertex_stamp[v] == stamp) continue;
+                        vertex_stamp[v] = stamp;
+                        local_vertex[v] = (uint32_t) vertices.size();
+                        vertices.push_back(v);
+                        added.push_back(v);
+                    }
+            };
+            for (uint32_t t : tets) tet_stamp[t] = stamp;
+            std::vector<uint32_t> frontier;
+            add_vertices(0, frontier);
+
+            for (uint32_t layer = 1; layer <= ghost_layers && !frontier.empty(); ++layer) {
+                size_t layer_begin = tets.size();
+                for (uint32_t v : frontier)
+                    for (uint64_t e = vertex_to_tet.offsets[v]; e < vertex_to_tet.offsets[v + 1]; ++e) {
+                        uint32_t t = vertex_to_tet.neighbors[e];
+                        if (tet_stamp[t] == stamp) continue;
+                        tet_stamp[t] = stamp;
+                        tets.push_back(t);
+                    }
+                std::sort(tets.begin() + layer_begin, tets.end());
+                layers.resize(tets.size(), (uint8_t) layer);
+                frontier.clear();
+                add_vertices(layer_begin, frontier);
+            }
+
+            /* Gather the part in local numbering */
+            std::vector<Stored> part_points(vertices.size() * 3), part_scalars(data_is_per_cell ? tets.size() : vertices.size());
+            std::vector<uint32_t> part_indices(tets.size() * points_per_primitive);
+            parallel_for(vertices.size(), [&](size_t begin, size_t end, uint32_t) {
+                for (size_t n = begin; n < end; ++n) {
+                    for (int a = 0; a < 3; ++a) part_points[n * 3 + a] = (Stored) coordinate(vertices[n], a);
+                    if (!data_is_per_cell) part_scalars[n] = (Stored) load_unaligned<Stored>(binary.scalars, vertices[n]);
+                }
+            });
+            parallel_for(tets.size(), [&](size_t begin, size_t end, uint32_t) {
+                for (size_t n = begin; n < end; ++n) {
+                    for (uint32_t c = 0; c < points_per_primitive; ++c)
+                        part_indices[n * points_per_primitive + c] = local_vertex[index((size_t) tets[n] * points_per_primitive + c)];
+                    if (data_is_per_cell) part_scalars[n] = (Stored) load_unaligned<Stored>(binary.scalars, tets[n]);
+                }
+            });
+
+            std::string part_path = partition_part_path(part_prefix, part);
+            std::fstream file;
+            file.open(part_path, std::ios::out | std::ios::trunc | std::ios::binary );
+
+            if (!file.is_open())
+                throw std::runtime_error( std::string("Unable to create " + part_path));
+
+            write_binary_data(file, part_points, part_scalars, part_indices, points_per_primitive, data_is_per_cell);
+            pad_binary_section(file);
+            append_binary_section(file, SECTION_LOCAL_TO_GLOBAL_VERTICES, vertices.data(), vertices.size() * sizeof(uint32_t));
+            append_binary_section(file, SECTION_LOCAL_TO_GLOBAL_TETS, tets.data(), tets.size() * sizeof(uint32_t));
+            append_binary_section(file, SECTION_GHOST_LAYERS, layers.data(), layers.size());
+            if (!file)
+                throw std::runtime_error( std::string("Unable to write " + part_path));
+            file.close();
+
+            report.owned_tets.push_back(last - first);
+            report.ghost_tets.push_back(tets.size() - (last - first));
+            report.points.push_back(vertices.size());
+        }
+    };
+    if (binary.is_double()) partition(0.0);
+    else partition(0.0f);
+    return report;
+}
+
+/* Reads the local to global maps and ghost layers of a part written by partition_binary.
+   Returns false if the file has none. */
+inline bool read_partition_maps(std::string part_path, std::vector<uint32_t> &global_vertices, std::vector<uint32_t> &global_tets, std::vector<uint8_t> &ghost_layers)
+{
+    return read_binary_section(part_path, SECTION_LOCAL_TO_GLOBAL_VERTICES, global_vertices)
+        && read_binary_section(part_path, SECTION_LOCAL_TO_GLOBAL_TETS, global_tets)
+        && read_binary_section(part_path, SECTION_GHOST_LAYERS, ghost_layers);
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Merging                                                         |
+// └──────────────────────────────────────────────────────────────────┘
+
+struct MergeReport {
+    uint64_t num_points;
+    uint64_t num_primitives;
+    uint64_t welded_vertices;
+};
+
+/* Concatenates binary meshes into one, offsetting the indices of each, and welds
+   vertices closer than weld_tolerance (0 welds only coincident ones) with
+   weld_vertices, so that the pieces share their interface vertices. All inputs
+   need the same points per primitive and scalar layout, and the output is double
+   precision if any input is. The inputs are memory mapped: only the points
+   (for welding) and the scalars (for the statistics) are gathered, while
+   the indices are remapped and written chunk by chunk straight from the mappings.
+   Sections of the inputs are not carried over, as they refer to the old numbering. */
+inline MergeReport merge_binaries(const std::vector<std::string> &input_paths, std::string output_path, double weld_tolerance = 0.0)
+{
+    if (input_paths.empty())
+        throw std::runtime_error( std::string("Nothing to merge"));
+
+    std::vector<std::unique_ptr<MappedBinary>> inputs;
+    std::vector<uint64_t> point_offsets = { 0 }, primitive_offsets = { 0 };
+    bool any_double = false;
+    for (const std::string &path : input_paths) {
+        inputs.push_back(std::make_unique<MappedBinary>(path));
+        const MappedBinary &input = *inputs.back();
+        if (input.header.points_per_primitive != inputs[0]->header.points_per_primitive || input.data_is_per_cell() != inputs[0]->data_is_per_cell())
+            throw std::runtime_error( std::string(path + " does not have the same points per primitive and scalar layout as " + input_paths[0]));
+        any_double |= input.is_double();
+        point_offsets.push_back(point_offsets.back() + input.header.num_points);
+        primitive_offsets.push_back(primitive_offsets.back() + input.header.num_indices / input.header.points_per_primitive);
+    }
+    uint32_t points_per_primitive = inputs[0]->header.points_per_primitive;
+    bool data_is_per_cell = inputs[0]->data_is_per_cell();
+    uint64_t num_points = point_offsets.back(), num_primitives = primitive_offsets.back();
+    if (num_points > std::numeric_limits<uint32_t>::max() || num_primitives * points_per_primitive > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error( std::string("Merged mesh would not fit 32 bit indices"));
+
+    MergeReport report;
+    auto merge = [&](auto zero) {
+        using T = decltype(zero);
+
+        /* Gathers the values of every input, converting them to T */
+        auto gather = [&](std::vector<T> &values, size_t stride, bool scalars) {
+            std::vector<uint64_t> &offsets = (scalars && data_is_per_cell) ? primitive_offsets : point_offsets;
+            values.resize(offsets.back() * stride);
+            for (size_t k = 0; k < inputs.size(); ++k) {
+                const MappedBinary &input = *inputs[k];
+                const char *data = scalars ? input.scalars : input.points;
+                size_t count = (offsets[k + 1] - offsets[k]) * stride;
+                T *out = &values[offsets[k] * stride];
+                parallel_for(count, [&](size_t begin, size_t end, uint32_t) {
+                    for (size_t i = begin; i < end; ++i)
+                        out[i] = (T) (input.is_double() ? load_unaligned<double>(data, i) : load_unaligned<float>(data, i));
+                });
+            }
+        };
+        std::vector<T> points, scalars;
+        gather(points, 3, false);
+        gather(scalars, 1, true);
+
+        /* Weld, and number the vertices which survive */
+        std::vector<uint32_t> representative = weld_vertices(points.data(), num_points, weld_tolerance);
+        std::vector<uint64_t> new_index(num_points + 1, 0);
+        parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t v = begin; v < end; ++v) new_index[v] = (representative[v] == v);
+        });
+        uint64_t kept = parallel_exclusive_scan(new_index);
+        parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t v = begin; v < end; ++v) representative[v] = (uint32_t) new_index[representative[v]];
+        });
+        compact_records(points, 3, new_index, kept);
+        if (!data_is_per_cell) compact_records(scalars, 1, new_index, kept);
+        std::vector<uint64_t>().swap(new_index);
+
+        report.num_points = kept;
+        report.num_primitives = num_primitives;
+        report.welded_vertices = num_points - kept;
+
+        /* Create/open the file */
+        std::fstream file;
+        file.open(output_path, std::ios::out | std::ios::trunc | std::ios::binary );
+
+        if (!file.is_open())
+            throw std::runtime_error( std::string("Unable to create " + output_path));
+
+        BinaryHeader header;
+        header.points_per_primitive = points_per_primitive;
+        header.num_points = (uint32_t) kept;
+        header.num_indices = (uint32_t) (num_primitives * points_per_primitive);
+        header.flags = (data_is_per_cell ? BINARY_DATA_IS_PER_CELL : 0) | (any_double ? BINARY_DOUBLE_PRECISION : 0);
+        write_binary_header(file, header);
+        BoundsSummary bounds;
+        ValueSummary summary;
+        write_values<T>(file, points.data(), points.size(), &bounds);
+        write_values<T>(file, scalars.data(), scalars.size(), &summary);
+
+        /* Stream the indices of every input through the welded numbering */
+        std::vector<uint32_t> chunk(BINARY_CONVERSION_CHUNK);
+        for (size_t k = 0; k < inputs.size(); ++k) {
+            const char *indices = inputs[k]->indices;
+            uint64_t count = inputs[k]->header.num_indices, offset = point_offsets[k];
+            for (uint64_t first = 0; first < count; first += chunk.size()) {
+                size_t n = (size_t) std::min<uint64_t>(chunk.size(), count - first);
+                parallel_for(n, [&](size_t begin, size_t end, uint32_t) {
+                    for (size_t i = begin; i < end; ++i) chunk[i] = representative[offset + (uint32_t) load_unaligned<uint32_t>(indices, first + i)];
+                });
+                file.write((const char*) chunk.data(), n * sizeof(uint32_t));
+            }
+        }
+        append_binary_statistics(file, scalars.data(), scalars.size(), bounds, summary);
+        if (!file)
+            throw std::runtime_error( std::string("Unable to write " + output_path));
+        file.close();
+    };
+    if (any_double) merge(0.0);
+    else merge(0.0f);
+    return report;
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Plane slicing                                                   |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Planes are given by four coefficients (a, b, c, d) and hold the points where
+   a x + b y + c z = d. Distances are signed, positive along (a, b, c), and in
+   units of its length. Distances within the rounding error of the points are
+   snapped to zero, so that a plane through mesh vertices, given in decimal,
+   passes through them rather than next to them and leaves no slivers. */
+template <typename T>
+inline double plane_distance(const double plane[4], const T *p)
+{
+    double d = plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2] - plane[3];
+    double scale = std::abs(plane[0] * p[0]) + std::abs(plane[1] * p[1]) + std::abs(plane[2] * p[2]) + std::abs(plane[3]);
+    return (std::abs(d) <= 4.0 * std::numeric_limits<T>::epsilon() * scale) ? 0.0 : d;
+}
+
+inline void throw_if_bad_plane(const std::vector<double> &plane)
+{
+    if (plane.size() != 4)
+        throw std::runtime_error( std::string("A plane needs four coefficients"));
+    if (plane[0] == 0.0 && plane[1] == 0.0 && plane[2] == 0.0)
+        throw std::runtime_error( std::string("The plane normal needs to be nonzero"));
+}
+
+/* Finds the tetrahedra the plane passes through or touches, in increasing order.
+   With a BVH only the leaves whose boxes straddle the plane are tested. */
+template <typename T>
+void find_sliced_tets(const T *points, const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive, const double plane[4],
+                      const BVH *bvh, std::vector<uint32_t> &tets)
+{
+    auto sliced = [&](size_t t) {
+        const uint32_t *tet = &indices[t * points_per_primitive];
+        double lo = std::numeric_limits<double>::max(), hi = std::numeric_limits<double>::lowest();
+        for (int c = 0; c < 4; ++c) {
+            double d = plane_distance(plane, &points[(size_t) tet[c] * 3]);
+            lo = std::min(lo, d);
+            hi = std::max(hi, d);
+        }
+        return lo <= 0.0 && hi >= 0.0;
+    };
+
+    tets.clear();
+    if (bvh && !bvh->nodes.empty()) {
+        traverse_bvh_where(*bvh, [&](const BVHNode &node) {
+            double lo = -plane[3], hi = -plane[3];
+            for (int a = 0; a < 3; ++a) {
+                double x0 = plane[a] * node.lower[a], x1 = plane[a] * node.upper[a];
+                lo += std::min(x0, x1);
+                hi += std::max(x0, x1);
+            }
+            return lo <= 0.0 && hi >= 0.0;
+        }, [&](uint32_t first, uint32_t count) {
+            for (uint32_t i = first; i < first + count; ++i)
+                if (sliced(bvh->primitives[i])) tets.push_back(bvh->primitives[i]);
+        });
+        std::sort(tets.begin(), tets.end());
+        return;
+    }
+
+    uint32_t workers = parallel_for_workers(num_tetrahedra);
+    std::vector<std::vector<uint32_t>> found(workers);
+    parallel_for(num_tetrahedra, [&](size_t begin, size_t end, uint32_t worker) {
+        for (size_t t = begin; t < end; ++t)
+            if (sliced(t)) found[worker].push_back((uint32_t) t);
+    });
+    for (auto &f : found) tets.insert(tets.end(), f.begin(), f.end());
+}
+
+/* Cuts a tetrahedral mesh with a plane into a triangle mesh (3 points per
+   primitive). The section of every tetrahedron is a triangle or a quad, which is
+   split into two triangles, and triangles face along the plane normal. Section
+   vertices are welded on the mesh edge they lie on, as for isosurfaces, and get
+   the point scalars interpolated along it. With cell scalars, every triangle
+   keeps the scalar of its tetrahedron. If bvh is given, only the tetrahedra in
+   the leaves straddling the plane are visited. */
+template <typename T>
+void slice_mesh(const T *points, const T *scalars, const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive, bool data_is_per_cell,
+                const double plane[4], const BVH *bvh, std::vector<T> &out_points, std::vector<T> &out_scalars, std::vector<uint32_t> &out_indices)
+{
+    std::vector<uint32_t> tets;
+    find_sliced_tets(points, indices, num_tetrahedra, points_per_primitive, plane, bvh, tets);
+
+    /* Every worker keeps the vertex keys of its triangles and the tetrahedron each came from */
+    uint32_t workers = parallel_for_workers(tets.size());
+    std::vector<std::vector<uint64_t>> buffers(workers);
+    std::vector<std::vector<uint32_t>> sources(workers);
+    parallel_for(tets.size(), [&](size_t begin, size_t end, uint32_t worker) {
+        for (size_t i = begin; i < end; ++i) {
+            const uint32_t *tet = &indices[(size_t) tets[i] * points_per_primitive];
+            double s[4];
+            for (int c = 0; c < 4; ++c) s[c] = plane_distance(plane, &points[(size_t) tet[c] * 3]);
+
+            uint64_t keys[4];
+            int num_keys = march_tetrahedron(points, tet, s, 0.0, keys);
+            if (num_keys == 0) continue;
+            buffers[worker].insert(buffers[worker].end(), { keys[0], keys[1], keys[2] });
+            sources[worker].push_back(tets[i]);
+            if (num_keys == 4) {
+                buffers[worker].insert(buffers[worker].end(), { keys[0], keys[2], keys[3] });
+                sources[worker].push_back(tets[i]);
+            }
+        }
+    });
+
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> triangle_tets;
+    for (uint32_t w = 0; w < workers; ++w) {
+        keys.insert(keys.end(), buffers[w].begin(), buffers[w].end());
+        triangle_tets.insert(triangle_tets.end(), sources[w].begin(), sources[w].end());
+        std::vector<uint64_t>().swap(buffers[w]);
+    }
+
+    out_points.resize(keys.size() * 3);
+    if (!data_is_per_cell) out_scalars.resize(keys.size());
+    std::vector<uint64_t> new_index;
+    uint64_t num_vertices = weld_section_corners(keys, 0, out_indices, new_index, [&](uint64_t vertex, uint32_t a, uint32_t b) {
+        /* Interpolate from the lower numbered point, so the vertex does not depend on the tetrahedron */
+        double da = plane_distance(plane, &points[(size_t) a * 3]), db = plane_distance(plane, &points[(size_t) b * 3]);
+        double f = (a == b || da == db) ? 0.0 : -da / (db - da);
+        for (int c = 0; c < 3; ++c)
+            out_points[vertex * 3 + c] = (T) (points[(size_t) a * 3 + c] + f * ((double) points[(size_t) b * 3 + c] - points[(size_t) a * 3 + c]));
+        if (!data_is_per_cell) out_scalars[vertex] = (T) (scalars[a] + f * ((double) scalars[b] - scalars[a]));
+    });
+    out_points.resize(num_vertices * 3);
+
+    if (data_is_per_cell) {
+        compact_records(triangle_tets, 1, new_index, new_index.back());
+        out_scalars.resize(triangle_tets.size());
+        parallel_for(triangle_tets.size(), [&](size_t begin, size_t end, uint32_t) {
+            for (size_t i = begin; i < end; ++i) out_scalars[i] = scalars[triangle_tets[i]];
+        });
+    } else {
+        out_scalars.resize(num_vertices);
+    }
+}
+
+template <typename T>
+void slice_mesh(const std::vector<T> &points, const std::vector<T> &scalars, const std::vector<uint32_t> &indices, uint32_t points_per_primitive,
+                bool data_is_per_cell, const std::vector<double> &plane, std::vector<T> &out_points, std::vector<T> &out_scalars,
+                std::vector<uint32_t> &out_indices, const BVH *bvh = nullptr)
+{
+    throw_if_bad_plane(plane);
+    size_t num_tetrahedra = indices.size() / points_per_primitive;
+    if (scalars.size() != (data_is_per_cell ? num_tetrahedra : points.size() / 3))
+        throw std::runtime_error( std::string("Slicing needs one scalar per ") + (data_is_per_cell ? "cell" : "point"));
+    slice_mesh(points.data(), scalars.data(), indices.data(), num_tetrahedra, points_per_primitive, data_is_per_cell,
+               plane.data(), bvh, out_points, out_scalars, out_indices);
+}
+
+/* Slices a binary tetrahedral mesh into a binary triangle mesh of the same
+   precision and scalar layout, using its BVH section if it has one */
+inline void write_slice_as_binary(std::string binary_path, const std::vector<double> &plane, std::string slice_path)
+{
+    throw_if_bad_plane(plane);
+    BinaryHeader header = read_binary_header(binary_path);
+    if (header.points_per_primitive != 4 && header.points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+
+    auto slice = [&](auto &points, auto &scalars) {
+        std::vector<uint32_t> indices, slice_indices;
+        bool data_is_per_cell;
+        read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        BVH bvh;
+        bool has_bvh = read_bvh_from_binary(binary_path, bvh);
+
+        std::remove_reference_t<decltype(points)> slice_points, slice_scalars;
+        slice_mesh(points.data(), scalars.data(), indices.data(), indices.size() / header.points_per_primitive, header.points_per_primitive,
+                   data_is_per_cell, plane.data(), has_bvh ? &bvh : nullptr, slice_points, slice_scalars, slice_indices);
+        write_to_binary(slice_points, slice_scalars, slice_indices, 3, data_is_per_cell, slice_path);
+    };
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        slice(points, scalars);
+    } else {
+        std::vector<float> points, scalars;
+        slice(points, scalars);
+    }
+}
+
+/* Pixels on a plane. Pixel (i, j) sits at origin + i * u + j * v, and pixels
+   are stored with i varying fastest. u and v need to be orthogonal. */
+struct SliceImage {
+    double origin[3];
+    double u[3];
+    double v[3];
+    uint32_t width;
+    uint32_t height;
+
+    uint64_t num_pixels() const { return (uint64_t) width * height; }
+};
+
+/* An image of the given size on the plane, spanning the projection of the bounds
+   of the points. u runs along the coordinate axis closest to the plane, and
+   u, v and the plane normal are right handed. */
+template <typename T>
+SliceImage fit_slice_image(const std::vector<T> &points, const std::vector<double> &plane, uint32_t width, uint32_t height)
+{
+    throw_if_bad_plane(plane);
+    double length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+    double normal[3] = { plane[0] / length, plane[1] / length, plane[2] / length };
+
+    int axis = 0;
+    for (int a = 1; a < 3; ++a)
+        if (std::abs(normal[a]) < std::abs(normal[axis])) axis = a;
+    double u[3], v[3];
+    for (int a = 0; a < 3; ++a) u[a] = (a == axis ? 1.0 : 0.0) - normal[axis] * normal[a];
+    double u_length = std::sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+    for (int a = 0; a < 3; ++a) u[a] /= u_length;
+    v[0] = normal[1] * u[2] - normal[2] * u[1];
+    v[1] = normal[2] * u[0] - normal[0] * u[2];
+    v[2] = normal[0] * u[1] - normal[1] * u[0];
+
+    double lower[3], upper[3];
+    compute_bounds(points.data(), points.size() / 3, lower, upper);
+    double u_lo = std::numeric_limits<double>::max(), u_hi = std::numeric_limits<double>::lowest();
+    double v_lo = u_lo, v_hi = u_hi;
+    for (int corner = 0; corner < 8; ++corner) {
+        double p[3] = { (corner & 1) ? upper[0] : lower[0], (corner & 2) ? upper[1] : lower[1], (corner & 4) ? upper[2] : lower[2] };
+        double pu = p[0] * u[0] + p[1] * u[1] + p[2] * u[2], pv = p[0] * v[0] + p[1] * v[1] + p[2] * v[2];
+        u_lo = std::min(u_lo, pu);
+        u_hi = std::max(u_hi, pu);
+        v_lo = std::min(v_lo, pv);
+        v_hi = std::max(v_hi, pv);
+    }
+
+    SliceImage image;
+    image.width = width;
+    image.height = height;
+    double u_spacing = (width > 1) ? (u_hi - u_lo) / (width - 1) : 1.0;
+    double v_spacing = (height > 1) ? (v_hi - v_lo) / (height - 1) : 1.0;
+    for (int a = 0; a < 3; ++a) {
+        image.origin[a] = normal[a] * plane[3] / length + u_lo * u[a] + v_lo * v[a];
+        image.u[a] = u[a] * u_spacing;
+        image.v[a] = v[a] * v_spacing;
+    }
+    return image;
+}
+
+/* Samples the scalars of a tetrahedral mesh on the pixels of an image, without
+   building the section polygons. Pixels outside the mesh get background. The
+   corners of the sliced tetrahedra are moved into image coordinates (along u,
+   along the plane normal, then along v), where the image rows are the planes of
+   a one sample thick grid, and rasterized with rasterize_tetrahedron. Every
+   thread owns a band of rows and only walks the tetrahedra bucketed into it,
+   kept in their original order, so where tetrahedra share pixels the last one
+   wins regardless of the thread count. */
+template <typename T>
+void slice_to_image(const T *points, const T *scalars, const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive, bool data_is_per_cell,
+                    const SliceImage &image, float background, float *pixels, const BVH *bvh = nullptr)
+{
+    double u_spacing = std::sqrt(image.u[0] * image.u[0] + image.u[1] * image.u[1] + image.u[2] * image.u[2]);
+    double v_spacing = std::sqrt(image.v[0] * image.v[0] + image.v[1] * image.v[1] + image.v[2] * image.v[2]);
+    if (!(u_spacing > 0.0 && v_spacing > 0.0))
+        throw std::runtime_error( std::string("Image axes need to be nonzero"));
+    if (std::abs(image.u[0] * image.v[0] + image.u[1] * image.v[1] + image.u[2] * image.v[2]) > 1e-9 * u_spacing * v_spacing)
+        throw std::runtime_error( std::string("Image axes need to be orthogonal"));
+
+    double axes[3][3];
+    for (int a = 0; a < 3; ++a) {
+        axes[0][a] = image.u[a] / u_spacing;
+        axes[2][a] = image.v[a] / v_spacing;
+    }
+    axes[1][0] = axes[0][1] * axes[2][2] - axes[0][2] * axes[2][1];
+    axes[1][1] = axes[0][2] * axes[2][0] - axes[0][0] * axes[2][2];
+    axes[1][2] = axes[0][0] * axes[2][1] - axes[0][1] * axes[2][0];
+    double plane[4] = { axes[1][0], axes[1][1], axes[1][2], axes[1][0] * image.origin[0] + axes[1][1] * image.origin[1] + axes[1][2] * image.origin[2] };
+
+    std::fill(pixels, pixels + image.num_pixels(), background);
+    if (image.num_pixels() == 0) return;
+    std::vector<uint32_t> tets;
+    find_sliced_tets(points, indices, num_tetrahedra, points_per_primitive, plane, bvh, tets);
+
+    std::vector<double> frame(tets.size() * 12), values(tets.size() * 4);
+    parallel_for(tets.size(), [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) {
+            const uint32_t *tet = &indices[(size_t) tets[i] * points_per_primitive];
+            for (int c = 0; c < 4; ++c) {
+                double d[3];
+                for (int a = 0; a < 3; ++a) d[a] = points[(size_t) tet[c] * 3 + a] - image.origin[a];
+                for (int a = 0; a < 3; ++a) frame[i * 12 + c * 3 + a] = d[0] * axes[a][0] + d[1] * axes[a][1] + d[2] * axes[a][2];
+                values[i * 4 + c] = scalars[data_is_per_cell ? tets[i] : tet[c]];
+            }
+        }
+    });
+
+    /* Sliced tetrahedra overlapping each band of rows, in compressed sparse row form */
+    uint32_t num_bands = parallel_for_workers(image.height, 1);
+    uint32_t band_rows = (image.height + num_bands - 1) / num_bands;
+    std::vector<uint32_t> band_range(tets.size() * 2);
+    std::vector<std::atomic<uint64_t>> band_counts(num_bands + 1);
+    parallel_for(tets.size(), [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i) {
+            double lo = frame[i * 12 + 2], hi = lo;
+            for (int c = 1; c < 4; ++c) {
+                lo = std::min(lo, frame[i * 12 + c * 3 + 2]);
+                hi = std::max(hi, frame[i * 12 + c * 3 + 2]);
+            }
+            double first = std::max(0.0, std::floor(lo / v_spacing)), last = std::min((double) image.height - 1, std::ceil(hi / v_spacing));
+            band_range[i * 2] = 1;
+            band_range[i * 2 + 1] = 0;
+            if (!(first <= last)) continue;
+            band_range[i * 2] = (uint32_t) first / band_rows;
+            band_range[i * 2 + 1] = (uint32_t) last / band_rows;
+            for (uint32_t b = band_range[i * 2]; b <= band_range[i * 2 + 1]; ++b) band_counts[b]++;
+        }
+    });
+    std::vector<uint64_t> band_offsets(num_bands + 1);
+    for (uint32_t b = 0; b <= num_bands; ++b) band_offsets[b] = band_counts[b];
+    parallel_exclusive_scan(band_offsets);
+    std::vector<uint32_t> band_tets(band_offsets[num_bands]);
+    for (uint32_t b = 0; b < num_bands; ++b) band_counts[b] = band_offsets[b];
+    parallel_for(tets.size(), [&](size_t begin, size_t end, uint32_t) {
+        for (size_t i = begin; i < end; ++i)
+            for (uint32_t b = band_range[i * 2]; b <= band_range[i * 2 + 1]; ++b)
+                band_tets[band_counts[b]++] = (uint32_t) i;
+    });
+    std::vector<uint32_t>().swap(band_range);
+    /* Where tetrahedra share pixels the last one wins, so keep a fixed order */
+    parallel_for(num_bands, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t b = begin; b < end; ++b)
+            std::sort(band_tets.begin() + band_offsets[b], band_tets.begin() + band_offsets[b + 1]);
+    }, 1);
+
+    RegularGrid grid;
+    for (int a = 0; a < 3; ++a) grid.origin[a] = 0.0;
+    grid.spacing[0] = u_spacing;
+    grid.spacing[1] = 1.0;
+    grid.spacing[2] = v_spacing;
+    grid.dims[0] = image.width;
+    grid.dims[1] = 1;
+    grid.dims[2] = image.height;
+    const uint32_t corners[4] = { 0, 1, 2, 3 };
+    parallel_for(num_bands, [&](size_t band_begin, size_t band_end, uint32_t) {
+        for (size_t b = band_begin; b < band_end; ++b) {
+            int64_t row_begin = (int64_t) b * band_rows, row_end = std::min<int64_t>(image.height, row_begin + band_rows);
+            for (uint64_t e = band_offsets[b]; e < band_offsets[b + 1]; ++e) {
+                size_t i = band_tets[e];
+                rasterize_tetrahedron(&frame[i * 12], &values[i * 4], corners, 0, 4, false, grid, row_begin, row_end, 0, 1,
+                    [&](int64_t, int64_t k, int64_t first, int64_t last, double value, double value_step) {
+                        float *row = &pixels[(size_t) k * image.width];
+                        for (int64_t p = first; p <= last; ++p)
+                            row[p] = (float) (value + p * value_step);
+                    });
+            }
+        }
+    }, 1);
+}
+
+template <typename T>
+std::vector<float> slice_to_image(const std::vector<T> &points, const std::vector<T> &scalars, const std::vector<uint32_t> &indices, uint32_t points_per_primitive,
+                                  bool data_is_per_cell, const SliceImage &image, float background = std::numeric_limits<float>::quiet_NaN())
+{
+    std::vector<float> pixels(image.num_pixels());
+    slice_to_image(points.data(), scalars.data(), indices.data(), indices.size() / points_per_primitive, points_per_primitive, data_is_per_cell,
+                   image, background, pixels.data());
+    return pixels;
+}
+
+/* Samples a binary mesh on the pixels of an image and writes them as raw little
+   endian float32, optionally preceded by an NRRD header placing the image in
+   space. The BVH section of the mesh is used if it has one. */
+inline void write_slice_image(std::string binary_path, const SliceImage &image, std::string image_path, bool nrrd_header = false,
+                              float background = std::numeric_limits<float>::quiet_NaN())
+{
+    BinaryHeader header = read_binary_header(binary_path);
+    if (header.points_per_primitive != 4 && header.points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+
+    std::vector<float> pixels(image.num_pixels());
+    auto sample = [&](auto &points, auto &scalars) {
+        std::vector<uint32_t> indices;
+        bool data_is_per_cell;
+        read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+        BVH bvh;
+        bool has_bvh = read_bvh_from_binary(binary_path, bvh);
+        slice_to_image(points.data(), scalars.data(), indices.data(), indices.size() / header.points_per_primitive, header.points_per_primitive,
+                       data_is_per_cell, image, background, pixels.data(), has_bvh ? &bvh : nullptr);
+    };
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        sample(points, scalars);
+    } else {
+        std::vector<float> points, scalars;
+        sample(points, scalars);
+    }
+
+    std::fstream file;
+    file.open(image_path, std::ios::out | std::ios::trunc | std::ios::binary );
+
+    if (!file.is_open())
+        throw std::runtime_error( std::string("Unable to create " + image_path));
+
+    if (nrrd_header) {
+        file.precision(std::numeric_limits<double>::max_digits10);
+        file << "NRRD0004\n"
+             << "type: float\n"
+             << "dimension: 2\n"
+             << "space dimension: 3\n"
+             << "sizes: " << image.width << " " << image.height << "\n"
+             << "space directions: (" << image.u[0] << "," << image.u[1] << "," << image.u[2] << ") ("
+             << image.v[0] << "," << image.v[1] << "," << image.v[2] << ")\n"
+             << "space origin: (" << image.origin[0] << "," << image.origin[1] << "," << image.origin[2] << ")\n"
+             << "kinds: domain domain\n"
+             << "endian: little\n"
+             << "encoding: raw\n\n";
+    }
+    file.write((const char*) pixels.data(), pixels.size() * sizeof(float));
+
+    if (!file)
+        throw std::runtime_error( std::string("Unable to write " + image_path));
+    file.close();
+}
+
+// ┌──────────────────────────────────────────────────────────────────┐
+// |  Gradients                                                       |
+// └──────────────────────────────────────────────────────────────────┘
+
+/* Gradients of the point scalars as sections of three values per tetrahedron
+   or per point, in the precision of the binary */
+const uint32_t SECTION_CELL_GRADIENTS = binary_section_tag('G', 'R', 'D', 'C');
+const uint32_t SECTION_POINT_GRADIENTS = binary_section_tag('G', 'R', 'D', 'P');
+
+/* Evaluates the gradients of tetrahedra [first, first + count), count <= QUALITY_BLOCK_SIZE,
+   and their unsigned volumes if volumes is not null. Like tet_quality_block, the
+   edge vectors and scalar differences are gathered into structure of arrays
+   layout and the cross products and determinant run over QualityPack lanes. */
+template <typename T>
+void tet_gradient_block(const T *points, const T *scalars, const uint32_t *indices, uint32_t points_per_primitive, size_t first, uint32_t count,
+                        T *gradients, double *volumes)
+{
+    typedef QualityPack P;
+    const uint32_t N = QUALITY_BLOCK_SIZE;
+    /* Edges from corner 0 to corners 1, 2 and 3, and the scalar differences along them */
+    alignas(32) double e[3][3][N], ds[3][N];
+    for (uint32_t lane = 0; lane < N; ++lane) {
+        size_t t = first + std::min(lane, count - 1);
+        const uint32_t *tet = &indices[t * points_per_primitive];
+        const T *p0 = &points[(size_t) tet[0] * 3];
+        double s0 = scalars[tet[0]];
+        for (int c = 0; c < 3; ++c) {
+            const T *p = &points[(size_t) tet[c + 1] * 3];
+            for (int a = 0; a < 3; ++a) e[c][a][lane] = (double) p[a] - p0[a];
+            ds[c][lane] = scalars[tet[c + 1]] - s0;
+        }
+    }
+
+    alignas(32) double gradient[3][N], volume6[N];
+    for (uint32_t lane = 0; lane < N; lane += P::WIDTH) {
+        P e1x = P::load(&e[0][0][lane]), e1y = P::load(&e[0][1][lane]), e1z = P::load(&e[0][2][lane]);
+        P e2x = P::load(&e[1][0][lane]), e2y = P::load(&e[1][1][lane]), e2z = P::load(&e[1][2][lane]);
+        P e3x = P::load(&e[2][0][lane]), e3y = P::load(&e[2][1][lane]), e3z = P::load(&e[2][2][lane]);
+        P d1 = P::load(&ds[0][lane]), d2 = P::load(&ds[1][lane]), d3 = P::load(&ds[2][lane]);
+
+        P c23x = e2y * e3z - e2z * e3y, c23y = e2z * e3x - e2x * e3z, c23z = e2x * e3y - e2y * e3x;
+        P c31x = e3y * e1z - e3z * e1y, c31y = e3z * e1x - e3x * e1z, c31z = e3x * e1y - e3y * e1x;
+        P c12x = e1y * e2z - e1z * e2y, c12y = e1z * e2x - e1x * e2z, c12z = e1x * e2y - e1y * e2x;
+        P determinant = e1x * c23x + e1y * c23y + e1z * c23z;
+        determinant.store(&volume6[lane]);
+        ((d1 * c23x + d2 * c31x + d3 * c12x) / determinant).store(&gradient[0][lane]);
+        ((d1 * c23y + d2 * c31y + d3 * c12y) / determinant).store(&gradient[1][lane]);
+        ((d1 * c23z + d2 * c31z + d3 * c12z) / determinant).store(&gradient[2][lane]);
+    }
+
+    for (uint32_t lane = 0; lane < count; ++lane) {
+        bool flat = volume6[lane] == 0.0;
+        for (int a = 0; a < 3; ++a) gradients[(first + lane) * 3 + a] = flat ? (T) 0 : (T) gradient[a][lane];
+        if (volumes) volumes[first + lane] = std::abs(volume6[lane]) / 6.0;
+    }
+}
+
+/* Computes the constant gradient of the linear interpolant of the point scalars
+   over every tetrahedron (three values each) and, if volumes is not null, its
+   unsigned volume. Quadratic tetrahedra use their corners. With edge vectors
+   e1, e2, e3 from corner 0 the gradient is
+   ((s1 - s0) e2 x e3 + (s2 - s0) e3 x e1 + (s3 - s0) e1 x e2) / (e1 . e2 x e3),
+   evaluated in blocks of eight tetrahedra by tet_gradient_block. Flat
+   tetrahedra get a zero gradient and volume. */
+template <typename T>
+void compute_tet_gradients(const T *points, const T *scalars, const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive,
+                           T *gradients, double *volumes = nullptr)
+{
+    parallel_for((num_tetrahedra + QUALITY_BLOCK_SIZE - 1) / QUALITY_BLOCK_SIZE, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t b = begin; b < end; ++b) {
+            size_t first = b * QUALITY_BLOCK_SIZE;
+            uint32_t count = (uint32_t) std::min<size_t>(QUALITY_BLOCK_SIZE, num_tetrahedra - first);
+            tet_gradient_block(points, scalars, indices, points_per_primitive, first, count, gradients, volumes);
+        }
+    }, 512);
+}
+
+/* Recovers gradients at the points as the volume weighted average of the
+   gradients of the tetrahedra around them (three values per point). Every point
+   gathers its tetrahedra through the vertex to tetrahedron incidence, so no two
+   threads write the same point and the sums do not depend on the thread count.
+   Points outside every tetrahedron get a zero gradient. */
+template <typename T>
+void recover_point_gradients(const uint32_t *indices, size_t num_tetrahedra, uint32_t points_per_primitive, size_t num_points,
+                             const T *tet_gradients, const double *volumes, T *point_gradients)
+{
+    CSRGraph incidence = build_vertex_to_primitive(indices, num_tetrahedra, points_per_primitive, num_points);
+    parallel_for(num_points, [&](size_t begin, size_t end, uint32_t) {
+        for (size_t v = begin; v < end; ++v) {
+            double sum[3] = { 0.0, 0.0, 0.0 }, weight = 0.0;
+            for (uint64_t e = incidence.offsets[v]; e < incidence.offsets[v + 1]; ++e) {
+                uint32_t t = incidence.neighbors[e];
+                for (int a = 0; a < 3; ++a) sum[a] += volumes[t] * tet_gradients[(size_t) t * 3 + a];
+                weight += volumes[t];
+            }
+            for (int a = 0; a < 3; ++a) point_gradients[v * 3 + a] = (T) ((weight > 0.0) ? sum[a] / weight : 0.0);
+        }
+    });
+}
+
+inline void throw_if_no_point_scalars(size_t num_scalars, size_t num_points)
+{
+    if (num_scalars != num_points)
+        throw std::runtime_error( std::string("Gradients need one scalar per point"));
+}
+
+template <typename T>
+std::vector<T> compute_tet_gradients(const std::vector<T> &points, const std::vector<T> &scalars, const std::vector<uint32_t> &indices, uint32_t points_per_primitive)
+{
+    throw_if_no_point_scalars(scalars.size(), points.size() / 3);
+    std::vector<T> gradients(indices.size() / points_per_primitive * 3);
+    compute_tet_gradients(points.data(), scalars.data(), indices.data(), indices.size() / points_per_primitive, points_per_primitive, gradients.data());
+    return gradients;
+}
+
+template <typename T>
+std::vector<T> compute_point_gradients(const std::vector<T> &points, const std::vector<T> &scalars, const std::vector<uint32_t> &indices, uint32_t points_per_primitive)
+{
+    throw_if_no_point_scalars(scalars.size(), points.size() / 3);
+    size_t num_tetrahedra = indices.size() / points_per_primitive;
+    std::vector<T> tet_gradients(num_tetrahedra * 3), point_gradients(points.size());
+    std::vector<double> volumes(num_tetrahedra);
+    compute_tet_gradients(points.data(), scalars.data(), indices.data(), num_tetrahedra, points_per_primitive, tet_gradients.data(), volumes.data());
+    recover_point_gradients(indices.data(), num_tetrahedra, points_per_primitive, points.size() / 3, tet_gradients.data(), volumes.data(), point_gradients.data());
+    return point_gradients;
+}
+
+/* Computes the tetrahedron and point gradients of a binary mesh and stores them
+   as sections, in the precision of the file */
+inline void add_gradients_to_binary(std::string binary_path)
+{
+    BinaryHeader header = read_binary_header(binary_path);
+    if (header.points_per_primitive != 4 && header.points_per_primitive != 10)
+        throw std::runtime_error( std::string("points per primitive needs to be 4 or 10"));
+    if (header.flags & BINARY_DATA_IS_PER_CELL)
+        throw std::runtime_error( std::string("Gradients need point scalars, " + binary_path + " has cell scalars"));
+
+    auto add = [&](auto &points, auto &scalars) {
+        std::vector<uint32_t> indices;
+        bool data_is_per_cell;
+        read_binary(binary_path, points, scalars, indices, data_is_per_cell);
+
+        size_t num_tetrahedra = indices.size() / header.points_per_primitive;
+        std::remove_reference_t<decltype(points)> tet_gradients(num_tetrahedra * 3), point_gradients(points.size());
+        std::vector<double> volumes(num_tetrahedra);
+        compute_tet_gradients(points.data(), scalars.data(), indices.data(), num_tetrahedra, header.points_per_primitive, tet_gradients.data(), volumes.data());
+        recover_point_gradients(indices.data(), num_tetrahedra, header.points_per_primitive, points.size() / 3, tet_gradients.data(), volumes.data(),
+                                point_gradients.data());
+        write_binary_section(binary_path, SECTION_CELL_GRADIENTS, tet_gradients);
+        write_binary_section(binary_path, SECTION_POINT_GRADIENTS, point_gradients);
+    };
+    if (header.flags & BINARY_DOUBLE_PRECISION) {
+        std::vector<double> points, scalars;
+        add(points, scalars);
+    } else {
+        std::vector<float> points, scalars;
+        add(points, scalars);
+    }
+}
+
+/* Reads the point (or tetrahedron) gradient section of a binary file, converting
+   it to the precision of gradients. Returns false if there is none */
+template <typename T>
+bool read_gradients_from_binary(std::string binary_path, bool per_point, std::vector<T> &gradients)
+{
+    BinaryHeader header = read_binary_header(binary_path);
+    uint32_t tag = per_point ? SECTION_POINT_GRADIENTS : SECTION_CELL_GRADIENTS;
+    auto read = [&](auto zero) {
+        using Stored = decltype(zero);
+        std::vector<Stored> stored;
+        if (!read_binary_section(binary_path, tag, stored)) return false;
+        gradients.assign(stored.begin(), stored.end());
+        return true;
+    };
+    return (header.flags & BINARY_DOUBLE_PRECISION) ? read(0.0) : read(0.0f);
+}
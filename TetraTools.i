@@ -11,6 +11,12 @@
 namespace std {
    %template(UIntVector) vector<uint32_t>;
    %template(FloatVector) vector<float>;
+   %template(DoubleVector) vector<double>;
+   %template(UInt64Vector) vector<uint64_t>;
+   %template(Int64Vector) vector<int64_t>;
+   %template(IntVector) vector<int32_t>;
+   %template(UInt8Vector) vector<uint8_t>;
+   %template(StringVector) vector<std::string>;
 };
 
 %{
@@ -19,4 +25,260 @@ namespace std {
 
 %apply bool& INOUT { bool& };
 
+/* Query points and outputs are taken straight from NumPy arrays (or anything
+   else exporting the buffer protocol), without copies */
+%{
+struct PyBufferView {
+    Py_buffer view;
+    bool acquired = false;
+    ~PyBufferView() { if (acquired) PyBuffer_Release(&view); }
+};
+
+/* formats lists the accepted struct codes of the elements */
+static bool get_buffer(PyObject *object, PyBufferView &buffer, const char *formats, Py_ssize_t itemsize, bool writable)
+{
+    int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+    if (PyObject_GetBuffer(object, &buffer.view, flags) != 0) return false;
+    buffer.acquired = true;
+    const char *f = buffer.view.format ? buffer.view.format : "B";
+    if (*f == '@' || *f == '=' || *f == '<') ++f;
+    if (buffer.view.itemsize != itemsize || f[0] == '\0' || f[1] != '\0' || !strchr(formats, f[0])) {
+        PyErr_SetString(PyExc_TypeError, "array has the wrong element type");
+        return false;
+    }
+    return true;
+}
+%}
+
+%typemap(in) (const double *queries, size_t num_queries) (PyBufferView buffer) {
+    if (!get_buffer($input, buffer, "d", sizeof(double), false)) SWIG_fail;
+    if (buffer.view.len % (3 * sizeof(double)) != 0) SWIG_exception_fail(SWIG_ValueError, "queries need to be xyz triples");
+    $1 = (double*) buffer.view.buf;
+    $2 = buffer.view.len / (3 * sizeof(double));
+}
+%typemap(in) (int64_t *tets, size_t num_tets) (PyBufferView buffer) {
+    if (!get_buffer($input, buffer, "ql", sizeof(int64_t), true)) SWIG_fail;
+    $1 = (int64_t*) buffer.view.buf;
+    $2 = buffer.view.len / sizeof(int64_t);
+}
+%typemap(in) (double *values, size_t num_values) (PyBufferView buffer) {
+    if (!get_buffer($input, buffer, "d", sizeof(double), true)) SWIG_fail;
+    $1 = (double*) buffer.view.buf;
+    $2 = buffer.view.len / sizeof(double);
+}
+%typemap(typecheck, precedence=SWIG_TYPECHECK_POINTER) (const double *queries, size_t num_queries), (int64_t *tets, size_t num_tets), (double *values, size_t num_values) {
+    $1 = PyObject_CheckBuffer($input);
+}
+
+/* Stream and thread level helpers are only meant for C++ */
+%ignore write_binary_header;
+%ignore read_binary_header(std::fstream &);
+%ignore write_binary_data;
+%ignore read_binary_data;
+%ignore pad_binary_section;
+%ignore load_unaligned;
+%ignore worker_thread_setting;
+%ignore atomic_min;
+%ignore parallel_level_search;
+%ignore PointHashGrid;
+%ignore coordinate_bits;
+%ignore atomic_max;
+%ignore compute_neighbors(const uint32_t *, size_t, uint32_t, size_t);
+%ignore build_vertex_to_primitive(const uint32_t *, size_t, uint32_t, size_t);
+%ignore build_vertex_adjacency(const uint32_t *, size_t, uint32_t, size_t);
+%ignore extract_edges(const uint32_t *, size_t, uint32_t, size_t, std::vector<uint32_t> &, std::vector<uint32_t> &);
+%ignore MappedFile;
+%ignore MappedBinary;
+%ignore StarScratch;
+%ignore CompactTetTopology::vertex(uint64_t, uint32_t, StarScratch &) const;
+%ignore CompactTetTopology::tet_vertices(uint64_t, uint32_t [4], StarScratch &) const;
+%ignore CompactTetTopology::face(uint64_t, uint32_t, uint32_t [3], StarScratch &) const;
+%ignore CompactTetTopology::vertex_star(uint32_t, std::vector<uint32_t> &, StarScratch &) const;
+%ignore CompactTetTopology::build;
+%ignore CompactTetTopology::from_data;
+%ignore CompactTetTopology::data;
+%ignore BVHBounds;
+%ignore BVHBuilder;
+%ignore build_bvh(const float *, const uint32_t *, size_t, uint32_t);
+%ignore build_bvh(const double *, const uint32_t *, size_t, uint32_t);
+%ignore query_bvh_box;
+%ignore serialize_bvh;
+%ignore deserialize_bvh;
+%ignore read_bvh_from_binary(const MappedBinary &, BVH &);
+%ignore TetBlock;
+%ignore tet_scalar_range;
+%ignore build_interval_node;
+%ignore build_interval_index(const float *, const uint32_t *, size_t, uint32_t, bool, uint32_t);
+%ignore build_interval_index(const double *, const uint32_t *, size_t, uint32_t, bool, uint32_t);
+%ignore find_active_tets(const IntervalIndex &, const float *, const uint32_t *, uint32_t, bool, double, double, std::vector<uint32_t> &);
+%ignore find_active_tets(const IntervalIndex &, const double *, const uint32_t *, uint32_t, bool, double, double, std::vector<uint32_t> &);
+%ignore serialize_interval_index;
+%ignore tet_quality_block;
+%ignore ValueSummary;
+%ignore BoundsSummary;
+%ignore compute_binary_statistics;
+%ignore quadratic_tet_shape_functions;
+%ignore evaluate_quadratic_shape_functions;
+%ignore append_edge_midpoints;
+%ignore repeat_for_children;
+%ignore throw_if_refinement_overflows;
+%ignore subdivide_tetrahedra;
+%ignore rasterize_tetrahedron;
+%ignore BrickPyramidWriter;
+%ignore BrickOctree::brick;
+%ignore two_sum;
+%ignore fast_two_sum;
+%ignore two_diff;
+%ignore two_product;
+%ignore grow_expansion;
+%ignore expansion_sum;
+%ignore scale_expansion;
+%ignore expansion_product;
+%ignore expansion_difference;
+%ignore expansion_sign;
+%ignore orient3d_exact;
+%ignore orient3d;
+%ignore flip_tet;
+%ignore normalize_orientation(const float *, uint32_t *, size_t, uint32_t, bool);
+%ignore normalize_orientation(const double *, uint32_t *, size_t, uint32_t, bool);
+%ignore normalize_orientation(const float *, uint32_t *, size_t, uint32_t);
+%ignore normalize_orientation(const double *, uint32_t *, size_t, uint32_t);
+%ignore measure_quality(const float *, const uint32_t *, size_t, uint32_t, QualityMetric, uint32_t);
+%ignore measure_quality(const double *, const uint32_t *, size_t, uint32_t, QualityMetric, uint32_t);
+%ignore measure_quality(const float *, const uint32_t *, size_t, uint32_t, QualityMetric);
+%ignore measure_quality(const double *, const uint32_t *, size_t, uint32_t, QualityMetric);
+%ignore measure_quality(const float *, const uint32_t *, size_t, uint32_t);
+%ignore measure_quality(const double *, const uint32_t *, size_t, uint32_t);
+%ignore deserialize_interval_index;
+%ignore extract_isosurfaces(const float *, const float *, const uint32_t *, size_t, uint32_t, const std::vector<double> &, std::vector<float> &, std::vector<float> &, std::vector<uint32_t> &);
+%ignore extract_isosurfaces(const double *, const double *, const uint32_t *, size_t, uint32_t, const std::vector<double> &, std::vector<double> &, std::vector<double> &, std::vector<uint32_t> &);
+%ignore interpolate_points(const BVH &, const float *, const float *, const uint32_t *, uint32_t, bool, const double *, size_t, int64_t *, double *);
+%ignore interpolate_points(const BVH &, const double *, const double *, const uint32_t *, uint32_t, bool, const double *, size_t, int64_t *, double *);
+%ignore throw_if_bad_plane;
+%ignore throw_if_no_point_scalars;
+%ignore compute_tet_gradients(const float *, const float *, const uint32_t *, size_t, uint32_t, float *, double *);
+%ignore compute_tet_gradients(const double *, const double *, const uint32_t *, size_t, uint32_t, double *, double *);
+%ignore compute_tet_gradients(const float *, const float *, const uint32_t *, size_t, uint32_t, float *);
+%ignore compute_tet_gradients(const double *, const double *, const uint32_t *, size_t, uint32_t, double *);
+%ignore recover_point_gradients;
+%ignore tet_gradient_block;
+%ignore slice_mesh(const float *, const float *, const uint32_t *, size_t, uint32_t, bool, const double *, const BVH *, std::vector<float> &, std::vector<float> &, std::vector<uint32_t> &);
+%ignore slice_mesh(const double *, const double *, const uint32_t *, size_t, uint32_t, bool, const double *, const BVH *, std::vector<double> &, std::vector<double> &, std::vector<uint32_t> &);
+%ignore slice_to_image(const float *, const float *, const uint32_t *, size_t, uint32_t, bool, const SliceImage &, float, float *, const BVH *);
+%ignore slice_to_image(const double *, const double *, const uint32_t *, size_t, uint32_t, bool, const SliceImage &, float, float *, const BVH *);
+%ignore slice_to_image(const float *, const float *, const uint32_t *, size_t, uint32_t, bool, const SliceImage &, float, float *);
+%ignore slice_to_image(const double *, const double *, const uint32_t *, size_t, uint32_t, bool, const SliceImage &, float, float *);
+
 %include "./TetraTools.hxx"
+
+%template(Ele) TEle<float>;
+%template(Node) TNode<float>;
+%template(EleD) TEle<double>;
+%template(NodeD) TNode<double>;
+
+%template(read_node) read_node<float>;
+%template(read_node_double) read_node<double>;
+%template(read_ele) read_ele<float>;
+%template(read_ele_double) read_ele<double>;
+%template(write_node) write_node<float>;
+%template(write_node) write_node<double>;
+%template(write_ele) write_ele<float>;
+%template(write_ele) write_ele<double>;
+%template(write_node_ele_as_binary) write_node_ele_as_binary<float>;
+%template(write_node_ele_as_binary_double) write_node_ele_as_binary<double>;
+%template(write_to_binary) write_to_binary<float>;
+%template(write_to_binary) write_to_binary<double>;
+%template(read_binary) read_binary<float>;
+%template(read_binary) read_binary<double>;
+%template(reorder_along_curve) reorder_along_curve<float>;
+%template(reorder_along_curve) reorder_along_curve<double>;
+%template(renumber_rcm) renumber_rcm<float>;
+%template(renumber_rcm) renumber_rcm<double>;
+%template(cleanup_mesh) cleanup_mesh<float>;
+%template(cleanup_mesh) cleanup_mesh<double>;
+%template(extract_boundary) extract_boundary<float>;
+%template(extract_boundary) extract_boundary<double>;
+%template(write_boundary_as_face) write_boundary_as_face<float>;
+%template(write_boundary_as_face) write_boundary_as_face<double>;
+%template(compute_neighbors) compute_neighbors<float>;
+%template(compute_neighbors) compute_neighbors<double>;
+%template(build_vertex_to_tet) build_vertex_to_tet<float>;
+%template(build_vertex_to_tet) build_vertex_to_tet<double>;
+%template(build_vertex_adjacency) build_vertex_adjacency<float>;
+%template(build_vertex_adjacency) build_vertex_adjacency<double>;
+%template(extract_edges) extract_edges<float>;
+%template(extract_edges) extract_edges<double>;
+%template(build_bvh) build_bvh<float>;
+%template(build_bvh) build_bvh<double>;
+%template(BVHNodeVector) std::vector<BVHNode>;
+%template(interpolate_points) interpolate_points<float>;
+%template(interpolate_points) interpolate_points<double>;
+
+%extend BVH {
+    std::vector<uint32_t> query_box(float x0, float y0, float z0, float x1, float y1, float z1) const
+    {
+        float lower[3] = { x0, y0, z0 }, upper[3] = { x1, y1, z1 };
+        std::vector<uint32_t> tets;
+        query_bvh_box(*$self, lower, upper, tets);
+        return tets;
+    }
+
+    int64_t locate_point(const std::vector<float> &points, const std::vector<uint32_t> &indices, uint32_t points_per_primitive, double x, double y, double z) const
+    {
+        double p[3] = { x, y, z };
+        return locate_point(*$self, points.data(), indices.data(), points_per_primitive, p);
+    }
+
+    int64_t locate_point(const std::vector<double> &points, const std::vector<uint32_t> &indices, uint32_t points_per_primitive, double x, double y, double z) const
+    {
+        double p[3] = { x, y, z };
+        return locate_point(*$self, points.data(), indices.data(), points_per_primitive, p);
+    }
+};
+
+%template(GridItemVector) std::vector<GridItem>;
+%template(fit_regular_grid) fit_regular_grid<float>;
+%template(fit_regular_grid) fit_regular_grid<double>;
+%template(voxelize_to_grid_items) voxelize_to_grid_items<float>;
+%template(voxelize_to_grid_items) voxelize_to_grid_items<double>;
+%template(extract_isosurfaces) extract_isosurfaces<float>;
+%template(extract_isosurfaces) extract_isosurfaces<double>;
+%template(build_interval_index) build_interval_index<float>;
+%template(build_interval_index) build_interval_index<double>;
+%template(find_active_tets) find_active_tets<float>;
+%template(find_active_tets) find_active_tets<double>;
+%template(TetQualityVector) std::vector<TetQuality>;
+%template(compute_tet_quality) compute_tet_quality<float>;
+%template(compute_tet_quality) compute_tet_quality<double>;
+%template(measure_quality) measure_quality<float>;
+%template(measure_quality) measure_quality<double>;
+%template(normalize_orientation) normalize_orientation<float>;
+%template(normalize_orientation) normalize_orientation<double>;
+%template(linearize_quadratic_mesh) linearize_quadratic_mesh<float>;
+%template(linearize_quadratic_mesh) linearize_quadratic_mesh<double>;
+%template(refine_uniform) refine_uniform<float>;
+%template(refine_uniform) refine_uniform<double>;
+%template(BinarySectionVector) std::vector<BinarySection>;
+%template(BinaryHeaderVector) std::vector<BinaryHeader>;
+%template(coarsen_mesh) coarsen_mesh<float>;
+%template(coarsen_mesh) coarsen_mesh<double>;
+%template(lod_cell_size) lod_cell_size<float>;
+%template(lod_cell_size) lod_cell_size<double>;
+%template(write_lod_binary) write_lod_binary<float>;
+%template(write_lod_binary) write_lod_binary<double>;
+%template(read_lod_level) read_lod_level<float>;
+%template(read_lod_level) read_lod_level<double>;
+%template(build_brick_octree) build_brick_octree<float>;
+%template(build_brick_octree) build_brick_octree<double>;
+%template(slice_mesh) slice_mesh<float>;
+%template(slice_mesh) slice_mesh<double>;
+%template(fit_slice_image) fit_slice_image<float>;
+%template(fit_slice_image) fit_slice_image<double>;
+%template(slice_to_image) slice_to_image<float>;
+%template(slice_to_image) slice_to_image<double>;
+%template(compute_tet_gradients) compute_tet_gradients<float>;
+%template(compute_tet_gradients) compute_tet_gradients<double>;
+%template(compute_point_gradients) compute_point_gradients<float>;
+%template(compute_point_gradients) compute_point_gradients<double>;
+%template(read_gradients_from_binary) read_gradients_from_binary<float>;
+%template(read_gradients_from_binary) read_gradients_from_binary<double>;